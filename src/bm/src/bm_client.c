@@ -59,6 +59,36 @@ static ds_tree_t                bm_clients = DS_TREE_INIT((ds_key_cmp_t *)strcmp
                                                           bm_client_t,
                                                           dst_node);
 
+static int
+bm_client_mac_cmp(void *a, void *b)
+{
+    uint64_t    ka = *(uint64_t *)a;
+    uint64_t    kb = *(uint64_t *)b;
+
+    if (ka < kb) return -1;
+    if (ka > kb) return 1;
+    return 0;
+}
+
+static inline uint64_t
+bm_client_mac_key(const os_macaddr_t *mac)
+{
+    return ((uint64_t)mac->addr[0] << 40) | ((uint64_t)mac->addr[1] << 32) |
+           ((uint64_t)mac->addr[2] << 24) | ((uint64_t)mac->addr[3] << 16) |
+           ((uint64_t)mac->addr[4] << 8)  |  (uint64_t)mac->addr[5];
+}
+
+/*
+ * Secondary indexes: event handling looks clients up by binary MAC and
+ * OVSDB updates by uuid, neither of which should format strings or scan.
+ */
+static ds_tree_t                bm_clients_by_mac = DS_TREE_INIT(bm_client_mac_cmp,
+                                                                 bm_client_t,
+                                                                 mac_node);
+static ds_tree_t                bm_clients_by_uuid = DS_TREE_INIT((ds_key_cmp_t *)strcmp,
+                                                                  bm_client_t,
+                                                                  uuid_node);
+
 static c_item_t map_bsal_bands[] = {
     C_ITEM_STR(RADIO_TYPE_NONE,                      "none"),
     C_ITEM_STR(RADIO_TYPE_2G,                        "2.4G"),
@@ -140,6 +170,8 @@ static bool     bm_client_from_ovsdb(struct schema_Band_Steering_Clients *bscli,
 static void     bm_client_remove(bm_client_t *client);
 static void     bm_client_ovsdb_update_cb(ovsdb_update_monitor_t *self);
 static void     bm_client_backoff(bm_client_t *client, bool enable);
+static void     bm_client_insert(bm_client_t *client);
+static void     bm_client_unindex(bm_client_t *client);
 static void     bm_client_disable_steering(bm_client_t *client);
 static void     bm_client_task_backoff(void *arg);
 static void     bm_client_state_change(bm_client_t *client,
@@ -1746,7 +1778,7 @@ bm_client_ovsdb_update_cb(ovsdb_update_monitor_t *self)
             LOGW("Client '%s' failed to add to one or more groups", client->mac_addr);
         }
 
-        ds_tree_insert(&bm_clients, client, client->mac_addr);
+        bm_client_insert(client);
         LOGN("Added client %s (hwm=%u, lwm=%u, reject=%s, max_rejects=%d/%d sec)",
                                     client->mac_addr,
                                     client->hwm, client->lwm,
@@ -1799,6 +1831,12 @@ bm_client_ovsdb_update_cb(ovsdb_update_monitor_t *self)
             return;
         }
 
+        if (client->mac_key != bm_client_mac_key(&client->macaddr)) {
+            ds_tree_remove(&bm_clients_by_mac, client);
+            client->mac_key = bm_client_mac_key(&client->macaddr);
+            ds_tree_insert(&bm_clients_by_mac, client, &client->mac_key);
+        }
+
         if( bm_client_lwm_toggled( prev_lwm, client, true ) ||
             bm_client_force_kick_type_toggled( prev_force_kick, client, true ) )
         {
@@ -1860,6 +1898,7 @@ bm_client_ovsdb_update_cb(ovsdb_update_monitor_t *self)
         bm_stats_remove_client_from_report( client );
 
         ds_tree_remove(&bm_clients, client);
+        bm_client_unindex(client);
         bm_client_remove(client);
 
         break;
@@ -2155,6 +2194,7 @@ bm_client_cleanup(void)
     client = ds_tree_ifirst(&iter, &bm_clients);
     while(client) {
         ds_tree_iremove(&iter);
+        bm_client_unindex(client);
 
         bm_client_remove(client);
 
@@ -2648,6 +2688,29 @@ bm_client_get_reject_detection( bm_client_t *client )
     return reject_detection;
 }
 
+static void
+bm_client_insert(bm_client_t *client)
+{
+    ds_tree_insert(&bm_clients, client, client->mac_addr);
+
+    client->mac_key = bm_client_mac_key(&client->macaddr);
+    ds_tree_insert(&bm_clients_by_mac, client, &client->mac_key);
+
+    if (client->uuid[0] != '\0') {
+        ds_tree_insert(&bm_clients_by_uuid, client, client->uuid);
+    }
+}
+
+static void
+bm_client_unindex(bm_client_t *client)
+{
+    ds_tree_remove(&bm_clients_by_mac, client);
+
+    if (client->uuid[0] != '\0') {
+        ds_tree_remove(&bm_clients_by_uuid, client);
+    }
+}
+
 ds_tree_t *
 bm_client_get_tree(void)
 {
@@ -2657,15 +2720,7 @@ bm_client_get_tree(void)
 bm_client_t *
 bm_client_find_by_uuid(const char *uuid)
 {
-    bm_client_t       *client;
-
-    ds_tree_foreach(&bm_clients, client) {
-        if (!strcmp(client->uuid, uuid)) {
-            return client;
-        }
-    }
-
-    return NULL;
+    return (bm_client_t *)ds_tree_find(&bm_clients_by_uuid, (char *)uuid);
 }
 
 bm_client_t *
@@ -2677,10 +2732,9 @@ bm_client_find_by_macstr(char *mac_str)
 bm_client_t *
 bm_client_find_by_macaddr(os_macaddr_t mac_addr)
 {
-    char              mac_str[MAC_STR_LEN];
+    uint64_t          key = bm_client_mac_key(&mac_addr);
 
-    sprintf(mac_str, PRI(os_macaddr_lower_t), FMT(os_macaddr_t, mac_addr));
-    return bm_client_find_by_macstr(mac_str);
+    return (bm_client_t *)ds_tree_find(&bm_clients_by_mac, &key);
 }
 
 bm_client_t *
@@ -2698,7 +2752,7 @@ bm_client_find_or_add_by_macaddr(os_macaddr_t *mac_addr)
         free(client);
         return NULL;
     }
-    ds_tree_insert(&bm_clients, client, client->mac_addr);
+    bm_client_insert(client);
     LOGN("Added client %s", client->mac_addr);
     return client;
 }
@@ -56,6 +56,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define BM_CLIENT_MAX_TM_NEIGHBORS          3
 
+#define BM_CLIENT_RSSI_RECORDS              4
+
 #define BTM_DEFAULT_MAX_RETRIES             3
 #define BTM_DEFAULT_RETRY_INTERVAL          10  // In seconds
 
@@ -266,6 +268,12 @@ typedef struct {
     void                        *client;
 } bm_rrm_req_t;
 
+typedef struct {
+    const void                  *owner;         // RSSI reporting context
+    dpp_rssi_record_t           *record;
+    unsigned int                generation;
+} bm_client_rssi_record_t;
+
 typedef struct {
     char                        mac_addr[MAC_STR_LEN];
     os_macaddr_t                macaddr;
@@ -399,6 +407,13 @@ typedef struct {
     unsigned int                active_treshold_bps;
 
     ds_tree_node_t              dst_node;
+
+    /* RSSI report record references, one slot per reporting context */
+    bm_client_rssi_record_t     rssi_records[BM_CLIENT_RSSI_RECORDS];
+
+    uint64_t                    mac_key;        // 48-bit MAC, lookup key
+    ds_tree_node_t              mac_node;
+    ds_tree_node_t              uuid_node;
 } bm_client_t;
 
 static inline bm_client_stats_t *
@@ -55,18 +55,36 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /*****************************************************************************/
 static struct ev_loop *     _evloop = NULL;
 
-static pthread_mutex_t      bm_cb_lock;
 static ev_async             bm_cb_async;
-static ds_dlist_t           bm_cb_queue;
-static int                  bm_cb_queue_len = 0;
 
 static bool                 _bsal_initialized = false;
 
+/*
+ * Driver events are handed over from the BSAL thread through a
+ * preallocated single-producer/single-consumer ring. The producer only
+ * advances bm_cb_head, the consumer only advances bm_cb_tail, so no lock
+ * is needed. Probe requests are refused once the ring passes
+ * BM_CB_QUEUE_PROBE_MAX so the remaining slots stay available for
+ * connect/disconnect and other state-changing events.
+ */
 typedef struct {
     bsal_event_t            event;
+    unsigned int            count;      // Probe requests folded into this slot
+} bm_cb_slot_t;
+
+static bm_cb_slot_t         *bm_cb_ring = NULL;
+static unsigned int         bm_cb_head = 0;
+static unsigned int         bm_cb_tail = 0;
 
-    ds_dlist_node_t         node;
-} bm_cb_entry_t;
+// Written by the producer only
+static unsigned int         bm_cb_dropped_probe = 0;
+static unsigned int         bm_cb_dropped = 0;
+
+// Written by the consumer only
+static unsigned int         bm_cb_coalesced = 0;
+static unsigned int         bm_cb_peak = 0;
+static unsigned int         bm_cb_reported_probe = 0;
+static unsigned int         bm_cb_reported = 0;
 
 static c_item_t map_bsal_disc_sources[] = {
     C_ITEM_STR(BSAL_DISC_SOURCE_LOCAL,              "Local"),
@@ -114,93 +132,178 @@ static c_item_t map_bsal_disc_reasons[] = {
 };
 
 /*****************************************************************************/
-static void     bm_events_handle_event(bsal_event_t *event );
+static void     bm_events_handle_event(bsal_event_t *event, unsigned int count);
 static void     bm_events_handle_rssi_xing( bm_client_t *client, bsal_event_t *event );
+static void     bm_events_probe_blocked( bm_client_t *client, bsal_event_t *event );
 /*****************************************************************************/
 
 // Callback function for BSAL upon receiving steering events from the driver
 static void
 bm_events_bsal_event_cb(bsal_event_t *event)
 {
-    bm_cb_entry_t       *cb_entry;
-    int                 ret = 0;
+    bm_cb_slot_t        *slot;
+    unsigned int        head;
+    unsigned int        used;
+
+    if( !bm_cb_ring ) {
+        return;
+    }
 
-    pthread_mutex_lock( &bm_cb_lock );
+    head = bm_cb_head;
+    used = head - __atomic_load_n( &bm_cb_tail, __ATOMIC_ACQUIRE );
 
-    if( bm_cb_queue_len >= BM_CB_QUEUE_MAX ) {
-        LOGW( "BM CB queue full! Ignoring event..." );
-        goto exit;
+    if( event->type == BSAL_EVENT_PROBE_REQ && used >= BM_CB_QUEUE_PROBE_MAX ) {
+        __atomic_fetch_add( &bm_cb_dropped_probe, 1, __ATOMIC_RELAXED );
+        return;
     }
 
-    if( !(cb_entry = calloc( 1, sizeof( *cb_entry ))) ) {
-        LOGE( "Failed to allocate memory for BM CB queue object" );
-        goto exit;
+    if( used >= BM_CB_QUEUE_MAX ) {
+        __atomic_fetch_add( &bm_cb_dropped, 1, __ATOMIC_RELAXED );
+        return;
     }
 
-    memcpy( &cb_entry->event, event, sizeof( cb_entry->event ) );
+    slot = &bm_cb_ring[head & (BM_CB_QUEUE_MAX - 1)];
+    memcpy( &slot->event, event, sizeof( slot->event ) );
+    slot->count = 1;
 
-    ds_dlist_insert_tail( &bm_cb_queue, cb_entry );
-    bm_cb_queue_len++;
-    if (bm_cb_queue_len > 5)
-        LOGT("bm_cm_queue_len++ (%d)", bm_cb_queue_len);
-    ret = 1;
+    __atomic_store_n( &bm_cb_head, head + 1, __ATOMIC_RELEASE );
 
-exit:
-    pthread_mutex_unlock( &bm_cb_lock );
-    if( ret && _evloop ) {
-            ev_async_send( _evloop, &bm_cb_async );
+    if( _evloop ) {
+        ev_async_send( _evloop, &bm_cb_async );
     }
 
     return;
 }
 
-// Asynchronous callback to process events in CB queue
+static bool
+bm_events_probe_match(bsal_event_t *a, bsal_event_t *b)
+{
+    return a->data.probe_req.ssid_null == b->data.probe_req.ssid_null &&
+           a->data.probe_req.blocked == b->data.probe_req.blocked &&
+           a->data.probe_req.rssi == b->data.probe_req.rssi &&
+           !memcmp( a->data.probe_req.client_addr, b->data.probe_req.client_addr,
+                    sizeof( a->data.probe_req.client_addr ) ) &&
+           !strncmp( a->ifname, b->ifname, sizeof( a->ifname ) );
+}
+
+/*
+ * Fold repeated probe requests from the same client on the same interface
+ * into the last one of the batch. Any other event type acts as a barrier,
+ * so probes are never reordered around connects, disconnects or RSSI events.
+ * Only probes with an identical RSSI are folded, so the client steering
+ * RSSI crossing check sees every distinct signal level.
+ */
 static void
-bm_events_async_cb( EV_P_ ev_async *w, int revents )
+bm_events_coalesce(unsigned int tail, unsigned int n)
 {
-    bm_cb_entry_t       *cb_entry;
-    bsal_event_t        *event;
+    bm_cb_slot_t        *probes[BM_CB_DRAIN_BATCH];
+    bm_cb_slot_t        *slot;
+    unsigned int        nprobes = 0;
+    unsigned int        i;
+    unsigned int        j;
 
-    while( true )
+    for( i = 0; i < n; i++ )
     {
-        pthread_mutex_lock( &bm_cb_lock );
-        cb_entry = ds_dlist_is_empty( &bm_cb_queue ) ? NULL : ds_dlist_remove_head( &bm_cb_queue );
-        if ( cb_entry )
-        {
-            bm_cb_queue_len--;
-            if (bm_cb_queue_len > 4)
-                LOGT("bm_cm_queue_len-- (%d)", bm_cb_queue_len);
+        slot = &bm_cb_ring[(tail + i) & (BM_CB_QUEUE_MAX - 1)];
+
+        if( slot->event.type != BSAL_EVENT_PROBE_REQ ) {
+            nprobes = 0;
+            continue;
         }
-        pthread_mutex_unlock( &bm_cb_lock );
 
-        if ( !cb_entry )
+        for( j = 0; j < nprobes; j++ )
         {
-            break;
+            if( bm_events_probe_match( &probes[j]->event, &slot->event ) ) {
+                slot->count += probes[j]->count;
+                probes[j]->count = 0;
+                probes[j] = slot;
+                bm_cb_coalesced++;
+                break;
+            }
         }
 
-        event = &cb_entry->event;
+        if( j == nprobes ) {
+            probes[nprobes++] = slot;
+        }
+    }
+}
+
+static void
+bm_events_report_overflow(void)
+{
+    unsigned int        dropped_probe;
+    unsigned int        dropped;
+
+    dropped_probe = __atomic_load_n( &bm_cb_dropped_probe, __ATOMIC_RELAXED );
+    dropped = __atomic_load_n( &bm_cb_dropped, __ATOMIC_RELAXED );
+
+    if( dropped != bm_cb_reported ) {
+        LOGW( "BM CB queue full! Dropped %u events (%u total)",
+              dropped - bm_cb_reported, dropped );
+        bm_cb_reported = dropped;
+    }
+
+    if( dropped_probe != bm_cb_reported_probe ) {
+        LOGD( "BM CB queue congested, dropped %u probe requests (%u total)",
+              dropped_probe - bm_cb_reported_probe, dropped_probe );
+        bm_cb_reported_probe = dropped_probe;
+    }
+}
 
-        bm_events_handle_event(event);
+// Asynchronous callback to process events in CB queue
+static void
+bm_events_async_cb( EV_P_ ev_async *w, int revents )
+{
+    bm_cb_slot_t        *slot;
+    unsigned int        tail;
+    unsigned int        used;
+    unsigned int        n;
+    unsigned int        i;
+
+    tail = bm_cb_tail;
+    used = __atomic_load_n( &bm_cb_head, __ATOMIC_ACQUIRE ) - tail;
+
+    if( used > bm_cb_peak ) {
+        bm_cb_peak = used;
+        LOGT( "BM CB queue peak (%u)", bm_cb_peak );
+    }
+
+    // Drain in batches so a probe storm does not starve other watchers
+    n = used < BM_CB_DRAIN_BATCH ? used : BM_CB_DRAIN_BATCH;
 
-        free( cb_entry );
+    bm_events_coalesce( tail, n );
+
+    for( i = 0; i < n; i++ )
+    {
+        slot = &bm_cb_ring[(tail + i) & (BM_CB_QUEUE_MAX - 1)];
+        if( slot->count ) {
+            bm_events_handle_event( &slot->event, slot->count );
+        }
     }
 
+    // Release the slots only after they have been consumed in place
+    __atomic_store_n( &bm_cb_tail, tail + n, __ATOMIC_RELEASE );
+
+    if( used > n ) {
+        ev_async_send( EV_A_ w );
+    }
+
+    bm_events_report_overflow();
+
     return;
 }
 
 static void
-bm_events_handle_event(bsal_event_t *event)
+bm_events_handle_event(bsal_event_t *event, unsigned int count)
 {
     bm_client_stats_t           *stats;
     bm_client_times_t           *times;
     bm_client_t                 *client;
     bm_group_t                  *group = bm_group_find_by_ifname(event->ifname);
     time_t                      now = time(NULL);
-    bool                        reject = false;
     radio_type_t                radio_type;
     char                        *bandstr;
     char                        *ifname = event->ifname;
-    bm_client_reject_t          reject_detection;
     unsigned int                i;
     time_t                      last_probe;
 
@@ -241,16 +344,16 @@ bm_events_handle_event(bsal_event_t *event)
         stats->probe.last = now;
         if (event->data.probe_req.ssid_null) {
             stats->probe.last_null = now;
-            stats->probe.null_cnt++;
+            stats->probe.null_cnt += count;
             if (event->data.probe_req.blocked) {
-                stats->probe.null_blocked++;
+                stats->probe.null_blocked += count;
             }
         }
         else {
             stats->probe.last_direct = now;
-            stats->probe.direct_cnt++;
+            stats->probe.direct_cnt += count;
             if (event->data.probe_req.blocked) {
-                stats->probe.direct_blocked++;
+                stats->probe.direct_blocked += count;
             }
         }
 
@@ -261,43 +364,11 @@ bm_events_handle_event(bsal_event_t *event)
         if (event->data.probe_req.blocked) {
             stats->probe.last_blocked = now;
 
-            if (client->state != BM_CLIENT_STATE_CONNECTED &&
-                client->state != BM_CLIENT_STATE_BACKOFF) {
-                if( client->steering_state != BM_CLIENT_CLIENT_STEERING ) {
-                    if (!bm_client_bs_ifname_allowed(client, ifname)) {
-                        bm_client_set_state(client, BM_CLIENT_STATE_STEERING);
-                    }
-                }
-
-                reject_detection = bm_client_get_reject_detection( client );
-                switch(reject_detection) {
-                    case BM_CLIENT_REJECT_NONE:
-                        break;
-
-                    case BM_CLIENT_REJECT_AUTH_BLOCKED:
-                        reject = true;
-                        break;
-
-                    case BM_CLIENT_REJECT_PROBE_ALL:
-                        reject = true;
-                        break;
-
-                    case BM_CLIENT_REJECT_PROBE_NULL:
-                        if (event->data.probe_req.ssid_null) {
-                            reject = true;
-                        }
-                        break;
-
-                    case BM_CLIENT_REJECT_PROBE_DIRECT:
-                        if (!event->data.probe_req.ssid_null) {
-                            reject = true;
-                        }
-                        break;
-                }
-
-                if (reject) {
-                    bm_client_rejected(client, event);
-                }
+            // Each folded probe counts as a separate reject, so the
+            // max_rejects / backoff decision is taken at the same probe
+            // as without coalescing
+            for (i = 0; i < count; i++) {
+                bm_events_probe_blocked( client, event );
             }
         }
 
@@ -573,6 +644,58 @@ bm_events_handle_event(bsal_event_t *event)
     return;
 }
 
+/*
+ * Handle a single probe request that was blocked by the driver: start
+ * steering and feed the reject detection
+ */
+static void
+bm_events_probe_blocked( bm_client_t *client, bsal_event_t *event )
+{
+    bm_client_reject_t          reject_detection;
+    bool                        reject = false;
+
+    if (client->state != BM_CLIENT_STATE_CONNECTED &&
+        client->state != BM_CLIENT_STATE_BACKOFF) {
+        if( client->steering_state != BM_CLIENT_CLIENT_STEERING ) {
+            if (!bm_client_bs_ifname_allowed(client, event->ifname)) {
+                bm_client_set_state(client, BM_CLIENT_STATE_STEERING);
+            }
+        }
+
+        reject_detection = bm_client_get_reject_detection( client );
+        switch(reject_detection) {
+            case BM_CLIENT_REJECT_NONE:
+                break;
+
+            case BM_CLIENT_REJECT_AUTH_BLOCKED:
+                reject = true;
+                break;
+
+            case BM_CLIENT_REJECT_PROBE_ALL:
+                reject = true;
+                break;
+
+            case BM_CLIENT_REJECT_PROBE_NULL:
+                if (event->data.probe_req.ssid_null) {
+                    reject = true;
+                }
+                break;
+
+            case BM_CLIENT_REJECT_PROBE_DIRECT:
+                if (!event->data.probe_req.ssid_null) {
+                    reject = true;
+                }
+                break;
+        }
+
+        if (reject) {
+            bm_client_rejected(client, event);
+        }
+    }
+
+    return;
+}
+
 static bool
 bm_events_kick_client_upon_idle( bm_client_t *client )
 {
@@ -828,11 +951,12 @@ bm_events_init(struct ev_loop *loop)
     _evloop             = loop;
 
     // Initialize CB queue
-    ds_dlist_init( &bm_cb_queue, bm_cb_entry_t, node );
-    bm_cb_queue_len     = 0;
-
-    // Initialize mutex lock for CB queue
-    pthread_mutex_init( &bm_cb_lock, NULL );
+    if( !(bm_cb_ring = calloc( BM_CB_QUEUE_MAX, sizeof( *bm_cb_ring ))) ) {
+        LOGE( "Failed to allocate memory for BM CB queue" );
+        return false;
+    }
+    bm_cb_head          = 0;
+    bm_cb_tail          = 0;
 
     // Initialize async watcher
     ev_async_init( &bm_cb_async, bm_events_async_cb );
@@ -855,9 +979,14 @@ bm_events_cleanup(void)
     LOGI( "Events cleaning up" );
 
     ev_async_stop( _evloop, &bm_cb_async );
-    pthread_mutex_destroy( &bm_cb_lock );
 
     target_bsal_cleanup();
+
+    LOGI( "Events queue stats: peak=%u coalesced=%u dropped=%u dropped_probe=%u",
+          bm_cb_peak, bm_cb_coalesced, bm_cb_dropped, bm_cb_dropped_probe );
+
+    free( bm_cb_ring );
+    bm_cb_ring          = NULL;
     _bsal_initialized   = false;
     _evloop            = NULL;
 
@@ -31,7 +31,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef BM_EVENTS_H_INCLUDED
 #define BM_EVENTS_H_INCLUDED
 
-#define                 BM_CB_QUEUE_MAX     256
+#define                 BM_CB_QUEUE_MAX         256     // Must be a power of 2
+#define                 BM_CB_QUEUE_PROBE_MAX   (BM_CB_QUEUE_MAX * 3 / 4)
+#define                 BM_CB_DRAIN_BATCH       32
 
 extern bool             bm_events_init(struct ev_loop *loop);
 extern bool             bm_events_cleanup(void);
@@ -52,6 +52,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "log.h"
 #include "target.h"
 #include "bm.h"
+#include "ovsdb.h"
 
 /*****************************************************************************/
 #define MODULE_ID LOG_MODULE_ID_MAIN
@@ -193,6 +194,9 @@ main(int argc, char **argv)
     /* Register to dynamic severity updates */
     log_register_dynamic_severity(_ev_loop);
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     // Run main loop
     ev_run(_ev_loop, 0);
 
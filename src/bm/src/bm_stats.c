@@ -751,7 +751,7 @@ bm_stats_steering_parse_event(
                 // Add it into RSSI report
                 bm_stats_rssi_stats_results_update(
                         &radio_cfg,
-                        client->macaddr.addr,
+                        client,
                         (uint32_t)event->data.probe_req.rssi,
                         RSSI_SOURCE_PROBE);
             } else {
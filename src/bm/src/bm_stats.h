@@ -138,7 +138,7 @@ bool bm_stats_rssi_is_reporting_enabled (
 
 bool bm_stats_rssi_stats_results_update(
         radio_entry_t              *radio_cfg,
-        mac_address_t               mac,
+        bm_client_t                *client,
         uint32_t                    rssi,
         rssi_source_t               source);
 char *bm_stats_get_event_to_str(dpp_bs_client_event_type_t event);
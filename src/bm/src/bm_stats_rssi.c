@@ -63,6 +63,9 @@ typedef struct
     /* Internal structure used to for rssi record fetching */
     ds_dlist_t                      record_list;
 
+    /* Bumped whenever record_list is flushed, invalidates client caches */
+    unsigned int                    generation;
+
     /* Reporting start timestamp used for reporting timestamp calculation */
     uint64_t                        report_ts;
 
@@ -131,6 +134,7 @@ bm_stats_rssi_ctx_t *bm_stats_rssi_ctx_get (
     rssi_ctx = bm_stats_rssi_ctx_alloc();
     if(rssi_ctx) {
         rssi_ctx->radio_cfg = radio_cfg;
+        rssi_ctx->generation = 1;
         ds_dlist_insert_tail(&g_rssi_ctx_list, rssi_ctx);
         LOGT("Created %s rssi reporting context",
              radio_get_name_from_cfg(radio_cfg));
@@ -229,6 +233,8 @@ bool bm_stats_rssi_records_clear(
         record_entry = NULL;
     }
 
+    rssi_ctx->generation++;
+
     return true;
 }
 
@@ -260,34 +266,70 @@ bool bm_stats_rssi_result_clear(
 }
 
 static
-dpp_rssi_record_t *bm_stats_rssi_records_mac_get(
+bm_client_rssi_record_t *bm_stats_rssi_records_slot_get(
+        bm_stats_rssi_ctx_t        *rssi_ctx,
+        bm_client_t                *client)
+{
+    bm_client_rssi_record_t        *slot;
+    bm_client_rssi_record_t        *free_slot = NULL;
+    unsigned int                    i;
+
+    for (i = 0; i < ARRAY_SIZE(client->rssi_records); i++) {
+        slot = &client->rssi_records[i];
+        if (slot->owner == rssi_ctx) {
+            return slot;
+        }
+
+        if (!free_slot && !slot->owner) {
+            free_slot = slot;
+        }
+    }
+
+    if (free_slot) {
+        free_slot->owner = rssi_ctx;
+        free_slot->record = NULL;
+    }
+
+    return free_slot;
+}
+
+static
+dpp_rssi_record_t *bm_stats_rssi_records_client_get(
         bm_stats_rssi_ctx_t        *rssi_ctx,
-        mac_address_t               mac,
+        bm_client_t                *client,
         rssi_source_t               source)
 {
     ds_dlist_t                     *record_list =
         &rssi_ctx->record_list;
+    bm_client_rssi_record_t        *cache;
     dpp_rssi_record_t              *record_entry = NULL;
     ds_dlist_iter_t                 record_iter;
 
-    /* Find current rssi in existing list */
-    for (   record_entry = ds_dlist_ifirst(&record_iter, record_list);
-            record_entry != NULL;
-            record_entry = ds_dlist_inext(&record_iter))
-    {
-        if (!memcmp(
-                    record_entry->mac,
-                    mac,
-                    sizeof(record_entry->mac))
-           ) {
-            return record_entry;
+    /* The client keeps a reference to its record for the current period */
+    cache = bm_stats_rssi_records_slot_get(rssi_ctx, client);
+    if (cache && cache->record && cache->generation == rssi_ctx->generation) {
+        return cache->record;
+    }
+
+    /* Out of slots, find current rssi in existing list */
+    if (!cache) {
+        for (   record_entry = ds_dlist_ifirst(&record_iter, record_list);
+                record_entry != NULL;
+                record_entry = ds_dlist_inext(&record_iter))
+        {
+            if (!memcmp(
+                        record_entry->mac,
+                        client->macaddr.addr,
+                        sizeof(record_entry->mac))
+               ) {
+                return record_entry;
+            }
         }
     }
 
-    record_entry = NULL;
     record_entry = dpp_rssi_record_alloc();
     if (NULL != record_entry) {
-        memcpy(record_entry->mac, mac, sizeof(mac_address_t));
+        memcpy(record_entry->mac, client->macaddr.addr, sizeof(mac_address_t));
         record_entry->source = source;
 
         /* Cache is always RAW */
@@ -297,6 +339,11 @@ dpp_rssi_record_t *bm_stats_rssi_records_mac_get(
                 node);
 
         ds_dlist_insert_tail(record_list, record_entry);
+
+        if (cache) {
+            cache->record = record_entry;
+            cache->generation = rssi_ctx->generation;
+        }
     }
 
     return record_entry;
@@ -743,10 +790,11 @@ bool bm_stats_rssi_is_reporting_enabled (
 
 bool bm_stats_rssi_stats_results_update(
         radio_entry_t              *radio_cfg,
-        mac_address_t               mac,
+        bm_client_t                *client,
         uint32_t                    rssi,
         rssi_source_t               source)
 {
+    uint8_t                        *mac = client->macaddr.addr;
     bm_stats_rssi_ctx_t            *rssi_ctx = NULL;
     dpp_rssi_record_t              *record_entry = NULL;
     dpp_rssi_raw_t                 *rssi_entry;
@@ -769,9 +817,9 @@ bool bm_stats_rssi_stats_results_update(
     rssi_ctx = bm_stats_rssi_ctx_get(radio_cfg),
 
     record_entry =
-        bm_stats_rssi_records_mac_get(
+        bm_stats_rssi_records_client_get(
                 rssi_ctx,
-                mac,
+                client,
                 source);
     if (NULL == record_entry) {
         LOGE("Updating %s rssi %d for "MAC_ADDRESS_FORMAT,
@@ -130,6 +130,9 @@ int main(int argc, char ** argv)
         return -1;
     }
 #endif
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     if (cm2_is_extender()) {
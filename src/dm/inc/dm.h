@@ -54,8 +54,10 @@ bool dm_st_monitor();
  *                              when killed by signals that usually do not 
  *                              trigger a restart
  * @param[in]   restart_timer   Restart timer in seconds or 0 to use default
+ * @param[in]   depends         Comma separated list of managers that must be
+ *                              ready before this one is started, or NULL
  */
-bool dm_manager_register(const char *path, bool plan_b, bool always_restart, int restart_timer);
+bool dm_manager_register(const char *path, bool plan_b, bool always_restart, int restart_timer, const char *depends);
 
 /*
  * DM cli
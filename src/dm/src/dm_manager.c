@@ -37,6 +37,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <glob.h>
+#include <signal.h>
 
 #include "os.h"
 #include "log.h"
@@ -60,6 +62,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define TM_OUT_FAST     (5)
 #define TM_OUT_SLOW     (60)
 
+#define DM_READY_TIMEOUT    (10)    /* Seconds to wait for a readiness notification */
+#define DM_DEPS_TIMEOUT     (30)    /* Seconds after which unresolved dependencies are ignored */
+#define DM_STALE_TIMEOUT    (3)     /* Seconds to wait for stale instances to exit on SIGTERM */
+#define DM_STALE_POLL       (0.1)   /* Seconds between checks on terminating stale instances */
+#define DM_STALE_TTL        (60)    /* Lifetime of the startup /proc snapshot in seconds */
+#define DM_COMM_LEN         (16)    /* Size of /proc/PID/comm, including the terminator */
+#define DM_MAX_STALE_PIDFILES (64)  /* Stale PID files handled on top of the /proc snapshot */
+
 struct dm_manager
 {
     char                dm_name[64];                /* Manager name */
@@ -72,14 +82,44 @@ struct dm_manager
     bool                dm_enable;                  /* True if enabled */
     ev_child            dm_child_watcher;           /* Child event watcher */
     ev_timer            dm_restart_timer;           /* Restart timer */
+    char                dm_depends[128];            /* Comma separated list of managers this one depends on */
+    bool                dm_pending;                 /* Waiting for dependencies to become ready */
+    bool                dm_deps_expired;            /* Dependency wait timed out, start regardless */
+    ev_timer            dm_deps_timer;              /* Dependency wait timer */
+    bool                dm_ready;                   /* Manager signalled readiness */
+    int                 dm_ready_fd;                /* Read end of the readiness pipe or -1 */
+    ev_io               dm_ready_watcher;           /* Readiness pipe watcher */
+    ev_timer            dm_ready_timer;             /* Readiness timeout */
 };
 
 #define DM_MANAGER_INIT (struct dm_manager)                         \
 {                                                                   \
     .dm_pid = -1,                                                   \
     .dm_enable = true,                                              \
+    .dm_ready_fd = -1,                                              \
 }
 
+/*
+ * Process snapshot taken once at startup; used to clean up stale manager
+ * instances without rescanning /proc for every registered manager
+ */
+struct dm_stale_proc
+{
+    pid_t               sp_pid;                     /* Process ID */
+    char                sp_name[DM_COMM_LEN];       /* Process name from /proc/PID/comm */
+    bool                sp_killed;                  /* Terminated as a stale instance */
+};
+
+/*
+ * Stale process being terminated, see dm_stale_terminate()
+ */
+struct dm_stale_kill
+{
+    pid_t               sk_pid;                     /* Process ID */
+    bool                sk_sigkill;                 /* SIGKILL was sent */
+    ev_tstamp           sk_deadline;                /* Escalate or give up at this time */
+};
+
 STATE_MACHINE_USE;
 
 /*
@@ -101,7 +141,17 @@ static char dm_name_valid[] =
     "0123456789"
     "/_";
 
+static struct dm_stale_proc *dm_stale_procs = NULL;
+static int dm_stale_num = 0;
+static ev_timer dm_stale_timer;
+
+static struct dm_stale_kill *dm_stale_kills = NULL;
+static int dm_stale_kills_num = 0;
+static bool dm_stale_plan_b = false;
+static ev_timer dm_stale_kill_timer;
+
 /* prototypes  */
+static bool dm_manager_pid_get(const char *pid_file, pid_t *pid);
 static bool dm_manager_pid_set(const char *pid_file, pid_t pid);
 static bool dm_manager_pid_file(struct dm_manager *dm, char *out, size_t outsz);
 static void dm_manager_child_fn(struct ev_loop *loop, ev_child *w, int revents);
@@ -111,10 +161,21 @@ static bool dm_manager_update(
         bool enable,
         bool plan_b,
         bool always_restart,
-        int restart_timer);
+        int restart_timer,
+        const char *depends);
+
+static struct dm_manager *dm_manager_add(
+        const char *path,
+        bool plan_b,
+        bool restart,
+        int restart_delay,
+        const char *depends);
 
 static bool dm_manager_start_all(void);
+static void dm_manager_start_pending(void);
 static void dm_manager_kill(struct dm_manager *dm);
+static void dm_manager_cleanup_stale(void);
+static void dm_manager_ready_reset(struct dm_manager *dm);
 static bool dm_manager_start(struct dm_manager *dm);
 static bool dm_manager_stop(struct dm_manager *dm);
 static bool dm_manager_exec(struct dm_manager *dm);
@@ -162,20 +223,25 @@ bool init_managers()
      */
     for (i = 0; i < (int)target_managers_num; i++)
     {
-        struct dm_manager *dm = calloc(1, sizeof(*dm));
-
         /*
          * Add manager to global list of managers
          */
         LOG(INFO, "Adding legacy manager: %s", target_managers_config[i].name);
 
-        dm_manager_register(
+        dm_manager_add(
                 target_managers_config[i].name,
                 target_managers_config[i].needs_plan_b,
                 target_managers_config[i].always_restart,
-                target_managers_config[i].restart_delay);
+                target_managers_config[i].restart_delay,
+                target_managers_config[i].depends_on);
     }
 
+    /*
+     * Clean up stale instances of all known managers in one go: a single
+     * pass over /proc and the PID folder, and a parallel termination
+     */
+    dm_manager_cleanup_stale();
+
     if (!dm_manager_start_all())
     {
         LOG(ERR, "Failed to start at least one manager.");
@@ -225,45 +291,17 @@ bool dm_manager_register(
         const char *path,
         bool plan_b,
         bool restart,
-        int restart_delay)
+        int restart_delay,
+        const char *depends)
 {
-    const char *name;
     struct dm_manager *dm;
 
-    /* Infer the manager name from the manager path */
-    name = dm_manager_basename(path);
-
-    dm = ds_tree_find(&dm_manager_list, (char *)name);
-    if (dm != NULL)
-    {
-        LOG(ERR, "Manager %s already registered.", name);
-        return false;
-    }
-
-    /* Check if the child process contains only valid characters */
-    if (strspn(path, dm_name_valid) != strlen(path))
-    {
-        LOG(ERR, "Manager path contains invalid characters: %s", path);
-        return false;
-    }
-
-    dm = calloc(1, sizeof(*dm));
-    *dm = DM_MANAGER_INIT;
-
-    STRSCPY(dm->dm_name, name);
-    STRSCPY(dm->dm_path, path);
-    dm->dm_plan_b = plan_b;
-    dm->dm_restart_always = restart;
-    dm->dm_restart_delay = restart_delay;
-
-    ds_tree_insert(&dm_manager_list, dm, (char *)dm->dm_name);
-
-    LOG(INFO, "Registered manager: %s", dm->dm_name);
+    dm = dm_manager_add(path, plan_b, restart, restart_delay, depends);
+    if (dm == NULL) return false;
 
     /* Clean up old instances of this manager */
     dm_manager_kill(dm);
 
-
     return true;
 }
 
@@ -272,10 +310,12 @@ bool dm_manager_update(
         bool enable,
         bool plan_b,
         bool restart_always,
-        int restart_delay)
+        int restart_delay,
+        const char *depends)
 {
    const  char *name;
     struct dm_manager *dm;
+    bool retval;
 
     name = dm_manager_basename(path);
 
@@ -290,17 +330,19 @@ bool dm_manager_update(
     dm->dm_restart_always = restart_always;
     dm->dm_restart_delay = restart_delay;
     dm->dm_enable = enable;
+    STRSCPY(dm->dm_depends, depends != NULL ? depends : "");
 
     if (enable)
     {
         return dm_manager_start(dm);
     }
-    else
-    {
-        return dm_manager_stop(dm);
-    }
 
-    return false;
+    retval = dm_manager_stop(dm);
+
+    /* Managers waiting on this one no longer need to */
+    dm_manager_start_pending();
+
+    return retval;
 }
 
 
@@ -310,9 +352,62 @@ bool dm_manager_update(
  * ===========================================================================
  */
 
+/**
+ * Add a manager to the list of managers without touching any running
+ * instances
+ */
+struct dm_manager *dm_manager_add(
+        const char *path,
+        bool plan_b,
+        bool restart,
+        int restart_delay,
+        const char *depends)
+{
+    const char *name;
+    struct dm_manager *dm;
+
+    /* Infer the manager name from the manager path */
+    name = dm_manager_basename(path);
+
+    dm = ds_tree_find(&dm_manager_list, (char *)name);
+    if (dm != NULL)
+    {
+        LOG(ERR, "Manager %s already registered.", name);
+        return NULL;
+    }
+
+    /* Check if the child process contains only valid characters */
+    if (strspn(path, dm_name_valid) != strlen(path))
+    {
+        LOG(ERR, "Manager path contains invalid characters: %s", path);
+        return NULL;
+    }
+
+    dm = calloc(1, sizeof(*dm));
+    *dm = DM_MANAGER_INIT;
+
+    STRSCPY(dm->dm_name, name);
+    STRSCPY(dm->dm_path, path);
+    STRSCPY(dm->dm_depends, depends != NULL ? depends : "");
+    dm->dm_plan_b = plan_b;
+    dm->dm_restart_always = restart;
+    dm->dm_restart_delay = restart_delay;
+
+    ds_tree_insert(&dm_manager_list, dm, (char *)dm->dm_name);
+
+    LOG(INFO, "Registered manager: %s depends_on=%s",
+              dm->dm_name,
+              dm->dm_depends[0] != '\0' ? dm->dm_depends : "(none)");
+
+    return dm;
+}
+
 /**
  * Start all currently registered (and stopped) managers
  *
+ * Managers without dependencies are started right away; the others are
+ * started as soon as the managers they depend on signal readiness.
+ *
  * Return false if at least one of the managers failed to start
  */
 bool dm_manager_start_all(void)
@@ -329,36 +424,575 @@ bool dm_manager_start_all(void)
     return retval;
 }
 
+/**
+ * Start managers that were waiting for their dependencies. Readiness of one
+ * manager may cascade into starting several others, so guard against
+ * re-entry and rescan until nothing changes.
+ */
+void dm_manager_start_pending(void)
+{
+    static bool in_progress = false;
+    static bool rescan = false;
+    struct dm_manager *dm;
+
+    if (in_progress)
+    {
+        rescan = true;
+        return;
+    }
+
+    in_progress = true;
+    do
+    {
+        rescan = false;
+        ds_tree_foreach(&dm_manager_list, dm)
+        {
+            if (!dm->dm_pending) continue;
+            dm_manager_start(dm);
+        }
+    }
+    while (rescan);
+    in_progress = false;
+}
+
+/**
+ * Check if all dependencies of a manager are ready. Dependencies that are
+ * disabled are skipped; dependencies that are not registered (yet) block the
+ * manager until the dependency wait times out.
+ */
+static bool dm_manager_deps_ready(struct dm_manager *dm)
+{
+    char deps[sizeof(dm->dm_depends)];
+    struct dm_manager *dep;
+    char *saveptr = NULL;
+    char *name;
+
+    if (dm->dm_deps_expired) return true;
+
+    STRSCPY(deps, dm->dm_depends);
+    for (name = strtok_r(deps, ", ", &saveptr);
+         name != NULL;
+         name = strtok_r(NULL, ", ", &saveptr))
+    {
+        dep = ds_tree_find(&dm_manager_list, (char *)dm_manager_basename(name));
+        if (dep == dm) continue;
+
+        if (dep == NULL)
+        {
+            LOG(DEBUG, "Manager %s: dependency %s not registered.", dm->dm_name, name);
+            return false;
+        }
+
+        if (!dep->dm_enable) continue;
+
+        if (!dep->dm_ready)
+        {
+            LOG(DEBUG, "Manager %s: dependency %s not ready.", dm->dm_name, name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Dependency wait timer; start the manager regardless of the state of its
+ * dependencies (dependency loops, managers that never come up, ...)
+ */
+static void dm_manager_deps_timeout_fn(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    (void)loop;
+    (void)revents;
+
+    struct dm_manager *dm = CONTAINER_OF(w, struct dm_manager, dm_deps_timer);
+
+    LOG(WARN, "Manager %s: dependencies (%s) not ready after %d seconds, starting anyway.",
+              dm->dm_name,
+              dm->dm_depends,
+              DM_DEPS_TIMEOUT);
+
+    dm->dm_deps_expired = true;
+    dm_manager_start_pending();
+}
+
+/*
+ * ===========================================================================
+ *  Stale instance cleanup
+ * ===========================================================================
+ */
+
+/**
+ * Check if @p pid is still alive and named @p name
+ */
+static bool dm_stale_pid_match(pid_t pid, const char *name)
+{
+    char comm[DM_COMM_LEN];
+
+    if (pid <= 0 || pid == getpid()) return false;
+
+    if (os_pid_to_name(pid, comm, sizeof(comm)) != 0) return false;
+
+    /* The kernel truncates process names to DM_COMM_LEN - 1 characters */
+    return strncmp(comm, name, DM_COMM_LEN - 1) == 0;
+}
+
+/**
+ * Take a snapshot of all running processes with a single pass over /proc
+ */
+static void dm_stale_snapshot(void)
+{
+    struct dm_stale_proc *sp;
+    char *newline;
+    glob_t g;
+    size_t ii;
+    FILE *f;
+    long pid;
+
+    if (glob("/proc/[0-9]*/comm", 0, NULL, &g) != 0) return;
+
+    dm_stale_procs = calloc(g.gl_pathc, sizeof(*dm_stale_procs));
+    if (dm_stale_procs == NULL)
+    {
+        LOG(ERR, "Error allocating process snapshot.");
+        globfree(&g);
+        return;
+    }
+
+    for (ii = 0; ii < g.gl_pathc; ii++)
+    {
+        pid = strtol(g.gl_pathv[ii] + strlen("/proc/"), NULL, 10);
+        if (pid <= 0 || pid == getpid()) continue;
+
+        f = fopen(g.gl_pathv[ii], "r");
+        if (f == NULL) continue;
+
+        sp = &dm_stale_procs[dm_stale_num];
+        if (fgets(sp->sp_name, sizeof(sp->sp_name), f) != NULL)
+        {
+            newline = strchr(sp->sp_name, '\n');
+            if (newline != NULL) *newline = '\0';
+            sp->sp_pid = (pid_t)pid;
+            dm_stale_num++;
+        }
+
+        fclose(f);
+    }
+
+    globfree(&g);
+
+    LOG(DEBUG, "Process snapshot: %d processes", dm_stale_num);
+}
+
+static void dm_stale_snapshot_free_fn(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    (void)loop;
+    (void)w;
+    (void)revents;
+
+    free(dm_stale_procs);
+    dm_stale_procs = NULL;
+    dm_stale_num = 0;
+}
+
+/**
+ * Add @p pid to the kill list if not already present
+ */
+static void dm_stale_kill_add(pid_t *pids, int *npids, int maxpids, pid_t pid)
+{
+    int ii;
+
+    for (ii = 0; ii < *npids; ii++)
+    {
+        if (pids[ii] == pid) return;
+    }
+
+    if (*npids >= maxpids) return;
+
+    pids[(*npids)++] = pid;
+}
+
+/**
+ * All stale processes are gone: run Plan B if a terminated instance required
+ * it, otherwise start the managers that were held back
+ */
+static void dm_stale_done(void)
+{
+    free(dm_stale_kills);
+    dm_stale_kills = NULL;
+    dm_stale_kills_num = 0;
+
+    if (dm_stale_plan_b)
+    {
+        dm_stale_plan_b = false;
+
+        LOG(NOTICE, "Plan B required by a stale manager instance.");
+
+        target_managers_restart();
+
+        LOG(ERR, "Restart manager was not executed!");
+        return;
+    }
+
+    dm_manager_start_pending();
+}
+
+/**
+ * Check on the processes being terminated, send SIGKILL to the ones that
+ * outlived DM_STALE_TIMEOUT and give up on the ones that outlived SIGKILL
+ */
+static void dm_stale_kill_fn(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    (void)revents;
+
+    struct dm_stale_kill *sk;
+    ev_tstamp now = ev_now(loop);
+    int status;
+    int ii;
+    int jj;
+
+    for (ii = 0, jj = 0; ii < dm_stale_kills_num; ii++)
+    {
+        sk = &dm_stale_kills[ii];
+
+        /* Reap our own children, kill(pid, 0) succeeds on zombies */
+        while (waitpid(sk->sk_pid, &status, WNOHANG) > 0);
+
+        if (kill(sk->sk_pid, 0) != 0) continue;
+
+        if (now >= sk->sk_deadline)
+        {
+            if (sk->sk_sigkill)
+            {
+                LOG(ERR, "Giving up on termination of stale process: pid=%d", (int)sk->sk_pid);
+                continue;
+            }
+
+            LOG(NOTICE, "Sending SIGKILL to stale process: pid=%d", (int)sk->sk_pid);
+            kill(sk->sk_pid, SIGKILL);
+            sk->sk_sigkill = true;
+            sk->sk_deadline = now + 1.0;
+        }
+
+        dm_stale_kills[jj++] = *sk;
+    }
+    dm_stale_kills_num = jj;
+
+    if (dm_stale_kills_num > 0) return;
+
+    ev_timer_stop(loop, w);
+    dm_stale_done();
+}
+
+/**
+ * Terminate a list of processes in parallel without blocking the event loop:
+ * SIGTERM everything now, then dm_stale_kill_fn() checks on them every
+ * DM_STALE_POLL seconds. Managers are not started until all of them are gone.
+ * If @p plan_b is set, Plan B runs at that point instead.
+ */
+static void dm_stale_terminate(pid_t *pids, int npids, bool plan_b)
+{
+    struct dm_stale_kill *sk;
+    int ii;
+    int jj;
+
+    dm_stale_plan_b |= plan_b;
+
+    if (npids > 0)
+    {
+        sk = realloc(dm_stale_kills, (dm_stale_kills_num + npids) * sizeof(*sk));
+        if (sk == NULL)
+        {
+            LOG(ERR, "Error allocating stale process kill list.");
+            npids = 0;
+        }
+        else
+        {
+            dm_stale_kills = sk;
+        }
+    }
+
+    for (ii = 0; ii < npids; ii++)
+    {
+        for (jj = 0; jj < dm_stale_kills_num; jj++)
+        {
+            if (dm_stale_kills[jj].sk_pid == pids[ii]) break;
+        }
+        if (jj < dm_stale_kills_num) continue;
+
+        LOG(NOTICE, "Killing stale process: pid=%d", (int)pids[ii]);
+        if (kill(pids[ii], SIGTERM) != 0) continue;
+
+        sk = &dm_stale_kills[dm_stale_kills_num++];
+        sk->sk_pid = pids[ii];
+        sk->sk_sigkill = false;
+        sk->sk_deadline = ev_now(EV_DEFAULT) + DM_STALE_TIMEOUT;
+    }
+
+    if (dm_stale_kills_num == 0)
+    {
+        dm_stale_done();
+        return;
+    }
+
+    if (!ev_is_active(&dm_stale_kill_timer))
+    {
+        ev_timer_init(&dm_stale_kill_timer, dm_stale_kill_fn, DM_STALE_POLL, DM_STALE_POLL);
+        ev_timer_start(EV_DEFAULT, &dm_stale_kill_timer);
+    }
+}
+
+/**
+ * Startup cleanup of stale manager instances:
+ *  - every PID file left behind by a previous DM instance is checked
+ *    against /proc/PID/comm and the process is terminated
+ *  - a single /proc pass is used to find instances of registered managers
+ *    that have no PID file
+ *  - all stale processes are terminated in parallel
+ *
+ * The process snapshot is kept for a while so that managers registered from
+ * OVSDB shortly after startup do not need to rescan /proc.
+ */
+void dm_manager_cleanup_stale(void)
+{
+    char pid_glob[C_MAXPATH_LEN];
+    char name[DM_COMM_LEN];
+    struct dm_manager *dm;
+    const char *pname;
+    bool plan_b = false;
+    pid_t *pids = NULL;
+    int npids = 0;
+    glob_t g;
+    size_t ii;
+    pid_t pid;
+    int jj;
+
+    dm_stale_snapshot();
+
+    pids = calloc(dm_stale_num + DM_MAX_STALE_PIDFILES, sizeof(*pids));
+    if (pids == NULL)
+    {
+        LOG(ERR, "Error allocating stale process list.");
+        return;
+    }
+
+    /* PID files left behind by a previous instance */
+    snprintf(pid_glob, sizeof(pid_glob), "%s/*.pid", CONFIG_DM_PID_PATH);
+    if (glob(pid_glob, 0, NULL, &g) == 0)
+    {
+        for (ii = 0; ii < g.gl_pathc; ii++)
+        {
+            pname = dm_manager_basename(g.gl_pathv[ii]);
+            STRSCPY(name, pname);
+            name[strcspn(name, ".")] = '\0';
+
+            if (dm_manager_pid_get(g.gl_pathv[ii], &pid) && dm_stale_pid_match(pid, name))
+            {
+                LOG(NOTICE, "Manager: %s - stale instance from PID file, pid=%d", name, (int)pid);
+                dm_stale_kill_add(pids, &npids, dm_stale_num + DM_MAX_STALE_PIDFILES, pid);
+            }
+
+            unlink(g.gl_pathv[ii]);
+        }
+        globfree(&g);
+    }
+
+    /* Instances of registered managers found in the process snapshot */
+    for (jj = 0; jj < dm_stale_num; jj++)
+    {
+        dm = ds_tree_find(&dm_manager_list, dm_stale_procs[jj].sp_name);
+        if (dm == NULL) continue;
+
+        LOG(NOTICE, "Manager: %s - stale instance, pid=%d",
+                    dm->dm_name,
+                    (int)dm_stale_procs[jj].sp_pid);
+        dm_stale_kill_add(pids, &npids, dm_stale_num + DM_MAX_STALE_PIDFILES, dm_stale_procs[jj].sp_pid);
+    }
+
+    /* Flag the killed processes in the snapshot so late registrations can see them */
+    for (jj = 0; jj < dm_stale_num; jj++)
+    {
+        int kk;
+
+        for (kk = 0; kk < npids; kk++)
+        {
+            if (pids[kk] != dm_stale_procs[jj].sp_pid) continue;
+
+            dm_stale_procs[jj].sp_killed = true;
+            dm = ds_tree_find(&dm_manager_list, dm_stale_procs[jj].sp_name);
+            if (dm != NULL && dm->dm_plan_b) plan_b = true;
+            break;
+        }
+    }
+
+    dm_stale_terminate(pids, npids, plan_b);
+    free(pids);
+
+    ev_timer_init(&dm_stale_timer, dm_stale_snapshot_free_fn, DM_STALE_TTL, 0.0);
+    ev_timer_start(EV_DEFAULT, &dm_stale_timer);
+}
+
 /*
  * Terminate a stale instances of the manager. This should be executed at
  * startup to possibly clear all instances that somehow weren't killed from a
- * previous run. This function looks up the manager processes by their names.
+ * previous run.
+ *
+ * Shortly after startup the process snapshot taken by
+ * dm_manager_cleanup_stale() is used; later on the manager PID file is
+ * checked first and /proc is scanned only if that yields nothing.
  */
 void dm_manager_kill(struct dm_manager *dm)
 {
-    pid_t pid2kill;
+    char ppid[C_MAXPATH_LEN];
+    pid_t pids[8];
+    int npids = 0;
+    bool found = false;
+    pid_t pid;
+    int ii;
+
+    if (dm_stale_procs != NULL)
+    {
+        for (ii = 0; ii < dm_stale_num; ii++)
+        {
+            if (strncmp(dm_stale_procs[ii].sp_name, dm->dm_name, DM_COMM_LEN - 1) != 0) continue;
 
-    pid2kill = os_name_to_pid(dm->dm_name);
-    if (pid2kill < 0)
+            if (dm_stale_procs[ii].sp_killed)
+            {
+                /* Already terminated by the startup cleanup */
+                found = true;
+                continue;
+            }
+
+            if (dm_stale_pid_match(dm_stale_procs[ii].sp_pid, dm->dm_name))
+            {
+                dm_stale_kill_add(pids, &npids, ARRAY_LEN(pids), dm_stale_procs[ii].sp_pid);
+                dm_stale_procs[ii].sp_killed = true;
+                found = true;
+            }
+        }
+    }
+    else
+    {
+        if (dm_manager_pid_file(dm, ppid, sizeof(ppid)) &&
+                dm_manager_pid_get(ppid, &pid) &&
+                dm_stale_pid_match(pid, dm->dm_name))
+        {
+            dm_stale_kill_add(pids, &npids, ARRAY_LEN(pids), pid);
+        }
+        else
+        {
+            pid = os_name_to_pid(dm->dm_name);
+            if (pid > 0) dm_stale_kill_add(pids, &npids, ARRAY_LEN(pids), pid);
+        }
+        found = npids > 0;
+    }
+
+    if (!found)
     {
         LOG(NOTICE, "Manager: %s - no instance", dm->dm_name);
         return;
     }
 
     /* try to terminate managers if it is running */
-    LOG(NOTICE, "Killing process: name=%s pid=%d", dm->dm_name, pid2kill);
-    mon_process_terminate(pid2kill);
-
+    for (ii = 0; ii < npids; ii++)
+    {
+        LOG(NOTICE, "Killing process: name=%s pid=%d", dm->dm_name, (int)pids[ii]);
+    }
     if (dm->dm_plan_b)
     {
-        LOG(NOTICE, "Plan B required by %s pid:%d",
-                    dm->dm_name,
-                    (int)pid2kill);
+        LOG(NOTICE, "Plan B required by %s", dm->dm_name);
+    }
+    dm_stale_terminate(pids, npids, dm->dm_plan_b);
+}
 
-        target_managers_restart();
+/*
+ * ===========================================================================
+ *  Readiness notification
+ * ===========================================================================
+ */
 
-        LOG(ERR, "Restart manager was not executed!");
+/**
+ * Mark the manager as ready and start managers that depend on it.
+ *
+ * The readiness pipe stays open until the manager exits: closing it would
+ * turn a late notification into a SIGPIPE in the manager.
+ */
+static void dm_manager_ready_set(struct dm_manager *dm)
+{
+    ev_timer_stop(EV_DEFAULT, &dm->dm_ready_timer);
+    dm->dm_ready = true;
+
+    dm_manager_start_pending();
+}
+
+/**
+ * Release readiness tracking resources and flag the manager as not ready
+ */
+void dm_manager_ready_reset(struct dm_manager *dm)
+{
+    ev_io_stop(EV_DEFAULT, &dm->dm_ready_watcher);
+    ev_timer_stop(EV_DEFAULT, &dm->dm_ready_timer);
+
+    if (dm->dm_ready_fd >= 0)
+    {
+        close(dm->dm_ready_fd);
+        dm->dm_ready_fd = -1;
+    }
+
+    dm->dm_ready = false;
+}
+
+/**
+ * Readiness pipe callback; managers write a line (see mon_notify_ready()) to
+ * the pipe once they are fully initialized
+ */
+static void dm_manager_ready_fn(struct ev_loop *loop, ev_io *w, int revents)
+{
+    (void)loop;
+    (void)revents;
+
+    struct dm_manager *dm = CONTAINER_OF(w, struct dm_manager, dm_ready_watcher);
+    char buf[64];
+    ssize_t rc;
+
+    rc = read(dm->dm_ready_fd, buf, sizeof(buf));
+    if (rc < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+    if (rc > 0)
+    {
+        /* Late notification, the manager was already assumed ready */
+        if (dm->dm_ready) return;
+
+        LOG(NOTICE, "Manager ready: name=%s pid=%d", dm->dm_name, (int)dm->dm_pid);
+        dm_manager_ready_set(dm);
+        return;
     }
+
+    /*
+     * The manager closed the pipe; if it did so without signalling
+     * readiness, rely on the readiness timeout
+     */
+    LOG(DEBUG, "Manager %s closed the readiness pipe.", dm->dm_name);
+    ev_io_stop(loop, w);
+    close(dm->dm_ready_fd);
+    dm->dm_ready_fd = -1;
+}
+
+/**
+ * Managers that do not support readiness notification are considered ready
+ * after DM_READY_TIMEOUT seconds
+ */
+static void dm_manager_ready_timeout_fn(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    (void)loop;
+    (void)revents;
+
+    struct dm_manager *dm = CONTAINER_OF(w, struct dm_manager, dm_ready_timer);
+
+    LOG(INFO, "Manager %s did not signal readiness in %d seconds, assuming ready.",
+              dm->dm_name,
+              DM_READY_TIMEOUT);
+
+    dm_manager_ready_set(dm);
 }
 
 /**
@@ -380,6 +1014,40 @@ bool dm_manager_start(struct dm_manager *dm)
         return true;
     }
 
+    /*
+     * Stale instances are still being terminated, the managers are started
+     * once they are gone (see dm_stale_done())
+     */
+    if (dm_stale_kills_num > 0)
+    {
+        dm->dm_pending = true;
+        return true;
+    }
+
+    /*
+     * Defer the start until the managers this one depends on are ready
+     */
+    if (!dm_manager_deps_ready(dm))
+    {
+        if (!ev_is_active(&dm->dm_deps_timer))
+        {
+            LOG(INFO, "Manager %s waiting for dependencies: %s", dm->dm_name, dm->dm_depends);
+
+            ev_timer_init(&dm->dm_deps_timer, dm_manager_deps_timeout_fn, DM_DEPS_TIMEOUT, 0.0);
+            ev_timer_start(EV_DEFAULT, &dm->dm_deps_timer);
+        }
+
+        dm->dm_pending = true;
+        return true;
+    }
+
+    if (dm->dm_pending)
+    {
+        ev_timer_stop(EV_DEFAULT, &dm->dm_deps_timer);
+        dm->dm_pending = false;
+    }
+    dm->dm_deps_expired = false;
+
     /*
      * Calculate the PID path
      */
@@ -418,6 +1086,20 @@ bool dm_manager_start(struct dm_manager *dm)
 
     ev_child_start(EV_DEFAULT, &dm->dm_child_watcher);
 
+    /* Wait for the readiness notification */
+    if (dm->dm_ready_fd >= 0)
+    {
+        ev_io_init(&dm->dm_ready_watcher, dm_manager_ready_fn, dm->dm_ready_fd, EV_READ);
+        ev_io_start(EV_DEFAULT, &dm->dm_ready_watcher);
+
+        ev_timer_init(&dm->dm_ready_timer, dm_manager_ready_timeout_fn, DM_READY_TIMEOUT, 0.0);
+        ev_timer_start(EV_DEFAULT, &dm->dm_ready_timer);
+    }
+    else
+    {
+        dm_manager_ready_set(dm);
+    }
+
     return true;
 }
 
@@ -425,8 +1107,16 @@ bool dm_manager_stop(struct dm_manager *dm)
 {
     char ppid[C_MAXPATH_LEN];
 
+    if (dm->dm_pending)
+    {
+        ev_timer_stop(EV_DEFAULT, &dm->dm_deps_timer);
+        dm->dm_pending = false;
+    }
+
     if (dm->dm_pid < 0) return true;
 
+    dm_manager_ready_reset(dm);
+
     /* Stop the process watcher */
     ev_child_stop(EV_DEFAULT, &dm->dm_child_watcher);
 
@@ -465,6 +1155,8 @@ bool dm_manager_exec(struct dm_manager *dm)
     pid_t cpid;
     int ifd;
     char pexe[C_MAXPATH_LEN];
+    char sfd[16];
+    int rfd[2];
 
     /*
      * Find out the path to the manager executable:
@@ -516,6 +1208,17 @@ bool dm_manager_exec(struct dm_manager *dm)
         return false;
     }
 
+    /*
+     * Readiness pipe; the write end is passed to the child in the
+     * MON_READY_FD_ENV environment variable. Without it the manager is
+     * considered ready as soon as it is started.
+     */
+    if (pipe(rfd) != 0)
+    {
+        LOG(WARN, "Error creating readiness pipe for %s.", dm->dm_name);
+        rfd[0] = rfd[1] = -1;
+    }
+
     /*
      * Fork the child process
      */
@@ -523,11 +1226,21 @@ bool dm_manager_exec(struct dm_manager *dm)
     if (cpid < 0)
     {
         LOG(ERR, "Fork error when executing %s.", dm->dm_name);
-        return cpid;
+        if (rfd[0] >= 0) close(rfd[0]);
+        if (rfd[1] >= 0) close(rfd[1]);
+        return false;
     }
     else if (cpid > 0)
     {
         dm->dm_pid = cpid;
+
+        dm->dm_ready_fd = rfd[0];
+        if (rfd[1] >= 0)
+        {
+            close(rfd[1]);
+            fcntl(rfd[0], F_SETFD, FD_CLOEXEC);
+            fcntl(rfd[0], F_SETFL, O_NONBLOCK);
+        }
         return true;
     }
 
@@ -540,9 +1253,20 @@ bool dm_manager_exec(struct dm_manager *dm)
     /* function - use this surrogate implementation */
     for (ifd = 3; ifd < DM_MAX_FD; ifd++)
     {
+        if (ifd == rfd[1]) continue;
         close(ifd);
     }
 
+    if (rfd[1] >= 0)
+    {
+        snprintf(sfd, sizeof(sfd), "%d", rfd[1]);
+        setenv(MON_READY_FD_ENV, sfd, 1);
+    }
+    else
+    {
+        unsetenv(MON_READY_FD_ENV);
+    }
+
     execl(pexe, pexe, NULL);
 
     _exit(EXIT_FAILURE);
@@ -583,7 +1307,6 @@ void dm_manager_restart(struct dm_manager *dm, int delay)
     ev_timer_start(EV_DEFAULT, &dm->dm_restart_timer);
 }
 
-#if 0
 /*
  * Read the PID from the PID file
  */
@@ -619,7 +1342,6 @@ error:
 
     return retval;
 }
-#endif
 
 /*
  * Write the PID to PID file
@@ -712,6 +1434,7 @@ void dm_manager_child_fn(struct ev_loop *loop, ev_child *w, int revents)
     /* Process exited, flag the manager as not active */
     ev_child_stop(loop, w);
     dm->dm_pid = -1;
+    dm_manager_ready_reset(dm);
 
     if (WIFEXITED(w->rstatus))
     {
@@ -812,6 +1535,7 @@ void callback_Node_Services(
     bool restart_always = false;
     bool restart_delay = 0;
     bool retval = false;
+    char depends[128] = "";
 
     /* Deletions not yet supported */
     if (mon->mon_type == OVSDB_UPDATE_DEL)
@@ -835,24 +1559,29 @@ void callback_Node_Services(
         {
             restart_delay = atoi(new->other_config[ii]);
         }
+        else if (strcmp(new->other_config_keys[ii], "depends_on") == 0)
+        {
+            STRSCPY(depends, new->other_config[ii]);
+        }
     }
 
     enable = new->enable_exists && new->enable;
 
-    LOG(INFO, "Registering/updating[%d] manager: name=%s enable=%s needs_plan_b=%s always_restart=%s restart_delay=%d",
+    LOG(INFO, "Registering/updating[%d] manager: name=%s enable=%s needs_plan_b=%s always_restart=%s restart_delay=%d depends_on=%s",
             old != NULL,
             new->service,
             enable ? "true" : "false",
             plan_b ? "true" : "false",
             restart_always ? "true" : "false",
-            restart_delay);
+            restart_delay,
+            depends);
 
     if (mon->mon_type == OVSDB_UPDATE_NEW)
     {
-        (void)dm_manager_register(new->service, plan_b, restart_always, restart_delay);
+        (void)dm_manager_register(new->service, plan_b, restart_always, restart_delay, depends);
     }
 
-    if (!dm_manager_update(new->service, enable, plan_b, restart_always, restart_delay))
+    if (!dm_manager_update(new->service, enable, plan_b, restart_always, restart_delay, depends))
     {
         goto error;
     }
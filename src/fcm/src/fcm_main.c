@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fcm_mgr.h"
 #include "fcm_filter.h"
 #include "neigh_table.h"
+#include "nf_utils.h"
 
 /* Default log severity */
 static log_severity_t  log_severity = LOG_SEVERITY_INFO;
@@ -119,6 +120,11 @@ int main(int argc, char ** argv)
     mgr = neigh_table_get_mgr();
     if (mgr) mgr->update_ovsdb_tables = NULL;
 
+    if (nf_util_neigh_init(loop) < 0)
+    {
+        LOGW("Neighbour cache unavailable, dumping the kernel table on lookups");
+    }
+
     // Register to relevant OVSDB tables events
     if (fcm_ovsdb_init())
     {
@@ -136,10 +142,14 @@ int main(int argc, char ** argv)
     }
 
     // Start the event loop
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     target_close(TARGET_INIT_MGR_FCM, loop);
 
+    nf_util_neigh_exit();
     neigh_table_cleanup();
 
     // De-init FCM filter manager
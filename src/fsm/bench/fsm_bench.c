@@ -0,0 +1,749 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * FSM plugin benchmark
+ *
+ * Replays a pcap file offline through net_header_parse() and the packet
+ * handlers of the configured FSM sessions at full speed, then reports the
+ * packet rate, the time spent per packet in each plugin handler, the number
+ * of allocations per packet and the peak RSS.
+ *
+ * Sessions are created through fsm_add_session() as if they came from
+ * OVSDB, and their plugins are loaded with fsm_init_plugin(). Side effects
+ * are stubbed: MQTT reports and conntrack netlink messages are counted and
+ * dropped, and the tap bridge/flood settings are no-ops. Reports a plugin
+ * sends to QM on its own, bypassing the session ops, are not intercepted.
+ *
+ * Usage:
+ *   fsm_bench -r <file.pcap> -s <handler>,<type>[,<dso>[,<dispatcher>]] ...
+ *
+ * Example:
+ *   fsm_bench -r http.pcap \
+ *             -s http,parser,/usr/opensync/lib/libfsm_http.so \
+ *             -s core_dpi_dispatch,dpi_dispatcher \
+ *             -s app,dpi_plugin,/usr/opensync/lib/libfsm_app.so,core_dpi_dispatch
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <ev.h>
+#include <pcap.h>
+#include <libmnl/libmnl.h>
+
+#include "fsm.h"
+#include "log.h"
+#include "net_header_parse.h"
+#include "qm_conn.h"
+#include "target.h"
+#include "util.h"
+
+#define FSM_BENCH_MAX_SESSIONS      16
+#define FSM_BENCH_MAX_OPTS          8
+#define FSM_BENCH_PERIODIC          5   /* s of capture time, see FSM_TIMER_INTERVAL */
+
+/**
+ * @brief a packet of the replayed capture
+ */
+struct fsm_bench_pkt
+{
+    struct pcap_pkthdr hdr;
+    uint8_t *data;
+};
+
+/**
+ * @brief per session counters
+ */
+struct fsm_bench_session
+{
+    char *spec;                 /* command line specification */
+    char type[32];              /* session type as configured */
+    struct fsm_session *session;
+    void (*handler)(struct fsm_session *, struct net_header_parser *);
+    uint64_t calls;             /* handler invocations */
+    uint64_t ns;                /* time spent in the handler */
+    uint64_t periodic_ns;       /* time spent in the periodic routine */
+};
+
+/**
+ * @brief benchmark context
+ */
+struct fsm_bench
+{
+    char *pcap_file;
+    int datalink;
+    struct fsm_bench_pkt *pkts;
+    size_t npkts;
+    size_t bytes;
+    int loops;
+
+    struct fsm_bench_session sessions[FSM_BENCH_MAX_SESSIONS];
+    int nsessions;
+    char *opts[FSM_BENCH_MAX_OPTS];
+    int nopts;
+
+    uint64_t parse_ns;          /* time spent in net_header_parse() */
+    uint64_t total_ns;          /* overall replay time */
+
+    bool counting;              /* count allocations */
+    uint64_t allocs;
+    uint64_t frees;
+
+    uint64_t reports;           /* stubbed MQTT reports */
+    uint64_t report_bytes;
+    uint64_t nl_msgs;           /* stubbed conntrack netlink messages */
+    uint64_t verdicts;          /* dispatcher drop/passthrough verdicts */
+};
+
+static struct fsm_bench g_bench;
+
+
+/******************************************************************************
+ *  Stubs
+ *****************************************************************************/
+
+/*
+ * MQTT reports, linked in with -Wl,--wrap=qm_conn_send_direct. This covers
+ * the session report ops and the dpi dispatcher's aggregator.
+ */
+bool
+__wrap_qm_conn_send_direct(qm_compress_t compress, char *topic, void *data,
+                           int data_size, qm_response_t *res);
+
+bool
+__wrap_qm_conn_send_direct(qm_compress_t compress, char *topic, void *data,
+                           int data_size, qm_response_t *res)
+{
+    (void)compress;
+    (void)topic;
+    (void)data;
+
+    if (res != NULL) memset(res, 0, sizeof(*res));
+
+    g_bench.reports++;
+    g_bench.report_bytes += data_size;
+
+    return true;
+}
+
+
+/*
+ * Conntrack mark updates. libmnl is a shared library, so this definition
+ * also takes precedence for the plugins (the binary links with -rdynamic).
+ */
+ssize_t
+mnl_socket_sendto(const struct mnl_socket *nl, const void *req, size_t size)
+{
+    (void)nl;
+    (void)req;
+
+    g_bench.nl_msgs++;
+
+    return size;
+}
+
+
+#if defined(__GLIBC__)
+/*
+ * Allocation counters. glibc lets the application replace malloc() and
+ * friends, including for allocations made inside libc and dlopen()ed
+ * plugins; the replacements forward to the libc implementation.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *
+malloc(size_t size)
+{
+    if (g_bench.counting) g_bench.allocs++;
+    return __libc_malloc(size);
+}
+
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    if (g_bench.counting) g_bench.allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+
+void *
+realloc(void *ptr, size_t size)
+{
+    if (g_bench.counting) g_bench.allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+
+void
+free(void *ptr)
+{
+    if (g_bench.counting && ptr != NULL) g_bench.frees++;
+    __libc_free(ptr);
+}
+
+#define FSM_BENCH_COUNT_ALLOCS      true
+#else
+#define FSM_BENCH_COUNT_ALLOCS      false
+#endif
+
+
+static bool
+fsm_bench_flood_mod(struct fsm_session *session)
+{
+    return true;
+}
+
+
+static int
+fsm_bench_get_br(char *if_name, char *bridge, size_t len)
+{
+    strscpy(bridge, "br-home", len);
+    return 0;
+}
+
+
+static int
+fsm_bench_set_dpi_state(struct net_header_parser *net_hdr,
+                        enum fsm_dpi_state state)
+{
+    g_bench.verdicts++;
+    return 0;
+}
+
+
+/******************************************************************************
+ *  Timing
+ *****************************************************************************/
+
+static inline uint64_t
+fsm_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static struct fsm_bench_session *
+fsm_bench_session_find(struct fsm_session *session)
+{
+    int i;
+
+    for (i = 0; i < g_bench.nsessions; i++)
+    {
+        if (g_bench.sessions[i].session == session) return &g_bench.sessions[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief timing wrapper installed in place of the dpi plugins' handlers
+ *
+ * DPI plugins are called by their dispatcher, so the dispatcher time
+ * includes theirs.
+ */
+static void
+fsm_bench_dpi_handler(struct fsm_session *session,
+                      struct net_header_parser *net_parser)
+{
+    struct fsm_bench_session *bs;
+    uint64_t start;
+
+    bs = fsm_bench_session_find(session);
+    if (bs == NULL || bs->handler == NULL) return;
+
+    start = fsm_bench_now_ns();
+    bs->handler(session, net_parser);
+    bs->ns += fsm_bench_now_ns() - start;
+    bs->calls++;
+}
+
+
+/******************************************************************************
+ *  Setup
+ *****************************************************************************/
+
+static bool
+fsm_bench_load_pcap(struct fsm_bench *bench)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct fsm_bench_pkt *pkts;
+    struct fsm_bench_pkt *pkt;
+    struct pcap_pkthdr *hdr;
+    const uint8_t *data;
+    size_t size;
+    pcap_t *pcap;
+    int rc;
+
+    pcap = pcap_open_offline(bench->pcap_file, errbuf);
+    if (pcap == NULL)
+    {
+        LOGE("%s: failed to open %s: %s", __func__, bench->pcap_file, errbuf);
+        return false;
+    }
+
+    bench->datalink = pcap_datalink(pcap);
+    if ((bench->datalink != DLT_EN10MB) &&
+        (bench->datalink != DLT_LINUX_SLL))
+    {
+        LOGE("%s: unsupported data link layer: %d", __func__, bench->datalink);
+        pcap_close(pcap);
+        return false;
+    }
+
+    size = 0;
+    while ((rc = pcap_next_ex(pcap, &hdr, &data)) == 1)
+    {
+        if (bench->npkts == size)
+        {
+            size = (size == 0) ? 1024 : size * 2;
+            pkts = realloc(bench->pkts, size * sizeof(*pkts));
+            if (pkts == NULL) goto err_close;
+            bench->pkts = pkts;
+        }
+
+        pkt = &bench->pkts[bench->npkts];
+        pkt->hdr = *hdr;
+        pkt->data = malloc(hdr->caplen);
+        if (pkt->data == NULL) goto err_close;
+        memcpy(pkt->data, data, hdr->caplen);
+
+        bench->bytes += hdr->caplen;
+        bench->npkts++;
+    }
+
+    if (rc == -1)
+    {
+        LOGE("%s: error reading %s: %s", __func__, bench->pcap_file,
+             pcap_geterr(pcap));
+        goto err_close;
+    }
+
+    pcap_close(pcap);
+
+    return (bench->npkts != 0);
+
+err_close:
+    pcap_close(pcap);
+    return false;
+}
+
+
+/**
+ * @brief parses "handler,type[,dso[,dispatcher]]" into an ovsdb record
+ */
+static bool
+fsm_bench_conf(struct fsm_bench *bench, char *spec,
+               struct schema_Flow_Service_Manager_Config *conf)
+{
+    char *fields[4] = { NULL };
+    char *spec_copy;
+    char *saveptr;
+    char *value;
+    char *field;
+    int nfields;
+    int n;
+    int i;
+
+    spec_copy = strdup(spec);
+    if (spec_copy == NULL) return false;
+
+    nfields = 0;
+    field = strtok_r(spec_copy, ",", &saveptr);
+    while (field != NULL && nfields < 4)
+    {
+        fields[nfields++] = field;
+        field = strtok_r(NULL, ",", &saveptr);
+    }
+
+    if (nfields < 2)
+    {
+        LOGE("%s: invalid session specification '%s'", __func__, spec);
+        free(spec_copy);
+        return false;
+    }
+
+    memset(conf, 0, sizeof(*conf));
+    STRSCPY(conf->handler, fields[0]);
+    STRSCPY(conf->type, fields[1]);
+    if (fields[2] != NULL) STRSCPY(conf->plugin, fields[2]);
+
+    n = 0;
+    STRSCPY(conf->other_config_keys[n], "mqtt_v");
+    snprintf(conf->other_config[n], sizeof(conf->other_config[n]),
+             "bench/fsm/%s", fields[0]);
+    n++;
+
+    if (fields[3] != NULL)
+    {
+        STRSCPY(conf->other_config_keys[n], "dpi_dispatcher");
+        STRSCPY(conf->other_config[n], fields[3]);
+        n++;
+    }
+
+    for (i = 0; i < bench->nopts && n < ARRAY_LEN(conf->other_config); i++)
+    {
+        value = strchr(bench->opts[i], '=');
+        if (value == NULL) continue;
+
+        snprintf(conf->other_config_keys[n], sizeof(conf->other_config_keys[n]),
+                 "%.*s", (int)(value - bench->opts[i]), bench->opts[i]);
+        STRSCPY(conf->other_config[n], value + 1);
+        n++;
+    }
+    conf->other_config_len = n;
+
+    free(spec_copy);
+
+    return true;
+}
+
+
+static bool
+fsm_bench_add_sessions(struct fsm_bench *bench)
+{
+    struct schema_Flow_Service_Manager_Config conf;
+    struct fsm_bench_session *bs;
+    struct fsm_parser_ops *ops;
+    ds_tree_t *sessions;
+    bool ret;
+    int i;
+
+    sessions = fsm_get_sessions();
+
+    for (i = 0; i < bench->nsessions; i++)
+    {
+        bs = &bench->sessions[i];
+
+        ret = fsm_bench_conf(bench, bs->spec, &conf);
+        if (!ret) return false;
+
+        STRSCPY(bs->type, conf.type);
+        fsm_add_session(&conf);
+        bs->session = ds_tree_find(sessions, conf.handler);
+        if (bs->session == NULL)
+        {
+            LOGE("%s: failed to create session '%s'", __func__, bs->spec);
+            return false;
+        }
+
+        if (bs->session->p_ops == NULL) continue;
+
+        ops = &bs->session->p_ops->parser_ops;
+        bs->handler = ops->handler;
+
+        if (bs->session->type == FSM_DPI_PLUGIN && ops->handler != NULL)
+        {
+            ops->handler = fsm_bench_dpi_handler;
+        }
+    }
+
+    return true;
+}
+
+
+/******************************************************************************
+ *  Replay
+ *****************************************************************************/
+
+static void
+fsm_bench_periodic(struct fsm_bench *bench)
+{
+    struct fsm_bench_session *bs;
+    struct fsm_session *session;
+    uint64_t start;
+    int i;
+
+    for (i = 0; i < bench->nsessions; i++)
+    {
+        bs = &bench->sessions[i];
+        session = bs->session;
+        if (session->ops.periodic == NULL) continue;
+
+        start = fsm_bench_now_ns();
+        session->ops.periodic(session);
+        bs->periodic_ns += fsm_bench_now_ns() - start;
+    }
+
+    /* Let plugin timers and callbacks run */
+    ev_run(fsm_get_mgr()->loop, EVRUN_NOWAIT);
+}
+
+
+static void
+fsm_bench_replay_pkt(struct fsm_bench *bench, struct fsm_bench_pkt *pkt)
+{
+    struct net_header_parser net_parser;
+    struct fsm_bench_session *bs;
+    uint64_t start;
+    uint64_t end;
+    size_t len;
+    int i;
+
+    /* Every session bound to a tap interface gets its own copy of the packet */
+    for (i = 0; i < bench->nsessions; i++)
+    {
+        bs = &bench->sessions[i];
+        if (!fsm_plugin_has_intf(bs->session)) continue;
+        if (bs->handler == NULL) continue;
+
+        start = fsm_bench_now_ns();
+        memset(&net_parser, 0, sizeof(net_parser));
+        net_parser.packet_len = pkt->hdr.caplen;
+        net_parser.caplen = pkt->hdr.caplen;
+        net_parser.data = pkt->data;
+        net_parser.pcap_datalink = bench->datalink;
+        len = net_header_parse(&net_parser);
+        end = fsm_bench_now_ns();
+        bench->parse_ns += end - start;
+        if (len == 0) continue;
+
+        bs->handler(bs->session, &net_parser);
+        bs->ns += fsm_bench_now_ns() - end;
+        bs->calls++;
+    }
+}
+
+
+static void
+fsm_bench_replay(struct fsm_bench *bench)
+{
+    struct fsm_bench_pkt *pkt;
+    time_t next_periodic;
+    uint64_t start;
+    size_t i;
+    int loop;
+
+    start = fsm_bench_now_ns();
+    bench->counting = true;
+
+    for (loop = 0; loop < bench->loops; loop++)
+    {
+        next_periodic = bench->pkts[0].hdr.ts.tv_sec + FSM_BENCH_PERIODIC;
+
+        for (i = 0; i < bench->npkts; i++)
+        {
+            pkt = &bench->pkts[i];
+
+            /* Drive the periodic routines off the capture timestamps */
+            if (pkt->hdr.ts.tv_sec >= next_periodic)
+            {
+                fsm_bench_periodic(bench);
+                next_periodic = pkt->hdr.ts.tv_sec + FSM_BENCH_PERIODIC;
+            }
+
+            fsm_bench_replay_pkt(bench, pkt);
+        }
+
+        /* Flush what was gathered */
+        fsm_bench_periodic(bench);
+    }
+
+    bench->counting = false;
+    bench->total_ns = fsm_bench_now_ns() - start;
+}
+
+
+/******************************************************************************
+ *  Report
+ *****************************************************************************/
+
+static void
+fsm_bench_print(struct fsm_bench *bench)
+{
+    struct fsm_bench_session *bs;
+    struct rusage usage;
+    uint64_t npkts;
+    double secs;
+    int i;
+
+    npkts = (uint64_t)bench->npkts * bench->loops;
+    secs = bench->total_ns / 1e9;
+
+    printf("capture:          %s (%zu packets, %zu bytes, x%d)\n",
+           bench->pcap_file, bench->npkts, bench->bytes, bench->loops);
+    printf("replay time:      %.3f s\n", secs);
+    printf("packets/s:        %.0f\n", secs > 0 ? npkts / secs : 0);
+    printf("Mbit/s:           %.1f\n",
+           secs > 0 ? (double)bench->bytes * bench->loops * 8 / secs / 1e6 : 0);
+    printf("ns/packet:        %.0f\n", (double)bench->total_ns / npkts);
+    printf("net_header_parse: %.0f ns/packet\n", (double)bench->parse_ns / npkts);
+
+    printf("\n%-24s %-16s %12s %12s %14s\n",
+           "session", "type", "calls", "ns/packet", "periodic ms");
+    for (i = 0; i < bench->nsessions; i++)
+    {
+        bs = &bench->sessions[i];
+        printf("%-24s %-16s %12" PRIu64 " %12.0f %14.3f\n",
+               bs->session->name,
+               bs->type,
+               bs->calls,
+               (double)bs->ns / npkts,
+               bs->periodic_ns / 1e6);
+    }
+    printf("\n");
+
+    if (FSM_BENCH_COUNT_ALLOCS)
+    {
+        printf("allocs/packet:    %.2f (frees/packet %.2f)\n",
+               (double)bench->allocs / npkts, (double)bench->frees / npkts);
+    }
+    else
+    {
+        printf("allocs/packet:    n/a\n");
+    }
+
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    printf("peak RSS:         %ld kB\n", usage.ru_maxrss);
+    printf("mqtt reports:     %" PRIu64 " (%" PRIu64 " bytes)\n",
+           bench->reports, bench->report_bytes);
+    printf("netlink messages: %" PRIu64 "\n", bench->nl_msgs);
+    printf("dpi verdicts:     %" PRIu64 "\n", bench->verdicts);
+}
+
+
+static void
+fsm_bench_usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s -r <file.pcap> -s <session> [-s <session> ...] [options]\n"
+            "  -r <file>     pcap file to replay\n"
+            "  -s <session>  handler,type[,dso[,dispatcher]]\n"
+            "                type is one of parser, dpi_dispatcher, dpi_plugin,\n"
+            "                web_cat_provider; dso defaults to libfsm_<handler>.so\n"
+            "  -o key=value  other_config entry added to every session\n"
+            "  -n <loops>    number of times the capture is replayed (default 1)\n"
+            "  -v            verbose logging\n",
+            name);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    struct schema_AWLAN_Node awlan;
+    struct fsm_bench *bench;
+    struct fsm_mgr *mgr;
+    bool ret;
+    int opt;
+
+    bench = &g_bench;
+    bench->loops = 1;
+
+    target_log_open("FSM_BENCH", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_WARN);
+
+    while ((opt = getopt(argc, argv, "r:s:o:n:vh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                bench->pcap_file = optarg;
+                break;
+
+            case 's':
+                if (bench->nsessions == FSM_BENCH_MAX_SESSIONS)
+                {
+                    fprintf(stderr, "too many sessions\n");
+                    return EXIT_FAILURE;
+                }
+                bench->sessions[bench->nsessions++].spec = optarg;
+                break;
+
+            case 'o':
+                if (bench->nopts == FSM_BENCH_MAX_OPTS)
+                {
+                    fprintf(stderr, "too many options\n");
+                    return EXIT_FAILURE;
+                }
+                bench->opts[bench->nopts++] = optarg;
+                break;
+
+            case 'n':
+                bench->loops = atoi(optarg);
+                if (bench->loops < 1) bench->loops = 1;
+                break;
+
+            case 'v':
+                log_severity_set(LOG_SEVERITY_DEBUG);
+                break;
+
+            default:
+                fsm_bench_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (bench->pcap_file == NULL || bench->nsessions == 0)
+    {
+        fsm_bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ret = fsm_bench_load_pcap(bench);
+    if (!ret) return EXIT_FAILURE;
+
+    fsm_init_mgr(EV_DEFAULT);
+    mgr = fsm_get_mgr();
+    mgr->init_plugin = fsm_init_plugin;
+    mgr->flood_mod = fsm_bench_flood_mod;
+    mgr->get_br = fsm_bench_get_br;
+    mgr->set_dpi_state = fsm_bench_set_dpi_state;
+
+    memset(&awlan, 0, sizeof(awlan));
+    STRSCPY(awlan.mqtt_headers_keys[0], "locationId");
+    STRSCPY(awlan.mqtt_headers[0], "bench");
+    STRSCPY(awlan.mqtt_headers_keys[1], "nodeId");
+    STRSCPY(awlan.mqtt_headers[1], "bench");
+    awlan.mqtt_headers_len = 2;
+    fsm_get_awlan_headers(&awlan);
+
+    ret = fsm_bench_add_sessions(bench);
+    if (!ret) return EXIT_FAILURE;
+
+    fsm_bench_replay(bench);
+    fsm_bench_print(bench);
+
+    fsm_reset_mgr();
+
+    return EXIT_SUCCESS;
+}
@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ds_tree.h"
 #include "fsm_policy.h"
+#include "metrics.h"
 #include "os_types.h"
 #include "ovsdb_utils.h"
 #include "schema.h"
@@ -145,6 +146,10 @@ struct fsm_pcaps
     int pcap_fd;
     ev_io fsm_evio;
     int pcap_datalink;
+    metrics_t pkts;            /* packets handed to the plugin */
+    metrics_t bytes;           /* bytes handed to the plugin */
+    metrics_t pkt_us;          /* per packet parsing and plugin time */
+    metrics_t drops;           /* packets dropped by the capture */
 };
 
 /**
@@ -202,6 +207,9 @@ struct fsm_dpi_plugin
 {
     struct fsm_session *session;
     char *targets;
+    struct om_tag_handle *targets_tag;  /* targets as a tag reference */
+    os_macaddr_t targets_mac;           /* targets as a mac address */
+    bool targets_mac_valid;
     bool bound;
     ds_tree_node_t dpi_node;
 };
@@ -227,6 +235,22 @@ struct fsm_dpi_flow_info
 };
 
 
+/**
+ * @brief json reports batch
+ */
+struct fsm_report_batch
+{
+    struct fsm_session *session;
+    char *buf;                       /* json array being assembled */
+    size_t len;                      /* used bytes */
+    size_t size;                     /* allocated bytes */
+    size_t max_bytes;                /* size bound */
+    double max_delay;                /* age bound, in seconds */
+    int count;                       /* queued reports */
+    ev_timer timer;                  /* age bound timer */
+};
+
+
 /**
  * @brief session container.
  *
@@ -255,6 +279,7 @@ struct fsm_session
     char bridge[64];                 /* underlying bridge name */
     char tx_intf[64];                /* plugin's TX interface */
     union fsm_dpi_context *dpi;      /* fsm dpi context */
+    struct fsm_report_batch *batch;  /* optional json reports batch */
 };
 
 
@@ -275,6 +300,7 @@ struct fsm_mgr
     char pid[16];             /* manager's pid */
     struct sysinfo sysinfo;   /* system information */
     uint64_t max_mem;         /* max amount of memory allowed in MB */
+    char *metrics_topic;      /* self-measurement report mqtt topic */
     bool (*init_plugin)(struct fsm_session *); /* DSO plugin init */
     bool (*flood_mod)(struct fsm_session *);   /* tap flood mode update */
     int (*get_br)(char *if_name, char *bridge, size_t len); /* get lan bridge */
@@ -389,6 +415,17 @@ void
 fsm_add_session(struct schema_Flow_Service_Manager_Config *conf);
 
 
+/**
+ * @brief initialize a plugin
+ *
+ * Loads the session's dso and calls its init routine
+ * @param session the session to initialize
+ * @return true if the plugin initialization succeeded
+ */
+bool
+fsm_init_plugin(struct fsm_session *session);
+
+
 /**
  * @brief delete a fsm session
  *
@@ -467,6 +504,35 @@ void
 fsm_send_report(struct fsm_session *session, char *report);
 
 
+/**
+ * @brief apply the session's report batching settings
+ *
+ * Batching is enabled by the report_batch_ms and/or report_batch_bytes
+ * other_config keys, and disabled when both are absent.
+ * @param session the fsm session
+ */
+void
+fsm_report_batch_update(struct fsm_session *session);
+
+
+/**
+ * @brief send the session's pending batched reports
+ *
+ * @param session the fsm session
+ */
+void
+fsm_report_batch_flush(struct fsm_session *session);
+
+
+/**
+ * @brief send pending reports and release the session's batch
+ *
+ * @param session the fsm session
+ */
+void
+fsm_report_batch_free(struct fsm_session *session);
+
+
 /**
  * @brief create a web_cat session based on a service plugin
  *
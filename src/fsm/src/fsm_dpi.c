@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <time.h>
 
 #include "os.h"
+#include "os_nif.h"
 #include "util.h"
 #include "ovsdb.h"
 #include "ovsdb_update.h"
@@ -60,7 +61,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 static struct imc_context g_imc_client =
 {
     .initialized = false,
-    .endpoint = "ipc:///tmp/imc_fsm2fcm",
+    .endpoint = IMC_FSM2FCM_ENDPOINT,
 };
 
 static struct imc_dso g_imc_context = { 0 };
@@ -205,6 +206,13 @@ fsm_dpi_send_report(struct fsm_session *session)
 
     /* Beware, sending the pb through imc will schedule its freeing */
     rc = fsm_dpi_client_send(client, pb->buf, pb->len, 0);
+    if (rc != 0 && errno == EAGAIN)
+    {
+        /* The receiver is not up or not keeping up, the report was dropped */
+        free(pb);
+        return -1;
+    }
+
     if (rc != 0)
     {
         LOGE("%s: could not send message", __func__);
@@ -221,8 +229,6 @@ err_send:
     free(pb); /* Assume that a send error still triggers the free callback */
 
 err_client:
-
-    free(client->endpoint);
     client->initialized = false;
 
     return -1;
@@ -267,6 +273,16 @@ fsm_init_dpi_plugin(struct fsm_session *session)
     dpi_plugin->bound = false;
 
     dpi_plugin->targets = fsm_get_other_config_val(session, "targeted_devices");
+    if (dpi_plugin->targets != NULL)
+    {
+        dpi_plugin->targets_tag = om_tag_handle_get(dpi_plugin->targets);
+        if (dpi_plugin->targets_tag == NULL)
+        {
+            dpi_plugin->targets_mac_valid =
+                os_nif_macaddr_from_str(&dpi_plugin->targets_mac,
+                                        dpi_plugin->targets);
+        }
+    }
 
     ret = fsm_dpi_add_plugin_to_dispatcher(session);
     if (!ret) return ret;
@@ -482,6 +498,9 @@ fsm_free_dpi_plugin(struct fsm_session *session)
     struct net_md_aggregator *aggr;
     struct fsm_session *dispatcher;
 
+    om_tag_handle_put(session->dpi->plugin.targets_tag);
+    session->dpi->plugin.targets_tag = NULL;
+
     /* Retrieve the dispatcher */
     dispatcher = fsm_dpi_find_dispatcher(session);
     if (dispatcher == NULL) return;
@@ -600,6 +619,7 @@ fsm_init_dpi_dispatcher(struct fsm_session *session)
     return true;
 
 error:
+    fsm_dpi_mark_cancel(dispatch->aggr);
     net_md_free_aggregator(dispatch->aggr);
     return false;
 }
@@ -633,6 +653,7 @@ fsm_free_dpi_dispatcher(struct fsm_session *session)
         ds_tree_remove(dpi_sessions, remove);
         dpi_plugin = next;
     }
+    fsm_dpi_mark_cancel(dispatch->aggr);
     net_md_free_aggregator(dispatch->aggr);
 }
 
@@ -916,48 +937,47 @@ fsm_dpi_mark_for_report(struct fsm_session *session,
 
 
 /**
- * @brief check if a mac address belongs to a given tag or matches a value
+ * @brief check if a mac address belongs to a plugin's targets
  *
  * @param the mac address to check
- * @param val an opensync tag name or the string representation of a mac address
- * @return true if the mac matches the value, false otherwise
+ * @param plugin the dpi plugin, its targets being an opensync tag name
+ *        or the string representation of a mac address
+ * @return true if the mac matches the targets, false otherwise
  */
 static bool
-fsm_dpi_find_mac_in_val(os_macaddr_t *mac, char *val)
+fsm_dpi_find_mac_in_val(os_macaddr_t *mac, struct fsm_dpi_plugin *plugin)
 {
-    char mac_s[32] = { 0 };
-    bool rc;
     int ret;
 
-    if (val == NULL) return true;
-
-    snprintf(mac_s, sizeof(mac_s), PRI_os_macaddr_lower_t,
-             FMT_os_macaddr_pt(mac));
+    if (plugin->targets_tag != NULL)
+    {
+        return om_tag_handle_in_mac(plugin->targets_tag, mac);
+    }
 
-    rc = om_tag_in(mac_s, val);
-    if (rc) return true;
+    if (!plugin->targets_mac_valid) return false;
 
-    ret = strncmp(mac_s, val, strlen(mac_s));
+    ret = memcmp(mac, &plugin->targets_mac, sizeof(*mac));
     return (ret == 0);
 }
 
 
 /**
- * @brief check if any mac of a ethernet header matches a given tag
+ * @brief check if any mac of a ethernet header matches a plugin's targets
  *
  * @param the mac address to check
- * @param val an opensync tag name or the string representation of a mac address
- * @return true if the mac matches the value, false otherwise
+ * @param plugin the dpi plugin
+ * @return true if the mac matches the targets, false otherwise
  */
 static bool
-fsm_dpi_find_macs_in_val(struct eth_header *eth_hdr, char *val)
+fsm_dpi_find_macs_in_val(struct eth_header *eth_hdr,
+                         struct fsm_dpi_plugin *plugin)
 {
     bool rc;
 
-    if (val == NULL) return true;
+    if (plugin->targets == NULL) return true;
 
-    rc = fsm_dpi_find_mac_in_val(eth_hdr->srcmac, val);
-    rc |= fsm_dpi_find_mac_in_val(eth_hdr->dstmac, val);
+    rc = fsm_dpi_find_mac_in_val(eth_hdr->srcmac, plugin);
+    rc |= fsm_dpi_find_mac_in_val(eth_hdr->dstmac, plugin);
 
     return rc;
 }
@@ -1013,7 +1033,7 @@ fsm_dispatch_pkt(struct net_header_parser *net_parser)
         plugin = &plugin_dpi_context->plugin;
 
         /* Check if the source or dest device is a target */
-        rc = fsm_dpi_find_macs_in_val(eth_hdr, plugin->targets);
+        rc = fsm_dpi_find_macs_in_val(eth_hdr, plugin);
         if (!rc)
         {
             info = ds_tree_next(tree, info);
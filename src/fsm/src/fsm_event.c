@@ -35,11 +35,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "fsm.h"
 #include "log.h"
+#include "metrics.h"
+#include "qm_conn.h"
 
 // Intervals and timeouts in seconds
 #define FSM_TIMER_INTERVAL 5
 #define FSM_MGR_INTERVAL 120
 
+static metrics_t fsm_metrics_mem = METRICS_GAUGE_INIT("fsm.mem_kb");
+
 /**
  * @brief gather pcap stats for an eligible a fsm session
  *
@@ -72,6 +76,50 @@ fsm_pcap_stats(struct fsm_session *session)
 
     LOGI("%s: %s: packets received: %u, dropped: %u",
          __func__, session->conf->if_name, stats.ps_recv, stats.ps_drop);
+
+    metrics_gauge_set(&pcaps->drops, stats.ps_drop);
+}
+
+
+/**
+ * @brief sends the manager's self-measurement report
+ *
+ * Enabled by setting the report topic in Node_Config,
+ * module "fsm", key "metrics_topic".
+ *
+ * @param mgr the fsm manager
+ */
+static void
+fsm_metrics_report(struct fsm_mgr *mgr)
+{
+    struct metrics_packed_buffer *pb;
+    struct metrics_report report;
+    qm_response_t res;
+    bool ret;
+
+    if (mgr->metrics_topic == NULL) return;
+
+    memset(&report, 0, sizeof(report));
+    report.node_id = mgr->node_id;
+    report.location_id = mgr->location_id;
+    report.process = "FSM";
+
+    pb = metrics_serialize_report(&report);
+    if (pb == NULL)
+    {
+        LOGE("%s: failed to serialize the metrics report", __func__);
+        return;
+    }
+
+    ret = qm_conn_send_direct(QM_REQ_COMPRESS_IF_CFG, mgr->metrics_topic,
+                              pb->buf, pb->len, &res);
+    if (ret == false)
+    {
+        LOGE("%s: error sending mqtt with topic %s",
+             __func__, mgr->metrics_topic);
+    }
+
+    metrics_free_packed_buffer(pb);
 }
 
 /**
@@ -112,6 +160,9 @@ fsm_event_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
     LOGI("pid %s: mem usage: real mem: %u, virt mem %u",
          mgr->pid, mem.curr_real_mem, mem.curr_virt_mem);
 
+    metrics_gauge_set(&fsm_metrics_mem, mem.curr_real_mem);
+    fsm_metrics_report(mgr);
+
     reset = ((uint64_t)mem.curr_real_mem > mgr->max_mem);
     if (reset)
     {
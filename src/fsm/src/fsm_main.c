@@ -50,6 +50,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "target.h"
 #include "fsm.h"
 #include "nf_utils.h"
+#include "metrics.h"
+#include "evx.h"
 
 /******************************************************************************/
 
@@ -91,6 +93,12 @@ int main(int argc, char ** argv)
 
     json_memdbg_init(loop);
 
+    metrics_server_start(loop, "FSM");
+
+#if defined(CONFIG_LIBEVX_LOOP_WATCHDOG)
+    evx_lag_start(loop, CONFIG_LIBEVX_LOOP_WATCHDOG_MS);
+#endif
+
     fsm_init_mgr(loop);
 
     if (!target_init(TARGET_INIT_MGR_FSM, loop)) {
@@ -127,10 +135,23 @@ int main(int argc, char ** argv)
         LOGE("Eror initializing conntrack\n");
         return -1;
     }
+
+    if (nf_util_neigh_init(loop) < 0)
+    {
+        LOGW("Neighbour cache unavailable, dumping the kernel table on lookups");
+    }
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     target_close(TARGET_INIT_MGR_FSM, loop);
 
+    nf_util_neigh_exit();
+
+    evx_lag_stop();
+    metrics_server_stop();
+
     if (!ovsdb_stop_loop(loop)) {
         LOGE("Stopping FSM "
              "(Failed to stop OVSDB");
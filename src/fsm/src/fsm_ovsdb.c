@@ -119,6 +119,7 @@ fsm_sessions_cmp(void *a, void *b)
 
 #define FSM_NODE_MODULE "fsm"
 #define FSM_NODE_STATE_MEM_KEY "max_mem"
+#define FSM_NODE_CONFIG_METRICS_KEY "metrics_topic"
 
 /**
  * @brief fsm manager init routine
@@ -180,6 +181,8 @@ fsm_reset_mgr(void)
         session = next;
     }
     free_str_tree(mgr->mqtt_headers);
+    free(mgr->metrics_topic);
+    mgr->metrics_topic = NULL;
 }
 
 
@@ -376,6 +379,9 @@ fsm_session_update(struct fsm_session *session,
 
     fconf = session->conf;
 
+    /* Pending reports were queued for the current topic */
+    fsm_report_batch_flush(session);
+
     /* Free old conf. Could be more efficient */
     fsm_free_session_conf(fconf);
     session->conf = NULL;
@@ -467,6 +473,8 @@ fsm_session_update(struct fsm_session *session,
 
     fsm_set_tx_intf(session);
 
+    fsm_report_batch_update(session);
+
     ret = fsm_is_dpi(session);
     if (ret)
     {
@@ -589,39 +597,6 @@ fsm_init_plugin(struct fsm_session *session)
 }
 
 
-/**
- * @brief send a json report over mqtt
- *
- * Emits and frees a json report
- * @param session the fsm session emitting the report
- * @param report the report to emit
- */
-void
-fsm_send_report(struct fsm_session *session, char *report)
-{
-    qm_response_t res;
-    bool ret = false;
-
-    LOGT("%s: msg len: %zu, msg: %s\n, topic: %s",
-         __func__, report ? strlen(report) : 0,
-         report ? report : "None", session->topic ? session->topic : "None");
-
-    if (report == NULL) return;
-    if (session->topic == NULL) goto free_report;
-
-    ret = qm_conn_send_direct(QM_REQ_COMPRESS_DISABLE, session->topic,
-                              report, strlen(report), &res);
-    if (ret == false) {
-        LOGE("%s: error sending mqtt with topic %s", __func__, session->topic);
-    }
-    session->report_count++;
-
-free_report:
-    json_free(report);
-    return;
-}
-
-
 /**
  * @brief send a protobuf report over mqtt
  *
@@ -767,6 +742,9 @@ fsm_free_session(struct fsm_session *session)
     /* Close the dynamic library handler */
     if (session->handle != NULL) dlclose(session->handle);
 
+    /* Send and free pending reports */
+    fsm_report_batch_free(session);
+
     /* Free the config settings */
     fsm_free_session_conf(session->conf);
 
@@ -1109,6 +1087,33 @@ fsm_set_node_state(const char *module, const char *key, const char *value)
 }
 
 
+/**
+ * @brief sets or clears the self-measurement report topic
+ *
+ * @param topic the mqtt topic, NULL to stop reporting
+ */
+static void
+fsm_set_metrics_topic(const char *topic)
+{
+    struct fsm_mgr *mgr;
+
+    /* Get the manager */
+    mgr = fsm_get_mgr();
+
+    free(mgr->metrics_topic);
+    mgr->metrics_topic = NULL;
+
+    if (topic == NULL || topic[0] == '\0')
+    {
+        LOGI("%s: metrics report disabled", __func__);
+        return;
+    }
+
+    mgr->metrics_topic = strdup(topic);
+    LOGI("%s: metrics report topic: %s", __func__, topic);
+}
+
+
 /**
  * @brief processes the addition of an entry in Node_Config
  */
@@ -1128,6 +1133,13 @@ fsm_get_node_config(struct schema_Node_Config *node_cfg)
     if (rc != 0) return;
 
     key = node_cfg->key;
+    rc = strcmp(FSM_NODE_CONFIG_METRICS_KEY, key);
+    if (rc == 0)
+    {
+        fsm_set_metrics_topic(node_cfg->value);
+        return;
+    }
+
     rc = strcmp("max_mem_percent", key);
     if (rc != 0) return;
 
@@ -1174,6 +1186,13 @@ fsm_rm_node_config(struct schema_Node_Config *old_rec)
     rc = strcmp("fsm", module);
     if (rc != 0) return;
 
+    rc = strcmp(FSM_NODE_CONFIG_METRICS_KEY, old_rec->key);
+    if (rc == 0)
+    {
+        fsm_set_metrics_topic(NULL);
+        return;
+    }
+
     /* Get the manager */
     mgr = fsm_get_mgr();
     if (mgr->sysinfo.totalram == 0) return;
@@ -46,20 +46,54 @@ fsm_pcap_handler(uint8_t * args, const struct pcap_pkthdr *header,
     struct net_header_parser net_parser;
     struct fsm_parser_ops *parser_ops;
     struct fsm_session *session;
+    struct fsm_pcaps *pcaps;
+    uint64_t t0;
     size_t len;
 
     session = (struct fsm_session *)args;
+    pcaps = session->pcaps;
+
+    metrics_counter_inc(&pcaps->pkts);
+    metrics_counter_add(&pcaps->bytes, header->caplen);
+    t0 = metrics_clock();
 
     memset(&net_parser, 0, sizeof(net_parser));
     net_parser.packet_len = header->caplen;
     net_parser.caplen = header->caplen;
     net_parser.data = (uint8_t *)bytes;
-    net_parser.pcap_datalink = session->pcaps->pcap_datalink;
+    net_parser.pcap_datalink = pcaps->pcap_datalink;
     len = net_header_parse(&net_parser);
     if (len == 0) return;
 
     parser_ops = &session->p_ops->parser_ops;
     parser_ops->handler(session, &net_parser);
+
+    metrics_hist_since(&pcaps->pkt_us, t0);
+}
+
+
+/**
+ * @brief registers the session's capture metrics
+ *
+ * @param session the fsm session
+ */
+static void
+fsm_pcap_metrics_init(struct fsm_session *session)
+{
+    struct fsm_pcaps *pcaps = session->pcaps;
+    char name[128];
+
+    snprintf(name, sizeof(name), "fsm.%s.pkts", session->name);
+    metrics_init(&pcaps->pkts, name, METRICS_COUNTER);
+
+    snprintf(name, sizeof(name), "fsm.%s.bytes", session->name);
+    metrics_init(&pcaps->bytes, name, METRICS_COUNTER);
+
+    snprintf(name, sizeof(name), "fsm.%s.pkt_us", session->name);
+    metrics_init(&pcaps->pkt_us, name, METRICS_HIST);
+
+    snprintf(name, sizeof(name), "fsm.%s.pcap_drops", session->name);
+    metrics_init(&pcaps->drops, name, METRICS_GAUGE);
 }
 
 
@@ -164,6 +198,8 @@ bool fsm_pcap_open(struct fsm_session *session) {
     /* Start watching it on the default queue */
     ev_io_start(mgr->loop, &pcaps->fsm_evio);
 
+    fsm_pcap_metrics_init(session);
+
     return true;
 
   error:
@@ -190,4 +226,9 @@ void fsm_pcap_close(struct fsm_session *session) {
         pcap_close(pcap);
         pcaps->pcap = NULL;
     }
+
+    metrics_fini(&pcaps->pkts);
+    metrics_fini(&pcaps->bytes);
+    metrics_fini(&pcaps->pkt_us);
+    metrics_fini(&pcaps->drops);
 }
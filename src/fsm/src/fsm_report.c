@@ -0,0 +1,257 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * FSM json report batching.
+ *
+ * When a session's other_config holds report_batch_ms and/or
+ * report_batch_bytes, json reports are accumulated into a json array
+ * and sent to QM as one compressed message, either when the batch
+ * reaches its size bound or when its oldest report reaches its age bound.
+ */
+
+#include <ev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "log.h"
+#include "json_util.h"
+#include "qm_conn.h"
+
+#define FSM_REPORT_BATCH_MS_DFLT     1000
+#define FSM_REPORT_BATCH_BYTES_DFLT  (16 * 1024)
+
+
+/**
+ * @brief hand a buffer over to QM
+ *
+ * @param session the fsm session emitting the report
+ * @param buf the buffer to send
+ * @param len the buffer length
+ * @param compress the QM compression request
+ */
+static void
+fsm_report_qm_send(struct fsm_session *session, char *buf, size_t len,
+                   qm_compress_t compress)
+{
+    qm_response_t res;
+    bool ret;
+
+    ret = qm_conn_send_direct(compress, session->topic, buf, len, &res);
+    if (ret == false)
+    {
+        LOGE("%s: error sending mqtt with topic %s", __func__, session->topic);
+    }
+}
+
+
+/**
+ * @brief batch age timer callback
+ */
+static void
+fsm_report_batch_timer_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+    struct fsm_report_batch *batch;
+
+    (void)loop;
+    (void)revents;
+
+    batch = watcher->data;
+    fsm_report_batch_flush(batch->session);
+}
+
+
+void
+fsm_report_batch_flush(struct fsm_session *session)
+{
+    struct fsm_report_batch *batch;
+
+    batch = session->batch;
+    if (batch == NULL) return;
+
+    ev_timer_stop(fsm_get_mgr()->loop, &batch->timer);
+    if (batch->count == 0) return;
+
+    batch->buf[batch->len++] = ']';
+    batch->buf[batch->len] = '\0';
+
+    LOGT("%s: session %s: sending %d reports, %zu bytes",
+         __func__, session->name, batch->count, batch->len);
+
+    if (session->topic != NULL)
+    {
+        fsm_report_qm_send(session, batch->buf, batch->len,
+                           QM_REQ_COMPRESS_FORCE);
+        session->report_count += batch->count;
+    }
+
+    batch->len = 0;
+    batch->count = 0;
+}
+
+
+/**
+ * @brief append a report to the session's batch
+ *
+ * @param session the fsm session emitting the report
+ * @param report the json report
+ * @return true if the report was queued
+ */
+static bool
+fsm_report_batch_add(struct fsm_session *session, char *report)
+{
+    struct fsm_report_batch *batch;
+    size_t rlen;
+    size_t need;
+    char *buf;
+
+    batch = session->batch;
+    rlen = strlen(report);
+
+    /* '[' or ',' before the report, ']' and '\0' at flush time */
+    need = rlen + 3;
+    if (need > batch->max_bytes) return false;
+
+    if (batch->len + need > batch->max_bytes) fsm_report_batch_flush(session);
+
+    if (batch->len + need > batch->size)
+    {
+        buf = realloc(batch->buf, batch->max_bytes);
+        if (buf == NULL) return false;
+
+        batch->buf = buf;
+        batch->size = batch->max_bytes;
+    }
+
+    batch->buf[batch->len++] = (batch->count == 0) ? '[' : ',';
+    memcpy(batch->buf + batch->len, report, rlen);
+    batch->len += rlen;
+    batch->count++;
+
+    if (batch->count == 1)
+    {
+        ev_timer_set(&batch->timer, batch->max_delay, 0.);
+        ev_timer_start(fsm_get_mgr()->loop, &batch->timer);
+    }
+
+    return true;
+}
+
+
+void
+fsm_report_batch_update(struct fsm_session *session)
+{
+    struct fsm_report_batch *batch;
+    char *bytes;
+    char *ms;
+
+    ms = fsm_get_other_config_val(session, "report_batch_ms");
+    bytes = fsm_get_other_config_val(session, "report_batch_bytes");
+
+    if ((ms == NULL) && (bytes == NULL))
+    {
+        fsm_report_batch_free(session);
+        return;
+    }
+
+    batch = session->batch;
+    if (batch == NULL)
+    {
+        batch = calloc(1, sizeof(*batch));
+        if (batch == NULL) return;
+
+        batch->session = session;
+        ev_init(&batch->timer, fsm_report_batch_timer_cb);
+        batch->timer.data = batch;
+        session->batch = batch;
+    }
+    else
+    {
+        fsm_report_batch_flush(session);
+    }
+
+    batch->max_delay = (ms != NULL ? strtoul(ms, NULL, 10) :
+                        FSM_REPORT_BATCH_MS_DFLT) / 1000.;
+    batch->max_bytes = (bytes != NULL ? strtoul(bytes, NULL, 10) :
+                        FSM_REPORT_BATCH_BYTES_DFLT);
+
+    LOGI("%s: session %s: batching reports up to %zu bytes, %.3f s",
+         __func__, session->name, batch->max_bytes, batch->max_delay);
+}
+
+
+void
+fsm_report_batch_free(struct fsm_session *session)
+{
+    struct fsm_report_batch *batch;
+
+    batch = session->batch;
+    if (batch == NULL) return;
+
+    fsm_report_batch_flush(session);
+
+    free(batch->buf);
+    free(batch);
+    session->batch = NULL;
+}
+
+
+/**
+ * @brief send a json report over mqtt
+ *
+ * Emits and frees a json report. Reports of sessions configured for
+ * batching are queued and sent along with their batch.
+ * @param session the fsm session emitting the report
+ * @param report the report to emit
+ */
+void
+fsm_send_report(struct fsm_session *session, char *report)
+{
+    bool queued;
+
+    LOGT("%s: msg len: %zu, msg: %s\n, topic: %s",
+         __func__, report ? strlen(report) : 0,
+         report ? report : "None", session->topic ? session->topic : "None");
+
+    if (report == NULL) return;
+    if (session->topic == NULL) goto free_report;
+
+    queued = false;
+    if (session->batch != NULL) queued = fsm_report_batch_add(session, report);
+
+    if (!queued)
+    {
+        fsm_report_qm_send(session, report, strlen(report),
+                           QM_REQ_COMPRESS_DISABLE);
+        session->report_count++;
+    }
+
+free_report:
+    json_free(report);
+    return;
+}
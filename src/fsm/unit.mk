@@ -38,6 +38,7 @@ UNIT_SRC += src/fsm_pcap.c
 UNIT_SRC += src/fsm_event.c
 UNIT_SRC += src/fsm_service.c
 UNIT_SRC += src/fsm_dpi.c
+UNIT_SRC += src/fsm_report.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/lib/imc/inc
@@ -63,3 +64,5 @@ UNIT_DEPS += src/qm/qm_conn
 UNIT_DEPS += src/lib/json_mqtt
 UNIT_DEPS += src/lib/network_telemetry
 UNIT_DEPS += src/lib/network_metadata
+UNIT_DEPS += src/lib/metrics
+UNIT_DEPS += src/lib/evx
@@ -34,10 +34,47 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fsm.h"
 #include "log.h"
 #include "network_metadata_report.h"
+#include "qm_conn.h"
 #include "target.h"
 #include "unity.h"
 #include "pcap.c"
 
+/* MQTT reports handed over to QM, see __wrap_qm_conn_send_direct() */
+struct test_qm_send
+{
+    int count;
+    qm_compress_t compress;
+    char data[512];
+    int data_size;
+};
+
+struct test_qm_send g_qm_send;
+
+bool
+__wrap_qm_conn_send_direct(qm_compress_t compress, char *topic, void *data,
+                           int data_size, qm_response_t *res);
+
+bool
+__wrap_qm_conn_send_direct(qm_compress_t compress, char *topic, void *data,
+                           int data_size, qm_response_t *res)
+{
+    size_t len;
+
+    (void)topic;
+
+    if (res != NULL) memset(res, 0, sizeof(*res));
+
+    g_qm_send.count++;
+    g_qm_send.compress = compress;
+    g_qm_send.data_size = data_size;
+    len = (size_t)data_size < sizeof(g_qm_send.data) ?
+          (size_t)data_size : sizeof(g_qm_send.data) - 1;
+    memcpy(g_qm_send.data, data, len);
+    g_qm_send.data[len] = '\0';
+
+    return true;
+}
+
 /**
  * @brief Converts a bytes array in a hex dump file wireshark can import.
  *
@@ -1095,6 +1132,132 @@ test_5_dpi_dispatcher_and_plugin(void)
 }
 
 
+struct schema_Flow_Service_Manager_Config g_batch_conf =
+{
+    .handler = "fsm_session_batch",
+    .plugin = "plugin_batch",
+    .type = "parser",
+    .other_config_keys =
+    {
+        "mqtt_v",                       /* topic */
+        "dso_init",                     /* plugin init routine */
+        "report_batch_bytes",           /* batch size bound */
+        "report_batch_ms",              /* batch age bound */
+    },
+    .other_config =
+    {
+        "dev-test/fsm_core_ut/batch",   /* topic */
+        "test_dso_init",                /* plugin init routine */
+        "64",                           /* batch size bound */
+        "60000",                        /* batch age bound */
+    },
+    .other_config_len = 4,
+};
+
+
+static struct fsm_session *
+test_add_batch_session(char *batch_bytes, char *batch_ms)
+{
+    struct fsm_session *session;
+
+    g_mgr->loop = EV_DEFAULT;
+    STRSCPY(g_batch_conf.other_config[2], batch_bytes);
+    STRSCPY(g_batch_conf.other_config[3], batch_ms);
+    fsm_add_session(&g_batch_conf);
+
+    session = ds_tree_find(fsm_get_sessions(), g_batch_conf.handler);
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_NOT_NULL(session->batch);
+
+    memset(&g_qm_send, 0, sizeof(g_qm_send));
+
+    return session;
+}
+
+
+/**
+ * @brief batched reports are sent once the batch is full
+ */
+void
+test_report_batch_size(void)
+{
+    struct fsm_session *session;
+    char *expected;
+    int i;
+
+    session = test_add_batch_session("64", "60000");
+    TEST_ASSERT_EQUAL_UINT(64, session->batch->max_bytes);
+
+    /* Each report takes 9 bytes, 6 of them fit along with the closing ']' */
+    for (i = 0; i < 6; i++)
+    {
+        fsm_send_report(session, strdup("{\"id\":1}"));
+    }
+    TEST_ASSERT_EQUAL_INT(0, g_qm_send.count);
+    TEST_ASSERT_EQUAL_INT(6, session->batch->count);
+    TEST_ASSERT_TRUE(ev_is_active(&session->batch->timer));
+
+    /* The 7th report does not fit, the batch is sent first */
+    fsm_send_report(session, strdup("{\"id\":2}"));
+    TEST_ASSERT_EQUAL_INT(1, g_qm_send.count);
+    TEST_ASSERT_EQUAL_INT(QM_REQ_COMPRESS_FORCE, g_qm_send.compress);
+    expected = "[{\"id\":1},{\"id\":1},{\"id\":1},"
+               "{\"id\":1},{\"id\":1},{\"id\":1}]";
+    TEST_ASSERT_EQUAL_STRING(expected, g_qm_send.data);
+    TEST_ASSERT_EQUAL_INT(strlen(expected), g_qm_send.data_size);
+    TEST_ASSERT_EQUAL_INT(1, session->batch->count);
+    TEST_ASSERT_EQUAL_INT(6, session->report_count);
+
+    /* A report larger than the bound is sent on its own, uncompressed */
+    fsm_send_report(session, strdup("{\"id\":\"0123456789012345678901234567"
+                                    "8901234567890123456789012345\"}"));
+    TEST_ASSERT_EQUAL_INT(2, g_qm_send.count);
+    TEST_ASSERT_EQUAL_INT(QM_REQ_COMPRESS_DISABLE, g_qm_send.compress);
+    TEST_ASSERT_EQUAL_INT(1, session->batch->count);
+
+    /* Deleting the session sends what is left */
+    fsm_delete_session(&g_batch_conf);
+    TEST_ASSERT_EQUAL_INT(3, g_qm_send.count);
+    TEST_ASSERT_EQUAL_STRING("[{\"id\":2}]", g_qm_send.data);
+}
+
+
+/**
+ * @brief batched reports are sent once the oldest one is old enough
+ */
+void
+test_report_batch_timer(void)
+{
+    struct fsm_session *session;
+
+    session = test_add_batch_session("16384", "10");
+    TEST_ASSERT_EQUAL_UINT(16384, session->batch->max_bytes);
+
+    fsm_send_report(session, strdup("{\"id\":1}"));
+    fsm_send_report(session, strdup("{\"id\":2}"));
+    TEST_ASSERT_EQUAL_INT(0, g_qm_send.count);
+    TEST_ASSERT_TRUE(ev_is_active(&session->batch->timer));
+
+    /* Wait for the age bound timer */
+    ev_run(g_mgr->loop, EVRUN_ONCE);
+    TEST_ASSERT_EQUAL_INT(1, g_qm_send.count);
+    TEST_ASSERT_EQUAL_INT(QM_REQ_COMPRESS_FORCE, g_qm_send.compress);
+    TEST_ASSERT_EQUAL_STRING("[{\"id\":1},{\"id\":2}]", g_qm_send.data);
+    TEST_ASSERT_EQUAL_INT(0, session->batch->count);
+    TEST_ASSERT_FALSE(ev_is_active(&session->batch->timer));
+
+    /* The next report starts a new batch and rearms the timer */
+    fsm_send_report(session, strdup("{\"id\":3}"));
+    TEST_ASSERT_TRUE(ev_is_active(&session->batch->timer));
+    ev_run(g_mgr->loop, EVRUN_ONCE);
+    TEST_ASSERT_EQUAL_INT(2, g_qm_send.count);
+    TEST_ASSERT_EQUAL_STRING("[{\"id\":3}]", g_qm_send.data);
+
+    fsm_delete_session(&g_batch_conf);
+    TEST_ASSERT_EQUAL_INT(2, g_qm_send.count);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -1123,6 +1286,8 @@ main(int argc, char *argv[])
     RUN_TEST(test_3_dpi_dispatcher_and_plugin);
     RUN_TEST(test_4_dpi_dispatcher_and_plugin);
     RUN_TEST(test_5_dpi_dispatcher_and_plugin);
+    RUN_TEST(test_report_batch_size);
+    RUN_TEST(test_report_batch_timer);
 
     return UNITY_END();
 }
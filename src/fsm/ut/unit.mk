@@ -34,6 +34,7 @@ UNIT_SRC += ../src/fsm_pcap.c
 UNIT_SRC += ../src/fsm_event.c
 UNIT_SRC += ../src/fsm_service.c
 UNIT_SRC += ../src/fsm_dpi.c
+UNIT_SRC += ../src/fsm_report.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/../inc
 UNIT_CFLAGS += -Isrc/lib/imc/inc
@@ -41,6 +42,7 @@ UNIT_CFLAGS += -Isrc/lib/imc/inc
 UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
 
 UNIT_LDFLAGS := -lev -ljansson -lpcap -lmnl
+UNIT_LDFLAGS += -Wl,--wrap=qm_conn_send_direct
 UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 
 UNIT_DEPS := src/lib/log
@@ -26,16 +26,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /**
  * MAC learning of wired clients on the native linux bridge
+ *
+ * Bridge FDB changes are received as AF_BRIDGE RTM_NEWNEIGH/RTM_DELNEIGH
+ * netlink events. A full FDB dump is only requested when the netlink socket
+ * is (re)opened or when events were lost.
  */
 
 #include <ev.h>
 #include <net/if.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
 
 #include "ds.h"
 #include "ds_list.h"
 #include "ds_tree.h"
 #include "log.h"
+#include "os_types.h"
 #include "schema.h"
 #include "schema_consts.h"
 
@@ -43,8 +54,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /*****************************************************************************/
 
+/* Netlink socket recovery interval */
 #define MAC_LEARNING_INTERVAL   10.0
 
+/* Netlink receive buffer size; FDB dumps use up to 32kB per batch */
+#define MAC_LEARNING_NL_BUF_SZ  32768
+
 #define MODULE_ID               LOG_MODULE_ID_TARGET
 
 #if defined(CONFIG_TARGET_LAN_BRIDGE_NAME)
@@ -57,13 +72,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 static int mac_learning_cmp(void *_a, void *_b);
 
-struct mac_learning_flt_t {
-    char                    brname[IFNAMSIZ];
-    char                    ifname[IFNAMSIZ];
-    int                     ifnum;
-    struct ds_dlist_node    list;
-};
-
 struct mac_learning_t {
     struct schema_OVS_MAC_Learning  oml;
     bool                            valid;
@@ -75,236 +83,401 @@ struct mac_learning_t {
  *****************************************************************************/
 
 static struct ev_timer             g_mac_learning_timer;
+static struct ev_io                g_mac_learning_nl_io;
+static int                         g_mac_learning_nl_sock = -1;
+static uint32_t                    g_mac_learning_nl_seq = 0;
+static uint32_t                    g_mac_learning_dump_seq = 0;
 static target_mac_learning_cb_t   *g_mac_learning_cb = NULL;
+static uint8_t                     g_mac_learning_nl_buf[MAC_LEARNING_NL_BUF_SZ];
 
 static ds_tree_t    g_mac_learning = DS_TREE_INIT(mac_learning_cmp,
                                                   struct mac_learning_t,
                                                   list);
-static ds_dlist_t   g_mac_learning_flt = DS_DLIST_INIT(struct mac_learning_flt_t,
-                                                       list);
 
 /******************************************************************************
  *  PROTECTED definitions
  *****************************************************************************/
 
-static struct mac_learning_flt_t *mac_learning_flt_find(int ifnum)
+/*
+ * Check if the bridge port is an ethernet client interface and return its name
+ */
+static bool mac_learning_port_get(int ifindex, char *ifname)
 {
-    struct mac_learning_flt_t *flt;
+    const char  **iflist;
+    int           ifidx;
 
-    ds_dlist_foreach(&g_mac_learning_flt, flt) {
-        if (flt->ifnum == ifnum) {
-            return flt;
+    if (if_indextoname(ifindex, ifname) == NULL)
+    {
+        return false;
+    }
+
+    iflist = target_ethclient_iflist_get();
+    for (ifidx = 0; iflist[ifidx]; ifidx++)
+    {
+        if (!strcmp(ifname, iflist[ifidx]))
+        {
+            return true;
         }
     }
 
-    return NULL;
+    LOGT("BRCTLMAC: Skip %s", ifname);
+
+    return false;
 }
 
-static bool mac_learning_flt_get(const char *brname)
+static void mac_learning_invalidate(void)
 {
-    FILE         *fp;
-    char          cmd[512];
-    char          buf[512];
-    const char  **iflist;
-    int           ifidx;
-    char          ifname[IFNAMSIZ];
-
-    /* Find port numbers for eth interfaces. Expected output:
-     *
-     * eth1 (2)
-     * eth2 (3)
-     * eth3 (4)
-     * ...
-     */
-    snprintf(cmd, sizeof(cmd), "brctl showstp %s | grep eth", brname);
-
-    fp = popen(cmd, "r");
-    if (!fp)
+    struct mac_learning_t *ml;
+
+    ds_tree_foreach(&g_mac_learning, ml)
     {
-        LOGE("BRCTLMAC: Unable to read bridge stp table! :: brname=%s", brname);
-        return false;
+        ml->valid = false;
     }
+}
 
-    while (fgets(buf, sizeof(buf), fp))
-    {
-        int                         eth;
-        int                         ifnum;
-        struct mac_learning_flt_t  *flt;
+static void mac_learning_flush(void)
+{
+    struct mac_learning_t  *ml;
+    ds_tree_iter_t          iter;
 
-        if (2 != sscanf(buf, "eth%d (%d)", &eth, &ifnum))
+    for (ml = ds_tree_ifirst(&iter, &g_mac_learning);
+         ml != NULL;
+         ml = ds_tree_inext(&iter))
+    {
+        if (ml->valid)
         {
             continue;
         }
 
-        // Skip non ethernet clients ports
-        snprintf(ifname, sizeof(ifname), "eth%d", eth);
-        iflist = target_ethclient_iflist_get();
-        for (ifidx=0; iflist[ifidx]; ifidx++)
-        {
-            if (!strcmp(ifname, iflist[ifidx]))
-            {
-                break;
-            }
-        }
-        if (iflist[ifidx] == NULL)
+        // Indicate deleted entry to NM
+        g_mac_learning_cb(&ml->oml, false);
+
+        // Remove our entry
+        ds_tree_iremove(&iter);
+        memset(ml, 0, sizeof(*ml));
+        free(ml);
+    }
+}
+
+/*
+ * Apply a single FDB change to the cache and notify NM
+ */
+static void mac_learning_update(const char *ifname, os_macaddr_t *mac, bool add)
+{
+    struct schema_OVS_MAC_Learning  oml;
+    struct mac_learning_t          *ml;
+
+    memset(&oml, 0, sizeof(oml));
+    snprintf(oml.hwaddr, sizeof(oml.hwaddr), PRI(os_macaddr_lower_t), FMT(os_macaddr_t, *mac));
+    strscpy(oml.brname, BRCTL_LAN_BRIDGE, sizeof(oml.brname));
+    strscpy(oml.ifname, ifname, sizeof(oml.ifname));
+
+    ml = ds_tree_find(&g_mac_learning, &oml);
+
+    LOGT("BRCTLMAC: mac table %s :: brname=%s ifname=%s mac=%s",
+         add ? "update" : "delete",
+         oml.brname,
+         oml.ifname,
+         oml.hwaddr);
+
+    if (!add)
+    {
+        // Ignore deletes of stale entries on the old port after a MAC move
+        if (ml == NULL || strcmp(ml->oml.ifname, ifname) != 0)
         {
-            LOGT("BRCTLMAC: Skip %s", ifname);
-            continue;
+            return;
         }
 
-        flt = mac_learning_flt_find(ifnum);
-        if (flt != NULL) {
-            LOGT("BRCTLMAC: Already exists %s @ %s :: ifnum=%d", flt->ifname, brname, flt->ifnum);
-            continue;
-        }
-        else
+        g_mac_learning_cb(&ml->oml, false);
+        ds_tree_remove(&g_mac_learning, ml);
+        free(ml);
+        return;
+    }
+
+    if (ml != NULL)
+    {
+        ml->valid = true;
+
+        if (strcmp(ml->oml.ifname, ifname) == 0)
         {
-            flt = calloc(1, sizeof(*flt));
-            if (flt == NULL)
-            {
-                LOGE("BRCTLMAC: Unable to allocate mac learning entry! :: brname=%s", brname);
-                return false;
-            }
+            return;
         }
 
-        snprintf(flt->ifname, sizeof(flt->ifname), "eth%d", eth);
-        snprintf(flt->brname, sizeof(flt->brname), "%s", brname);
-        flt->ifnum = ifnum;
+        // The MAC moved to a different port
+        g_mac_learning_cb(&ml->oml, false);
+        strscpy(ml->oml.ifname, ifname, sizeof(ml->oml.ifname));
+        g_mac_learning_cb(&ml->oml, true);
+        return;
+    }
 
-        ds_dlist_insert_tail(&g_mac_learning_flt, flt);
+    // New entry
+    ml = calloc(1, sizeof(*ml));
+    if (ml == NULL)
+    {
+        LOGE("BRCTLMAC: Error allocating struct mac_learning!");
+        return;
+    }
+
+    memcpy(&ml->oml, &oml, sizeof(ml->oml));
+    ml->valid = true;
+    ds_tree_insert(&g_mac_learning, ml, &ml->oml);
+
+    // Pass new entry to NM
+    g_mac_learning_cb(&ml->oml, true);
+}
+
+/*
+ * The MAC was learned on a bridge port that is not an ethernet client port;
+ * drop the cached entry (if any) that still points to its old eth port
+ */
+static void mac_learning_moved_away(os_macaddr_t *mac)
+{
+    struct schema_OVS_MAC_Learning  oml;
+    struct mac_learning_t          *ml;
+
+    memset(&oml, 0, sizeof(oml));
+    snprintf(oml.hwaddr, sizeof(oml.hwaddr), PRI(os_macaddr_lower_t), FMT(os_macaddr_t, *mac));
 
-        LOGI("BRCTLMAC: Using %s @ %s :: ifnum=%d", flt->ifname, brname, flt->ifnum);
+    ml = ds_tree_find(&g_mac_learning, &oml);
+    if (ml == NULL)
+    {
+        return;
     }
 
-    if (fp)
-        pclose(fp);
+    LOGT("BRCTLMAC: mac table delete (moved to non-client port) :: brname=%s ifname=%s mac=%s",
+         ml->oml.brname,
+         ml->oml.ifname,
+         ml->oml.hwaddr);
 
-    return true;
+    g_mac_learning_cb(&ml->oml, false);
+    ds_tree_remove(&g_mac_learning, ml);
+    free(ml);
 }
 
-static bool mac_learning_parse(const char *brname)
+/*
+ * Process a single AF_BRIDGE RTM_NEWNEIGH/RTM_DELNEIGH message
+ */
+static void mac_learning_nl_neigh(struct nlmsghdr *nh)
 {
-    FILE *fp;
-    char cmd[512];
-    char buf[512];
-
-    /* Find bridge port numbers and mac addresses. Expected output:
-     *
-     * 6 00:c0:02:12:35:8a yes 0.00
-     * 1 40:b9:3c:1d:d9:09 no 1.80
-     * 1 68:05:ca:28:c1:45 no 5.40
-     * ...
-     */
-    snprintf(cmd,
-             sizeof(cmd),
-             "brctl showmacs %s | awk '{ print $1\" \"$2\" \"$3\" \"$4 }'",
-             brname);
-
-    fp = popen(cmd, "r");
-    if (!fp)
+    struct ndmsg   *ndm;
+    struct rtattr  *rta;
+    os_macaddr_t    mac;
+    char            ifname[IFNAMSIZ];
+    int             rtalen;
+    int             brindex;
+    bool            has_mac = false;
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ndm)))
     {
-        LOGE("BRCTLMAC: Unable to read bridge mac table! :: brname=%s", brname);
-        return false;
+        return;
     }
 
-    while (fgets(buf, sizeof(buf), fp))
+    ndm = NLMSG_DATA(nh);
+    if (ndm->ndm_family != AF_BRIDGE)
     {
-        int   ifnum;
-        float age;
-        char  mac[64];
-        char  local[64];
+        return;
+    }
+
+    // Skip local (is_local=yes) entries and entries reported by the port device itself
+    if ((ndm->ndm_state & NUD_PERMANENT) || (ndm->ndm_flags & NTF_SELF))
+    {
+        return;
+    }
 
-        if ((4 != sscanf(buf, "%d %64s %64s %f", &ifnum, mac, local, &age)) ||
-            (0 == strcmp(local, "yes")))
+    brindex = if_nametoindex(BRCTL_LAN_BRIDGE);
+
+    rtalen = RTM_PAYLOAD(nh);
+    for (rta = RTM_RTA(ndm); RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen))
+    {
+        switch (rta->rta_type)
         {
-            continue;
+            case NDA_LLADDR:
+                if (RTA_PAYLOAD(rta) != sizeof(mac.addr))
+                {
+                    return;
+                }
+                memcpy(mac.addr, RTA_DATA(rta), sizeof(mac.addr));
+                has_mac = true;
+                break;
+
+            case NDA_MASTER:
+                // Look only at entries of the LAN bridge
+                if (*(uint32_t *)RTA_DATA(rta) != (uint32_t)brindex)
+                {
+                    return;
+                }
+                break;
         }
+    }
 
-        // Look only at eth interfaces
-        struct mac_learning_flt_t *flt = mac_learning_flt_find(ifnum);
-        if (flt == NULL)
+    if (!has_mac)
+    {
+        return;
+    }
+
+    // Look only at eth interfaces
+    if (!mac_learning_port_get(ndm->ndm_ifindex, ifname))
+    {
+        if (nh->nlmsg_type == RTM_NEWNEIGH)
         {
-            continue;
+            mac_learning_moved_away(&mac);
         }
+        return;
+    }
 
-        struct schema_OVS_MAC_Learning oml;
-        memset(&oml, 0, sizeof(oml));
-        strscpy(oml.hwaddr, mac, sizeof(oml.hwaddr));
-        strscpy(oml.brname, BRCTL_LAN_BRIDGE, sizeof(oml.brname));
-        strscpy(oml.ifname, flt->ifname, sizeof(oml.ifname));
-
-        // New entry
-        bool update = false;
-        struct mac_learning_t *ml;
-        ml = ds_tree_find(&g_mac_learning, &oml);
-        if (ml == NULL)
-        {
-            ml = calloc(1, sizeof(*ml));
-            if (ml == NULL)
-            {
-                LOGE("BRCTLMAC: Error allocating struct mac_learning!");
-                continue;
-            }
+    mac_learning_update(ifname, &mac, nh->nlmsg_type == RTM_NEWNEIGH);
+}
 
-            memcpy(&ml->oml, &oml, sizeof(ml->oml));
-            ds_tree_insert(&g_mac_learning, ml, &ml->oml);
+static void mac_learning_nl_close(void)
+{
+    if (g_mac_learning_nl_sock < 0)
+    {
+        return;
+    }
 
-            update = true;
-        }
+    ev_io_stop(EV_DEFAULT, &g_mac_learning_nl_io);
+    close(g_mac_learning_nl_sock);
+    g_mac_learning_nl_sock = -1;
+    g_mac_learning_dump_seq = 0;
+}
 
-        ml->valid = true;
+/*
+ * Request a full dump of the bridge FDB. All current entries are invalidated;
+ * entries that are not reported by the dump are flushed when it completes.
+ */
+static bool mac_learning_nl_dump(void)
+{
+    struct sockaddr_nl  nladdr;
+    struct
+    {
+        struct nlmsghdr nh;
+        struct ndmsg    ndm;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ndm));
+    req.nh.nlmsg_type = RTM_GETNEIGH;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++g_mac_learning_nl_seq;
+    req.ndm.ndm_family = AF_BRIDGE;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    if (sendto(g_mac_learning_nl_sock, &req, req.nh.nlmsg_len, 0,
+               (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0)
+    {
+        LOGE("BRCTLMAC: Unable to request bridge FDB dump! :: error=%s", strerror(errno));
+        return false;
+    }
+
+    mac_learning_invalidate();
+    g_mac_learning_dump_seq = req.nh.nlmsg_seq;
+
+    LOGD("BRCTLMAC: refreshing mac learning table");
 
-        LOGT("BRCTLMAC: parsed mac table entry :: brname=%s ifname=%s mac=%s update=%s",
-             oml.brname,
-             oml.ifname,
-             oml.hwaddr,
-             update ? "true" : "false");
+    return true;
+}
+
+static void mac_learning_nl_cb(struct ev_loop *loop, ev_io *watcher, int revents)
+{
+    struct nlmsghdr *nh;
+    ssize_t          rc;
+    size_t           len;
+
+    (void)loop;
+    (void)watcher;
+    (void)revents;
+
+    rc = recv(g_mac_learning_nl_sock, g_mac_learning_nl_buf, sizeof(g_mac_learning_nl_buf), MSG_DONTWAIT);
+    if (rc < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+        {
+            return;
+        }
 
-        // Pass new entry to NM
-        if (update)
+        if (errno == ENOBUFS)
         {
-            g_mac_learning_cb(&ml->oml, true);
+            // Events were dropped by the kernel, resynchronize (unless a dump is already running)
+            LOGW("BRCTLMAC: Netlink events lost, resyncing bridge FDB.");
+            if (g_mac_learning_dump_seq == 0 && !mac_learning_nl_dump())
+            {
+                mac_learning_nl_close();
+            }
+            return;
         }
+
+        LOGE("BRCTLMAC: Error reading netlink socket! :: error=%s", strerror(errno));
+        mac_learning_nl_close();
+        return;
     }
 
-    if (fp)
-        pclose(fp);
+    for (nh = (struct nlmsghdr *)g_mac_learning_nl_buf, len = (size_t)rc;
+         NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len))
+    {
+        switch (nh->nlmsg_type)
+        {
+            case NLMSG_DONE:
+            case NLMSG_ERROR:
+                if (g_mac_learning_dump_seq != 0 && nh->nlmsg_seq == g_mac_learning_dump_seq)
+                {
+                    // Dump finished, remove entries that were not reported
+                    mac_learning_flush();
+                    g_mac_learning_dump_seq = 0;
+                }
+                break;
 
-    return true;
+            case RTM_NEWNEIGH:
+            case RTM_DELNEIGH:
+                mac_learning_nl_neigh(nh);
+                break;
+
+            default:
+                break;
+        }
+    }
 }
 
-static void mac_learning_invalidate(void)
+static bool mac_learning_nl_open(void)
 {
-    struct mac_learning_t *ml;
+    struct sockaddr_nl  nladdr;
 
-    ds_tree_foreach(&g_mac_learning, ml)
+    if (g_mac_learning_nl_sock >= 0)
     {
-        ml->valid = false;
+        return true;
     }
-}
 
-static void mac_learning_flush(void)
-{
-    struct mac_learning_t  *ml;
-    ds_tree_iter_t          iter;
+    g_mac_learning_nl_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (g_mac_learning_nl_sock < 0)
+    {
+        LOGE("BRCTLMAC: Unable to create netlink socket! :: error=%s", strerror(errno));
+        return false;
+    }
 
-    for (ml = ds_tree_ifirst(&iter, &g_mac_learning);
-         ml != NULL;
-         ml = ds_tree_inext(&iter))
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    nladdr.nl_groups = 1 << (RTNLGRP_NEIGH - 1);
+
+    if (bind(g_mac_learning_nl_sock, (struct sockaddr *)&nladdr, sizeof(nladdr)) != 0)
     {
-        if (ml->valid)
-        {
-            continue;
-        }
+        LOGE("BRCTLMAC: Unable to bind netlink socket! :: error=%s", strerror(errno));
+        close(g_mac_learning_nl_sock);
+        g_mac_learning_nl_sock = -1;
+        return false;
+    }
 
-        // Indicate deleted entry to NM
-        g_mac_learning_cb(&ml->oml, false);
+    ev_io_init(&g_mac_learning_nl_io, mac_learning_nl_cb, g_mac_learning_nl_sock, EV_READ);
+    ev_io_start(EV_DEFAULT, &g_mac_learning_nl_io);
 
-        // Remove our entry
-        ds_tree_iremove(&iter);
-        memset(ml, 0, sizeof(*ml));
-        free(ml);
+    if (!mac_learning_nl_dump())
+    {
+        mac_learning_nl_close();
+        return false;
     }
+
+    return true;
 }
 
 static int mac_learning_cmp(void *_a, void *_b)
@@ -316,17 +489,11 @@ static int mac_learning_cmp(void *_a, void *_b)
 
 static void mac_learing_timer_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
 {
-    // Some vendors add/remove ethernet interface in runtime
-    if (!mac_learning_flt_get(BRCTL_LAN_BRIDGE))
+    // The netlink socket is closed on errors, try to reopen it and resync
+    if (!mac_learning_nl_open())
     {
-        LOGE("BRCTLMAC: Unable to create MAC learning filter!");
-        return;
+        LOGE("BRCTLMAC: Unable to open netlink socket, retrying in %.0f seconds.", MAC_LEARNING_INTERVAL);
     }
-
-    LOGD("BRCTLMAC: refreshing mac learning table");
-    mac_learning_invalidate();
-    mac_learning_parse(BRCTL_LAN_BRIDGE);
-    mac_learning_flush();
 }
 
 /******************************************************************************
@@ -341,7 +508,13 @@ bool brctl_mac_learning_register(target_mac_learning_cb_t *omac_cb)
     // Init NM callback
     g_mac_learning_cb = omac_cb;
 
-    // Init timer
+    // Subscribe to bridge FDB events
+    if (!mac_learning_nl_open())
+    {
+        LOGW("BRCTLMAC: Unable to open netlink socket, retrying in %.0f seconds.", MAC_LEARNING_INTERVAL);
+    }
+
+    // Init socket recovery timer
     ev_timer_init(&g_mac_learning_timer,
                   mac_learing_timer_cb,
                   MAC_LEARNING_INTERVAL,
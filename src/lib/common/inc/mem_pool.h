@@ -0,0 +1,254 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MEM_POOL_H_INCLUDED
+#define MEM_POOL_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ds_dlist.h"
+
+/*
+ * ===========================================================================
+ *  Fixed-size object pools
+ * ===========================================================================
+ *
+ * A pool hands out objects of a single size carved from slabs of
+ * mp_slab_objs objects. Freed objects go to a freelist and are reused
+ * before a new slab is allocated, so a steady alloc/free pattern never
+ * touches malloc() and does not fragment the heap. Slabs are only returned
+ * to the system by mem_pool_fini().
+ *
+ * Pools can be declared statically; the first slab is allocated on first
+ * use:
+ *
+ *  static mem_pool_t task_pool = MEM_POOL_INIT("evsched_task", struct task, 32, 0);
+ *
+ *  struct task *t = mem_pool_alloc(&task_pool);
+ *  mem_pool_free(&task_pool, t);
+ *
+ * Neither pools nor arenas are thread-safe, and pools register themselves
+ * in a global list on first use: a pool or an arena must only be used from
+ * one thread, or under a lock held by the caller.
+ */
+
+/*
+ * Most strictly aligned fundamental type, the alignment malloc() guarantees.
+ * Same as max_align_t, which is only available from C11 on.
+ */
+typedef union
+{
+    long long       mpa_ll;
+    long double     mpa_ld;
+    void           *mpa_ptr;
+    void          (*mpa_fn)(void);
+} mem_pool_max_align_t;
+
+/** Alignment of pool objects and arena allocations */
+#define MEM_POOL_ALIGN              (__alignof__(mem_pool_max_align_t))
+
+#define MEM_POOL_ALIGN_UP(x)        (((x) + MEM_POOL_ALIGN - 1) & ~((size_t)MEM_POOL_ALIGN - 1))
+
+/**
+ * Static pool initializer
+ *
+ * @param[in]   name        Pool name, used for statistics
+ * @param[in]   type        Object type
+ * @param[in]   slab_objs   Number of objects allocated at once
+ * @param[in]   max         Maximum number of objects in use or 0 for no limit
+ */
+#define MEM_POOL_INIT(name, type, slab_objs, max)   \
+{                                                   \
+    .mp_name        = (name),                       \
+    .mp_objsz       = sizeof(type),                 \
+    .mp_slab_objs   = (slab_objs),                  \
+    .mp_max         = (max),                        \
+}
+
+typedef struct mem_pool mem_pool_t;
+typedef struct mem_pool_stats mem_pool_stats_t;
+
+struct mem_pool
+{
+    const char         *mp_name;        /**< Pool name                          */
+    size_t              mp_objsz;       /**< Object size as requested           */
+    size_t              mp_slab_objs;   /**< Objects per slab                   */
+    size_t              mp_max;         /**< Cap on objects in use, 0 = none    */
+    bool                mp_init;        /**< Registered and sizes calculated    */
+    size_t              mp_stride;      /**< Aligned object size                */
+    void               *mp_free;        /**< Freelist                           */
+    void               *mp_slabs;       /**< List of allocated slabs            */
+    size_t              mp_nslabs;      /**< Number of slabs                    */
+    size_t              mp_inuse;       /**< Objects currently in use           */
+    size_t              mp_peak;        /**< Peak number of objects in use      */
+    uint64_t            mp_nalloc;      /**< Number of successful allocations   */
+    uint64_t            mp_nfail;       /**< Failed allocations (cap or ENOMEM) */
+    ds_dlist_node_t     mp_dnode;       /**< Global list of pools               */
+};
+
+/**
+ * Pool usage counters
+ */
+struct mem_pool_stats
+{
+    const char         *name;
+    size_t              objsz;          /**< Aligned object size                */
+    size_t              inuse;          /**< Objects in use                     */
+    size_t              peak;           /**< Peak objects in use                */
+    size_t              capacity;       /**< Objects allocated in slabs         */
+    size_t              bytes;          /**< Bytes held by the pool             */
+    uint64_t            nalloc;         /**< Successful allocations             */
+    uint64_t            nfail;          /**< Failed allocations                 */
+};
+
+/**
+ * Run-time pool initializer, see MEM_POOL_INIT()
+ */
+void mem_pool_init(mem_pool_t *pool, const char *name, size_t objsz, size_t slab_objs, size_t max);
+
+/**
+ * Release all slabs. All objects allocated from the pool become invalid.
+ */
+void mem_pool_fini(mem_pool_t *pool);
+
+/**
+ * Allocate a zeroed object from the pool
+ *
+ * @return
+ * Pointer to the object or NULL if the pool cap was reached or memory is
+ * exhausted
+ */
+void *mem_pool_alloc(mem_pool_t *pool);
+
+/**
+ * Return @p obj to the pool; NULL is ignored
+ */
+void mem_pool_free(mem_pool_t *pool, void *obj);
+
+/**
+ * Fill @p stats with the pool counters
+ */
+void mem_pool_stats_get(mem_pool_t *pool, mem_pool_stats_t *stats);
+
+/**
+ * Log usage of every pool that was used at least once
+ */
+void mem_pool_stats_log(void);
+
+/**
+ * Iterate all pools that were used at least once
+ */
+mem_pool_t *mem_pool_first(void);
+mem_pool_t *mem_pool_next(mem_pool_t *pool);
+
+/*
+ * ===========================================================================
+ *  Arena allocator
+ * ===========================================================================
+ *
+ * Arenas are meant for scratch memory with a well defined lifetime, for
+ * example everything built for one report or one packet. Allocations are
+ * bump-pointer allocations from chunks; there is no per-object free.
+ * mem_arena_reset() releases everything at once but keeps one chunk of the
+ * default size, so an arena that is reset after every report settles at
+ * zero malloc() calls per report. Oversized chunks are never kept. mem_arena_mark()/mem_arena_rewind() release only what
+ * was allocated after the mark.
+ *
+ *  mem_arena_t arena = MEM_ARENA_INIT(4096);
+ *
+ *  rec = mem_arena_alloc(&arena, sizeof(*rec));
+ *  ...
+ *  mem_arena_reset(&arena);
+ */
+
+#define MEM_ARENA_INIT(chunk_sz)    \
+{                                   \
+    .ma_chunk_sz    = (chunk_sz),   \
+    .ma_head        = NULL,         \
+}
+
+typedef struct mem_arena mem_arena_t;
+typedef struct mem_arena_chunk mem_arena_chunk_t;
+
+struct mem_arena
+{
+    size_t              ma_chunk_sz;    /**< Default chunk size                 */
+    mem_arena_chunk_t  *ma_head;        /**< Current chunk, chunks are linked
+                                             towards the first one              */
+    size_t              ma_used;        /**< Bytes handed out                   */
+    size_t              ma_peak;        /**< Peak of ma_used                    */
+};
+
+/**
+ * Position in the arena returned by mem_arena_mark()
+ */
+typedef struct
+{
+    mem_arena_chunk_t  *am_chunk;
+    size_t              am_off;
+    size_t              am_used;
+} mem_arena_mark_t;
+
+void mem_arena_init(mem_arena_t *arena, size_t chunk_sz);
+
+/**
+ * Release all chunks
+ */
+void mem_arena_fini(mem_arena_t *arena);
+
+/**
+ * Allocate @p size bytes (uninitialized); returns NULL on ENOMEM
+ */
+void *mem_arena_alloc(mem_arena_t *arena, size_t size);
+
+/**
+ * Allocate @p size zeroed bytes
+ */
+void *mem_arena_zalloc(mem_arena_t *arena, size_t size);
+
+/**
+ * Copy string @p str into the arena
+ */
+char *mem_arena_strdup(mem_arena_t *arena, const char *str);
+
+/**
+ * Release all allocations, keeping one chunk of the default size for reuse
+ */
+void mem_arena_reset(mem_arena_t *arena);
+
+/**
+ * Remember the current arena position
+ */
+mem_arena_mark_t mem_arena_mark(mem_arena_t *arena);
+
+/**
+ * Release everything allocated after @p mark was taken
+ */
+void mem_arena_rewind(mem_arena_t *arena, mem_arena_mark_t mark);
+
+#endif /* MEM_POOL_H_INCLUDED */
@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MON_CHECKIN(id)        mon_checkin((id), __FILE__, __LINE__)
 
+#define MON_READY_FD_ENV       "PLUME_READY_FD"    /* Readiness pipe passed down by DM */
+
 /** monitor counter IDs */
 enum mon_cnt_id
 {
@@ -44,5 +46,6 @@ extern void mon_start(int argc, char *argv[]);
 extern void mon_checkin(enum mon_cnt_id id, char *file, int line);
 extern void mon_stackdump(void);
 extern void mon_process_terminate(pid_t child);
+extern void mon_notify_ready(void);
 
 #endif /* MONITOR_H_INCLUDED */
@@ -0,0 +1,384 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "mem_pool.h"
+
+#define MODULE_ID LOG_MODULE_ID_OSA
+
+/* Slab header, objects follow */
+struct mem_pool_slab
+{
+    struct mem_pool_slab   *ms_next;
+};
+
+#define MEM_POOL_SLAB_HDR       MEM_POOL_ALIGN_UP(sizeof(struct mem_pool_slab))
+
+struct mem_arena_chunk
+{
+    mem_arena_chunk_t      *mac_prev;       /* Previous (older) chunk */
+    size_t                  mac_size;       /* Usable size */
+    size_t                  mac_off;        /* Allocation offset */
+};
+
+#define MEM_ARENA_CHUNK_HDR     MEM_POOL_ALIGN_UP(sizeof(struct mem_arena_chunk))
+
+static ds_dlist_t mem_pool_list = DS_DLIST_INIT(mem_pool_t, mp_dnode);
+
+/*
+ * ===========================================================================
+ *  Pools
+ * ===========================================================================
+ */
+
+void mem_pool_init(mem_pool_t *pool, const char *name, size_t objsz, size_t slab_objs, size_t max)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    pool->mp_name = name;
+    pool->mp_objsz = objsz;
+    pool->mp_slab_objs = slab_objs;
+    pool->mp_max = max;
+}
+
+/*
+ * Calculate the object stride and register the pool on first use
+ */
+static void mem_pool_setup(mem_pool_t *pool)
+{
+    size_t objsz = pool->mp_objsz;
+
+    /* Free objects store the freelist link */
+    if (objsz < sizeof(void *)) objsz = sizeof(void *);
+
+    pool->mp_stride = MEM_POOL_ALIGN_UP(objsz);
+    if (pool->mp_slab_objs == 0) pool->mp_slab_objs = 1;
+
+    ds_dlist_insert_tail(&mem_pool_list, pool);
+    pool->mp_init = true;
+}
+
+/*
+ * Allocate a new slab and put all of its objects on the freelist
+ */
+static bool mem_pool_grow(mem_pool_t *pool)
+{
+    struct mem_pool_slab *slab;
+    size_t nobjs;
+    char *obj;
+    size_t ii;
+
+    nobjs = pool->mp_slab_objs;
+    if (pool->mp_max != 0)
+    {
+        size_t capacity = pool->mp_nslabs * pool->mp_slab_objs;
+
+        if (capacity >= pool->mp_max) return false;
+        if (nobjs > pool->mp_max - capacity) nobjs = pool->mp_max - capacity;
+    }
+
+    slab = malloc(MEM_POOL_SLAB_HDR + nobjs * pool->mp_stride);
+    if (slab == NULL) return false;
+
+    slab->ms_next = pool->mp_slabs;
+    pool->mp_slabs = slab;
+    pool->mp_nslabs++;
+
+    /* Thread the objects in address order */
+    obj = (char *)slab + MEM_POOL_SLAB_HDR + (nobjs - 1) * pool->mp_stride;
+    for (ii = 0; ii < nobjs; ii++, obj -= pool->mp_stride)
+    {
+        *(void **)obj = pool->mp_free;
+        pool->mp_free = obj;
+    }
+
+    return true;
+}
+
+void *mem_pool_alloc(mem_pool_t *pool)
+{
+    void *obj;
+
+    if (!pool->mp_init) mem_pool_setup(pool);
+
+    if (pool->mp_max != 0 && pool->mp_inuse >= pool->mp_max)
+    {
+        pool->mp_nfail++;
+        return NULL;
+    }
+
+    if (pool->mp_free == NULL && !mem_pool_grow(pool))
+    {
+        pool->mp_nfail++;
+        LOG(DEBUG, "mem_pool: %s: allocation failed, in use %zu",
+                   pool->mp_name, pool->mp_inuse);
+        return NULL;
+    }
+
+    obj = pool->mp_free;
+    pool->mp_free = *(void **)obj;
+
+    memset(obj, 0, pool->mp_objsz);
+
+    pool->mp_nalloc++;
+    pool->mp_inuse++;
+    if (pool->mp_inuse > pool->mp_peak) pool->mp_peak = pool->mp_inuse;
+
+    return obj;
+}
+
+void mem_pool_free(mem_pool_t *pool, void *obj)
+{
+    if (obj == NULL) return;
+
+    *(void **)obj = pool->mp_free;
+    pool->mp_free = obj;
+
+    pool->mp_inuse--;
+}
+
+void mem_pool_fini(mem_pool_t *pool)
+{
+    struct mem_pool_slab *slab;
+
+    if (pool->mp_inuse != 0)
+    {
+        LOG(NOTICE, "mem_pool: %s: releasing pool with %zu objects in use",
+                    pool->mp_name, pool->mp_inuse);
+    }
+
+    while ((slab = pool->mp_slabs) != NULL)
+    {
+        pool->mp_slabs = slab->ms_next;
+        free(slab);
+    }
+
+    if (pool->mp_init) ds_dlist_remove(&mem_pool_list, pool);
+
+    pool->mp_init = false;
+    pool->mp_free = NULL;
+    pool->mp_nslabs = 0;
+    pool->mp_inuse = 0;
+}
+
+void mem_pool_stats_get(mem_pool_t *pool, mem_pool_stats_t *stats)
+{
+    size_t capacity = 0;
+    struct mem_pool_slab *slab;
+
+    /* The last slab may be shorter if the pool is capped, count it exactly */
+    for (slab = pool->mp_slabs; slab != NULL; slab = slab->ms_next)
+    {
+        capacity += pool->mp_slab_objs;
+    }
+    if (pool->mp_max != 0 && capacity > pool->mp_max) capacity = pool->mp_max;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->name = pool->mp_name;
+    stats->objsz = pool->mp_stride;
+    stats->inuse = pool->mp_inuse;
+    stats->peak = pool->mp_peak;
+    stats->capacity = capacity;
+    stats->bytes = pool->mp_nslabs * MEM_POOL_SLAB_HDR + capacity * pool->mp_stride;
+    stats->nalloc = pool->mp_nalloc;
+    stats->nfail = pool->mp_nfail;
+}
+
+mem_pool_t *mem_pool_first(void)
+{
+    return ds_dlist_head(&mem_pool_list);
+}
+
+mem_pool_t *mem_pool_next(mem_pool_t *pool)
+{
+    return ds_dlist_next(&mem_pool_list, pool);
+}
+
+void mem_pool_stats_log(void)
+{
+    mem_pool_stats_t stats;
+    mem_pool_t *pool;
+
+    ds_dlist_foreach(&mem_pool_list, pool)
+    {
+        mem_pool_stats_get(pool, &stats);
+
+        LOG(INFO, "mem_pool: %s: objsz=%zu inuse=%zu peak=%zu capacity=%zu bytes=%zu allocs=%llu failed=%llu",
+                  stats.name,
+                  stats.objsz,
+                  stats.inuse,
+                  stats.peak,
+                  stats.capacity,
+                  stats.bytes,
+                  (unsigned long long)stats.nalloc,
+                  (unsigned long long)stats.nfail);
+    }
+}
+
+/*
+ * ===========================================================================
+ *  Arenas
+ * ===========================================================================
+ */
+
+void mem_arena_init(mem_arena_t *arena, size_t chunk_sz)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->ma_chunk_sz = chunk_sz;
+}
+
+void mem_arena_fini(mem_arena_t *arena)
+{
+    mem_arena_chunk_t *chunk;
+
+    while ((chunk = arena->ma_head) != NULL)
+    {
+        arena->ma_head = chunk->mac_prev;
+        free(chunk);
+    }
+
+    arena->ma_used = 0;
+}
+
+void *mem_arena_alloc(mem_arena_t *arena, size_t size)
+{
+    mem_arena_chunk_t *chunk = arena->ma_head;
+    size_t chunk_sz;
+    void *ptr;
+
+    size = MEM_POOL_ALIGN_UP(size == 0 ? 1 : size);
+
+    if (chunk == NULL || chunk->mac_off + size > chunk->mac_size)
+    {
+        /* Oversized allocations get a chunk of their own */
+        chunk_sz = arena->ma_chunk_sz;
+        if (chunk_sz < size) chunk_sz = size;
+
+        chunk = malloc(MEM_ARENA_CHUNK_HDR + chunk_sz);
+        if (chunk == NULL) return NULL;
+
+        chunk->mac_prev = arena->ma_head;
+        chunk->mac_size = chunk_sz;
+        chunk->mac_off = 0;
+        arena->ma_head = chunk;
+    }
+
+    ptr = (char *)chunk + MEM_ARENA_CHUNK_HDR + chunk->mac_off;
+    chunk->mac_off += size;
+
+    arena->ma_used += size;
+    if (arena->ma_used > arena->ma_peak) arena->ma_peak = arena->ma_used;
+
+    return ptr;
+}
+
+void *mem_arena_zalloc(mem_arena_t *arena, size_t size)
+{
+    void *ptr;
+
+    ptr = mem_arena_alloc(arena, size);
+    if (ptr != NULL) memset(ptr, 0, size);
+
+    return ptr;
+}
+
+char *mem_arena_strdup(mem_arena_t *arena, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *ptr;
+
+    ptr = mem_arena_alloc(arena, len);
+    if (ptr != NULL) memcpy(ptr, str, len);
+
+    return ptr;
+}
+
+mem_arena_mark_t mem_arena_mark(mem_arena_t *arena)
+{
+    mem_arena_mark_t mark;
+
+    mark.am_chunk = arena->ma_head;
+    mark.am_off = (arena->ma_head != NULL) ? arena->ma_head->mac_off : 0;
+    mark.am_used = arena->ma_used;
+
+    return mark;
+}
+
+void mem_arena_rewind(mem_arena_t *arena, mem_arena_mark_t mark)
+{
+    mem_arena_chunk_t *chunk;
+
+    /* Mark taken on an empty arena */
+    if (mark.am_chunk == NULL)
+    {
+        mem_arena_reset(arena);
+        return;
+    }
+
+    while ((chunk = arena->ma_head) != NULL && chunk != mark.am_chunk)
+    {
+        arena->ma_head = chunk->mac_prev;
+        free(chunk);
+    }
+
+    if (arena->ma_head == NULL) return;
+
+    arena->ma_head->mac_off = mark.am_off;
+    arena->ma_used = mark.am_used;
+}
+
+void mem_arena_reset(mem_arena_t *arena)
+{
+    mem_arena_chunk_t *keep = NULL;
+    mem_arena_chunk_t *chunk;
+
+    /*
+     * Keep the oldest chunk that an oversized allocation did not inflate, so
+     * the same chunk is reused from one reset to the next
+     */
+    for (chunk = arena->ma_head; chunk != NULL; chunk = chunk->mac_prev)
+    {
+        if (chunk->mac_size <= arena->ma_chunk_sz) keep = chunk;
+    }
+
+    while ((chunk = arena->ma_head) != NULL)
+    {
+        arena->ma_head = chunk->mac_prev;
+        if (chunk != keep) free(chunk);
+    }
+
+    if (keep != NULL)
+    {
+        keep->mac_prev = NULL;
+        keep->mac_off = 0;
+    }
+
+    arena->ma_head = keep;
+    arena->ma_used = 0;
+}
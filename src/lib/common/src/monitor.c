@@ -36,7 +36,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <string.h>
 
 #include "log.h"
 #include "os.h"
@@ -198,6 +200,76 @@ void mon_start(int argc, char *argv[])
     exit(exit_status);
 }
 
+/**
+ * Return the readiness pipe passed down by DM, or -1
+ */
+static int mon_ready_fd(void)
+{
+    const char *env;
+    int fd;
+
+    env = getenv(MON_READY_FD_ENV);
+    if (env == NULL) return -1;
+
+    fd = atoi(env);
+
+    /* Never touch stdin, stdout or stderr */
+    if (fd <= 2) return -1;
+
+    return fd;
+}
+
+/**
+ * Keep the readiness pipe out of the daemons a manager forks before it
+ * signals readiness (dnsmasq, udhcpc, ...). Runs at startup, before main().
+ */
+static void __attribute__((constructor)) mon_ready_fd_cloexec(void)
+{
+    int fd;
+
+    fd = mon_ready_fd();
+    if (fd < 0) return;
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)
+    {
+        /* Not a valid descriptor, forget about it */
+        unsetenv(MON_READY_FD_ENV);
+    }
+}
+
+/**
+ * Notify the parent (DM) that the process is fully initialized.
+ *
+ * DM passes the write end of a pipe in the MON_READY_FD_ENV environment
+ * variable; managers that depend on this process are started as soon as
+ * something is written to it. Safe to call when not started by DM.
+ */
+void mon_notify_ready(void)
+{
+    struct sigaction sa_ign;
+    struct sigaction sa_old;
+    int fd;
+
+    fd = mon_ready_fd();
+    unsetenv(MON_READY_FD_ENV);
+    if (fd < 0) return;
+
+    /* DM may be gone or restarting, a closed pipe must not kill us */
+    memset(&sa_ign, 0, sizeof(sa_ign));
+    sa_ign.sa_handler = SIG_IGN;
+    sigemptyset(&sa_ign.sa_mask);
+    sigaction(SIGPIPE, &sa_ign, &sa_old);
+
+    if (write(fd, "READY\n", strlen("READY\n")) < 0)
+    {
+        LOG(DEBUG, "Error sending readiness notification: %s", strerror(errno));
+    }
+
+    sigaction(SIGPIPE, &sa_old, NULL);
+
+    close(fd);
+}
+
 /**
  * Wait for a process or process group to terminate, this function works on any process not just direct descendants.
  *
@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "monitor.h"
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "monitor_tests";
+
+/* Re-executed to check the readiness pipe as seen before main() */
+#define TEST_CLOEXEC_ARG    "--cloexec-child"
+
+static const char *test_argv0;
+static int test_pipe[2];
+
+static void test_ready_fd_set(int fd)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%d", fd);
+    TEST_ASSERT_EQUAL_INT(0, setenv(MON_READY_FD_ENV, buf, 1));
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, pipe(test_pipe));
+    /* Reads below must never block the test */
+    fcntl(test_pipe[0], F_SETFL, O_NONBLOCK);
+}
+
+void tearDown(void)
+{
+    unsetenv(MON_READY_FD_ENV);
+    if (test_pipe[0] >= 0) close(test_pipe[0]);
+    if (fcntl(test_pipe[1], F_GETFD) >= 0) close(test_pipe[1]);
+}
+
+/* The notification is written to the pipe, which is then closed */
+void test_notify_ready(void)
+{
+    char buf[16];
+
+    test_ready_fd_set(test_pipe[1]);
+    mon_notify_ready();
+
+    memset(buf, 0, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(strlen("READY\n"), read(test_pipe[0], buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("READY\n", buf);
+
+    TEST_ASSERT_NULL(getenv(MON_READY_FD_ENV));
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(test_pipe[1], F_GETFD));
+    TEST_ASSERT_EQUAL_INT(EBADF, errno);
+
+    /* End of file, nothing more is written */
+    TEST_ASSERT_EQUAL_INT(0, read(test_pipe[0], buf, sizeof(buf)));
+
+    /* Only the first call notifies */
+    close(test_pipe[0]);
+    setUp();
+    mon_notify_ready();
+    TEST_ASSERT_EQUAL_INT(-1, read(test_pipe[0], buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_INT(EAGAIN, errno);
+}
+
+/* Without a reader the notification must not raise SIGPIPE */
+void test_notify_ready_no_reader(void)
+{
+    struct sigaction sa;
+
+    close(test_pipe[0]);
+    test_pipe[0] = -1;
+
+    test_ready_fd_set(test_pipe[1]);
+    mon_notify_ready();
+
+    /* Still alive, and the default disposition is back */
+    TEST_ASSERT_EQUAL_INT(0, sigaction(SIGPIPE, NULL, &sa));
+    TEST_ASSERT_TRUE(sa.sa_handler == SIG_DFL);
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(test_pipe[1], F_GETFD));
+}
+
+/* Standard descriptors and garbage are never written to or closed */
+void test_notify_ready_invalid_fd(void)
+{
+    test_ready_fd_set(STDOUT_FILENO);
+    mon_notify_ready();
+    TEST_ASSERT_TRUE(fcntl(STDOUT_FILENO, F_GETFD) >= 0);
+
+    TEST_ASSERT_EQUAL_INT(0, setenv(MON_READY_FD_ENV, "garbage", 1));
+    mon_notify_ready();
+    TEST_ASSERT_TRUE(fcntl(STDIN_FILENO, F_GETFD) >= 0);
+
+    /* Not started by DM */
+    mon_notify_ready();
+}
+
+/* The pipe is close-on-exec from startup on, before mon_notify_ready() */
+void test_ready_fd_cloexec(void)
+{
+    int status;
+    pid_t pid;
+
+    /* Inherited across this exec, but not across the ones of the child */
+    fcntl(test_pipe[1], F_SETFD, 0);
+
+    pid = fork();
+    TEST_ASSERT_TRUE(pid >= 0);
+    if (pid == 0)
+    {
+        test_ready_fd_set(test_pipe[1]);
+        execl(test_argv0, test_argv0, TEST_CLOEXEC_ARG, NULL);
+        _exit(127);
+    }
+
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+}
+
+/* Child side of test_ready_fd_cloexec() */
+static int test_cloexec_child(void)
+{
+    const char *env;
+    int flags;
+
+    env = getenv(MON_READY_FD_ENV);
+    if (env == NULL) return 1;
+
+    flags = fcntl(atoi(env), F_GETFD);
+    if (flags < 0 || !(flags & FD_CLOEXEC)) return 2;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], TEST_CLOEXEC_ARG) == 0)
+    {
+        return test_cloexec_child();
+    }
+
+    test_argv0 = argv[0];
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_notify_ready);
+    RUN_TEST(test_notify_ready_no_reader);
+    RUN_TEST(test_notify_ready_invalid_fd);
+    RUN_TEST(test_ready_fd_cloexec);
+
+    return UNITY_END();
+}
@@ -0,0 +1,303 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem_pool.h"
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "mem_pool_tests";
+
+#define TEST_CYCLES         (4 * 1000 * 1000)
+#define TEST_LIVE_MAX       4096
+#define TEST_SLAB_OBJS      64
+
+struct test_obj
+{
+    uint64_t            id;
+    char                payload[40];
+};
+
+/* Number of objects on the freelist of @p pool */
+static size_t test_free_len(mem_pool_t *pool)
+{
+    size_t len = 0;
+    void *obj;
+
+    for (obj = pool->mp_free; obj != NULL; obj = *(void **)obj) len++;
+
+    return len;
+}
+
+/* Small xorshift generator, rand() is too slow and not reentrant */
+static uint32_t test_rand(void)
+{
+    static uint32_t x = 2463534242u;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return x;
+}
+
+/**
+ * @brief setUp() is called by the Unity framework before each test
+ */
+void
+setUp(void)
+{
+    return;
+}
+
+/**
+ * @brief tearDown() is called by the Unity framework after each test
+ */
+void
+tearDown(void)
+{
+    return;
+}
+
+/**
+ * @brief objects are zeroed, reused and the cap is honoured
+ */
+void
+test_mem_pool_basic(void)
+{
+    mem_pool_t pool = MEM_POOL_INIT("test_basic", struct test_obj, 4, 10);
+    struct test_obj *objs[10];
+    mem_pool_stats_t stats;
+    struct test_obj *obj;
+    int ii;
+
+    for (ii = 0; ii < 10; ii++)
+    {
+        objs[ii] = mem_pool_alloc(&pool);
+        TEST_ASSERT_NOT_NULL(objs[ii]);
+        TEST_ASSERT_EQUAL_INT(0, ((uintptr_t)objs[ii]) % MEM_POOL_ALIGN);
+        TEST_ASSERT_EQUAL_UINT64(0, objs[ii]->id);
+        objs[ii]->id = ii + 1;
+    }
+
+    /* Cap reached */
+    TEST_ASSERT_NULL(mem_pool_alloc(&pool));
+
+    mem_pool_free(&pool, objs[3]);
+    obj = mem_pool_alloc(&pool);
+    TEST_ASSERT_EQUAL_PTR(objs[3], obj);
+    TEST_ASSERT_EQUAL_UINT64(0, obj->id);
+
+    mem_pool_stats_get(&pool, &stats);
+    TEST_ASSERT_EQUAL_INT(10, stats.inuse);
+    TEST_ASSERT_EQUAL_INT(10, stats.peak);
+    TEST_ASSERT_EQUAL_INT(10, stats.capacity);
+    TEST_ASSERT_EQUAL_UINT64(11, stats.nalloc);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.nfail);
+
+    TEST_ASSERT_EQUAL_PTR(&pool, mem_pool_first());
+    mem_pool_stats_log();
+
+    for (ii = 0; ii < 10; ii++)
+    {
+        mem_pool_free(&pool, objs[ii]);
+    }
+    mem_pool_fini(&pool);
+    TEST_ASSERT_NULL(mem_pool_first());
+}
+
+/**
+ * @brief arena allocations, marks and resets
+ */
+void
+test_mem_arena_basic(void)
+{
+    mem_arena_t arena = MEM_ARENA_INIT(256);
+    mem_arena_mark_t mark;
+    char *big;
+    char *str;
+    void *ptr;
+    int ii;
+
+    str = mem_arena_strdup(&arena, "hello");
+    TEST_ASSERT_EQUAL_STRING("hello", str);
+
+    mark = mem_arena_mark(&arena);
+
+    /* Spill over into new chunks, including an oversized one */
+    for (ii = 0; ii < 100; ii++)
+    {
+        ptr = mem_arena_zalloc(&arena, 24);
+        TEST_ASSERT_NOT_NULL(ptr);
+        TEST_ASSERT_EQUAL_INT(0, ((uintptr_t)ptr) % MEM_POOL_ALIGN);
+    }
+    big = mem_arena_alloc(&arena, 4096);
+    TEST_ASSERT_NOT_NULL(big);
+    memset(big, 0xaa, 4096);
+
+    mem_arena_rewind(&arena, mark);
+    TEST_ASSERT_EQUAL_STRING("hello", str);
+    TEST_ASSERT_EQUAL_PTR(mark.am_chunk, arena.ma_head);
+    TEST_ASSERT_EQUAL_INT(mark.am_used, arena.ma_used);
+
+    mem_arena_reset(&arena);
+    TEST_ASSERT_NOT_NULL(arena.ma_head);
+    TEST_ASSERT_EQUAL_INT(0, arena.ma_used);
+
+    mem_arena_fini(&arena);
+    TEST_ASSERT_NULL(arena.ma_head);
+}
+
+/**
+ * @brief an arena reset after an oversized allocation does not keep the
+ * oversized chunk
+ */
+void
+test_mem_arena_reset_oversized(void)
+{
+    mem_arena_t arena = MEM_ARENA_INIT(256);
+    mem_arena_chunk_t *chunk;
+    mem_arena_mark_t mark;
+
+    /* Oversized first chunk only */
+    TEST_ASSERT_NOT_NULL(mem_arena_alloc(&arena, 64 * 1024));
+    mem_arena_reset(&arena);
+    TEST_ASSERT_NULL(arena.ma_head);
+
+    /* Oversized first chunk followed by a regular one, which is kept */
+    TEST_ASSERT_NOT_NULL(mem_arena_alloc(&arena, 64 * 1024));
+    TEST_ASSERT_NOT_NULL(mem_arena_alloc(&arena, 16));
+    chunk = arena.ma_head;
+    mem_arena_reset(&arena);
+    TEST_ASSERT_EQUAL_PTR(chunk, arena.ma_head);
+    TEST_ASSERT_EQUAL_INT(0, arena.ma_used);
+
+    /* Reused from its start, without new chunks */
+    mark = mem_arena_mark(&arena);
+    TEST_ASSERT_EQUAL_INT(0, mark.am_off);
+    TEST_ASSERT_NOT_NULL(mem_arena_alloc(&arena, 200));
+    TEST_ASSERT_EQUAL_PTR(chunk, arena.ma_head);
+
+    mem_arena_fini(&arena);
+}
+
+/**
+ * @brief millions of random alloc/free cycles are served from the slabs
+ * allocated for the peak working set, and arena resets reuse one chunk
+ */
+void
+test_mem_pool_stress(void)
+{
+    mem_pool_t pool = MEM_POOL_INIT("test_stress", struct test_obj, TEST_SLAB_OBJS, 0);
+    mem_arena_t arena = MEM_ARENA_INIT(4096);
+    mem_arena_chunk_t *chunk = NULL;
+    struct test_obj **live;
+    mem_pool_stats_t stats;
+    size_t nslabs = 0;
+    uint32_t slot;
+    int ii;
+    int jj;
+
+    live = calloc(TEST_LIVE_MAX, sizeof(*live));
+    TEST_ASSERT_NOT_NULL(live);
+
+    for (ii = 0; ii < TEST_CYCLES; ii++)
+    {
+        /* Replace a random live object */
+        slot = test_rand() % TEST_LIVE_MAX;
+        mem_pool_free(&pool, live[slot]);
+        live[slot] = mem_pool_alloc(&pool);
+        TEST_ASSERT_NOT_NULL(live[slot]);
+        live[slot]->id = ii;
+
+        /* Per "report" scratch memory of varying size, up to 2 chunks */
+        if ((ii % 1000) == 0)
+        {
+            for (jj = test_rand() % 50; jj > 0; jj--)
+            {
+                TEST_ASSERT_NOT_NULL(mem_arena_alloc(&arena, 16 + test_rand() % 128));
+            }
+            mem_arena_reset(&arena);
+
+            /* The same chunk is kept once there is one */
+            if (chunk != NULL) TEST_ASSERT_EQUAL_PTR(chunk, arena.ma_head);
+            chunk = arena.ma_head;
+        }
+
+        if (ii == TEST_CYCLES / 10)
+        {
+            /* Every slot holds an object by now */
+            TEST_ASSERT_EQUAL_INT(TEST_LIVE_MAX, pool.mp_inuse);
+            nslabs = pool.mp_nslabs;
+        }
+    }
+
+    mem_pool_stats_get(&pool, &stats);
+    LOGI("%s: cycles=%d slabs=%zu", __func__, TEST_CYCLES, pool.mp_nslabs);
+    mem_pool_stats_log();
+
+    /* Objects were reused, no slab was added past the peak working set */
+    TEST_ASSERT_EQUAL_INT(TEST_LIVE_MAX / TEST_SLAB_OBJS, nslabs);
+    TEST_ASSERT_EQUAL_INT(nslabs, pool.mp_nslabs);
+    TEST_ASSERT_EQUAL_INT(TEST_LIVE_MAX, stats.peak);
+    TEST_ASSERT_EQUAL_UINT64(TEST_CYCLES, stats.nalloc);
+    TEST_ASSERT_EQUAL_INT(stats.capacity - stats.inuse, test_free_len(&pool));
+
+    for (ii = 0; ii < TEST_LIVE_MAX; ii++)
+    {
+        mem_pool_free(&pool, live[ii]);
+    }
+    free(live);
+
+    /* Every object is back on the freelist exactly once */
+    TEST_ASSERT_EQUAL_INT(stats.capacity, test_free_len(&pool));
+
+    mem_pool_fini(&pool);
+    mem_arena_fini(&arena);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_mem_pool_basic);
+    RUN_TEST(test_mem_arena_basic);
+    RUN_TEST(test_mem_arena_reset_oversized);
+    RUN_TEST(test_mem_pool_stress);
+
+    return UNITY_END();
+}
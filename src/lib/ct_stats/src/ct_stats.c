@@ -68,7 +68,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 static struct imc_context g_imc_server =
 {
     .initialized = false,
-    .endpoint = "ipc:///tmp/imc_fsm2fcm",
+    .endpoint = IMC_FSM2FCM_ENDPOINT,
 };
 
 
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ds.h"
 #include "ds_dlist.h"
 #include "log.h"
+#include "metrics.h"
 #include "opensync_stats.pb-c.h"
 
 #include "dpp_client.h"
@@ -172,6 +173,13 @@ typedef struct dpp_stats
 /* Internal variables */
 ds_dlist_t  g_dppline_list; /* double linked list used to hold stats queue */
 
+/* Self-measurement */
+static metrics_t dppline_metrics_queue_depth = METRICS_GAUGE_INIT("dpp.queue_depth");
+static metrics_t dppline_metrics_queue_bytes = METRICS_GAUGE_INIT("dpp.queue_bytes");
+static metrics_t dppline_metrics_dropped = METRICS_COUNTER_INIT("dpp.dropped");
+static metrics_t dppline_metrics_report_us = METRICS_HIST_INIT("dpp.report_build_us");
+static metrics_t dppline_metrics_report_bytes = METRICS_COUNTER_INIT("dpp.report_bytes");
+
 /* private functions    */
 static dppline_stats_t * dpp_alloc_stat()
 {
@@ -1918,6 +1926,9 @@ bool dppline_remove_head()
 void dppline_log_queue()
 {
     LOGT( "Q len: %d size: %d\n", queue_depth, queue_size );
+
+    metrics_gauge_set(&dppline_metrics_queue_depth, queue_depth);
+    metrics_gauge_set(&dppline_metrics_queue_bytes, queue_size);
 }
 
 /*
@@ -1960,6 +1971,7 @@ static bool dppline_put(DPP_STS_TYPE type, void * rpt)
                 queue_depth, DPP_MAX_QUEUE_DEPTH,
                 queue_size, DPP_MAX_QUEUE_SIZE_BYTES);
         dppline_remove_head();
+        metrics_counter_inc(&dppline_metrics_dropped);
     }
 
     dppline_log_queue();
@@ -2048,6 +2060,7 @@ bool dpp_get_report(uint8_t * buff, size_t sz, uint32_t * packed_sz)
     dppline_stats_t *s;
     bool ret = false;
     size_t tmp_packed_size; /* packed size of current report */
+    uint64_t t0;
 
     /* prevent sending empty reports */
     if (dpp_get_queue_elements() == 0)
@@ -2063,6 +2076,8 @@ bool dpp_get_report(uint8_t * buff, size_t sz, uint32_t * packed_sz)
         return false;
     }
 
+    t0 = metrics_clock();
+
     /* initialize report structure. Note - it has to be on heap,
      * otherwise __free_unpacked function fails
      */
@@ -2121,6 +2136,12 @@ bool dpp_get_report(uint8_t * buff, size_t sz, uint32_t * packed_sz)
     sts__report__free_unpacked(report, NULL);
     dppline_log_queue();
 
+    if (ret)
+    {
+        metrics_hist_since(&dppline_metrics_report_us, t0);
+        metrics_counter_add(&dppline_metrics_report_bytes, *packed_sz);
+    }
+
     return ret;
 }
 #else
@@ -2132,6 +2153,7 @@ bool dpp_get_report2(uint8_t **pbuff, size_t suggest_sz, uint32_t *packed_sz)
     size_t packed_size; // packed size of current report
     size_t unpacked_size = 0; // unpacked size of current report
     uint8_t *buff;
+    uint64_t t0;
 
     // prevent sending empty reports
     if (dpp_get_queue_elements() == 0)
@@ -2147,6 +2169,8 @@ bool dpp_get_report2(uint8_t **pbuff, size_t suggest_sz, uint32_t *packed_sz)
         return false;
     }
 
+    t0 = metrics_clock();
+
     buff = malloc(suggest_sz);
     if (NULL == buff)
     {
@@ -2225,6 +2249,9 @@ bool dpp_get_report2(uint8_t **pbuff, size_t suggest_sz, uint32_t *packed_sz)
     // debug
     dppline_log_queue();
 
+    metrics_hist_since(&dppline_metrics_report_us, t0);
+    metrics_counter_add(&dppline_metrics_report_bytes, *packed_sz);
+
     return ret;
 }
 #endif
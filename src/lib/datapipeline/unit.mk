@@ -43,4 +43,5 @@ UNIT_EXPORT_LDFLAGS := -lprotobuf-c
 UNIT_DEPS := src/lib/ds
 UNIT_DEPS += src/lib/osa
 UNIT_DEPS += src/lib/common
+UNIT_DEPS += src/lib/metrics
 
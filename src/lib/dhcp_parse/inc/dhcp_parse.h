@@ -115,10 +115,39 @@ struct dhcp_session
     size_t                  num_local_domains;
 };
 
+/*
+ * DHCP_leased_IP rows are updated in batches: lease changes are recorded
+ * in this table, keyed by (hwaddr, inet_addr), and flushed to OVSDB as a
+ * single asynchronous transaction.
+ */
+#define DHCP_LEASE_FLUSH_INTERVAL   1.0     // seconds
+#define DHCP_LEASE_FLUSH_MAX        64      // pending rows forcing a flush
+#define DHCP_LEASE_EXPIRY_MARGIN    300     // seconds kept past the lease end
+
+enum dhcp_lease_op
+{
+    DHCP_LEASE_OP_NONE = 0,
+    DHCP_LEASE_OP_UPSERT,
+    DHCP_LEASE_OP_DELETE,
+};
+
+struct dhcp_ovsdb_lease
+{
+    struct schema_DHCP_leased_IP    dlip;       // hwaddr is lower case
+    enum dhcp_lease_op              op;         // pending operation
+    bool                            in_ovsdb;   // row written by us
+    time_t                          expires;    // lease end plus margin
+    ds_tree_node_t                  ovsdb_node;
+};
+
 struct dhcp_parse_mgr
 {
     bool                    initialized;
     ds_tree_t               fsm_sessions;
+    ds_tree_t               ovsdb_leases;
+    size_t                  ovsdb_pending;
+    struct ev_loop          *loop;
+    ev_timer                ovsdb_timer;
 };
 
 struct dhcp_local_domain
@@ -155,5 +184,7 @@ void        dhcp_process_message(struct dhcp_session *d_session);
 bool        dp_fingerprint_to_str(uint8_t *fingerprint, char *s, size_t sz);
 bool        dhcp_lease_update_table(struct dhcp_session *d_session,
                                     struct schema_DHCP_leased_IP *dlip);
+void        dhcp_lease_flush_table(void);
+void        dhcp_lease_expire(time_t now);
 
 #endif /* DHCP_PARSE_H_INCLUDED */
@@ -601,12 +601,342 @@ bool dp_fingerprint_to_str(uint8_t *finger, char *s, size_t sz)
  * OVSDB Table Sync for DHCP_leased_IP
  */
 
+static int dhcp_ovsdb_lease_cmp(void *a, void *b)
+{
+    struct schema_DHCP_leased_IP *dlip_a = a;
+    struct schema_DHCP_leased_IP *dlip_b = b;
+    int cmp;
+
+    cmp = strcmp(dlip_a->hwaddr, dlip_b->hwaddr);
+    if (cmp != 0) return cmp;
+
+    return strcmp(dlip_a->inet_addr, dlip_b->inet_addr);
+}
+
+static json_t *dhcp_lease_where(struct schema_DHCP_leased_IP *dlip)
+{
+    json_t  *where;
+    json_t  *cond;
+
+    // OVSDB transaction where multi condition
+    where = json_array();
+
+    cond = ovsdb_tran_cond_single("hwaddr", OFUNC_EQ, dlip->hwaddr);
+    json_array_append_new(where, cond);
+
+    cond = ovsdb_tran_cond_single("inet_addr", OFUNC_EQ, dlip->inet_addr);
+    json_array_append_new(where, cond);
+
+    return where;
+}
+
+/*
+ * Rows updated in place by a DHCP_leased_IP transaction, used to check the
+ * per-operation "count" of the reply
+ */
+struct dhcp_lease_flush_ctx
+{
+    size_t  nupdates;
+    struct
+    {
+        size_t  op;     // index of the update operation in the transaction
+        char    hwaddr[sizeof(((struct schema_DHCP_leased_IP *)0)->hwaddr)];
+        char    inet_addr[sizeof(((struct schema_DHCP_leased_IP *)0)->inet_addr)];
+    } updates[DHCP_LEASE_FLUSH_MAX];
+};
+
+static void dhcp_lease_schedule_flush(struct dhcp_parse_mgr *mgr)
+{
+    if (mgr->ovsdb_pending >= DHCP_LEASE_FLUSH_MAX)
+    {
+        dhcp_lease_flush_table();
+    }
+    else if (mgr->loop != NULL && !ev_is_active(&mgr->ovsdb_timer))
+    {
+        ev_timer_set(&mgr->ovsdb_timer, DHCP_LEASE_FLUSH_INTERVAL, 0.);
+        ev_timer_start(mgr->loop, &mgr->ovsdb_timer);
+    }
+}
+
+/*
+ * An update that matched no row means the row was deleted behind our back;
+ * write the lease again with delete + insert
+ */
+static void dhcp_lease_check_updates(struct dhcp_lease_flush_ctx *ctx, json_t *js)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_ovsdb_lease *entry;
+    struct schema_DHCP_leased_IP key;
+    json_t                  *jcount;
+    bool                    requeued = false;
+    size_t                  i;
+
+    for (i = 0; i < ctx->nupdates; i++)
+    {
+        jcount = json_object_get(json_array_get(js, ctx->updates[i].op), "count");
+        if (!json_is_integer(jcount) || json_integer_value(jcount) != 0) continue;
+
+        memset(&key, 0, sizeof(key));
+        STRSCPY(key.hwaddr, ctx->updates[i].hwaddr);
+        STRSCPY(key.inet_addr, ctx->updates[i].inet_addr);
+
+        entry = ds_tree_find(&mgr->ovsdb_leases, &key);
+        if (entry == NULL) continue;
+
+        LOGN("DHCP lease '%s' '%s' missing from OVSDB, re-inserting",
+             key.hwaddr, key.inet_addr);
+
+        entry->in_ovsdb = false;
+        if (entry->op != DHCP_LEASE_OP_NONE) continue;
+
+        entry->op = DHCP_LEASE_OP_UPSERT;
+        mgr->ovsdb_pending++;
+        requeued = true;
+    }
+
+    if (requeued) dhcp_lease_schedule_flush(mgr);
+}
+
+static void dhcp_lease_flush_cb(int id, bool is_error, json_t *js, void *data)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_lease_flush_ctx *ctx = data;
+    struct dhcp_ovsdb_lease *entry;
+    ds_tree_iter_t          iter;
+    json_t                  *res;
+    size_t                  i;
+
+    (void)id;
+
+    if (!is_error && json_is_array(js))
+    {
+        json_array_foreach(js, i, res)
+        {
+            if (json_object_get(res, "error") != NULL)
+            {
+                is_error = true;
+                break;
+            }
+        }
+    }
+
+    if (!is_error)
+    {
+        if (ctx != NULL) dhcp_lease_check_updates(ctx, js);
+        free(ctx);
+        return;
+    }
+
+    free(ctx);
+
+    LOGE("%s: DHCP_leased_IP transaction failed", __func__);
+
+    /*
+     * Rows are in an unknown state. Idle entries are evicted, they are
+     * rewritten (delete + insert) on their next lease update.
+     */
+    for (entry = ds_tree_ifirst(&iter, &mgr->ovsdb_leases);
+         entry != NULL;
+         entry = ds_tree_inext(&iter))
+    {
+        entry->in_ovsdb = false;
+        if (entry->op != DHCP_LEASE_OP_NONE) continue;
+
+        ds_tree_iremove(&iter);
+        free(entry);
+    }
+}
+
+/*
+ * Build the transaction for the pending DHCP_leased_IP changes. Rows not
+ * known to be written by us are replaced (delete + insert) so that stale
+ * rows left by a previous instance are cleaned up. In-place updates are
+ * recorded in ctx (may be NULL) for the reply check.
+ */
+static json_t *dhcp_lease_build_trans(struct dhcp_lease_flush_ctx *ctx)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_ovsdb_lease *entry;
+    ds_tree_iter_t          iter;
+    pjs_errmsg_t            perr;
+    json_t                  *trans = NULL;
+    json_t                  *row;
+    size_t                  nops = 0;
+
+    for (entry = ds_tree_ifirst(&iter, &mgr->ovsdb_leases);
+         entry != NULL;
+         entry = ds_tree_inext(&iter))
+    {
+        struct schema_DHCP_leased_IP *dlip = &entry->dlip;
+
+        switch (entry->op)
+        {
+            case DHCP_LEASE_OP_DELETE:
+                // Released or expired lease... remove from OVSDB
+                trans = ovsdb_tran_multi(trans, NULL, OVSDB_DHCP_TABLE,
+                                         OTR_DELETE, dhcp_lease_where(dlip),
+                                         NULL);
+                nops++;
+
+                LOGN("Removed DHCP lease '%s' with '%s' '%s' '%d'",
+                     dlip->hwaddr, dlip->inet_addr, dlip->hostname,
+                     dlip->lease_time);
+
+                ds_tree_iremove(&iter);
+                free(entry);
+                continue;
+
+            case DHCP_LEASE_OP_UPSERT:
+                // New/active lease, upsert it into OVSDB
+                row = schema_DHCP_leased_IP_to_json(dlip, perr);
+                if (row == NULL)
+                {
+                    LOGE("Updating DHCP lease %s (Failed to convert entry)",
+                         dlip->hwaddr);
+
+                    // Nothing of ours in OVSDB to keep track of
+                    if (!entry->in_ovsdb)
+                    {
+                        ds_tree_iremove(&iter);
+                        free(entry);
+                        continue;
+                    }
+                    break;
+                }
+
+                if (entry->in_ovsdb)
+                {
+                    trans = ovsdb_tran_multi(trans, NULL, OVSDB_DHCP_TABLE,
+                                             OTR_UPDATE, dhcp_lease_where(dlip),
+                                             row);
+
+                    if (ctx != NULL && ctx->nupdates < ARRAY_SIZE(ctx->updates))
+                    {
+                        ctx->updates[ctx->nupdates].op = nops;
+                        STRSCPY(ctx->updates[ctx->nupdates].hwaddr, dlip->hwaddr);
+                        STRSCPY(ctx->updates[ctx->nupdates].inet_addr, dlip->inet_addr);
+                        ctx->nupdates++;
+                    }
+                    nops++;
+                }
+                else
+                {
+                    trans = ovsdb_tran_multi(trans, NULL, OVSDB_DHCP_TABLE,
+                                             OTR_DELETE, dhcp_lease_where(dlip),
+                                             NULL);
+                    trans = ovsdb_tran_multi(trans, NULL, OVSDB_DHCP_TABLE,
+                                             OTR_INSERT, NULL, row);
+                    nops += 2;
+                    entry->in_ovsdb = true;
+                }
+
+                LOGN("Updated DHCP lease '%s' with '%s' '%s' '%d'",
+                     dlip->hwaddr, dlip->inet_addr, dlip->hostname,
+                     dlip->lease_time);
+                break;
+
+            default:
+                break;
+        }
+
+        entry->op = DHCP_LEASE_OP_NONE;
+    }
+
+    LOGD("%s: flushing %zu DHCP_leased_IP changes", __func__,
+         mgr->ovsdb_pending);
+    mgr->ovsdb_pending = 0;
+
+    return trans;
+}
+
+/**
+ * @brief send the pending DHCP_leased_IP changes to OVSDB
+ *
+ * All pending changes are sent as one asynchronous transaction.
+ */
+void dhcp_lease_flush_table(void)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_lease_flush_ctx *ctx;
+    json_t                  *trans;
+
+    if (mgr->loop != NULL) ev_timer_stop(mgr->loop, &mgr->ovsdb_timer);
+    if (mgr->ovsdb_pending == 0) return;
+
+    ctx = calloc(1, sizeof(*ctx));
+
+    trans = dhcp_lease_build_trans(ctx);
+    if (trans == NULL)
+    {
+        free(ctx);
+        return;
+    }
+
+    if (!ovsdb_method_send(dhcp_lease_flush_cb, ctx, MT_TRANS, trans))
+    {
+        LOGE("%s: failed to send DHCP_leased_IP transaction", __func__);
+        free(ctx);
+    }
+}
+
+static void dhcp_lease_timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    (void)loop;
+    (void)w;
+    (void)revents;
+
+    dhcp_lease_flush_table();
+}
+
+/*
+ * The plugin is about to be unloaded: no reply may reach dhcp_lease_flush_cb()
+ * anymore, so earlier transactions are forgotten and the last changes are
+ * written synchronously.
+ */
+static void dhcp_lease_free_table(void)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_ovsdb_lease *entry;
+    ds_tree_iter_t          iter;
+    json_t                  *trans;
+    json_t                  *resp;
+
+    if (mgr->loop != NULL) ev_timer_stop(mgr->loop, &mgr->ovsdb_timer);
+    ovsdb_method_cancel(dhcp_lease_flush_cb, free);
+
+    if (mgr->ovsdb_pending != 0)
+    {
+        trans = dhcp_lease_build_trans(NULL);
+        if (trans != NULL)
+        {
+            resp = ovsdb_method_send_s(MT_TRANS, trans);
+            if (resp == NULL) LOGE("%s: failed to send DHCP_leased_IP transaction", __func__);
+            json_decref(resp);
+        }
+    }
+
+    for (entry = ds_tree_ifirst(&iter, &mgr->ovsdb_leases);
+         entry != NULL;
+         entry = ds_tree_inext(&iter))
+    {
+        ds_tree_iremove(&iter);
+        free(entry);
+    }
+}
+
+/**
+ * @brief record a lease change for the DHCP_leased_IP table
+ *
+ * The change is applied to the in-memory lease table only. Repeated
+ * changes to the same (hwaddr, inet_addr) row are merged, and the table
+ * is flushed to OVSDB periodically.
+ */
 bool dhcp_lease_update_table(struct dhcp_session *d_session,
                              struct schema_DHCP_leased_IP *dlip)
 {
-    pjs_errmsg_t    perr;
-    json_t          *where, *row, *cond;
-    bool            ret;
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_ovsdb_lease *entry;
+    struct schema_DHCP_leased_IP key;
     char            *update_ovsdb = NULL;
     int             val;
     bool            update = false;
@@ -638,42 +968,35 @@ bool dhcp_lease_update_table(struct dhcp_session *d_session,
         return false;
     }
 
-    // OVSDB transaction where multi condition
-    where = json_array();
-
-    cond = ovsdb_tran_cond_single("hwaddr", OFUNC_EQ, str_tolower(dlip->hwaddr));
-    json_array_append_new(where, cond);
-
-    cond = ovsdb_tran_cond_single("inet_addr", OFUNC_EQ, dlip->inet_addr);
-    json_array_append_new(where, cond);
+    memset(&key, 0, sizeof(key));
+    STRSCPY(key.hwaddr, dlip->hwaddr);
+    str_tolower(key.hwaddr);
+    STRSCPY(key.inet_addr, dlip->inet_addr);
 
-    if (dlip->lease_time == 0)
+    entry = ds_tree_find(&mgr->ovsdb_leases, &key);
+    if (entry == NULL)
     {
-        // Released or expired lease... remove from OVSDB
-        ret = ovsdb_sync_delete_where(OVSDB_DHCP_TABLE, where);
-        if (!ret)
+        entry = calloc(1, sizeof(*entry));
+        if (entry == NULL)
         {
-            LOGE("Updating DHCP lease %s (Failed to remove entry)", dlip->hwaddr);
+            LOGE("Updating DHCP lease %s (Failed to allocate entry)", dlip->hwaddr);
             return false;
         }
-
-        LOGN("Removed DHCP lease '%s' with '%s' '%s' '%d'",
-             dlip->hwaddr, dlip->inet_addr, dlip->hostname, dlip->lease_time);
+        ds_tree_insert(&mgr->ovsdb_leases, entry, &entry->dlip);
     }
-    else
-    {
-        // New/active lease, upsert it into OVSDB
-        row = schema_DHCP_leased_IP_to_json(dlip, perr);
-        ret = ovsdb_sync_upsert_where(OVSDB_DHCP_TABLE, where, row, NULL);
-        if (!ret)
-        {
-            LOGE("Updating DHCP lease %s (Failed to insert entry)", dlip->hwaddr);
-            return false;
-        }
 
-        LOGN("Updated DHCP lease '%s' with '%s' '%s' '%d'",
-             dlip->hwaddr, dlip->inet_addr, dlip->hostname, dlip->lease_time);
-    }
+    if (entry->op == DHCP_LEASE_OP_NONE) mgr->ovsdb_pending++;
+
+    memcpy(&entry->dlip, dlip, sizeof(entry->dlip));
+    STRSCPY(entry->dlip.hwaddr, key.hwaddr);
+    entry->op = (dlip->lease_time == 0) ? DHCP_LEASE_OP_DELETE :
+                                          DHCP_LEASE_OP_UPSERT;
+    // A negative lease time is the infinite (0xffffffff) lease
+    entry->expires = (dlip->lease_time > 0) ?
+                     time(NULL) + dlip->lease_time + DHCP_LEASE_EXPIRY_MARGIN : 0;
+
+    dhcp_lease_schedule_flush(mgr);
+
     return true;
 }
 
@@ -698,11 +1021,42 @@ static void dhcp_handler(struct fsm_session *session,
     return;
 }
 
+/**
+ * @brief age out leases that ended without a RELEASE
+ *
+ * Clients that just vanish never release their lease. Their rows are
+ * removed once the lease time (plus a margin) is over, so the table is
+ * bounded by the live leases.
+ */
+void dhcp_lease_expire(time_t now)
+{
+    struct dhcp_parse_mgr   *mgr = dhcp_get_mgr();
+    struct dhcp_ovsdb_lease *entry;
+    bool                    expired = false;
+
+    ds_tree_foreach(&mgr->ovsdb_leases, entry)
+    {
+        if (entry->op != DHCP_LEASE_OP_NONE) continue;
+        if (entry->expires == 0 || entry->expires > now) continue;
+
+        LOGN("DHCP lease '%s' '%s' expired", entry->dlip.hwaddr,
+             entry->dlip.inet_addr);
+
+        entry->op = DHCP_LEASE_OP_DELETE;
+        mgr->ovsdb_pending++;
+        expired = true;
+    }
+
+    if (expired) dhcp_lease_schedule_flush(mgr);
+}
+
 void dhcp_periodic(struct fsm_session *session)
 {
     struct dhcp_parse_mgr *mgr = dhcp_get_mgr();
 
     if (!mgr->initialized) return;
+
+    dhcp_lease_expire(time(NULL));
 }
 
 /**
@@ -805,6 +1159,9 @@ void dhcp_plugin_exit(struct fsm_session *session)
     if (!mgr->initialized) return;
 
     dhcp_delete_session(session);
+
+    /* Last session gone: send pending lease changes, drop the table */
+    if (ds_tree_is_empty(&mgr->fsm_sessions)) dhcp_lease_free_table();
 }
 
 /**
@@ -830,6 +1187,11 @@ int dhcp_plugin_init(struct fsm_session *session)
     {
         ds_tree_init(&mgr->fsm_sessions, dhcp_session_cmp,
                      struct dhcp_session, session_node);
+        ds_tree_init(&mgr->ovsdb_leases, dhcp_ovsdb_lease_cmp,
+                     struct dhcp_ovsdb_lease, ovsdb_node);
+        mgr->loop = session->loop;
+        ev_timer_init(&mgr->ovsdb_timer, dhcp_lease_timer_cb,
+                      DHCP_LEASE_FLUSH_INTERVAL, 0.);
         mgr->initialized = true;
     }
 
@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pcap.c"
 
 static void send_report(struct fsm_session *session, char *report);
+static char *get_config(struct fsm_session *session, char *key);
 
 #define OTHER_CONFIG_NELEMS 4
 #define OTHER_CONFIG_NELEM_SIZE 128
@@ -112,9 +113,20 @@ static void send_report(struct fsm_session *session, char *report) {
 
 }
 
+static char *get_config(struct fsm_session *session, char *key)
+{
+    struct str_pair *pair;
+
+    pair = ds_tree_find(session->conf->other_config, key);
+    if (pair == NULL) return NULL;
+
+    return pair->value;
+}
+
 struct fsm_session_ops g_ops =
 {
     .send_report = send_report,
+    .get_config = get_config,
 };
 
 union fsm_plugin_ops p_ops;
@@ -407,6 +419,114 @@ void test_dhcp_parse_pkt(void)
     free(net_parser);
 }
 
+/**
+ * @brief validate DHCP_leased_IP updates are merged per (hwaddr, inet_addr)
+ */
+void test_dhcp_lease_update_table(void)
+{
+    struct dhcp_session             *d_session;
+    struct dhcp_ovsdb_lease         *entry;
+    struct schema_DHCP_leased_IP    dlip;
+    bool                            ret;
+
+    memset(&dlip, 0, sizeof(dlip));
+    STRSCPY(dlip.hwaddr, "00:E1:33:00:0A:A5");
+    STRSCPY(dlip.inet_addr, "192.168.1.23");
+    STRSCPY(dlip.hostname, "Shadowfax");
+    dlip.lease_time = 86400;
+
+    /* Session 0 updates ovsdb */
+    d_session = dhcp_lookup_session(&g_sessions[0]);
+    TEST_ASSERT_NOT_NULL(d_session);
+
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_TRUE(ret);
+
+    dlip.lease_time = 43200;
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_EQUAL_UINT(1, g_mgr->ovsdb_pending);
+
+    entry = ds_tree_head(&g_mgr->ovsdb_leases);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_STRING("00:e1:33:00:0a:a5", entry->dlip.hwaddr);
+    TEST_ASSERT_EQUAL_INT(43200, entry->dlip.lease_time);
+    TEST_ASSERT_EQUAL_INT(DHCP_LEASE_OP_UPSERT, entry->op);
+
+    /* A release supersedes the pending update */
+    dlip.lease_time = 0;
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_EQUAL_UINT(1, g_mgr->ovsdb_pending);
+    TEST_ASSERT_EQUAL_INT(DHCP_LEASE_OP_DELETE, entry->op);
+
+    /* The flush consumes the release */
+    dhcp_lease_flush_table();
+    TEST_ASSERT_EQUAL_UINT(0, g_mgr->ovsdb_pending);
+    TEST_ASSERT_NULL(ds_tree_head(&g_mgr->ovsdb_leases));
+
+    /* Session 1 does not update ovsdb */
+    d_session = dhcp_lookup_session(&g_sessions[1]);
+    TEST_ASSERT_NOT_NULL(d_session);
+
+    dlip.lease_time = 86400;
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_FALSE(ret);
+    TEST_ASSERT_EQUAL_UINT(0, g_mgr->ovsdb_pending);
+}
+
+/**
+ * @brief validate leases that are never released are aged out
+ */
+void test_dhcp_lease_expire(void)
+{
+    struct dhcp_session             *d_session;
+    struct dhcp_ovsdb_lease         *entry;
+    struct schema_DHCP_leased_IP    dlip;
+    time_t                          now;
+    bool                            ret;
+
+    memset(&dlip, 0, sizeof(dlip));
+    STRSCPY(dlip.hwaddr, "00:e1:33:00:0a:a6");
+    STRSCPY(dlip.inet_addr, "192.168.1.24");
+    dlip.lease_time = 600;
+
+    d_session = dhcp_lookup_session(&g_sessions[0]);
+    TEST_ASSERT_NOT_NULL(d_session);
+
+    now = time(NULL);
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_TRUE(ret);
+    dhcp_lease_flush_table();
+
+    entry = ds_tree_head(&g_mgr->ovsdb_leases);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_INT(DHCP_LEASE_OP_NONE, entry->op);
+
+    /* Still within the lease time and its margin */
+    dhcp_lease_expire(now + 600);
+    TEST_ASSERT_EQUAL_UINT(0, g_mgr->ovsdb_pending);
+    TEST_ASSERT_EQUAL_INT(DHCP_LEASE_OP_NONE, entry->op);
+
+    /* The client vanished: the lease is removed once it is over */
+    dhcp_lease_expire(now + 600 + DHCP_LEASE_EXPIRY_MARGIN + 1);
+    TEST_ASSERT_EQUAL_UINT(1, g_mgr->ovsdb_pending);
+    TEST_ASSERT_EQUAL_INT(DHCP_LEASE_OP_DELETE, entry->op);
+
+    dhcp_lease_flush_table();
+    TEST_ASSERT_NULL(ds_tree_head(&g_mgr->ovsdb_leases));
+
+    /* Infinite leases never expire */
+    dlip.lease_time = -1;
+    ret = dhcp_lease_update_table(d_session, &dlip);
+    TEST_ASSERT_TRUE(ret);
+    dhcp_lease_flush_table();
+
+    dhcp_lease_expire(now + 365 * 86400);
+    TEST_ASSERT_EQUAL_UINT(0, g_mgr->ovsdb_pending);
+    TEST_ASSERT_NOT_NULL(ds_tree_head(&g_mgr->ovsdb_leases));
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -421,6 +541,8 @@ int main(int argc, char *argv[])
 
     RUN_TEST(test_load_unload_plugin);
     RUN_TEST(test_dhcp_parse_pkt);
+    RUN_TEST(test_dhcp_lease_update_table);
+    RUN_TEST(test_dhcp_lease_expire);
 
     global_test_exit();
 
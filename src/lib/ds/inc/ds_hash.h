@@ -0,0 +1,209 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DS_HASH_H_INCLUDED
+#define DS_HASH_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds.h"
+
+/*
+ * ============================================================
+ * ACLA Data Structures: Hash tables
+ * ============================================================
+ *
+ * Chained hash table with incremental resizing. When the load factor
+ * reaches 1 a table twice the size is allocated and buckets are migrated
+ * from the old table a few at a time on every insert/remove, so no single
+ * operation has to rehash the whole table.
+ *
+ * Lookups and iterators look at both tables while a resize is in
+ * progress. Lookups and iterators never migrate buckets; the only
+ * modification allowed while iterating is ds_hash_iremove().
+ */
+
+#define DS_HASH_INIT(H, C, type, elem)          \
+{                                               \
+    .oh_cof         = offsetof(type, elem),     \
+    .oh_hash_fn     = (H),                      \
+    .oh_cmp_fn      = (C),                      \
+    .oh_table       = NULL,                     \
+    .oh_nbuckets    = 1,                        \
+    .oh_old         = NULL,                     \
+    .oh_old_nbuckets= 0,                        \
+    .oh_old_pos     = 0,                        \
+    .oh_inline      = NULL,                     \
+    .oh_len         = 0,                        \
+    .oh_ndel        = 0,                        \
+}
+
+#define ds_hash_init(root, hash, cmp, type, elem)   __ds_hash_init(root, hash, cmp, offsetof(type, elem))
+
+#define DS_HASH_MIN_BUCKETS         16      /**< Size of the first allocated table */
+#define DS_HASH_REHASH_STEP         2       /**< Buckets migrated per insert/remove */
+
+#define ds_hash_foreach(root, p)    \
+    for (p = ds_hash_head(root); p != NULL; p = ds_hash_next(root, p))
+
+#define ds_hash_foreach_iter(root, p, iter) \
+    for (p = ds_hash_ifirst(iter, root); p != NULL; p = ds_hash_inext(iter))
+
+typedef struct ds_hash_node ds_hash_node_t;
+typedef struct ds_hash ds_hash_t;
+typedef struct ds_hash_iter ds_hash_iter_t;
+
+/**
+ * Key hash function; keys that compare equal must have the same hash
+ */
+typedef uint32_t ds_key_hash_t(void *key);
+
+/**
+ * Hash node
+ */
+struct ds_hash_node
+{
+    void*               ohn_key;            /**< Node key                   */
+    uint32_t            ohn_hash;           /**< Cached key hash            */
+    ds_hash_node_t*     ohn_next;           /**< Next node in the bucket    */
+};
+
+/**
+ * This structure defines a hash table root
+ */
+struct ds_hash
+{
+    size_t              oh_cof;             /**< Container offset           */
+    ds_key_hash_t*      oh_hash_fn;         /**< Hash function              */
+    ds_key_cmp_t*       oh_cmp_fn;          /**< Compare function           */
+    ds_hash_node_t**    oh_table;           /**< Bucket array, NULL if the
+                                                 inline bucket is used      */
+    size_t              oh_nbuckets;        /**< Number of buckets, power of 2 */
+    ds_hash_node_t**    oh_old;             /**< Table being migrated or NULL */
+    size_t              oh_old_nbuckets;    /**< Number of buckets in oh_old */
+    size_t              oh_old_pos;         /**< Next bucket to migrate     */
+    ds_hash_node_t*     oh_inline;          /**< Single bucket used before the
+                                                 first table is allocated   */
+    size_t              oh_len;             /**< Number of elements         */
+    uint32_t            oh_ndel;            /**< Number of delete operations
+                                                 This is used by iterators. */
+};
+
+/**
+ * Iterator structure
+ */
+struct ds_hash_iter
+{
+    ds_hash_t           *ohi_root;
+    ds_hash_node_t      *ohi_curr;
+    ds_hash_node_t      *ohi_next;
+    uint32_t            ohi_ndel;           /**< ohi_ndel and ds_hash->oh_ndel must match exactly,
+                                                 otherwise assume somebody removed an element while
+                                                 we were looping through it */
+};
+
+/*
+ * ===========================================================================
+ *  Key helpers
+ * ===========================================================================
+ */
+
+/** MAC address key (6 bytes) */
+typedef struct ds_hash_mac
+{
+    uint8_t             addr[6];
+} ds_hash_mac_t;
+
+/** IPv4/IPv6 address key; addr holds 4 or 16 bytes depending on family */
+typedef struct ds_hash_ip
+{
+    int                 family;             /**< AF_INET or AF_INET6        */
+    uint8_t             addr[16];
+} ds_hash_ip_t;
+
+/** 5-tuple key, ports in network byte order */
+typedef struct ds_hash_5tuple
+{
+    int                 family;             /**< AF_INET or AF_INET6        */
+    uint8_t             src[16];
+    uint8_t             dst[16];
+    uint16_t            sport;
+    uint16_t            dport;
+    uint8_t             proto;
+} ds_hash_5tuple_t;
+
+/** Generic byte buffer hash (FNV-1a); pass 0 as seed to start a new hash or
+ *  the result of a previous call to chain multiple buffers */
+extern uint32_t      ds_hash_mem(const void *data, size_t len, uint32_t seed);
+
+/** Integer hash, key is a pointer to int */
+extern ds_key_hash_t ds_int_hash;
+/** String hash, use together with ds_str_cmp */
+extern ds_key_hash_t ds_str_hash;
+/** Pointer hash (the key value is stored directly), use with ds_void_cmp */
+extern ds_key_hash_t ds_void_hash;
+/** MAC address hash and comparator, key is a pointer to 6 bytes */
+extern ds_key_hash_t ds_mac_hash;
+extern ds_key_cmp_t  ds_mac_cmp;
+/** IP address hash and comparator, key is a pointer to ds_hash_ip_t */
+extern ds_key_hash_t ds_ip_hash;
+extern ds_key_cmp_t  ds_ip_cmp;
+/** 5-tuple hash and comparator, key is a pointer to ds_hash_5tuple_t */
+extern ds_key_hash_t ds_5tuple_hash;
+extern ds_key_cmp_t  ds_5tuple_cmp;
+
+/*
+ * ===========================================================================
+ *  Public API
+ * ===========================================================================
+ */
+static inline bool   ds_hash_is_empty(ds_hash_t *root);
+static inline size_t ds_hash_len(ds_hash_t *root);
+static inline void  *ds_hash_head(ds_hash_t *root);
+static inline void  *ds_hash_next(ds_hash_t *root, void *data);
+static inline void   ds_hash_insert(ds_hash_t *root, void *data, void *key);
+static inline void  *ds_hash_find(ds_hash_t *root, void *key);
+static inline void  *ds_hash_remove(ds_hash_t *root, void *data);
+
+/*
+ * ===========================================================================
+ *  Iterator API
+ * ===========================================================================
+ */
+static inline void  *ds_hash_ifirst(ds_hash_iter_t *iter, ds_hash_t *root);
+static inline void  *ds_hash_inext(ds_hash_iter_t *iter);
+static inline void  *ds_hash_iremove(ds_hash_iter_t *iter);
+
+extern void         __ds_hash_init(ds_hash_t *root, ds_key_hash_t *hash_fn, ds_key_cmp_t *cmp_fn, size_t cof);
+extern void         ds_hash_fini(ds_hash_t *root);
+extern void         ds_hash_node_insert(ds_hash_t *root, ds_hash_node_t *node, void *key);
+extern void         ds_hash_node_remove(ds_hash_t *root, ds_hash_node_t *node);
+extern void         ds_hash_node_unlink(ds_hash_t *root, ds_hash_node_t *node);
+
+#include "../src/ds_hash.c.h"
+
+#endif /* DS_HASH_H_INCLUDED */
@@ -0,0 +1,385 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/socket.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds_hash.h"
+
+#define DS_HASH_FNV_INIT        2166136261u
+#define DS_HASH_FNV_PRIME       16777619u
+
+/* Empty buckets skipped per migrated bucket before giving up for this round */
+#define DS_HASH_EMPTY_VISITS    10
+
+/*
+ * ============================================================
+ *  Hash table implementation
+ * ============================================================
+ */
+
+/**
+ * Hash table run-time initializer
+ */
+void __ds_hash_init(ds_hash_t *root, ds_key_hash_t *hash_fn, ds_key_cmp_t *cmp_fn, size_t cof)
+{
+    memset(root, 0, sizeof(*root));
+
+    root->oh_cof        = cof;
+    root->oh_hash_fn    = hash_fn;
+    root->oh_cmp_fn     = cmp_fn;
+    root->oh_nbuckets   = 1;
+}
+
+/**
+ * Release the bucket arrays; the elements are not touched and the hash table
+ * is left empty, ready to be reused
+ */
+void ds_hash_fini(ds_hash_t *root)
+{
+    if (root->oh_old != NULL && root->oh_old != &root->oh_inline)
+    {
+        free(root->oh_old);
+    }
+
+    free(root->oh_table);
+
+    __ds_hash_init(root, root->oh_hash_fn, root->oh_cmp_fn, root->oh_cof);
+}
+
+/**
+ * Migrate up to @p steps non-empty buckets from the old table to the
+ * current one; release the old table when done
+ */
+static void ds_hash_rehash(ds_hash_t *root, int steps)
+{
+    ds_hash_node_t **table = ds_hash_table(root);
+    ds_hash_node_t *node;
+    ds_hash_node_t *next;
+    int empty = steps * DS_HASH_EMPTY_VISITS;
+    size_t bucket;
+
+    while (steps > 0 && root->oh_old_pos < root->oh_old_nbuckets)
+    {
+        node = root->oh_old[root->oh_old_pos];
+        root->oh_old[root->oh_old_pos] = NULL;
+        root->oh_old_pos++;
+
+        if (node == NULL)
+        {
+            if (--empty <= 0) break;
+            continue;
+        }
+
+        for (; node != NULL; node = next)
+        {
+            next = node->ohn_next;
+
+            bucket = node->ohn_hash & (root->oh_nbuckets - 1);
+            node->ohn_next = table[bucket];
+            table[bucket] = node;
+        }
+
+        steps--;
+    }
+
+    if (root->oh_old_pos < root->oh_old_nbuckets) return;
+
+    if (root->oh_old != &root->oh_inline) free(root->oh_old);
+
+    root->oh_old = NULL;
+    root->oh_old_nbuckets = 0;
+    root->oh_old_pos = 0;
+}
+
+/**
+ * Start an incremental resize to a table twice the size. If the allocation
+ * fails the current table is kept; chains just get longer.
+ */
+static void ds_hash_grow(ds_hash_t *root)
+{
+    ds_hash_node_t **table;
+    size_t nbuckets;
+
+    nbuckets = root->oh_nbuckets * 2;
+    if (nbuckets < DS_HASH_MIN_BUCKETS) nbuckets = DS_HASH_MIN_BUCKETS;
+
+    table = calloc(nbuckets, sizeof(*table));
+    if (table == NULL) return;
+
+    root->oh_old = ds_hash_table(root);
+    root->oh_old_nbuckets = root->oh_nbuckets;
+    root->oh_old_pos = 0;
+
+    root->oh_table = table;
+    root->oh_nbuckets = nbuckets;
+}
+
+/**
+ * Insert @p node with key @p key
+ */
+void ds_hash_node_insert(ds_hash_t *root, ds_hash_node_t *node, void *key)
+{
+    ds_hash_node_t **table;
+    size_t bucket;
+
+    if (root->oh_old == NULL && root->oh_len >= root->oh_nbuckets)
+    {
+        ds_hash_grow(root);
+    }
+
+    if (root->oh_old != NULL)
+    {
+        ds_hash_rehash(root, DS_HASH_REHASH_STEP);
+    }
+
+    node->ohn_key = key;
+    node->ohn_hash = root->oh_hash_fn(key);
+
+    table = ds_hash_table(root);
+    bucket = node->ohn_hash & (root->oh_nbuckets - 1);
+
+    node->ohn_next = table[bucket];
+    table[bucket] = node;
+
+    root->oh_len++;
+}
+
+/**
+ * Unlink @p node from the bucket @p pnode points to; return true if found
+ */
+static bool ds_hash_bucket_unlink(ds_hash_node_t **pnode, ds_hash_node_t *node)
+{
+    for (; *pnode != NULL; pnode = &(*pnode)->ohn_next)
+    {
+        if (*pnode != node) continue;
+
+        *pnode = node->ohn_next;
+        node->ohn_next = NULL;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Remove @p node without migrating any buckets; safe to use while iterating
+ */
+void ds_hash_node_unlink(ds_hash_t *root, ds_hash_node_t *node)
+{
+    ds_hash_node_t **table = ds_hash_table(root);
+    bool found;
+
+    found = ds_hash_bucket_unlink(&table[node->ohn_hash & (root->oh_nbuckets - 1)], node);
+    if (!found && root->oh_old != NULL)
+    {
+        found = ds_hash_bucket_unlink(&root->oh_old[node->ohn_hash & (root->oh_old_nbuckets - 1)], node);
+    }
+
+    if (!found) return;
+
+    root->oh_len--;
+    root->oh_ndel++;
+}
+
+/**
+ * Remove @p node
+ */
+void ds_hash_node_remove(ds_hash_t *root, ds_hash_node_t *node)
+{
+    ds_hash_node_unlink(root, node);
+
+    if (root->oh_old != NULL)
+    {
+        ds_hash_rehash(root, DS_HASH_REHASH_STEP);
+    }
+}
+
+/*
+ * ============================================================
+ *  Key helpers
+ * ============================================================
+ */
+
+/**
+ * Final avalanche step (murmur3 fmix32); buckets are selected by the low
+ * bits of the hash so make sure every input bit affects them
+ */
+static inline uint32_t ds_hash_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/**
+ * FNV-1a over a byte buffer; pass DS_HASH_FNV_INIT or the result of a
+ * previous call as @p seed to hash multiple buffers
+ */
+uint32_t ds_hash_mem(const void *data, size_t len, uint32_t seed)
+{
+    const uint8_t *p = data;
+    uint32_t h = (seed == 0) ? DS_HASH_FNV_INIT : seed;
+
+    while (len-- > 0)
+    {
+        h ^= *p++;
+        h *= DS_HASH_FNV_PRIME;
+    }
+
+    return h;
+}
+
+/**
+ * Integer hash
+ */
+uint32_t ds_int_hash(void *key)
+{
+    return ds_hash_mix((uint32_t)*(int *)key);
+}
+
+/**
+ * Pointer hash (the key value is stored directly)
+ */
+uint32_t ds_void_hash(void *key)
+{
+    uint64_t v = (uintptr_t)key;
+
+    return ds_hash_mix((uint32_t)v ^ (uint32_t)(v >> 32));
+}
+
+/**
+ * String hash
+ */
+uint32_t ds_str_hash(void *key)
+{
+    const uint8_t *p = key;
+    uint32_t h = DS_HASH_FNV_INIT;
+
+    while (*p != '\0')
+    {
+        h ^= *p++;
+        h *= DS_HASH_FNV_PRIME;
+    }
+
+    return ds_hash_mix(h);
+}
+
+/**
+ * MAC address hash
+ */
+uint32_t ds_mac_hash(void *key)
+{
+    return ds_hash_mix(ds_hash_mem(key, 6, 0));
+}
+
+/**
+ * MAC address comparator
+ */
+int ds_mac_cmp(void *a, void *b)
+{
+    return memcmp(a, b, 6);
+}
+
+static inline size_t ds_hash_ip_len(int family)
+{
+    return (family == AF_INET) ? 4 : 16;
+}
+
+/**
+ * IP address hash
+ */
+uint32_t ds_ip_hash(void *key)
+{
+    ds_hash_ip_t *ip = key;
+    uint32_t h;
+
+    h = ds_hash_mem(&ip->family, sizeof(ip->family), 0);
+    h = ds_hash_mem(ip->addr, ds_hash_ip_len(ip->family), h);
+
+    return ds_hash_mix(h);
+}
+
+/**
+ * IP address comparator
+ */
+int ds_ip_cmp(void *_a, void *_b)
+{
+    ds_hash_ip_t *a = _a;
+    ds_hash_ip_t *b = _b;
+
+    if (a->family != b->family) return a->family - b->family;
+
+    return memcmp(a->addr, b->addr, ds_hash_ip_len(a->family));
+}
+
+/**
+ * 5-tuple hash
+ */
+uint32_t ds_5tuple_hash(void *key)
+{
+    ds_hash_5tuple_t *t = key;
+    size_t len = ds_hash_ip_len(t->family);
+    uint32_t h;
+
+    h = ds_hash_mem(&t->family, sizeof(t->family), 0);
+    h = ds_hash_mem(t->src, len, h);
+    h = ds_hash_mem(t->dst, len, h);
+    h = ds_hash_mem(&t->sport, sizeof(t->sport), h);
+    h = ds_hash_mem(&t->dport, sizeof(t->dport), h);
+    h = ds_hash_mem(&t->proto, sizeof(t->proto), h);
+
+    return ds_hash_mix(h);
+}
+
+/**
+ * 5-tuple comparator
+ */
+int ds_5tuple_cmp(void *_a, void *_b)
+{
+    ds_hash_5tuple_t *a = _a;
+    ds_hash_5tuple_t *b = _b;
+    size_t len;
+    int rc;
+
+    if (a->family != b->family) return a->family - b->family;
+    if (a->proto != b->proto) return a->proto - b->proto;
+    if (a->sport != b->sport) return a->sport - b->sport;
+    if (a->dport != b->dport) return a->dport - b->dport;
+
+    len = ds_hash_ip_len(a->family);
+
+    rc = memcmp(a->src, b->src, len);
+    if (rc != 0) return rc;
+
+    return memcmp(a->dst, b->dst, len);
+}
@@ -0,0 +1,284 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * ============================================================
+ *  Inline functions
+ * ============================================================
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "ds_hash.h"
+
+static inline ds_hash_node_t   **ds_hash_table(ds_hash_t *root);
+static inline ds_hash_node_t    *ds_hash_node_next(ds_hash_t *root, ds_hash_node_t *node);
+static inline ds_hash_node_t    *ds_hash_node_seek(ds_hash_t *root, bool old, size_t bucket);
+
+/*
+ * ===========================================================================
+ *  Public API
+ * ===========================================================================
+ */
+
+/**
+ * Find the node corresponding to the node @p key in the hash table @p root
+ *
+ * @return
+ * This function returns they node that corresponds to key @p key or NULL if not found
+ */
+static inline void *ds_hash_find(ds_hash_t *root, void *key)
+{
+    ds_hash_node_t *node;
+    uint32_t hash;
+
+    hash = root->oh_hash_fn(key);
+
+    node = ds_hash_table(root)[hash & (root->oh_nbuckets - 1)];
+    for (; node != NULL; node = node->ohn_next)
+    {
+        if (node->ohn_hash == hash && root->oh_cmp_fn(node->ohn_key, key) == 0)
+        {
+            return NODE_TO_CONT(node, root->oh_cof);
+        }
+    }
+
+    /* Not found in the current table, check the table that is being migrated */
+    if (root->oh_old == NULL) return NULL;
+
+    node = root->oh_old[hash & (root->oh_old_nbuckets - 1)];
+    for (; node != NULL; node = node->ohn_next)
+    {
+        if (node->ohn_hash == hash && root->oh_cmp_fn(node->ohn_key, key) == 0)
+        {
+            return NODE_TO_CONT(node, root->oh_cof);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Return true if the hash table is empty
+ */
+static inline bool ds_hash_is_empty(ds_hash_t *root)
+{
+    return (root->oh_len == 0);
+}
+
+/**
+ * Return the number of elements in the hash table
+ */
+static inline size_t ds_hash_len(ds_hash_t *root)
+{
+    return root->oh_len;
+}
+
+/*
+ * Return the first element in the hash table; the order is arbitrary
+ */
+static inline void *ds_hash_head(ds_hash_t *root)
+{
+    ds_hash_node_t *node;
+
+    node = ds_hash_node_seek(
+            root,
+            root->oh_old != NULL,
+            root->oh_old != NULL ? root->oh_old_pos : 0);
+
+    return NODE_TO_CONT(node, root->oh_cof);
+}
+
+/*
+ * Return the next element in the hash table
+ */
+static inline void *ds_hash_next(ds_hash_t *root, void *data)
+{
+    ds_hash_node_t *node = CONT_TO_NODE(data, root->oh_cof);
+
+    ds_hash_node_t *next = ds_hash_node_next(root, node);
+
+    return NODE_TO_CONT(next, root->oh_cof);
+}
+
+/*
+ * Insert an element into the hash table; duplicate keys are not checked for
+ */
+static inline void ds_hash_insert(ds_hash_t *root, void *data, void *key)
+{
+    ds_hash_node_t *node = CONT_TO_NODE(data, root->oh_cof);
+
+    ds_hash_node_insert(root, node, key);
+}
+
+/*
+ * Remove an element from the hash table
+ */
+static inline void *ds_hash_remove(ds_hash_t *root, void *data)
+{
+    ds_hash_node_t *node = CONT_TO_NODE(data, root->oh_cof);
+
+    ds_hash_node_remove(root, node);
+
+    return data;
+}
+
+/*
+ * ============================================================
+ *  Iterators
+ * ============================================================
+ */
+
+/**
+ * Initialize the @p iter strucure, @p iter will point to the first element in the hash table
+ */
+static inline void *ds_hash_ifirst(ds_hash_iter_t *iter, ds_hash_t *root)
+{
+    memset(iter, 0, sizeof(*iter));
+
+    iter->ohi_root = root;
+    iter->ohi_ndel = root->oh_ndel;
+
+    void *data = ds_hash_head(root);
+    if (data == NULL) return NULL;
+
+    iter->ohi_curr = CONT_TO_NODE(data, root->oh_cof);
+    iter->ohi_next = ds_hash_node_next(root, iter->ohi_curr);
+
+    return NODE_TO_CONT(iter->ohi_curr, root->oh_cof);
+}
+
+/**
+ * Retrieve the next node
+ */
+static inline void *ds_hash_inext(ds_hash_iter_t *iter)
+{
+    if (iter->ohi_ndel != iter->ohi_root->oh_ndel)
+    {
+        return DS_ITER_ERROR;
+    }
+
+    iter->ohi_curr = iter->ohi_next;
+    if (iter->ohi_curr == NULL) return NULL;
+
+    iter->ohi_next = ds_hash_node_next(iter->ohi_root, iter->ohi_curr);
+
+    return NODE_TO_CONT(iter->ohi_curr, iter->ohi_root->oh_cof);
+}
+
+/**
+ * Remove the current node; the removed element is returned and the
+ * iteration continues with ds_hash_inext()
+ */
+static inline void *ds_hash_iremove(ds_hash_iter_t *iter)
+{
+    if (iter->ohi_ndel != iter->ohi_root->oh_ndel)
+    {
+        return DS_ITER_ERROR;
+    }
+
+    /* Element was already removed once -- or we're at the end of the list */
+    if (iter->ohi_curr == NULL)
+    {
+        return NULL;
+    }
+
+    ds_hash_node_t *curr = iter->ohi_curr;
+    iter->ohi_curr = NULL;
+
+    /* Unlink without migrating buckets, so the iterator position stays valid */
+    ds_hash_node_unlink(iter->ohi_root, curr);
+
+    iter->ohi_ndel++;
+
+    return NODE_TO_CONT(curr, iter->ohi_root->oh_cof);
+}
+
+/*
+ * ===========================================================================
+ *  Support functions
+ * ===========================================================================
+ */
+
+/**
+ * Return the current bucket array; before the first table is allocated the
+ * inline single bucket is used
+ */
+static inline ds_hash_node_t **ds_hash_table(ds_hash_t *root)
+{
+    return (root->oh_table != NULL) ? root->oh_table : &root->oh_inline;
+}
+
+/**
+ * Return the first node at or after @p bucket. If @p old is true, the scan
+ * starts in the table being migrated and continues with the current table.
+ */
+static inline ds_hash_node_t *ds_hash_node_seek(ds_hash_t *root, bool old, size_t bucket)
+{
+    ds_hash_node_t **table;
+
+    if (old)
+    {
+        for (; bucket < root->oh_old_nbuckets; bucket++)
+        {
+            if (root->oh_old[bucket] != NULL) return root->oh_old[bucket];
+        }
+
+        bucket = 0;
+    }
+
+    table = ds_hash_table(root);
+    for (; bucket < root->oh_nbuckets; bucket++)
+    {
+        if (table[bucket] != NULL) return table[bucket];
+    }
+
+    return NULL;
+}
+
+/**
+ * Return the node following @p node
+ */
+static inline ds_hash_node_t *ds_hash_node_next(ds_hash_t *root, ds_hash_node_t *node)
+{
+    ds_hash_node_t *pn;
+    size_t bucket;
+
+    if (node->ohn_next != NULL) return node->ohn_next;
+
+    /* Check if the node still lives in the table being migrated */
+    if (root->oh_old != NULL)
+    {
+        bucket = node->ohn_hash & (root->oh_old_nbuckets - 1);
+        for (pn = root->oh_old[bucket]; pn != NULL; pn = pn->ohn_next)
+        {
+            if (pn == node) return ds_hash_node_seek(root, true, bucket + 1);
+        }
+    }
+
+    bucket = node->ohn_hash & (root->oh_nbuckets - 1);
+    return ds_hash_node_seek(root, false, bucket + 1);
+}
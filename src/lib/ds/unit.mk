@@ -33,6 +33,7 @@ UNIT_NAME := ds
 UNIT_TYPE := LIB
 
 UNIT_SRC += src/ds_tree.c
+UNIT_SRC += src/ds_hash.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 
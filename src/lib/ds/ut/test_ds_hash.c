@@ -0,0 +1,367 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ds_hash.h"
+#include "ds_tree.h"
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "ds_hash_tests";
+
+struct test_node
+{
+    char                key[32];
+    int                 value;
+    ds_hash_node_t      hnode;
+    ds_tree_node_t      tnode;
+};
+
+struct test_flow
+{
+    ds_hash_5tuple_t    key;
+    ds_hash_node_t      hnode;
+};
+
+static struct test_node *test_nodes_alloc(int num)
+{
+    struct test_node *nodes;
+    int ii;
+
+    nodes = calloc(num, sizeof(*nodes));
+    TEST_ASSERT_NOT_NULL(nodes);
+
+    for (ii = 0; ii < num; ii++)
+    {
+        snprintf(nodes[ii].key, sizeof(nodes[ii].key), "node-%d", ii);
+        nodes[ii].value = ii;
+    }
+
+    return nodes;
+}
+
+static double test_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief setUp() is called by the Unity framework before each test
+ */
+void
+setUp(void)
+{
+    return;
+}
+
+/**
+ * @brief tearDown() is called by the Unity framework after each test
+ */
+void
+tearDown(void)
+{
+    return;
+}
+
+/**
+ * @brief insert, find and remove across several incremental resizes
+ */
+void
+test_ds_hash_basic(void)
+{
+    ds_hash_t hash = DS_HASH_INIT(ds_str_hash, ds_str_cmp, struct test_node, hnode);
+    struct test_node *nodes;
+    struct test_node *node;
+    int num = 5000;
+    int ii;
+
+    nodes = test_nodes_alloc(num);
+
+    TEST_ASSERT_TRUE(ds_hash_is_empty(&hash));
+    TEST_ASSERT_NULL(ds_hash_find(&hash, "node-0"));
+
+    for (ii = 0; ii < num; ii++)
+    {
+        ds_hash_insert(&hash, &nodes[ii], nodes[ii].key);
+
+        /* Every element inserted so far must be reachable, even mid-resize */
+        node = ds_hash_find(&hash, nodes[ii / 2].key);
+        TEST_ASSERT_EQUAL_PTR(&nodes[ii / 2], node);
+    }
+    TEST_ASSERT_EQUAL_INT(num, ds_hash_len(&hash));
+
+    for (ii = 0; ii < num; ii++)
+    {
+        TEST_ASSERT_EQUAL_PTR(&nodes[ii], ds_hash_find(&hash, nodes[ii].key));
+    }
+
+    /* Remove the odd entries */
+    for (ii = 1; ii < num; ii += 2)
+    {
+        ds_hash_remove(&hash, &nodes[ii]);
+    }
+    TEST_ASSERT_EQUAL_INT(num / 2, ds_hash_len(&hash));
+
+    for (ii = 0; ii < num; ii++)
+    {
+        node = ds_hash_find(&hash, nodes[ii].key);
+        TEST_ASSERT_EQUAL_PTR((ii & 1) ? NULL : &nodes[ii], node);
+    }
+
+    ds_hash_fini(&hash);
+    TEST_ASSERT_TRUE(ds_hash_is_empty(&hash));
+    free(nodes);
+}
+
+/**
+ * @brief iterate and remove while a resize is in progress
+ */
+void
+test_ds_hash_iremove(void)
+{
+    ds_hash_t hash;
+    ds_hash_iter_t iter;
+    struct test_node *nodes;
+    struct test_node *node;
+    int *seen;
+    int count;
+    int num = 1000;
+    int ii;
+
+    ds_hash_init(&hash, ds_str_hash, ds_str_cmp, struct test_node, hnode);
+
+    nodes = test_nodes_alloc(num);
+    seen = calloc(num, sizeof(*seen));
+    TEST_ASSERT_NOT_NULL(seen);
+
+    /* 1024 buckets are allocated at 512 elements, migration is still running */
+    for (ii = 0; ii < 520; ii++)
+    {
+        ds_hash_insert(&hash, &nodes[ii], nodes[ii].key);
+    }
+    TEST_ASSERT_NOT_NULL(hash.oh_old);
+
+    /* Every node must be visited exactly once; remove every third one */
+    count = 0;
+    ds_hash_foreach_iter(&hash, node, &iter)
+    {
+        TEST_ASSERT_TRUE(node != DS_ITER_ERROR);
+        seen[node->value]++;
+        count++;
+
+        if ((node->value % 3) == 0)
+        {
+            TEST_ASSERT_EQUAL_PTR(node, ds_hash_iremove(&iter));
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(520, count);
+
+    for (ii = 0; ii < 520; ii++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, seen[ii]);
+        node = ds_hash_find(&hash, nodes[ii].key);
+        TEST_ASSERT_EQUAL_PTR((ii % 3) == 0 ? NULL : &nodes[ii], node);
+    }
+
+    /* Plain traversal sees the remaining elements */
+    count = 0;
+    ds_hash_foreach(&hash, node)
+    {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_INT(ds_hash_len(&hash), count);
+
+    /* Removing behind the iterator's back is detected */
+    node = ds_hash_ifirst(&iter, &hash);
+    TEST_ASSERT_NOT_NULL(node);
+    ds_hash_remove(&hash, node);
+    TEST_ASSERT_EQUAL_PTR(DS_ITER_ERROR, ds_hash_inext(&iter));
+
+    ds_hash_fini(&hash);
+    free(seen);
+    free(nodes);
+}
+
+/**
+ * @brief MAC, IP and 5-tuple key helpers
+ */
+void
+test_ds_hash_keys(void)
+{
+    uint8_t mac1[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    uint8_t mac2[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    uint8_t mac3[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x56 };
+    ds_hash_ip_t ip1;
+    ds_hash_ip_t ip2;
+    ds_hash_t flows;
+    struct test_flow flow[2];
+    ds_hash_5tuple_t key;
+
+    TEST_ASSERT_EQUAL_UINT32(ds_mac_hash(mac1), ds_mac_hash(mac2));
+    TEST_ASSERT_EQUAL_INT(0, ds_mac_cmp(mac1, mac2));
+    TEST_ASSERT_TRUE(ds_mac_cmp(mac1, mac3) != 0);
+
+    /* Bytes past the IPv4 address must not matter */
+    memset(&ip1, 0x00, sizeof(ip1));
+    memset(&ip2, 0xff, sizeof(ip2));
+    ip1.family = ip2.family = AF_INET;
+    memcpy(ip1.addr, "\xc0\xa8\x01\x01", 4);
+    memcpy(ip2.addr, "\xc0\xa8\x01\x01", 4);
+    TEST_ASSERT_EQUAL_UINT32(ds_ip_hash(&ip1), ds_ip_hash(&ip2));
+    TEST_ASSERT_EQUAL_INT(0, ds_ip_cmp(&ip1, &ip2));
+
+    ip2.family = AF_INET6;
+    TEST_ASSERT_TRUE(ds_ip_cmp(&ip1, &ip2) != 0);
+
+    ds_hash_init(&flows, ds_5tuple_hash, ds_5tuple_cmp, struct test_flow, hnode);
+
+    memset(flow, 0, sizeof(flow));
+    flow[0].key.family = AF_INET;
+    memcpy(flow[0].key.src, "\x0a\x00\x00\x01", 4);
+    memcpy(flow[0].key.dst, "\x0a\x00\x00\x02", 4);
+    flow[0].key.sport = 1234;
+    flow[0].key.dport = 80;
+    flow[0].key.proto = 6;
+
+    /* Reverse direction is a different flow */
+    flow[1].key = flow[0].key;
+    memcpy(flow[1].key.src, "\x0a\x00\x00\x02", 4);
+    memcpy(flow[1].key.dst, "\x0a\x00\x00\x01", 4);
+
+    ds_hash_insert(&flows, &flow[0], &flow[0].key);
+    ds_hash_insert(&flows, &flow[1], &flow[1].key);
+
+    key = flow[0].key;
+    TEST_ASSERT_EQUAL_PTR(&flow[0], ds_hash_find(&flows, &key));
+    key.dport = 443;
+    TEST_ASSERT_NULL(ds_hash_find(&flows, &key));
+
+    ds_hash_fini(&flows);
+}
+
+/**
+ * @brief compare insert and lookup times with ds_tree
+ */
+static void
+test_ds_hash_bench_run(int num)
+{
+    ds_hash_t hash = DS_HASH_INIT(ds_str_hash, ds_str_cmp, struct test_node, hnode);
+    ds_tree_t tree = DS_TREE_INIT(ds_str_cmp, struct test_node, tnode);
+    struct test_node *nodes;
+    double t_hash_ins;
+    double t_tree_ins;
+    double t_hash_find;
+    double t_tree_find;
+    double t;
+    int rounds;
+    int ii;
+    int rr;
+
+    nodes = test_nodes_alloc(num);
+    rounds = 1000000 / num;
+    if (rounds < 1) rounds = 1;
+
+    t = test_now();
+    for (ii = 0; ii < num; ii++)
+    {
+        ds_hash_insert(&hash, &nodes[ii], nodes[ii].key);
+    }
+    t_hash_ins = test_now() - t;
+
+    t = test_now();
+    for (ii = 0; ii < num; ii++)
+    {
+        ds_tree_insert(&tree, &nodes[ii], nodes[ii].key);
+    }
+    t_tree_ins = test_now() - t;
+
+    t = test_now();
+    for (rr = 0; rr < rounds; rr++)
+    {
+        for (ii = 0; ii < num; ii++)
+        {
+            TEST_ASSERT_EQUAL_PTR(&nodes[ii], ds_hash_find(&hash, nodes[ii].key));
+        }
+    }
+    t_hash_find = test_now() - t;
+
+    t = test_now();
+    for (rr = 0; rr < rounds; rr++)
+    {
+        for (ii = 0; ii < num; ii++)
+        {
+            TEST_ASSERT_EQUAL_PTR(&nodes[ii], ds_tree_find(&tree, nodes[ii].key));
+        }
+    }
+    t_tree_find = test_now() - t;
+
+    LOGI("%s: entries=%d insert hash=%.1fns tree=%.1fns find hash=%.1fns tree=%.1fns",
+         __func__,
+         num,
+         t_hash_ins * 1e9 / num,
+         t_tree_ins * 1e9 / num,
+         t_hash_find * 1e9 / ((double)num * rounds),
+         t_tree_find * 1e9 / ((double)num * rounds));
+
+    ds_hash_fini(&hash);
+    free(nodes);
+}
+
+void
+test_ds_hash_bench(void)
+{
+    test_ds_hash_bench_run(1000);
+    test_ds_hash_bench_run(10000);
+    test_ds_hash_bench_run(100000);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_ds_hash_basic);
+    RUN_TEST(test_ds_hash_iremove);
+    RUN_TEST(test_ds_hash_keys);
+    RUN_TEST(test_ds_hash_bench);
+
+    return UNITY_END();
+}
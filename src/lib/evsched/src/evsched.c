@@ -38,6 +38,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <log.h>
 #include <ds_list.h>
+#include <mem_pool.h>
+#include <metrics.h>
+#include <evx.h>
 
 #include "evsched.h"
 
@@ -76,6 +79,12 @@ static ds_list_t                    evsched_tasklist;
 static ds_list_t                    evsched_pending;
 static ev_timer                     evsched_timer;
 static bool                         evsched_initialized = false;
+static mem_pool_t                   evsched_task_pool =
+        MEM_POOL_INIT("evsched_task", evsched_taskinfo_t, 32, 0);
+
+static metrics_t                    evsched_metrics_tasks = METRICS_COUNTER_INIT("evsched.tasks");
+static metrics_t                    evsched_metrics_task_us = METRICS_HIST_INIT("evsched.task_us");
+static metrics_t                    evsched_metrics_late_us = METRICS_HIST_INIT("evsched.late_us");
 
 
 /*****************************************************************************/
@@ -128,6 +137,8 @@ evsched_timer_callback(struct ev_loop *loop, ev_timer *timer, int revents)
     evsched_taskinfo_t      *tp;
     ds_list_iter_t          iter;
     ev_tstamp               cur_tm = ev_now(evsched_loop);
+    uint64_t                t0;
+    uint64_t                lag;
 
     // Avoid compiler warnings
     (void)loop;
@@ -146,14 +157,25 @@ evsched_timer_callback(struct ev_loop *loop, ev_timer *timer, int revents)
         if (tp->remove) {
             // Marked for removal, so free it
             LOGT("Task %u canceled", tp->task_id);
-            free(tp);
+            mem_pool_free(&evsched_task_pool, tp);
         }
         else {
             // Call function
+            t0 = metrics_clock();
+            if (t0 != 0) {
+                metrics_hist_add(&evsched_metrics_late_us,
+                                 (uint64_t)((cur_tm - tp->trigger_time) * 1000000));
+            }
+
             evsched_current = tp;
+            lag = evx_lag_trace_begin();
             tp->func(tp->func_arg);
+            evx_lag_trace_end((void *)tp->func, lag);
             evsched_current = NULL;
 
+            metrics_counter_inc(&evsched_metrics_tasks);
+            metrics_hist_since(&evsched_metrics_task_us, t0);
+
             if (tp->resched) {
                 // Queue it to be rescheduled
                 tp->sched_time = cur_tm;
@@ -161,7 +183,7 @@ evsched_timer_callback(struct ev_loop *loop, ev_timer *timer, int revents)
             }
             else {
                 // we're done with it, let's free it
-                free(tp);
+                mem_pool_free(&evsched_task_pool, tp);
             }
         }
 
@@ -177,7 +199,7 @@ evsched_timer_callback(struct ev_loop *loop, ev_timer *timer, int revents)
 
             // Marked for removal, so free it
             LOGT("Task %u canceled", tp->task_id);
-            free(tp);
+            mem_pool_free(&evsched_task_pool, tp);
         }
 
         tp = ds_list_inext(&iter);
@@ -191,7 +213,7 @@ evsched_timer_callback(struct ev_loop *loop, ev_timer *timer, int revents)
         // Reinsert it
         if (evsched_task_insert(tp, false) == false) {
             LOGE("evsched_timer_callback() failed to reschedule task %u", tp->task_id);
-            free(tp);
+            mem_pool_free(&evsched_task_pool, tp);
         }
 
         tp = ds_list_inext(&iter);
@@ -313,7 +335,7 @@ evsched_cleanup(void)
     tp = ds_list_ifirst(&iter, &evsched_tasklist);
     while(tp) {
         ds_list_iremove(&iter);
-        free(tp);
+        mem_pool_free(&evsched_task_pool, tp);
 
         tp = ds_list_inext(&iter);
     }
@@ -332,7 +354,7 @@ evsched_task(evsched_task_func_t func, void *arg, uint32_t ms)
         return 0;
     }
 
-    ntp = calloc(1, sizeof(*ntp));
+    ntp = mem_pool_alloc(&evsched_task_pool);
     if (!ntp) {
         LOGE("evsched_task() failed to allocate memory for new task!");
         return 0;
@@ -356,7 +378,7 @@ evsched_task(evsched_task_func_t func, void *arg, uint32_t ms)
         // Insert it into our task list
         if (evsched_task_insert(ntp, true) == false) {
             LOGE("evsched_task() failed to insert task into tasklist!");
-            free(ntp);
+            mem_pool_free(&evsched_task_pool, ntp);
             return 0;
         }
 
@@ -450,7 +472,7 @@ evsched_task_update(evsched_task_t task, uint32_t ms)
         tp->ms = ms;
         if (evsched_task_insert(tp, true) == false) {
             LOGE("evsched_task_update() failed to re-insert task into tasklist!");
-            free(tp);
+            mem_pool_free(&evsched_task_pool, tp);
             return false;
         }
 
@@ -492,7 +514,7 @@ evsched_task_cancel(evsched_task_t task)
     if (!tp) {
         return false;
     }
-    free(tp);
+    mem_pool_free(&evsched_task_pool, tp);
 
     LOGT("Task %u canceled", task);
     return true;
@@ -36,6 +36,8 @@ UNIT_SRC := src/evsched.c
 
 UNIT_DEPS := src/lib/common
 UNIT_DEPS += src/lib/ds
+UNIT_DEPS += src/lib/metrics
+UNIT_DEPS += src/lib/evx
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 
@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define EVX_H_INCLUDED
 
 #include <ev.h>
+#include <stdbool.h>
+#include <stdint.h>
 #ifdef BUILD_HAVE_LIBCARES
 #include <ares.h>
 #endif
@@ -86,6 +88,39 @@ void ev_debounce_start(struct ev_loop *loop, ev_debounce *w);
  */
 void ev_debounce_stop(struct ev_loop *loop, ev_debounce *w);
 
+/*
+ * ===========================================================================
+ *  Event loop lag watchdog. Measures how long each loop iteration spends
+ *  running callbacks and reports iterations longer than the threshold.
+ *  Dispatchers that invoke user callbacks (evsched, ev_debounce, ovsdb) wrap
+ *  them in evx_lag_trace_begin()/evx_lag_trace_end() so that a stall can be
+ *  attributed to a symbol; anything else shows up as "untraced watchers".
+ *
+ *  Busy time is exported as the evx.loop_busy_us histogram.
+ * ===========================================================================
+ */
+
+/**
+ * Start the watchdog on @p loop; iterations or traced callbacks that take
+ * longer than @p threshold_ms are logged. Only one loop can be watched.
+ */
+bool evx_lag_start(struct ev_loop *loop, int threshold_ms);
+
+/**
+ * Stop the watchdog
+ */
+void evx_lag_stop(void);
+
+/**
+ * Start timing a callback; returns 0 if the watchdog is not running
+ */
+uint64_t evx_lag_trace_begin(void);
+
+/**
+ * Finish timing callback @p fn started at @p start
+ */
+void evx_lag_trace_end(void *fn, uint64_t start);
+
 #ifdef BUILD_HAVE_LIBCARES
 struct evx_ares {
     struct ares_ctx {
@@ -32,9 +32,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 static void ev_debounce_fn(struct ev_loop *loop, ev_debounce *w, int revent)
 {
+    uint64_t t0;
+
     /* Reset the start timer */
     w->ts_start = 0.0;
+
+    t0 = evx_lag_trace_begin();
     w->fn(loop, w, revent);
+    evx_lag_trace_end((void *)w->fn, t0);
 }
 
 void ev_debounce_init2(
@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "log.h"
+#include "metrics.h"
+
+#include "evx.h"
+
+/**
+ * The check watcher runs first after the loop wakes up and the prepare
+ * watcher runs last before it blocks again; the time between the two is the
+ * time spent running callbacks, i.e. the lag every other event waiting on
+ * this loop sees.
+ */
+struct evx_lag
+{
+    struct ev_loop     *loop;
+    ev_check            check;              /* Loop woke up */
+    ev_prepare          prepare;            /* Loop is about to block */
+    uint64_t            threshold_us;       /* Stall threshold */
+    uint64_t            wakeup;             /* Clock at wake up, 0 if unknown */
+    int                 pending;            /* Watchers pending at wake up */
+    void               *slow_fn;            /* Slowest traced callback of the iteration */
+    uint64_t            slow_us;            /* ... and its run time */
+    bool                active;
+};
+
+static struct evx_lag evx_lag;
+
+static metrics_t evx_lag_metrics_busy = METRICS_HIST_INIT("evx.loop_busy_us");
+static metrics_t evx_lag_metrics_stalls = METRICS_COUNTER_INIT("evx.loop_stalls");
+static metrics_t evx_lag_metrics_slow = METRICS_COUNTER_INIT("evx.slow_callbacks");
+
+/**
+ * Resolve a callback address to "symbol", "symbol+offset" or the raw
+ * address. Static functions only resolve when linked with -rdynamic.
+ */
+static const char *evx_lag_symbol(void *fn, char *buf, size_t sz)
+{
+    Dl_info dli;
+
+    if (dladdr(fn, &dli) == 0 || dli.dli_sname == NULL)
+    {
+        snprintf(buf, sz, "%p", fn);
+    }
+    else if (dli.dli_saddr == fn)
+    {
+        snprintf(buf, sz, "%s", dli.dli_sname);
+    }
+    else
+    {
+        snprintf(buf, sz, "%s+0x%tx", dli.dli_sname, (char *)fn - (char *)dli.dli_saddr);
+    }
+
+    return buf;
+}
+
+static void evx_lag_check_fn(struct ev_loop *loop, ev_check *w, int revent)
+{
+    (void)w;
+    (void)revent;
+
+    evx_lag.wakeup = metrics_clock_us();
+    evx_lag.pending = ev_pending_count(loop);
+    evx_lag.slow_fn = NULL;
+    evx_lag.slow_us = 0;
+}
+
+static void evx_lag_prepare_fn(struct ev_loop *loop, ev_prepare *w, int revent)
+{
+    char sym[128];
+    uint64_t busy;
+
+    (void)loop;
+    (void)w;
+    (void)revent;
+
+    /* First iteration, the loop has not woken up yet */
+    if (evx_lag.wakeup == 0) return;
+
+    busy = metrics_clock_us() - evx_lag.wakeup;
+    evx_lag.wakeup = 0;
+
+    metrics_hist_add(&evx_lag_metrics_busy, busy);
+    if (busy < evx_lag.threshold_us) return;
+
+    metrics_counter_inc(&evx_lag_metrics_stalls);
+
+    /* Traced callbacks over the threshold have already been reported */
+    if (evx_lag.slow_us >= evx_lag.threshold_us) return;
+
+    if (evx_lag.slow_fn == NULL)
+    {
+        LOGW("evx_lag: Event loop blocked for %" PRIu64 " ms by untraced watchers (%d pending).",
+             busy / 1000, evx_lag.pending);
+        return;
+    }
+
+    LOGW("evx_lag: Event loop blocked for %" PRIu64 " ms (%d pending), slowest traced callback %s took %" PRIu64 " ms.",
+         busy / 1000, evx_lag.pending,
+         evx_lag_symbol(evx_lag.slow_fn, sym, sizeof(sym)),
+         evx_lag.slow_us / 1000);
+}
+
+bool evx_lag_start(struct ev_loop *loop, int threshold_ms)
+{
+    if (evx_lag.active) return true;
+
+    if (threshold_ms <= 0)
+    {
+        LOGE("evx_lag: Invalid stall threshold: %d ms", threshold_ms);
+        return false;
+    }
+
+    evx_lag.loop = loop;
+    evx_lag.threshold_us = (uint64_t)threshold_ms * 1000;
+    evx_lag.wakeup = 0;
+
+    ev_check_init(&evx_lag.check, evx_lag_check_fn);
+    ev_set_priority(&evx_lag.check, EV_MAXPRI);
+    ev_check_start(loop, &evx_lag.check);
+    /* The watchdog alone must not keep the loop alive */
+    ev_unref(loop);
+
+    ev_prepare_init(&evx_lag.prepare, evx_lag_prepare_fn);
+    ev_set_priority(&evx_lag.prepare, EV_MINPRI);
+    ev_prepare_start(loop, &evx_lag.prepare);
+    ev_unref(loop);
+
+    evx_lag.active = true;
+
+    LOGI("evx_lag: Event loop watchdog started, threshold %d ms.", threshold_ms);
+
+    return true;
+}
+
+void evx_lag_stop(void)
+{
+    if (!evx_lag.active) return;
+
+    ev_ref(evx_lag.loop);
+    ev_check_stop(evx_lag.loop, &evx_lag.check);
+    ev_ref(evx_lag.loop);
+    ev_prepare_stop(evx_lag.loop, &evx_lag.prepare);
+
+    evx_lag.active = false;
+    evx_lag.wakeup = 0;
+}
+
+uint64_t evx_lag_trace_begin(void)
+{
+    if (!evx_lag.active) return 0;
+
+    return metrics_clock_us();
+}
+
+void evx_lag_trace_end(void *fn, uint64_t start)
+{
+    char sym[128];
+    uint64_t dt;
+
+    if (start == 0) return;
+
+    dt = metrics_clock_us() - start;
+    if (dt > evx_lag.slow_us)
+    {
+        evx_lag.slow_us = dt;
+        evx_lag.slow_fn = fn;
+    }
+
+    if (dt < evx_lag.threshold_us) return;
+
+    metrics_counter_inc(&evx_lag_metrics_slow);
+
+    LOGW("evx_lag: Callback %s blocked the event loop for %" PRIu64 " ms.",
+         evx_lag_symbol(fn, sym, sizeof(sym)), dt / 1000);
+}
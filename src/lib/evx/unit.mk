@@ -41,10 +41,13 @@ UNIT_CFLAGS += -Isrc/lib/log/inc
 
 UNIT_SRC += src/evx_debounce.c
 UNIT_SRC += src/evx_debounce_call.c
+UNIT_SRC += src/evx_lag.c
 UNIT_DEPS += src/lib/ds
 UNIT_DEPS += src/lib/const
+UNIT_DEPS += src/lib/metrics
 
 UNIT_EXPORT_CFLAGS := -I$(UNIT_PATH)/inc
+UNIT_EXPORT_LDFLAGS := -ldl
 
 ifeq ($(BUILD_HAVE_LIBCARES),y)
 UNIT_SRC += src/evx_ares.c
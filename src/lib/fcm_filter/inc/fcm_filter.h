@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ds_tree.h"
 #include "ds_dlist.h"
+#include "os_types.h"
 #include "network_metadata.h"
 #include "network_metadata_report.h"
 
@@ -175,10 +176,54 @@ typedef struct rule_name_tree
     ds_tree_node_t  dl_node;
 } rule_name_tree_t;
 
+struct fcm_filter_table;
+
+enum fcm_filter_field_id
+{
+    FCM_FIELD_SMAC = 0,
+    FCM_FIELD_DMAC,
+    FCM_FIELD_SRC_IP,
+    FCM_FIELD_DST_IP,
+    FCM_FIELD_MAX
+};
+
+/* A flow MAC or IP address, converted to binary once per lookup */
+struct fcm_filter_value
+{
+    const char *str;
+    bool valid;
+    int af;     /* AF_INET or AF_INET6 for an IP address */
+    union
+    {
+        os_macaddr_t mac;
+        uint8_t ip[16];
+    } addr;
+};
+
+/* Rule bitmap words an iterator holds inline, larger tables allocate */
+#define FCM_FILTER_MATCH_WORDS 2
+
+/*
+ * Iterator over the rules of a compiled filter table that agree with a
+ * flow's layer 2 and layer 3 fields, in rule index order. It holds all
+ * the per flow state, the table itself is only read during a lookup.
+ */
+struct fcm_filter_match
+{
+    struct fcm_filter_table *table;
+    struct fcm_filter_l2_info *l2_info;
+    struct fcm_filter_l3_info *l3_info;
+    struct fcm_filter_value values[FCM_FIELD_MAX];
+    uint64_t *bits;     /* Per field hits, then the candidates */
+    uint64_t bits_buf[(FCM_FIELD_MAX + 1) * FCM_FILTER_MATCH_WORDS];
+    size_t pos;
+};
+
 struct fcm_filter_mgr
 {
     int initialized;
     ds_dlist_t filter_type_list[FCM_MAX_FILTER_BY_NAME];
+    struct fcm_filter_table *tables[FCM_MAX_FILTER_BY_NAME];
     ds_tree_t name_list;
     char pid[16];
     void (*ovsdb_init)(void);
@@ -203,6 +248,18 @@ void fcm_filter_app_apply(char *filter_name,
                           bool *action);
 int fcm_filter_init(void);
 void fcm_filter_cleanup(void);
+
+struct fcm_filter_table *fcm_filter_table_build(ds_dlist_t *filter_list);
+void fcm_filter_table_free(struct fcm_filter_table *table);
+bool fcm_filter_table_match_init(struct fcm_filter_table *table,
+                                 struct fcm_filter_match *match,
+                                 struct fcm_filter_l2_info *l2_info,
+                                 struct fcm_filter_l3_info *l3_info);
+fcm_filter_t *fcm_filter_table_match_next(struct fcm_filter_match *match);
+void fcm_filter_table_match_fini(struct fcm_filter_match *match);
+bool fcm_filter_value_in(enum fcm_filter_field_id id, const char *value,
+                         const char *rule_value);
+
 void fcm_filter_print();
 void fcm_filter_app_print(struct fcm_filter_app *app);
 
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -374,53 +375,37 @@ bool fcm_find_app_names_in_tag(char *app_name, char *schema_tag)
 }
 
 /**
- * fcm_find_ip_addr_in_tag: looks up a mac address in a tag's value set
- * @ip_addr: string representation of a MAC
- * @schema_tag: tag name as read in ovsdb schema
+ * fcm_find_ip_addr_in_tag: looks up an ip address in a rule value
+ * @ip_addr: string representation of an IP address
+ * @schema_tag: tag name, address or CIDR as read in ovsdb schema
  *
- * Looks up a tag by its name, then looks up the mac in the tag values set.
+ * Matches the same way as the compiled filter table.
  * Returns true if found, false otherwise.
  */
 
 static
 bool fcm_find_ip_addr_in_tag(char *ip_addr, char *schema_tag)
 {
-    bool rc;
-    int ret;
-
     if (schema_tag == NULL) return true;
 
-    rc = om_tag_in(ip_addr, schema_tag);
-    if (rc) return true;
-
-    ret = strncmp(ip_addr, schema_tag, strlen(ip_addr));
-
-    return (ret == 0);
+    return fcm_filter_value_in(FCM_FIELD_SRC_IP, ip_addr, schema_tag);
 }
 
 /**
- * fcm_find_device_in_tag: looks up a mac address in a tag's value set
+ * fcm_find_device_in_tag: looks up a mac address in a rule value
  * @mac_s: string representation of a MAC
- * @schema_tag: tag name as read in ovsdb schema
+ * @schema_tag: tag name or MAC as read in ovsdb schema
  *
- * Looks up a tag by its name, then looks up the mac in the tag values set.
+ * Matches the same way as the compiled filter table.
  * Returns true if found, false otherwise.
  */
 
 static
 bool fcm_find_device_in_tag(char *mac_s, char *schema_tag)
 {
-    bool rc;
-    int ret;
-
     if (schema_tag == NULL) return true;
 
-    rc = om_tag_in(mac_s, schema_tag);
-    if (rc) return true;
-
-    ret = strncmp(mac_s, schema_tag, strlen(mac_s));
-
-    return (ret == 0);
+    return fcm_filter_value_in(FCM_FIELD_SMAC, mac_s, schema_tag);
 }
 
 /**
@@ -1086,6 +1071,39 @@ ds_dlist_t *fcm_filter_get_list_by_name(char *filter_name)
     return NULL;
 }
 
+/**
+ * fcm_filter_get_table: returns the compiled form of a filter list
+ * @filter_head: the filter list
+ *
+ * The table is compiled on first use after a change of the list.
+ * Returns NULL if the list could not be compiled.
+ */
+static
+struct fcm_filter_table *fcm_filter_get_table(ds_dlist_t *filter_head)
+{
+    struct fcm_filter_mgr *mgr = get_filter_mgr();
+    ptrdiff_t i;
+
+    i = filter_head - mgr->filter_type_list;
+    if (i < 0 || i >= FCM_MAX_FILTER_BY_NAME) return NULL;
+
+    if (!mgr->tables[i]) mgr->tables[i] = fcm_filter_table_build(filter_head);
+    return mgr->tables[i];
+}
+
+static
+void fcm_filter_invalidate_table(ds_dlist_t *filter_head)
+{
+    struct fcm_filter_mgr *mgr = get_filter_mgr();
+    ptrdiff_t i;
+
+    i = filter_head - mgr->filter_type_list;
+    if (i < 0 || i >= FCM_MAX_FILTER_BY_NAME) return;
+
+    fcm_filter_table_free(mgr->tables[i]);
+    mgr->tables[i] = NULL;
+}
+
 /**
  * fcm_add_filter: add a FCM Filter
  * @policy: the policy to add
@@ -1121,6 +1139,7 @@ void fcm_add_filter(struct schema_FCM_Filter *filter)
     }
 
     rule->valid = true;
+    fcm_filter_invalidate_table(filter_head);
     fcm_filter_insert_rule(filter_head, rule);
 
     if (LOG_SEVERITY_ENABLED(LOG_SEVERITY_TRACE))
@@ -1152,6 +1171,7 @@ void fcm_delete_filter(struct schema_FCM_Filter *filter)
     }
 
     rule = fcm_filter_find_rule(filter_head, filter->index);
+    fcm_filter_invalidate_table(filter_head);
 
     LOGT("fcm_filter: Removing filter index %d = index %d", rule->filter_rule.index,
          filter->index);
@@ -1183,6 +1203,7 @@ void fcm_update_filter(struct schema_FCM_Filter *old_rec,
         LOGE("fcm_filter: Couldn't find the filter[%s] to update", new_rec->name);
         return;
     }
+    fcm_filter_invalidate_table(filter_head);
 
     /* find the rule based on index */
     if (old_rec->index_exists)
@@ -1291,6 +1312,8 @@ void fcm_filter_layer2_apply(char *filter_name, struct fcm_filter_l2_info *l2_in
 {
     struct fcm_filter_mgr *mgr = get_filter_mgr();
     struct fcm_filter *rule = NULL;
+    struct fcm_filter_table *table;
+    struct fcm_filter_match match;
     bool allow = true;
     bool action_op = true;
 
@@ -1311,6 +1334,25 @@ void fcm_filter_layer2_apply(char *filter_name, struct fcm_filter_l2_info *l2_in
         return;
     }
 
+    table = fcm_filter_get_table(filter_head);
+    if (table && fcm_filter_table_match_init(table, &match, l2_info, NULL))
+    {
+        while ((rule = fcm_filter_table_match_next(&match)) != NULL)
+        {
+            pktcnt_allow = fcm_pkt_cnt_filter(mgr, &rule->filter_rule, pkts);
+            allow = (pktcnt_allow == FCM_RULED_FALSE? false: true);
+
+            LOGT("fcm_filter: rule index %d --> pktcnt_allow %d rule sucess %s",
+                 rule->filter_rule.index, pktcnt_allow, allow?"YES":"NO");
+
+            action_op = fcm_action_filter(&rule->filter_rule);
+            if (allow) break;
+        }
+        if (rule == NULL) allow = false;
+        fcm_filter_table_match_fini(&match);
+        goto out;
+    }
+
     ds_dlist_foreach(filter_head, rule)
     {
         allow = true;
@@ -1356,6 +1398,8 @@ void fcm_filter_7tuple_apply(char *filter_name, struct fcm_filter_l2_info *l2_in
 {
     struct fcm_filter_mgr *mgr = get_filter_mgr();
     struct fcm_filter *rule = NULL;
+    struct fcm_filter_table *table;
+    struct fcm_filter_match match;
     bool allow = true;
     bool action_op = true;
     ds_dlist_t *filter_head = NULL;
@@ -1378,6 +1422,35 @@ void fcm_filter_7tuple_apply(char *filter_name, struct fcm_filter_l2_info *l2_in
         *action = true;
         return;
     }
+
+    table = fcm_filter_get_table(filter_head);
+    if (table && fcm_filter_table_match_init(table, &match, l2_info, l3_info))
+    {
+        while ((rule = fcm_filter_table_match_next(&match)) != NULL)
+        {
+            allow = true;
+            if (fkey)
+            {
+                name_allow = fcm_app_name_filter(&rule->app, fkey);
+                allow &= (name_allow == FCM_RULED_FALSE? false: true);
+            }
+            if (pkts)
+            {
+                pktcnt_allow = fcm_pkt_cnt_filter(mgr, &rule->filter_rule, pkts);
+                allow &= (pktcnt_allow == FCM_RULED_FALSE? false: true);
+            }
+
+            LOGT("fcm_filter: rule index %d --> rule sucess %s",
+                 rule->filter_rule.index, allow?"YES":"NO");
+
+            action_op = fcm_action_filter(&rule->filter_rule);
+            if (allow) break;
+        }
+        if (rule == NULL) allow = false;
+        fcm_filter_table_match_fini(&match);
+        goto tuple_out;
+    }
+
     ds_dlist_foreach(filter_head, rule)
     {
         allow = true;
@@ -1557,6 +1630,9 @@ void fcm_filter_cleanup(void)
 
     for (i = 0; i < FCM_MAX_FILTER_BY_NAME; i++)
     {
+        fcm_filter_table_free(mgr->tables[i]);
+        mgr->tables[i] = NULL;
+
         while (!ds_dlist_is_empty(&mgr->filter_type_list[i]))
         {
             rule = ds_dlist_head(&mgr->filter_type_list[i]);
@@ -0,0 +1,952 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "ds_dlist.h"
+#include "os_nif.h"
+#include "ovsdb_utils.h"
+#include "policy_tags.h"
+#include "fcm_filter.h"
+
+/*
+ * A filter list compiled into binary form.
+ *
+ * Literal addresses and CIDRs of the src_ip/dst_ip sets are stored in a
+ * binary prefix trie per family, literal MACs of the smac/dmac sets in a
+ * hash. Each trie node and MAC entry carries the bitmap of the rules it
+ * belongs to, so a single lookup per flow field tells which rules contain
+ * the flow value. Rules whose field is fully compiled are then pruned from
+ * the candidate bitmap before any of them gets evaluated: the first set bit
+ * left is the first rule that may match.
+ *
+ * Tag references are resolved to tag handles. Values that could not be
+ * compiled are kept as strings, and checked with fcm_filter_value_in() like
+ * the rules of a list that could not be compiled at all.
+ *
+ * The table is read only once built. The per flow state, hits and candidate
+ * bitmaps, lives in the fcm_filter_match iterator.
+ */
+
+#define FCM_FILTER_BITS 64
+
+struct fcm_filter_lpm_node
+{
+    struct fcm_filter_lpm_node *child[2];
+    bool has_rules;
+    uint64_t rules[];
+};
+
+struct fcm_filter_mac_entry
+{
+    bool used;
+    os_macaddr_t mac;
+    uint64_t *rules;
+};
+
+struct fcm_filter_mac_set
+{
+    struct fcm_filter_mac_entry *entries;
+    size_t size;    /* Power of 2 */
+    size_t count;
+};
+
+struct fcm_filter_field
+{
+    bool present;
+    enum fcm_operation op;
+    om_tag_handle_t **tags;
+    size_t n_tags;
+    char **strs;    /* Owned by the rule */
+    size_t n_strs;
+};
+
+struct fcm_filter_ports
+{
+    bool present;
+    enum fcm_operation op;
+    struct ip_port *ranges; /* Sorted, merged, port_max inclusive */
+    size_t n_ranges;
+};
+
+struct fcm_filter_crule
+{
+    fcm_filter_t *rule;
+    struct fcm_filter_field fields[FCM_FIELD_MAX];
+    struct fcm_filter_ports sport;
+    struct fcm_filter_ports dport;
+};
+
+struct fcm_filter_table
+{
+    size_t n_rules;
+    size_t nwords;
+    struct fcm_filter_crule *rules;
+    struct fcm_filter_mac_set macs[2];                  /* smac, dmac */
+    struct fcm_filter_lpm_node *lpm[2][2];              /* [src, dst][v4, v6] */
+    uint64_t *strict_in[FCM_FIELD_MAX];
+    uint64_t *strict_out[FCM_FIELD_MAX];
+    uint64_t *bitmaps;
+};
+
+
+static inline void
+fcm_filter_bit_set(uint64_t *bitmap, size_t idx)
+{
+    bitmap[idx / FCM_FILTER_BITS] |= (1ULL << (idx % FCM_FILTER_BITS));
+}
+
+static inline bool
+fcm_filter_bit_test(uint64_t *bitmap, size_t idx)
+{
+    return (bitmap[idx / FCM_FILTER_BITS] >> (idx % FCM_FILTER_BITS)) & 1;
+}
+
+static inline bool
+fcm_filter_field_is_mac(enum fcm_filter_field_id id)
+{
+    return (id == FCM_FIELD_SMAC || id == FCM_FIELD_DMAC);
+}
+
+static inline uint64_t *
+fcm_filter_match_hits(struct fcm_filter_match *match,
+                      enum fcm_filter_field_id id)
+{
+    return match->bits + id * match->table->nwords;
+}
+
+static inline uint64_t *
+fcm_filter_match_candidates(struct fcm_filter_match *match)
+{
+    return match->bits + FCM_FIELD_MAX * match->table->nwords;
+}
+
+
+/**
+ * fcm_filter_parse_prefix: parses an address or a CIDR
+ * @value: the string to parse, "192.168.1.0/24", "fe80::1"...
+ * @af: set to the address family
+ * @addr: set to the address in network order, 16 bytes
+ * @plen: set to the prefix length, the full address length if none given
+ *
+ * Returns true if the value is an address or a CIDR, false otherwise.
+ */
+static bool
+fcm_filter_parse_prefix(const char *value, int *af, uint8_t *addr, int *plen)
+{
+    char buf[FCM_FILTER_IP_SIZE];
+    char *slash;
+    char *end;
+    long len;
+    int max;
+
+    if (strlen(value) >= sizeof(buf)) return false;
+    strcpy(buf, value);
+
+    slash = strchr(buf, '/');
+    if (slash) *slash = '\0';
+
+    *af = strchr(buf, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(*af, buf, addr) != 1) return false;
+
+    max = (*af == AF_INET) ? 32 : 128;
+    *plen = max;
+    if (!slash) return true;
+
+    len = strtol(slash + 1, &end, 10);
+    if (end == slash + 1 || *end != '\0') return false;
+    if (len < 0 || len > max) return false;
+
+    *plen = (int)len;
+    return true;
+}
+
+/* Compares the first plen bits of two addresses */
+static bool
+fcm_filter_prefix_equal(const uint8_t *a, const uint8_t *b, int plen)
+{
+    int bytes = plen / 8;
+    int bits = plen % 8;
+    uint8_t mask;
+
+    if (memcmp(a, b, bytes)) return false;
+    if (bits == 0) return true;
+
+    mask = (uint8_t)(0xff << (8 - bits));
+    return ((a[bytes] ^ b[bytes]) & mask) == 0;
+}
+
+/* Converts a flow MAC or IP address to binary */
+static void
+fcm_filter_value_init(struct fcm_filter_value *v, enum fcm_filter_field_id id,
+                      const char *str)
+{
+    memset(v, 0, sizeof(*v));
+    v->str = str;
+
+    if (fcm_filter_field_is_mac(id))
+    {
+        v->valid = os_nif_macaddr_from_str(&v->addr.mac, str);
+        return;
+    }
+
+    v->af = strchr(str, ':') ? AF_INET6 : AF_INET;
+    v->valid = (inet_pton(v->af, str, v->addr.ip) == 1);
+}
+
+/* Checks a flow value against a tag */
+static bool
+fcm_filter_tag_in(om_tag_handle_t *handle, enum fcm_filter_field_id id,
+                  struct fcm_filter_value *v)
+{
+    if (!v->valid) return om_tag_handle_in(handle, (char *)v->str);
+
+    if (fcm_filter_field_is_mac(id)) return om_tag_handle_in_mac(handle, &v->addr.mac);
+
+    return om_tag_handle_in_ip(handle, v->af, v->addr.ip);
+}
+
+/* Checks a flow value against a MAC, an address, a CIDR or a plain string */
+static bool
+fcm_filter_literal_in(enum fcm_filter_field_id id, struct fcm_filter_value *v,
+                      const char *rule_value)
+{
+    os_macaddr_t mac;
+    uint8_t addr[16];
+    int plen;
+    int af;
+
+    if (v->valid && fcm_filter_field_is_mac(id))
+    {
+        if (os_nif_macaddr_from_str(&mac, rule_value))
+        {
+            return !memcmp(&mac, &v->addr.mac, sizeof(mac));
+        }
+    }
+    else if (v->valid)
+    {
+        if (fcm_filter_parse_prefix(rule_value, &af, addr, &plen))
+        {
+            return (af == v->af && fcm_filter_prefix_equal(addr, v->addr.ip, plen));
+        }
+    }
+
+    return !strcmp(v->str, rule_value);
+}
+
+/**
+ * fcm_filter_value_in: checks a flow address against a value of a rule set
+ * @id: the rule field, tells MACs and IP addresses apart
+ * @value: the flow MAC or IP address
+ * @rule_value: a tag reference, a MAC, an address, a CIDR or a plain string
+ *
+ * The same matching as the compiled table, for the rules of a list that
+ * could not be compiled.
+ * Returns true if the value is in the rule value, false otherwise.
+ */
+bool
+fcm_filter_value_in(enum fcm_filter_field_id id, const char *value,
+                    const char *rule_value)
+{
+    struct fcm_filter_value v;
+    om_tag_handle_t *handle;
+    bool rc;
+
+    fcm_filter_value_init(&v, id, value);
+
+    handle = om_tag_handle_get(rule_value);
+    if (handle != NULL)
+    {
+        rc = fcm_filter_tag_in(handle, id, &v);
+        om_tag_handle_put(handle);
+        return rc;
+    }
+
+    /* Out of memory for the handle, check the tag values as strings */
+    if (om_tag_get_type((char *)rule_value) != NOT_A_OPENSYNC_TAG)
+    {
+        return om_tag_in((char *)value, (char *)rule_value);
+    }
+
+    return fcm_filter_literal_in(id, &v, rule_value);
+}
+
+static bool
+fcm_filter_lpm_insert(struct fcm_filter_table *table,
+                      struct fcm_filter_lpm_node **root,
+                      const uint8_t *addr, int plen, size_t idx)
+{
+    struct fcm_filter_lpm_node **slot = root;
+    int bit;
+    int b;
+
+    for (bit = 0; ; bit++)
+    {
+        if (*slot == NULL)
+        {
+            *slot = calloc(1, sizeof(**slot) + table->nwords * sizeof(uint64_t));
+            if (*slot == NULL) return false;
+        }
+        if (bit == plen) break;
+
+        b = (addr[bit / 8] >> (7 - (bit % 8))) & 1;
+        slot = &(*slot)->child[b];
+    }
+
+    (*slot)->has_rules = true;
+    fcm_filter_bit_set((*slot)->rules, idx);
+    return true;
+}
+
+/* ORs the rules of all the prefixes covering addr into hits */
+static void
+fcm_filter_lpm_lookup(struct fcm_filter_table *table,
+                      struct fcm_filter_lpm_node *node,
+                      const uint8_t *addr, int max, uint64_t *hits)
+{
+    size_t w;
+    int bit = 0;
+    int b;
+
+    while (node != NULL)
+    {
+        if (node->has_rules)
+        {
+            for (w = 0; w < table->nwords; w++) hits[w] |= node->rules[w];
+        }
+        if (bit == max) break;
+
+        b = (addr[bit / 8] >> (7 - (bit % 8))) & 1;
+        node = node->child[b];
+        bit++;
+    }
+}
+
+static void
+fcm_filter_lpm_free(struct fcm_filter_lpm_node *node)
+{
+    if (node == NULL) return;
+
+    fcm_filter_lpm_free(node->child[0]);
+    fcm_filter_lpm_free(node->child[1]);
+    free(node);
+}
+
+static size_t
+fcm_filter_mac_hash(const os_macaddr_t *mac)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < sizeof(mac->addr); i++)
+    {
+        hash ^= mac->addr[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static struct fcm_filter_mac_entry *
+fcm_filter_mac_slot(struct fcm_filter_mac_set *set, const os_macaddr_t *mac)
+{
+    struct fcm_filter_mac_entry *e;
+    size_t i;
+
+    if (set->size == 0) return NULL;
+
+    i = fcm_filter_mac_hash(mac) & (set->size - 1);
+    for (;;)
+    {
+        e = &set->entries[i];
+        if (!e->used) return e;
+        if (!memcmp(&e->mac, mac, sizeof(*mac))) return e;
+        i = (i + 1) & (set->size - 1);
+    }
+}
+
+static bool
+fcm_filter_mac_grow(struct fcm_filter_mac_set *set)
+{
+    struct fcm_filter_mac_entry *old = set->entries;
+    struct fcm_filter_mac_entry *e;
+    size_t old_size = set->size;
+    size_t i;
+
+    set->size = old_size ? old_size * 2 : 16;
+    set->entries = calloc(set->size, sizeof(*set->entries));
+    if (set->entries == NULL)
+    {
+        set->entries = old;
+        set->size = old_size;
+        return false;
+    }
+
+    for (i = 0; i < old_size; i++)
+    {
+        if (!old[i].used) continue;
+        e = fcm_filter_mac_slot(set, &old[i].mac);
+        *e = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static bool
+fcm_filter_mac_insert(struct fcm_filter_table *table,
+                      struct fcm_filter_mac_set *set,
+                      const os_macaddr_t *mac, size_t idx)
+{
+    struct fcm_filter_mac_entry *e;
+
+    /* Keep the load factor under 1/2 */
+    if ((set->count + 1) * 2 > set->size)
+    {
+        if (!fcm_filter_mac_grow(set)) return false;
+    }
+
+    e = fcm_filter_mac_slot(set, mac);
+    if (!e->used)
+    {
+        e->rules = calloc(table->nwords, sizeof(uint64_t));
+        if (e->rules == NULL) return false;
+        e->used = true;
+        e->mac = *mac;
+        set->count++;
+    }
+
+    fcm_filter_bit_set(e->rules, idx);
+    return true;
+}
+
+static void
+fcm_filter_mac_free(struct fcm_filter_mac_set *set)
+{
+    size_t i;
+
+    for (i = 0; i < set->size; i++) free(set->entries[i].rules);
+    free(set->entries);
+    memset(set, 0, sizeof(*set));
+}
+
+static bool
+fcm_filter_table_add_field(struct fcm_filter_table *table, size_t idx,
+                           enum fcm_filter_field_id id,
+                           struct str_set *set, enum fcm_operation op)
+{
+    struct fcm_filter_field *field = &table->rules[idx].fields[id];
+    om_tag_handle_t *handle;
+    os_macaddr_t mac;
+    uint8_t addr[16];
+    char *value;
+    size_t i;
+    bool rc;
+    int plen;
+    int af;
+
+    field->op = op;
+    field->present = (set != NULL);
+    if (set == NULL) return true;
+
+    field->tags = calloc(set->nelems + 1, sizeof(*field->tags));
+    field->strs = calloc(set->nelems + 1, sizeof(*field->strs));
+    if (field->tags == NULL || field->strs == NULL) return false;
+
+    for (i = 0; i < set->nelems; i++)
+    {
+        value = set->array[i];
+
+        handle = om_tag_handle_get(value);
+        if (handle != NULL)
+        {
+            field->tags[field->n_tags++] = handle;
+            continue;
+        }
+
+        if (fcm_filter_field_is_mac(id))
+        {
+            rc = os_nif_macaddr_from_str(&mac, value);
+            if (rc) rc = fcm_filter_mac_insert(table, &table->macs[id], &mac, idx);
+        }
+        else
+        {
+            rc = fcm_filter_parse_prefix(value, &af, addr, &plen);
+            if (rc)
+            {
+                rc = fcm_filter_lpm_insert(table,
+                                           &table->lpm[id - FCM_FIELD_SRC_IP][af == AF_INET6],
+                                           addr, plen, idx);
+            }
+        }
+        if (!rc) field->strs[field->n_strs++] = value;
+    }
+
+    /* Fully compiled, the binary lookup alone decides */
+    if (field->n_tags == 0 && field->n_strs == 0)
+    {
+        if (op == FCM_OP_IN) fcm_filter_bit_set(table->strict_in[id], idx);
+        if (op == FCM_OP_OUT) fcm_filter_bit_set(table->strict_out[id], idx);
+    }
+
+    return true;
+}
+
+static int
+fcm_filter_port_cmp(const void *a, const void *b)
+{
+    const struct ip_port *pa = a;
+    const struct ip_port *pb = b;
+
+    return (int)pa->port_min - (int)pb->port_min;
+}
+
+static bool
+fcm_filter_table_add_ports(struct fcm_filter_ports *ports,
+                           struct ip_port *src, int len,
+                           enum fcm_operation op)
+{
+    struct ip_port *last;
+    size_t n = 0;
+    int i;
+
+    ports->op = op;
+    ports->present = (src != NULL);
+    if (src == NULL || len <= 0) return true;
+
+    ports->ranges = calloc(len, sizeof(*ports->ranges));
+    if (ports->ranges == NULL) return false;
+
+    /* A null port_max means a single port. A port_max below port_min too. */
+    for (i = 0; i < len; i++)
+    {
+        ports->ranges[i].port_min = src[i].port_min;
+        ports->ranges[i].port_max = (src[i].port_max > src[i].port_min) ?
+                                    src[i].port_max : src[i].port_min;
+    }
+    qsort(ports->ranges, len, sizeof(*ports->ranges), fcm_filter_port_cmp);
+
+    for (i = 1; i < len; i++)
+    {
+        last = &ports->ranges[n];
+        if ((int)ports->ranges[i].port_min <= (int)last->port_max + 1)
+        {
+            if (ports->ranges[i].port_max > last->port_max)
+                last->port_max = ports->ranges[i].port_max;
+            continue;
+        }
+        ports->ranges[++n] = ports->ranges[i];
+    }
+    ports->n_ranges = n + 1;
+
+    return true;
+}
+
+static bool
+fcm_filter_ports_in(struct fcm_filter_ports *ports, uint16_t port)
+{
+    size_t lo = 0;
+    size_t hi = ports->n_ranges;
+    size_t mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (port < ports->ranges[mid].port_min) hi = mid;
+        else if (port > ports->ranges[mid].port_max) lo = mid + 1;
+        else return true;
+    }
+    return false;
+}
+
+static bool
+fcm_filter_option(enum fcm_operation op, bool present)
+{
+    if (op == FCM_OP_NONE) return true;
+    if (present && op == FCM_OP_OUT) return false;
+    if (!present && op == FCM_OP_IN) return false;
+
+    return true;
+}
+
+static bool
+fcm_filter_ports_check(struct fcm_filter_ports *ports, uint16_t port)
+{
+    if (!ports->present) return true;
+    return fcm_filter_option(ports->op, fcm_filter_ports_in(ports, port));
+}
+
+static bool
+fcm_filter_int_check(struct int_set *set, enum fcm_operation op, int value)
+{
+    bool present = false;
+    size_t i;
+
+    if (set == NULL) return true;
+
+    for (i = 0; i < set->nelems && !present; i++)
+    {
+        present = (set->array[i] == value);
+    }
+    return fcm_filter_option(op, present);
+}
+
+static bool
+fcm_filter_field_check(struct fcm_filter_match *match, size_t idx,
+                       enum fcm_filter_field_id id)
+{
+    struct fcm_filter_field *field = &match->table->rules[idx].fields[id];
+    struct fcm_filter_value *v = &match->values[id];
+    bool present;
+    size_t i;
+
+    if (!field->present) return true;
+    if (field->op == FCM_OP_NONE) return true;
+
+    present = fcm_filter_bit_test(fcm_filter_match_hits(match, id), idx);
+
+    for (i = 0; i < field->n_tags && !present; i++)
+    {
+        present = fcm_filter_tag_in(field->tags[i], id, v);
+    }
+
+    for (i = 0; i < field->n_strs && !present; i++)
+    {
+        present = fcm_filter_literal_in(id, v, field->strs[i]);
+    }
+
+    return fcm_filter_option(field->op, present);
+}
+
+static bool
+fcm_filter_table_rule_check(struct fcm_filter_match *match, size_t idx)
+{
+    struct fcm_filter_crule *crule = &match->table->rules[idx];
+    schema_FCM_Filter_rule_t *rule = &crule->rule->filter_rule;
+    struct fcm_filter_l2_info *l2_info = match->l2_info;
+    struct fcm_filter_l3_info *l3_info = match->l3_info;
+
+    if (l3_info)
+    {
+        if (!fcm_filter_field_check(match, idx, FCM_FIELD_SRC_IP)) return false;
+        if (!fcm_filter_field_check(match, idx, FCM_FIELD_DST_IP)) return false;
+        if (!fcm_filter_ports_check(&crule->sport, l3_info->sport)) return false;
+        if (!fcm_filter_ports_check(&crule->dport, l3_info->dport)) return false;
+        if (!fcm_filter_int_check(rule->proto, rule->proto_op, l3_info->l4_proto))
+            return false;
+    }
+
+    if (l2_info)
+    {
+        if (!fcm_filter_field_check(match, idx, FCM_FIELD_SMAC)) return false;
+        if (!fcm_filter_field_check(match, idx, FCM_FIELD_DMAC)) return false;
+        if (!fcm_filter_int_check(rule->vlanid, rule->vlanid_op,
+                                  (int)l2_info->vlan_id))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * fcm_filter_table_free: frees a compiled filter table
+ * @table: the table to free, may be NULL
+ */
+void
+fcm_filter_table_free(struct fcm_filter_table *table)
+{
+    struct fcm_filter_crule *crule;
+    size_t i, j, k;
+
+    if (table == NULL) return;
+
+    for (i = 0; table->rules && i < table->n_rules; i++)
+    {
+        crule = &table->rules[i];
+        for (j = 0; j < FCM_FIELD_MAX; j++)
+        {
+            for (k = 0; k < crule->fields[j].n_tags; k++)
+            {
+                om_tag_handle_put(crule->fields[j].tags[k]);
+            }
+            free(crule->fields[j].tags);
+            free(crule->fields[j].strs);
+        }
+        free(crule->sport.ranges);
+        free(crule->dport.ranges);
+    }
+    free(table->rules);
+
+    fcm_filter_mac_free(&table->macs[0]);
+    fcm_filter_mac_free(&table->macs[1]);
+    for (i = 0; i < 2; i++)
+    {
+        fcm_filter_lpm_free(table->lpm[i][0]);
+        fcm_filter_lpm_free(table->lpm[i][1]);
+    }
+
+    free(table->bitmaps);
+    free(table);
+}
+
+/**
+ * fcm_filter_table_build: compiles a filter list
+ * @filter_list: the rules of a filter, sorted by index
+ *
+ * The table refers to the rules of the list, and must be freed whenever
+ * a rule is added, removed or modified.
+ * Returns the compiled table, NULL on allocation failure.
+ */
+struct fcm_filter_table *
+fcm_filter_table_build(ds_dlist_t *filter_list)
+{
+    struct fcm_filter_table *table;
+    struct fcm_filter_crule *crule;
+    schema_FCM_Filter_rule_t *fr;
+    struct fcm_filter *rule;
+    size_t nbitmaps;
+    size_t idx;
+    size_t i;
+    bool rc;
+
+    table = calloc(1, sizeof(*table));
+    if (table == NULL) return NULL;
+
+    ds_dlist_foreach(filter_list, rule) table->n_rules++;
+    table->nwords = table->n_rules / FCM_FILTER_BITS + 1;
+
+    table->rules = calloc(table->n_rules + 1, sizeof(*table->rules));
+    if (table->rules == NULL) goto err_free;
+
+    /* strict_in and strict_out per field */
+    nbitmaps = 2 * FCM_FIELD_MAX;
+    table->bitmaps = calloc(nbitmaps * table->nwords, sizeof(uint64_t));
+    if (table->bitmaps == NULL) goto err_free;
+
+    for (i = 0; i < FCM_FIELD_MAX; i++)
+    {
+        table->strict_in[i] = table->bitmaps + (2 * i) * table->nwords;
+        table->strict_out[i] = table->bitmaps + (2 * i + 1) * table->nwords;
+    }
+
+    idx = 0;
+    ds_dlist_foreach(filter_list, rule)
+    {
+        crule = &table->rules[idx];
+        crule->rule = rule;
+        fr = &rule->filter_rule;
+
+        rc = fcm_filter_table_add_field(table, idx, FCM_FIELD_SMAC,
+                                        fr->smac, fr->smac_op);
+        rc &= fcm_filter_table_add_field(table, idx, FCM_FIELD_DMAC,
+                                         fr->dmac, fr->dmac_op);
+        rc &= fcm_filter_table_add_field(table, idx, FCM_FIELD_SRC_IP,
+                                         fr->src_ip, fr->src_ip_op);
+        rc &= fcm_filter_table_add_field(table, idx, FCM_FIELD_DST_IP,
+                                         fr->dst_ip, fr->dst_ip_op);
+        rc &= fcm_filter_table_add_ports(&crule->sport, fr->src_port,
+                                         fr->src_port_len, fr->src_port_op);
+        rc &= fcm_filter_table_add_ports(&crule->dport, fr->dst_port,
+                                         fr->dst_port_len, fr->dst_port_op);
+        if (!rc) goto err_free;
+
+        idx++;
+    }
+
+    LOGT("fcm_filter: compiled %zu rules, %zu smacs, %zu dmacs",
+         table->n_rules, table->macs[0].count, table->macs[1].count);
+
+    return table;
+
+err_free:
+    LOGE("fcm_filter: failed to compile the filter rules");
+    fcm_filter_table_free(table);
+    return NULL;
+}
+
+/**
+ * fcm_filter_table_match_init: starts a lookup of the rules matching a flow
+ * @table: the compiled filter
+ * @match: the iterator to initialize
+ * @l2_info: the flow layer 2 info, may be NULL
+ * @l3_info: the flow layer 3 info, may be NULL
+ *
+ * Converts the flow fields to binary once, looks them up in the compiled
+ * sets, and prunes the rules the lookups already rule out.
+ * Returns false if the iterator could not be allocated, the caller then
+ * checks the rules one by one.
+ */
+bool
+fcm_filter_table_match_init(struct fcm_filter_table *table,
+                            struct fcm_filter_match *match,
+                            struct fcm_filter_l2_info *l2_info,
+                            struct fcm_filter_l3_info *l3_info)
+{
+    struct fcm_filter_mac_entry *e;
+    struct fcm_filter_lpm_node *root;
+    struct fcm_filter_value *v;
+    uint64_t *candidates;
+    uint64_t *hits;
+    size_t nwords;
+    size_t first, last;
+    size_t w;
+    int dir;
+    int id;
+
+    memset(match, 0, sizeof(*match));
+    match->table = table;
+    match->l2_info = l2_info;
+    match->l3_info = l3_info;
+
+    /* Per field hits, then the candidates */
+    nwords = (FCM_FIELD_MAX + 1) * table->nwords;
+    match->bits = match->bits_buf;
+    if (nwords > ARRAY_SIZE(match->bits_buf))
+    {
+        match->bits = calloc(nwords, sizeof(uint64_t));
+        if (match->bits == NULL) return false;
+    }
+
+    if (l2_info)
+    {
+        fcm_filter_value_init(&match->values[FCM_FIELD_SMAC], FCM_FIELD_SMAC,
+                              l2_info->src_mac);
+        fcm_filter_value_init(&match->values[FCM_FIELD_DMAC], FCM_FIELD_DMAC,
+                              l2_info->dst_mac);
+
+        for (dir = 0; dir < 2; dir++)
+        {
+            v = &match->values[FCM_FIELD_SMAC + dir];
+            if (!v->valid) continue;
+
+            e = fcm_filter_mac_slot(&table->macs[dir], &v->addr.mac);
+            if (e == NULL || !e->used) continue;
+
+            memcpy(fcm_filter_match_hits(match, FCM_FIELD_SMAC + dir), e->rules,
+                   table->nwords * sizeof(uint64_t));
+        }
+    }
+
+    if (l3_info)
+    {
+        fcm_filter_value_init(&match->values[FCM_FIELD_SRC_IP], FCM_FIELD_SRC_IP,
+                              l3_info->src_ip);
+        fcm_filter_value_init(&match->values[FCM_FIELD_DST_IP], FCM_FIELD_DST_IP,
+                              l3_info->dst_ip);
+
+        for (dir = 0; dir < 2; dir++)
+        {
+            v = &match->values[FCM_FIELD_SRC_IP + dir];
+            if (!v->valid) continue;
+
+            root = table->lpm[dir][v->af == AF_INET6];
+            fcm_filter_lpm_lookup(table, root, v->addr.ip,
+                                  (v->af == AF_INET) ? 32 : 128,
+                                  fcm_filter_match_hits(match, FCM_FIELD_SRC_IP + dir));
+        }
+    }
+
+    /* All the rules are candidates to start with */
+    candidates = fcm_filter_match_candidates(match);
+    for (w = 0; w < table->n_rules / FCM_FILTER_BITS; w++)
+    {
+        candidates[w] = ~0ULL;
+    }
+    if (table->n_rules % FCM_FILTER_BITS)
+    {
+        candidates[w] = (1ULL << (table->n_rules % FCM_FILTER_BITS)) - 1;
+    }
+
+    first = l2_info ? FCM_FIELD_SMAC : FCM_FIELD_SRC_IP;
+    last = l3_info ? FCM_FIELD_DST_IP : FCM_FIELD_DMAC;
+    for (id = first; id <= (int)last; id++)
+    {
+        hits = fcm_filter_match_hits(match, id);
+        for (w = 0; w < table->nwords; w++)
+        {
+            candidates[w] &= ~(table->strict_in[id][w] & ~hits[w]);
+            candidates[w] &= ~(table->strict_out[id][w] & hits[w]);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * fcm_filter_table_match_next: returns the next rule matching the flow
+ * @match: the iterator set by fcm_filter_table_match_init()
+ *
+ * Only the layer 2 and layer 3 fields are checked, the caller checks
+ * the app names and packet counts.
+ * Returns the next matching rule in index order, NULL when none is left.
+ */
+fcm_filter_t *
+fcm_filter_table_match_next(struct fcm_filter_match *match)
+{
+    struct fcm_filter_table *table = match->table;
+    uint64_t *candidates = fcm_filter_match_candidates(match);
+    uint64_t bits;
+    size_t idx;
+    size_t w;
+
+    while (match->pos < table->n_rules)
+    {
+        w = match->pos / FCM_FILTER_BITS;
+        bits = candidates[w] >> (match->pos % FCM_FILTER_BITS);
+        if (bits == 0)
+        {
+            match->pos = (w + 1) * FCM_FILTER_BITS;
+            continue;
+        }
+
+        idx = match->pos + __builtin_ctzll(bits);
+        match->pos = idx + 1;
+        if (idx >= table->n_rules) break;
+
+        if (fcm_filter_table_rule_check(match, idx))
+        {
+            return table->rules[idx].rule;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * fcm_filter_table_match_fini: releases an iterator
+ * @match: the iterator set by fcm_filter_table_match_init()
+ */
+void
+fcm_filter_table_match_fini(struct fcm_filter_match *match)
+{
+    if (match->bits != match->bits_buf) free(match->bits);
+    match->bits = NULL;
+}
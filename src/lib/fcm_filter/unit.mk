@@ -32,6 +32,7 @@ UNIT_DISABLE := $(if $(CONFIG_MANAGER_FCM),n,y)
 UNIT_TYPE := LIB
 UNIT_DIR := lib
 UNIT_SRC := src/fcm_filter.c
+UNIT_SRC += src/fcm_filter_table.c
 UNIT_SRC += src/fcm_report_filter.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
@@ -54,6 +54,16 @@ void setup_alloc_flow_tag(struct flow_key *fkey, char *appname,
 void free_flow_tag(struct flow_key *fkey);
 const char *test_name = "fcm_filter_ut";
 
+/* Fails all calloc() calls while set */
+static bool g_calloc_fail;
+
+void *__real_calloc(size_t nmemb, size_t size);
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    return g_calloc_fail ? NULL : __real_calloc(nmemb, size);
+}
+
 
 struct schema_FCM_Filter g_fcm_filter[] =
 {   /* entry 0 */
@@ -176,6 +186,21 @@ struct schema_FCM_Filter g_fcm_filter[] =
         .apptag_op = "in",
         .apptags_len = 3,
 
+        .action = "include",
+    },
+    /* entry 7 */
+    /* subnet and port range filter */
+    {
+        .name = "fcm_filter_cidr",
+        .index = 8,
+        .src_ip_len = 1,
+        .src_ip[0] = "192.168.40.0/24",
+        .src_ip_op = "in",
+        .dst_port_len = 2,
+        .dst_port[0] = "8000-9000",
+        .dst_port[1] = "68",
+        .dst_port_op = "in",
+
         .action = "include",
     }
 };
@@ -316,6 +341,7 @@ void setUp(void)
 
 void tearDown(void)
 {
+    g_calloc_fail = false;
     fcm_filter_cleanup();
 
     free_flow_tag(&g_fkey[0]);
@@ -628,6 +654,106 @@ void test_fcm_filter_ip(void)
 
 }
 
+void test_fcm_filter_cidr(void)
+{
+    struct schema_FCM_Filter *sch_filter;
+    bool allow = false;
+
+    sch_filter = &g_fcm_filter[7];
+    g_mon.mon_type = OVSDB_UPDATE_NEW;
+    callback_FCM_Filter(&g_mon, NULL, sch_filter);
+
+    /* source in the subnet, destination port in the range */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[2],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_TRUE(allow);
+
+    /* source in the subnet, single destination port */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[0],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_TRUE(allow);
+
+    /* destination port out of the range */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[1],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_FALSE(allow);
+
+    /* source out of the subnet */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[3],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_FALSE(allow);
+}
+
+void test_fcm_filter_cidr_no_table(void)
+{
+    struct schema_FCM_Filter *sch_filter;
+    bool allow = false;
+
+    sch_filter = &g_fcm_filter[7];
+    g_mon.mon_type = OVSDB_UPDATE_NEW;
+    callback_FCM_Filter(&g_mon, NULL, sch_filter);
+
+    /* The filter can't be compiled, rules are checked one by one */
+    g_calloc_fail = true;
+
+    /* source in the subnet, destination port in the range */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[2],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_TRUE(allow);
+
+    /* destination port out of the range */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[1],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_FALSE(allow);
+
+    /* source out of the subnet */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[3],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_FALSE(allow);
+
+    g_calloc_fail = false;
+}
+
+void test_fcm_filter_match_interleaved(void)
+{
+    struct fcm_filter_mgr *mgr = get_filter_mgr();
+    struct schema_FCM_Filter *sch_filter;
+    struct fcm_filter_table *table = NULL;
+    struct fcm_filter_match match_in;
+    struct fcm_filter_match match_out;
+    bool allow = false;
+    bool rc;
+    int i;
+
+    sch_filter = &g_fcm_filter[7];
+    g_mon.mon_type = OVSDB_UPDATE_NEW;
+    callback_FCM_Filter(&g_mon, NULL, sch_filter);
+
+    /* Compile the filter */
+    fcm_filter_7tuple_apply("fcm_filter_cidr", NULL, &g_flow_l3[2],
+                            NULL, NULL, &allow);
+    TEST_ASSERT_TRUE(allow);
+
+    for (i = 0; i < FCM_MAX_FILTER_BY_NAME && table == NULL; i++)
+    {
+        table = mgr->tables[i];
+    }
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* Two lookups on the same table don't share any state */
+    rc = fcm_filter_table_match_init(table, &match_in, NULL, &g_flow_l3[2]);
+    TEST_ASSERT_TRUE(rc);
+    rc = fcm_filter_table_match_init(table, &match_out, NULL, &g_flow_l3[3]);
+    TEST_ASSERT_TRUE(rc);
+
+    TEST_ASSERT_NOT_NULL(fcm_filter_table_match_next(&match_in));
+    TEST_ASSERT_NULL(fcm_filter_table_match_next(&match_out));
+    TEST_ASSERT_NULL(fcm_filter_table_match_next(&match_in));
+
+    fcm_filter_table_match_fini(&match_out);
+    fcm_filter_table_match_fini(&match_in);
+}
+
 void test_fcm_filter_app_add(void)
 {
     struct schema_FCM_Filter *sch_filter;
@@ -770,6 +896,9 @@ int main(int argc, char *argv[])
     RUN_TEST(test_fcm_filter_delete);
     RUN_TEST(test_fcm_filter_update);
     RUN_TEST(test_fcm_filter_ip);
+    RUN_TEST(test_fcm_filter_cidr);
+    RUN_TEST(test_fcm_filter_cidr_no_table);
+    RUN_TEST(test_fcm_filter_match_interleaved);
     // App filter tests.
     RUN_TEST(test_fcm_filter_app_add);
     RUN_TEST(test_fcm_filter_app_delete);
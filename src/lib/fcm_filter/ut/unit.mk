@@ -32,6 +32,9 @@ UNIT_SRC := test_fcm_filter.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 
+# Allocation failures are injected by the test
+UNIT_LDFLAGS := -Wl,--wrap=calloc
+
 UNIT_DEPS += src/lib/log
 UNIT_DEPS += src/lib/common
 UNIT_DEPS += src/lib/osa
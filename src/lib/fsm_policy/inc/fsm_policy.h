@@ -255,11 +255,27 @@ struct fsm_policy_req
  *   move on to the next check.
  * - Else the rule has failed.
  */
+/**
+ * @brief pre-resolved entry of a policy's macs set
+ *
+ * An entry is either a tag reference, resolved to its tag handle,
+ * or the string representation of a mac address, converted to binary.
+ */
+struct fsm_policy_mac
+{
+    struct om_tag_handle *tag;
+    os_macaddr_t mac;
+    bool mac_valid;
+};
+
+
 struct fsm_policy_rules
 {
     bool mac_rule_present;
     int mac_op;
     struct str_set *macs;
+    struct fsm_policy_mac *mac_entries;
+    size_t n_mac_entries;
     bool fqdn_rule_present;
     int fqdn_op;
     struct str_set *fqdns;
@@ -359,5 +375,7 @@ void fsm_policy_register_client(struct fsm_policy_client *client);
 void fsm_policy_deregister_client(struct fsm_policy_client *client);
 void fsm_policy_update_clients(struct policy_table *table);
 bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set);
+bool find_mac_in_entries(os_macaddr_t *mac, struct fsm_policy_mac *entries,
+                         size_t nelems);
 
 #endif /* FSM_POLICY_H_INCLUDED */
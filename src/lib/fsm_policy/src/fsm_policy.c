@@ -164,6 +164,41 @@ bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set)
     return false;
 }
 
+/**
+ * @brief looks up a mac address in a policy's pre-resolved macs set.
+ *
+ * @param mac the mac address to look up
+ * @param entries the resolved macs set entries
+ * @param nelems the number of entries
+ * @return true if found, false otherwise.
+ */
+bool find_mac_in_entries(os_macaddr_t *mac, struct fsm_policy_mac *entries,
+                         size_t nelems)
+{
+    struct fsm_policy_mac *entry;
+    size_t i;
+    bool rc;
+
+    for (i = 0; i < nelems; i++)
+    {
+        entry = &entries[i];
+
+        if (entry->tag != NULL)
+        {
+            rc = om_tag_handle_in_mac(entry->tag, mac);
+            if (rc) return true;
+            continue;
+        }
+
+        if (!entry->mac_valid) continue;
+
+        rc = (memcmp(&entry->mac, mac, sizeof(*mac)) == 0);
+        if (rc) return true;
+    }
+
+    return false;
+}
+
 /**
  * @brief looks up a mac address in a policy's macs set.
  *
@@ -184,6 +219,12 @@ bool fsm_device_in_set(struct fsm_policy_req *req, struct fsm_policy *p)
 
     if (macs_set == NULL) return false;
 
+    if (p->rules.mac_entries != NULL)
+    {
+        return find_mac_in_entries(mac, p->rules.mac_entries,
+                                   p->rules.n_mac_entries);
+    }
+
     return find_mac_in_set(mac, macs_set);
 }
 
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <netdb.h>
 
 #include "os.h"
+#include "os_nif.h"
 #include "util.h"
 #include "ovsdb.h"
 #include "ovsdb_update.h"
@@ -203,6 +204,61 @@ void fsm_policy_get_next(struct policy_table *table,
     fpolicy->lookup_prev = idx;
 }
 
+/**
+ * @brief release the pre-resolved entries of a rule's macs set
+ *
+ * @param rules the rule instance
+ */
+static void
+fsm_free_mac_entries(struct fsm_policy_rules *rules)
+{
+    size_t i;
+
+    for (i = 0; i < rules->n_mac_entries; i++)
+    {
+        om_tag_handle_put(rules->mac_entries[i].tag);
+    }
+
+    free(rules->mac_entries);
+    rules->mac_entries = NULL;
+    rules->n_mac_entries = 0;
+}
+
+
+/**
+ * @brief pre-resolve a rule's macs set
+ *
+ * Tag references are turned into tag handles, mac addresses into their
+ * binary form, so that policy checks do not have to format or parse
+ * strings. On allocation failure, the checks fall back to the string set.
+ * @param rules the rule instance
+ */
+static void
+fsm_set_mac_entries(struct fsm_policy_rules *rules)
+{
+    struct fsm_policy_mac *entry;
+    struct str_set *macs;
+    size_t i;
+
+    macs = rules->macs;
+    if (macs == NULL || macs->nelems == 0) return;
+
+    rules->mac_entries = calloc(macs->nelems, sizeof(*rules->mac_entries));
+    if (rules->mac_entries == NULL) return;
+
+    rules->n_mac_entries = macs->nelems;
+    for (i = 0; i < macs->nelems; i++)
+    {
+        entry = &rules->mac_entries[i];
+        entry->tag = om_tag_handle_get(macs->array[i]);
+        if (entry->tag != NULL) continue;
+
+        entry->mac_valid = os_nif_macaddr_from_str(&entry->mac,
+                                                   macs->array[i]);
+    }
+}
+
+
 /**
  * @brief reset a rule and free its memory resources
  *
@@ -217,6 +273,7 @@ fsm_free_rules(struct fsm_policy_rules *rules)
     rules->mac_rule_present = false;
     rules->mac_op = -1;
     free_str_set(rules->macs);
+    fsm_free_mac_entries(rules);
 
     /* Reset fqdn check */
     rules->fqdn_rule_present = false;
@@ -271,7 +328,10 @@ bool fsm_set_mac_rules(struct fsm_policy_rules *rules,
                                  spolicy->macs_len,
                                  spolicy->macs);
     check = fsm_check_conversion(rules->macs, spolicy->macs_len);
-    return check;
+    if (!check) return false;
+
+    fsm_set_mac_entries(rules);
+    return true;
 }
 
 
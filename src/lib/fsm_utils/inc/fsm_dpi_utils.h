@@ -29,6 +29,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "fsm.h"
 
+/**
+ * @brief validity of the conntrack mark cached in a flow accumulator
+ *
+ * The conntrack entry may be re-created or its mark reset outside of FSM
+ * without FSM noticing: a verdict repeated after this many seconds is
+ * applied again.
+ */
+#define FSM_DPI_CT_MARK_TTL 60
+
 /**
  * @brief FSM DPI APIs using 5 tuples
  */
@@ -93,6 +102,15 @@ int fsm_set_dpi_state_timeout(
         uint32_t timeout
 );
 
+/**
+ * @brief cancels the pending conntrack mark updates of an aggregator
+ *
+ * To be called before the aggregator is freed.
+ *
+ * @param aggr the aggregator owning the flows
+ */
+void fsm_dpi_mark_cancel(struct net_md_aggregator *aggr);
+
 void fsm_dpi_set_acc_state(
         struct fsm_session *session,
         struct net_header_parser *net_parser,
@@ -24,9 +24,13 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <netinet/ip_icmp.h>
 #include <netinet/icmp6.h>
+#include <netinet/tcp.h>
 #include "log.h"
 #include "ds_tree.h"
 #include "nf_utils.h"
@@ -175,6 +179,33 @@ static void copy_nf_flow_from_net_hdr(
     flow->zone = zone;
 }
 
+/*
+ * Set the conntrack mark of a flow in both the default and the DPI zone.
+ * Both updates are queued in the conntrack batch and go out together in a
+ * single netlink write; an update that cannot be queued is sent
+ * synchronously.
+ *
+ * Returns a positive value if at least one zone was updated (or queued),
+ * 0 or a negative value otherwise.
+ */
+static int fsm_dpi_set_mark_zones(nf_flow_t *flow)
+{
+    int ret0;
+    int ret1;
+
+    flow->zone = DEFAULT_ZONE;
+    ret0 = nf_ct_batch_set_mark(flow, NULL, NULL);
+    ret0 = (ret0 == 0) ? 1 : nf_ct_set_mark(flow);
+
+    /* Set the conn mark for FSM_DPI_ZONE also */
+    flow->zone = FSM_DPI_ZONE;
+    ret1 = nf_ct_batch_set_mark(flow, NULL, NULL);
+    ret1 = (ret1 == 0) ? 1 : nf_ct_set_mark(flow);
+
+    /* -ve or 0 - failed in both zones or +ve atleast one zone passed */
+    return (ret0 + ret1);
+}
+
 // TODO ctx used to hold flow and its state when multiple plugins used
 int fsm_set_ip_dpi_state(
         void *ctx,
@@ -188,8 +219,6 @@ int fsm_set_ip_dpi_state(
 )
 {
     nf_flow_t flow;
-    int ret0;
-    int ret1;
 
     memset(&flow, 0, sizeof(flow));
     copy_nf_ip_flow(
@@ -202,13 +231,8 @@ int fsm_set_ip_dpi_state(
             family,
             DEFAULT_ZONE,
             state);
-    ret0 = nf_ct_set_mark(&flow);
-    /* Set the conn mark for FSM_DPI_ZONE also */
-    flow.zone = FSM_DPI_ZONE;
-    ret1 = nf_ct_set_mark(&flow);
 
-    /* -ve or 0 - failed in both zones or +ve atleast one zone passed */
-    return (ret0 + ret1);
+    return fsm_dpi_set_mark_zones(&flow);
 }
 
 int fsm_set_ip_dpi_state_timeout(
@@ -258,8 +282,6 @@ int fsm_set_icmp_dpi_state(
 )
 {
     nf_flow_t flow;
-    int ret0;
-    int ret1;
 
     memset(&flow, 0, sizeof(flow));
     copy_nf_icmp_flow(
@@ -272,12 +294,8 @@ int fsm_set_icmp_dpi_state(
             family,
             DEFAULT_ZONE,
             state);
-    ret0 = nf_ct_set_mark(&flow);
-    /* Set the conn mark for FSM_DPI_ZONE also */
-    flow.zone = FSM_DPI_ZONE;
-    ret1 = nf_ct_set_mark(&flow);
-    /* -ve or 0 - failed in both zones or +ve atleast one zone passed */
-    return (ret0 + ret1);
+
+    return fsm_dpi_set_mark_zones(&flow);
 }
 
 int fsm_set_icmp_dpi_state_timeout(
@@ -315,15 +333,165 @@ int fsm_set_icmp_dpi_state_timeout(
     return (ret0 + ret1);
 }
 
+/*
+ * Outcome of the mark updates queued for one verdict. The accumulator is
+ * referenced until every ACK is in, and its cached mark is forgotten if no
+ * zone accepted the update so the next verdict is sent again.
+ */
+struct fsm_dpi_mark_ctx
+{
+    struct net_md_stats_accumulator *acc;
+    uint32_t mark;
+    int pending;                /* ACKs (plus the caller) still expected */
+    int ok;                     /* zones that accepted the mark */
+};
+
+static struct fsm_dpi_mark_ctx *
+fsm_dpi_mark_ctx_get(struct net_md_stats_accumulator *acc, uint32_t mark)
+{
+    struct fsm_dpi_mark_ctx *ctx;
+
+    if (acc == NULL) return NULL;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) return NULL;
+
+    ctx->acc = acc;
+    ctx->mark = mark;
+    ctx->pending = 1;
+    acc->refcnt++;
+
+    return ctx;
+}
+
+static void
+fsm_dpi_mark_ctx_put(struct fsm_dpi_mark_ctx *ctx)
+{
+    struct net_md_stats_accumulator *acc;
+
+    if (ctx == NULL) return;
+    if (--ctx->pending > 0) return;
+
+    acc = ctx->acc;
+    if (ctx->ok == 0 && acc->dpi_ct_mark == ctx->mark)
+    {
+        acc->dpi_ct_mark_set = false;
+    }
+
+    acc->refcnt--;
+    free(ctx);
+}
+
+static void
+fsm_dpi_mark_cb(int error, void *arg)
+{
+    struct fsm_dpi_mark_ctx *ctx = arg;
+
+    if (error == 0)
+        ctx->ok++;
+    else if (error == -ENOBUFS)
+        LOGD("%s: conntrack mark %u in unknown state, will be resent",
+             __func__, ctx->mark);
+    else
+        LOGD("%s: conntrack mark %u not applied: %s", __func__,
+             ctx->mark, strerror(-error));
+
+    fsm_dpi_mark_ctx_put(ctx);
+}
+
+static bool
+fsm_dpi_mark_match(void *arg, void *aggr)
+{
+    struct fsm_dpi_mark_ctx *ctx = arg;
+
+    return (ctx->acc->aggr == aggr);
+}
+
+/*
+ * The aggregator is about to free its accumulators: complete the mark
+ * updates still waiting for an ACK while the accumulators are valid
+ */
+void
+fsm_dpi_mark_cancel(struct net_md_aggregator *aggr)
+{
+    if (aggr == NULL) return;
+
+    nf_ct_batch_cancel(fsm_dpi_mark_cb, fsm_dpi_mark_match, aggr);
+}
+
+static int
+fsm_dpi_mark_queue(struct net_header_parser *net_hdr, uint32_t mark,
+                   uint16_t zone, struct fsm_dpi_mark_ctx *ctx)
+{
+    int ret;
+
+    if (ctx != NULL) ctx->pending++;
+    ret = nf_ct_batch_set_flow_mark(net_hdr, mark, zone,
+                                    ctx != NULL ? fsm_dpi_mark_cb : NULL, ctx);
+    if (ret == 0) return 1;
+
+    /* Not queued, the callback will not be called */
+    if (ctx != NULL) ctx->pending--;
+
+    /* No ACK is tracked for a direct update, a successful send counts */
+    ret = nf_ct_set_flow_mark(net_hdr, mark, zone);
+    if (ret > 0 && ctx != NULL) ctx->ok++;
+
+    return ret;
+}
+
+/*
+ * Check if the cached mark of the flow can be trusted for this packet.
+ * A TCP SYN starts a new conntrack entry for the same 5-tuple, and the
+ * cache expires after FSM_DPI_CT_MARK_TTL in case the entry was re-created
+ * or its mark was reset behind our back.
+ */
+static bool
+fsm_dpi_mark_cached(struct net_header_parser *net_hdr, uint32_t mark)
+{
+    struct net_md_stats_accumulator *acc;
+    struct tcphdr *tcph;
+
+    acc = net_hdr->acc;
+    if (acc == NULL) return false;
+    if (!acc->dpi_ct_mark_set || acc->dpi_ct_mark != mark) return false;
+
+    if (net_hdr->ip_protocol == IPPROTO_TCP && net_hdr->ip_pld.tcphdr != NULL)
+    {
+        tcph = net_hdr->ip_pld.tcphdr;
+        if (tcph->syn && !tcph->ack)
+        {
+            acc->dpi_ct_mark_set = false;
+            return false;
+        }
+    }
+
+    if ((time(NULL) - acc->dpi_ct_mark_ts) >= FSM_DPI_CT_MARK_TTL)
+    {
+        acc->dpi_ct_mark_set = false;
+        return false;
+    }
+
+    return true;
+}
+
 // APIs using net_header_parser
 int fsm_set_dpi_state(
         struct net_header_parser *net_hdr,
         enum fsm_dpi_state state)
 {
+    struct net_md_stats_accumulator *acc;
+    struct fsm_dpi_mark_ctx *ctx;
     int ret0;
     int ret1;
 
-    ret0 = nf_ct_set_flow_mark(net_hdr, state, 0);
+    /*
+     * The accumulator remembers the last mark applied to the flow, verdicts
+     * repeated for an already decided flow do not hit netlink again.
+     */
+    acc = net_hdr->acc;
+    if (fsm_dpi_mark_cached(net_hdr, state)) return 1;
+
     /*
      * Set the mark for the default zone 0 also.
      * The reason behind it in router mode
@@ -335,9 +503,27 @@ int fsm_set_dpi_state(
      * now. Cloud will configure appropriate mode.
      * TODO Either check Router/Bridge mode and make this additional call
      * or dump_all_flows and apply mark for all mathching 5 tuple flows.
+     *
+     * Both updates are queued in the conntrack batch and sent in a single
+     * netlink write before the event loop blocks. The ACKs are checked by
+     * fsm_dpi_mark_cb().
      */
-    ret1 = nf_ct_set_flow_mark(net_hdr, state, FSM_DPI_ZONE);
+    ctx = fsm_dpi_mark_ctx_get(acc, state);
+
+    ret0 = fsm_dpi_mark_queue(net_hdr, state, DEFAULT_ZONE, ctx);
+    ret1 = fsm_dpi_mark_queue(net_hdr, state, FSM_DPI_ZONE, ctx);
+
     /* -ve or 0 - failed in both zones or +ve atleast one zone passed */
+    if ((ret0 + ret1) > 0 && acc != NULL)
+    {
+        acc->dpi_ct_mark = state;
+        acc->dpi_ct_mark_set = true;
+        acc->dpi_ct_mark_ts = time(NULL);
+    }
+
+    /* Drop the caller's hold, the ACKs may still be pending */
+    fsm_dpi_mark_ctx_put(ctx);
+
     return (ret0 + ret1);
 }
 
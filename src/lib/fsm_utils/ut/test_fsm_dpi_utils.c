@@ -0,0 +1,294 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "log.h"
+#include "net_header_parse.h"
+#include "network_metadata_report.h"
+#include "nf_utils.h"
+#include "fsm_dpi_utils.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "fsm_utils_tests";
+
+/*
+ * Conntrack stubs: batched updates are recorded and acknowledged by the
+ * tests through ack_update()
+ */
+#define MAX_UPDATES 16
+
+struct ct_update
+{
+    uint16_t zone;
+    nf_ct_mark_cb cb;
+    void *ctx;
+    bool done;
+};
+
+static struct ct_update g_updates[MAX_UPDATES];
+static size_t g_num_updates;
+static int g_direct_updates;
+
+int nf_ct_batch_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark,
+                              uint16_t zone, nf_ct_mark_cb cb, void *ctx)
+{
+    struct ct_update *update;
+
+    (void)net_pkt;
+    (void)mark;
+
+    TEST_ASSERT_TRUE(g_num_updates < MAX_UPDATES);
+    update = &g_updates[g_num_updates++];
+    update->zone = zone;
+    update->cb = cb;
+    update->ctx = ctx;
+    update->done = false;
+
+    return 0;
+}
+
+int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16_t zone)
+{
+    (void)net_pkt;
+    (void)mark;
+    (void)zone;
+
+    g_direct_updates++;
+    return 1;
+}
+
+void nf_ct_batch_cancel(nf_ct_mark_cb cb, bool (*match)(void *ctx, void *arg), void *arg)
+{
+    struct ct_update *update;
+    size_t i;
+
+    for (i = 0; i < g_num_updates; i++)
+    {
+        update = &g_updates[i];
+        if (update->done || update->cb != cb) continue;
+        if (match != NULL && !match(update->ctx, arg)) continue;
+
+        update->done = true;
+        update->cb(-ECANCELED, update->ctx);
+    }
+}
+
+int nf_ct_set_mark(nf_flow_t *flow) { (void)flow; return 0; }
+int nf_ct_set_mark_timeout(nf_flow_t *flow, uint32_t timeout) { (void)flow; (void)timeout; return 0; }
+int nf_ct_batch_set_mark(nf_flow_t *flow, nf_ct_mark_cb cb, void *ctx) { (void)flow; (void)cb; (void)ctx; return 0; }
+
+static void ack_update(size_t idx, int error)
+{
+    struct ct_update *update;
+
+    TEST_ASSERT_TRUE(idx < g_num_updates);
+    update = &g_updates[idx];
+    TEST_ASSERT_FALSE(update->done);
+    TEST_ASSERT_NOT_NULL(update->cb);
+
+    update->done = true;
+    update->cb(error, update->ctx);
+}
+
+static struct net_md_aggregator g_aggr;
+static struct net_md_stats_accumulator g_acc;
+static struct net_header_parser g_net_hdr;
+static struct tcphdr g_tcph;
+
+void setUp(void)
+{
+    memset(g_updates, 0, sizeof(g_updates));
+    g_num_updates = 0;
+    g_direct_updates = 0;
+
+    memset(&g_acc, 0, sizeof(g_acc));
+    g_acc.aggr = &g_aggr;
+
+    memset(&g_tcph, 0, sizeof(g_tcph));
+    g_tcph.ack = 1;
+
+    memset(&g_net_hdr, 0, sizeof(g_net_hdr));
+    g_net_hdr.ip_protocol = IPPROTO_TCP;
+    g_net_hdr.ip_pld.tcphdr = &g_tcph;
+    g_net_hdr.acc = &g_acc;
+}
+
+void tearDown(void)
+{
+    /* Every context was released along with its accumulator hold */
+    TEST_ASSERT_EQUAL_INT(0, g_acc.refcnt);
+}
+
+/**
+ * @brief a repeated verdict is not sent again once applied
+ */
+void test_mark_cache_skip(void)
+{
+    int ret;
+
+    ret = fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_TRUE(ret > 0);
+    TEST_ASSERT_EQUAL_UINT(2, g_num_updates);
+    TEST_ASSERT_TRUE(g_acc.dpi_ct_mark_set);
+    TEST_ASSERT_EQUAL_INT(1, g_acc.refcnt);
+
+    /* Skipped while the ACKs are pending */
+    ret = fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_TRUE(ret > 0);
+    TEST_ASSERT_EQUAL_UINT(2, g_num_updates);
+
+    ack_update(0, 0);
+    ack_update(1, 0);
+    TEST_ASSERT_TRUE(g_acc.dpi_ct_mark_set);
+
+    /* ... and once they are in */
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(2, g_num_updates);
+
+    /* A different verdict is applied */
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_DROP);
+    TEST_ASSERT_EQUAL_UINT(4, g_num_updates);
+    TEST_ASSERT_EQUAL_UINT(FSM_DPI_DROP, g_acc.dpi_ct_mark);
+
+    ack_update(2, 0);
+    ack_update(3, 0);
+    TEST_ASSERT_EQUAL_INT(0, g_direct_updates);
+}
+
+/**
+ * @brief the cached mark is dropped when no zone accepted it
+ */
+void test_mark_cache_rejected(void)
+{
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(2, g_num_updates);
+
+    ack_update(0, -ENOENT);
+    TEST_ASSERT_TRUE(g_acc.dpi_ct_mark_set);
+    ack_update(1, -ENOENT);
+    TEST_ASSERT_FALSE(g_acc.dpi_ct_mark_set);
+
+    /* The next verdict is sent again */
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(4, g_num_updates);
+
+    ack_update(2, 0);
+    ack_update(3, -ENOENT);
+    TEST_ASSERT_TRUE(g_acc.dpi_ct_mark_set);
+}
+
+/**
+ * @brief a single rejected zone (bridge mode) keeps the cache
+ */
+void test_mark_cache_one_zone(void)
+{
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    ack_update(0, -ENOENT);
+    ack_update(1, 0);
+    TEST_ASSERT_TRUE(g_acc.dpi_ct_mark_set);
+
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(2, g_num_updates);
+}
+
+/**
+ * @brief a new connection or an old cache entry is marked again
+ */
+void test_mark_cache_invalidate(void)
+{
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    ack_update(0, 0);
+    ack_update(1, 0);
+
+    /* A SYN starts a new conntrack entry for the same 5-tuple */
+    g_tcph.syn = 1;
+    g_tcph.ack = 0;
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(4, g_num_updates);
+    ack_update(2, 0);
+    ack_update(3, 0);
+
+    g_tcph.syn = 0;
+    g_tcph.ack = 1;
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(4, g_num_updates);
+
+    /* The cache expires */
+    g_acc.dpi_ct_mark_ts = time(NULL) - FSM_DPI_CT_MARK_TTL;
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_UINT(6, g_num_updates);
+    ack_update(4, 0);
+    ack_update(5, 0);
+}
+
+/**
+ * @brief pending ACKs are settled before the aggregator goes away
+ */
+void test_mark_cancel(void)
+{
+    struct net_md_aggregator other;
+
+    fsm_set_dpi_state(&g_net_hdr, FSM_DPI_PASSTHRU);
+    TEST_ASSERT_EQUAL_INT(1, g_acc.refcnt);
+
+    /* Unrelated aggregator */
+    fsm_dpi_mark_cancel(&other);
+    TEST_ASSERT_EQUAL_INT(1, g_acc.refcnt);
+    TEST_ASSERT_FALSE(g_updates[0].done);
+
+    fsm_dpi_mark_cancel(&g_aggr);
+    TEST_ASSERT_TRUE(g_updates[0].done);
+    TEST_ASSERT_TRUE(g_updates[1].done);
+    TEST_ASSERT_FALSE(g_acc.dpi_ct_mark_set);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_TRACE);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_mark_cache_skip);
+    RUN_TEST(test_mark_cache_rejected);
+    RUN_TEST(test_mark_cache_one_zone);
+    RUN_TEST(test_mark_cache_invalidate);
+    RUN_TEST(test_mark_cancel);
+
+    return UNITY_END();
+}
@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * IMC transport benchmark
+ *
+ * Forks a client process that pushes messages to a server running in the
+ * parent process over each given endpoint, then reports the message rate
+ * and the send to receive latency. Every endpoint is measured twice: a burst
+ * of back to back messages (throughput, latency under load) and a paced run
+ * with a pause between messages (latency of an idle receiver).
+ *
+ * Usage:
+ *   imc_bench [-n <count>] [-s <size>] [-g <gap us>] [endpoint ...]
+ *
+ * Example, comparing zeromq with the shared memory ring:
+ *   imc_bench -n 200000 -s 256 ipc:///tmp/imc_bench shm:///tmp/imc_bench
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <ev.h>
+
+#include "imc.h"
+#include "log.h"
+#include "target.h"
+
+#define IMC_BENCH_COUNT     100000
+#define IMC_BENCH_SIZE      256
+#define IMC_BENCH_GAP_US    100
+#define IMC_BENCH_PACED     2000    /* messages of the paced run */
+#define IMC_BENCH_IDLE      2.0     /* s without progress ending a run */
+
+/**
+ * @brief a run, as seen by the server
+ */
+struct imc_bench_run
+{
+    struct ev_loop *loop;
+    ev_timer idle;
+    size_t count;               /* expected messages */
+    size_t size;
+    size_t received;
+    size_t last_received;       /* progress at the previous idle check */
+    uint64_t first_ns;          /* send time of the first message */
+    uint64_t last_ns;           /* receive time of the last message */
+    uint64_t *lat_ns;
+};
+
+static struct imc_bench_run g_run;
+
+
+static uint64_t
+imc_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+imc_bench_free_msg(void *data, void *hint)
+{
+    free(data);
+}
+
+
+/**
+ * @brief client side: sends @p count messages, stamped with their send time
+ */
+static int
+imc_bench_client(const char *endpoint, size_t count, size_t size, int gap_us)
+{
+    struct imc_context client;
+    uint64_t dropped;
+    uint64_t ts;
+    uint8_t *buf;
+    size_t i;
+    int rc;
+
+    memset(&client, 0, sizeof(client));
+    client.ztype = IMC_PUSH;
+    client.endpoint = strdup(endpoint);
+
+    rc = imc_init_client(&client, imc_bench_free_msg, NULL);
+    if (rc != 0) return EXIT_FAILURE;
+
+    dropped = 0;
+    for (i = 0; i < count; i++)
+    {
+        buf = calloc(1, size);
+        if (buf == NULL) return EXIT_FAILURE;
+
+        ts = imc_bench_now_ns();
+        memcpy(buf, &ts, sizeof(ts));
+
+        rc = imc_send(&client, buf, size, 0);
+        if (rc != 0) dropped++;
+
+        if (gap_us != 0) usleep(gap_us);
+    }
+
+    /* zeromq flushes its queue on termination */
+    imc_terminate_client(&client);
+    free(client.endpoint);
+
+    if (dropped != 0) fprintf(stderr, "%s: %" PRIu64 " messages dropped\n", endpoint, dropped);
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+imc_bench_recv(void *data, size_t len)
+{
+    struct imc_bench_run *run;
+    uint64_t now;
+    uint64_t ts;
+
+    run = &g_run;
+    now = imc_bench_now_ns();
+
+    if (len != run->size || run->received == run->count) return;
+
+    memcpy(&ts, data, sizeof(ts));
+    if (run->received == 0) run->first_ns = ts;
+
+    run->lat_ns[run->received++] = now - ts;
+    run->last_ns = now;
+
+    if (run->received == run->count) ev_break(run->loop, EVBREAK_ONE);
+}
+
+
+static void
+imc_bench_idle_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct imc_bench_run *run;
+
+    run = w->data;
+    if (run->received == run->last_received) ev_break(loop, EVBREAK_ONE);
+
+    run->last_received = run->received;
+}
+
+
+static int
+imc_bench_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief runs the server, forks the client and prints one result line
+ */
+static int
+imc_bench_endpoint(const char *endpoint, const char *mode, size_t count,
+                   size_t size, int gap_us)
+{
+    struct imc_context server;
+    struct imc_bench_run *run;
+    int status;
+    double secs;
+    int sync[2];
+    pid_t pid;
+    char go;
+    int rc;
+
+    run = &g_run;
+    memset(run, 0, sizeof(*run));
+    run->loop = EV_DEFAULT;
+    run->count = count;
+    run->size = size;
+    run->lat_ns = calloc(count, sizeof(*run->lat_ns));
+    if (run->lat_ns == NULL) return -1;
+
+    if (pipe(sync) != 0) return -1;
+
+    pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0)
+    {
+        /* Wait for the server to be up */
+        close(sync[1]);
+        if (read(sync[0], &go, 1) != 1) _exit(EXIT_FAILURE);
+        _exit(imc_bench_client(endpoint, count, size, gap_us));
+    }
+
+    close(sync[0]);
+
+    memset(&server, 0, sizeof(server));
+    server.ztype = IMC_PULL;
+    server.endpoint = strdup(endpoint);
+
+    rc = imc_init_server(&server, run->loop, imc_bench_recv);
+    if (rc != 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+        return -1;
+    }
+
+    go = 1;
+    rc = write(sync[1], &go, 1);
+    close(sync[1]);
+
+    ev_timer_init(&run->idle, imc_bench_idle_cb, IMC_BENCH_IDLE, IMC_BENCH_IDLE);
+    run->idle.data = run;
+    ev_timer_start(run->loop, &run->idle);
+
+    ev_run(run->loop, 0);
+
+    ev_timer_stop(run->loop, &run->idle);
+    waitpid(pid, &status, 0);
+    imc_terminate_server(&server);
+    free(server.endpoint);
+
+    secs = run->received ? (run->last_ns - run->first_ns) / 1e9 : 0;
+    qsort(run->lat_ns, run->received, sizeof(*run->lat_ns), imc_bench_cmp);
+
+    printf("%-26s %-6s %10zu %10zu %12.0f %10.1f %10.1f %10.1f\n",
+           endpoint, mode, size, run->received,
+           secs > 0 ? run->received / secs : 0,
+           run->received ? run->lat_ns[run->received / 2] / 1e3 : 0,
+           run->received ? run->lat_ns[run->received * 99 / 100] / 1e3 : 0,
+           run->received ? run->lat_ns[run->received - 1] / 1e3 : 0);
+
+    free(run->lat_ns);
+
+    return 0;
+}
+
+
+static void
+imc_bench_usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n <count>] [-s <size>] [-g <gap us>] [endpoint ...]\n"
+            "  -n  messages of the burst run (default %d)\n"
+            "  -s  message size in bytes (default %d)\n"
+            "  -g  pause between messages of the paced run (default %d us)\n"
+            "  endpoints default to ipc:///tmp/imc_bench and " IMC_SHM_SCHEME "/tmp/imc_bench\n",
+            name, IMC_BENCH_COUNT, IMC_BENCH_SIZE, IMC_BENCH_GAP_US);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    const char *defaults[] =
+    {
+        "ipc:///tmp/imc_bench",
+        IMC_SHM_SCHEME "/tmp/imc_bench",
+    };
+    const char **endpoints;
+    size_t count;
+    size_t size;
+    int nendpoints;
+    int gap_us;
+    int opt;
+    int i;
+
+    count = IMC_BENCH_COUNT;
+    size = IMC_BENCH_SIZE;
+    gap_us = IMC_BENCH_GAP_US;
+
+    target_log_open("IMC_BENCH", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_WARN);
+
+    while ((opt = getopt(argc, argv, "n:s:g:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+
+            case 's':
+                size = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'g':
+                gap_us = atoi(optarg);
+                break;
+
+            default:
+                imc_bench_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (count == 0 || size < sizeof(uint64_t))
+    {
+        imc_bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    endpoints = defaults;
+    nendpoints = sizeof(defaults) / sizeof(defaults[0]);
+    if (optind < argc)
+    {
+        endpoints = (const char **)&argv[optind];
+        nendpoints = argc - optind;
+    }
+
+    printf("%-26s %-6s %10s %10s %12s %10s %10s %10s\n",
+           "endpoint", "run", "size", "messages", "msgs/s", "p50 us", "p99 us", "max us");
+
+    for (i = 0; i < nendpoints; i++)
+    {
+        if (imc_bench_endpoint(endpoints[i], "burst", count, size, 0) != 0 ||
+            imc_bench_endpoint(endpoints[i], "paced", IMC_BENCH_PACED, size, gap_us) != 0)
+        {
+            fprintf(stderr, "%s: benchmark failed\n", endpoints[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -37,6 +37,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * distributed under a MIT license
  */
 
+/**
+ * Endpoints starting with IMC_SHM_SCHEME, followed by the path of a unix
+ * socket, use a shared memory ring (memfd and eventfd) instead of zeromq.
+ * The client copies each message once into the ring and the server receive
+ * callback reads it in place. Both sides must use the same scheme.
+ */
+#define IMC_SHM_SCHEME "shm://"
+
+/**
+ * FSM -> FCM flow reports endpoint
+ */
+#if defined(CONFIG_TARGET_IMC_SHM)
+#define IMC_FSM2FCM_ENDPOINT IMC_SHM_SCHEME "/tmp/imc_fsm2fcm"
+#else
+#define IMC_FSM2FCM_ENDPOINT "ipc:///tmp/imc_fsm2fcm"
+#endif
+
 /**
  * @brief Receive callback provided by the manager
  *
@@ -45,6 +62,7 @@ typedef void (*imc_recv)(void *, size_t);
 
 struct imc_context;
 struct imc_dso;
+struct imc_shm;
 
 typedef void (*imc_ev_cbfn)(struct ev_loop *, struct imc_context *, int);
 
@@ -83,6 +101,7 @@ struct imc_context
     void *free_msg_hint;
     void *zctx;
     void *zsock;
+    struct imc_shm *shm;
     int ztype;
     int events;
     ev_prepare w_prepare;
@@ -102,6 +121,11 @@ enum
     IMC_PUSH = ZMQ_PUSH,
 };
 
+enum
+{
+    IMC_DONTWAIT = ZMQ_DONTWAIT,
+};
+
 
 /**
  * @brief initiates a imc server
@@ -150,6 +174,11 @@ imc_terminate_client(struct imc_context *client);
 /**
  * @brief send data to a imc server
  *
+ * On a shared memory endpoint, a message that cannot be delivered because
+ * the server is not up or not keeping up is dropped and the call fails with
+ * errno set to EAGAIN. IMC_DONTWAIT drops it rather than waiting for space,
+ * on both transports. The message is released whether it was sent or not.
+ *
  * @param context the socket context
  * @param buf the buffer to send
  * @param len the buffer size
@@ -169,6 +198,11 @@ enum
     IMC_PUSH,
 };
 
+enum
+{
+    IMC_DONTWAIT = 1,
+};
+
 static inline int
 imc_init_server(struct imc_context *server, struct ev_loop *loop,
                 imc_recv recv_cb)
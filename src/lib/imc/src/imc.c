@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <zmq.h>
 
 #include "imc.h"
+#include "imc_shm.h"
 #include "log.h"
 
 
@@ -225,6 +226,11 @@ imc_init_server(struct imc_context *server, struct ev_loop *loop,
     void *zctx;
     int rc;
 
+    if (imc_shm_endpoint(server->endpoint))
+    {
+        return imc_shm_init_server(server, loop, recv_cb);
+    }
+
     server->recv_fn = recv_cb;
     server->imc_ev_cb = imc_ev_recv_cb;
 
@@ -294,6 +300,12 @@ err_free_zctx:
 void
 imc_terminate_server(struct imc_context *server)
 {
+    if (server->shm != NULL)
+    {
+        imc_shm_terminate_server(server);
+        return;
+    }
+
     ev_prepare_stop(server->loop, &server->w_prepare);
     ev_check_stop(server->loop, &server->w_check);
     ev_idle_stop(server->loop, &server->w_idle);
@@ -326,6 +338,11 @@ imc_init_client(struct imc_context *client, imc_free_sndmsg free_snd_msg,
     void *zctx;
     int rc;
 
+    if (imc_shm_endpoint(client->endpoint))
+    {
+        return imc_shm_init_client(client, free_snd_msg, free_msg_hint);
+    }
+
     /* Allocate a zmq context */
     zctx = zmq_ctx_new();
     if (zctx == NULL)
@@ -389,6 +406,12 @@ err_free_zctx:
 void
 imc_terminate_client(struct imc_context *client)
 {
+    if (client->shm != NULL)
+    {
+        imc_shm_terminate_client(client);
+        return;
+    }
+
     if (client->zctx == NULL) return;
 
     zmq_close(client->zsock);
@@ -420,13 +443,26 @@ imc_send(struct imc_context *client, void *buf, size_t buflen, int flags)
     zmq_msg_t msg;
     int rc;
 
+    if (client->shm != NULL) return imc_shm_send(client, buf, buflen, flags);
+
     zmq_msg_init_data(&msg, buf, buflen, client->imc_free_sndmsg, NULL);
-    rc = zmq_msg_send(&msg, client->zsock, 0);
+    rc = zmq_msg_send(&msg, client->zsock, flags);
     if (rc == -1)
     {
         rc = errno;
-        LOGE("%s: failed to send data to %s: %s", __func__,
-             client->endpoint, strerror(rc));
+        if (rc == EAGAIN)
+        {
+            LOGD("%s: %s not ready, dropping data", __func__, client->endpoint);
+        }
+        else
+        {
+            LOGE("%s: failed to send data to %s: %s", __func__,
+                 client->endpoint, strerror(rc));
+        }
+
+        /* The message was not queued, release it as the shm transport does */
+        zmq_msg_close(&msg);
+        errno = rc;
 
         return -1;
     }
@@ -0,0 +1,1029 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Shared memory ring transport for IMC
+ *
+ * The client (producer) creates the ring: a sealed memfd holding a header and
+ * a power of two data area, an eventfd the server sleeps on and an eventfd
+ * the client waits on when the ring is full. It connects to the server's unix
+ * socket and passes the three descriptors along; after that the socket only
+ * serves to detect that the peer went away. A server accepts any number of
+ * clients, each with its own ring, as a zeromq PULL socket would.
+ *
+ * Records are an 8 bytes header followed by the payload, padded to 8 bytes.
+ * A record never wraps: when it does not fit before the end of the data area,
+ * a pad record fills the remainder and the record starts at offset 0. The
+ * server hands the payload to the receive callback in place.
+ *
+ * Wakeups are batched: each side raises its *_waiting flag before going to
+ * sleep and the other side only writes the eventfd when it finds the flag
+ * set. A busy server is never signalled, and it handles at most
+ * IMC_SHM_BATCH records per loop iteration.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <ev.h>
+
+#include "ds_dlist.h"
+#include "log.h"
+
+#include "imc.h"
+#include "imc_shm.h"
+
+#define IMC_SHM_MAGIC           0x494d4352  /* "IMCR" */
+#define IMC_SHM_VERSION         1
+#define IMC_SHM_RING_SIZE       (1 << 20)
+#define IMC_SHM_BATCH           64          /* Records per loop iteration */
+#define IMC_SHM_SEND_TIMEOUT_MS 100         /* Blocking send on a full ring */
+#define IMC_SHM_RETRY_MS        1000        /* Client reconnection interval */
+#define IMC_SHM_PEER_CHECK_MS   10          /* Client check of the server socket */
+#define IMC_SHM_REC_PAD         UINT32_MAX
+#define IMC_SHM_ALIGN(x)        (((x) + 7) & ~(size_t)7)
+
+/* glibc only wraps memfd_create() and defines the sealing flags since 2.27 */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             (1024 + 9)
+#define F_GET_SEALS             (1024 + 10)
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL             0x0001
+#define F_SEAL_SHRINK           0x0002
+#define F_SEAL_GROW             0x0004
+#endif
+
+/**
+ * @brief ring header, shared between the two processes
+ */
+struct imc_shm_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      /* Data area size, power of two */
+    uint32_t closed;                    /* Server released the ring */
+
+    /* Written by the client */
+    uint64_t head __attribute__((aligned(64)));
+    uint32_t consumer_waiting;          /* Server asleep, kick efd_data */
+
+    /* Written by the server */
+    uint64_t tail __attribute__((aligned(64)));
+    uint32_t producer_waiting;          /* Client blocked, kick efd_space */
+
+    uint8_t data[] __attribute__((aligned(64)));
+};
+
+struct imc_shm_rec
+{
+    uint32_t len;
+    uint32_t reserved;
+};
+
+/**
+ * @brief a ring, either the client's or one of the server's peers
+ */
+struct imc_shm_conn
+{
+    struct imc_context *context;
+    int sock;
+    int efd_data;
+    int efd_space;
+    struct imc_shm_hdr *hdr;
+    size_t map_size;
+    uint32_t size;              /* Local copy, the header is not trusted */
+    uint64_t checked;           /* Client: last check of the server socket */
+    ev_io w_sock;
+    ev_io w_data;
+    ds_dlist_node_t node;
+};
+
+/**
+ * @brief transport state of an imc context
+ */
+struct imc_shm
+{
+    struct sockaddr_un addr;
+    int sock;                   /* Server: listening socket */
+    ev_io w_listen;
+    ds_dlist_t conns;           /* Server: connected clients */
+    struct imc_shm_conn *conn;  /* Client: the ring, NULL when disconnected */
+    uint64_t retry;             /* Client: next connection attempt */
+    uint64_t drops;             /* Client: messages dropped in a row */
+};
+
+
+static uint64_t
+imc_shm_clock_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void
+imc_shm_kick(int efd)
+{
+    uint64_t one = 1;
+    ssize_t rc;
+
+    rc = write(efd, &one, sizeof(one));
+    if (rc < 0 && errno != EAGAIN)
+    {
+        LOGE("%s: eventfd write failed: %s", __func__, strerror(errno));
+    }
+}
+
+
+static void
+imc_shm_clear(int efd)
+{
+    uint64_t cnt;
+    ssize_t rc;
+
+    rc = read(efd, &cnt, sizeof(cnt));
+    (void)rc;
+}
+
+
+static int
+imc_shm_memfd_create(const char *name, unsigned int flags)
+{
+#ifdef SYS_memfd_create
+    return syscall(SYS_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/**
+ * @brief tells whether an endpoint selects the shared memory transport
+ */
+bool
+imc_shm_endpoint(const char *endpoint)
+{
+    if (endpoint == NULL) return false;
+
+    return (strncmp(endpoint, IMC_SHM_SCHEME, strlen(IMC_SHM_SCHEME)) == 0);
+}
+
+
+static struct imc_shm *
+imc_shm_alloc(struct imc_context *context)
+{
+    struct imc_shm *shm;
+    const char *path;
+    size_t len;
+
+    path = context->endpoint + strlen(IMC_SHM_SCHEME);
+    len = strlen(path);
+    if (len == 0 || len >= sizeof(shm->addr.sun_path))
+    {
+        LOGE("%s: invalid endpoint %s", __func__, context->endpoint);
+        return NULL;
+    }
+
+    shm = calloc(1, sizeof(*shm));
+    if (shm == NULL) return NULL;
+
+    shm->addr.sun_family = AF_UNIX;
+    memcpy(shm->addr.sun_path, path, len + 1);
+    shm->sock = -1;
+    ds_dlist_init(&shm->conns, struct imc_shm_conn, node);
+
+    return shm;
+}
+
+
+static struct imc_shm_conn *
+imc_shm_conn_alloc(struct imc_context *context)
+{
+    struct imc_shm_conn *conn;
+
+    conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) return NULL;
+
+    conn->context = context;
+    conn->sock = -1;
+    conn->efd_data = -1;
+    conn->efd_space = -1;
+
+    return conn;
+}
+
+
+static void
+imc_shm_conn_free(struct imc_shm_conn *conn)
+{
+    if (conn->hdr != NULL) munmap(conn->hdr, conn->map_size);
+    if (conn->efd_data >= 0) close(conn->efd_data);
+    if (conn->efd_space >= 0) close(conn->efd_space);
+    if (conn->sock >= 0) close(conn->sock);
+
+    free(conn);
+}
+
+
+/*
+ * ===========================================================================
+ *  Server
+ * ===========================================================================
+ */
+
+/**
+ * @brief releases a client's ring
+ */
+static void
+imc_shm_conn_close(struct imc_shm_conn *conn)
+{
+    struct imc_context *context;
+
+    context = conn->context;
+
+    ev_io_stop(context->loop, &conn->w_sock);
+    ev_io_stop(context->loop, &conn->w_data);
+
+    /* Let the client know it has to reconnect */
+    if (conn->hdr != NULL) __atomic_store_n(&conn->hdr->closed, 1, __ATOMIC_RELEASE);
+
+    ds_dlist_remove(&context->shm->conns, conn);
+    imc_shm_conn_free(conn);
+}
+
+
+/**
+ * @brief delivers up to IMC_SHM_BATCH records to the receive callback
+ *
+ * @return -1 if the ring is corrupted, 1 if records are left, 0 otherwise
+ */
+static int
+imc_shm_drain(struct imc_shm_conn *conn)
+{
+    struct imc_shm_hdr *hdr;
+    struct imc_shm_rec *rec;
+    uint32_t offset;
+    uint64_t head;
+    uint64_t tail;
+    size_t reclen;
+    uint32_t len;
+    bool freed;
+    int budget;
+
+    hdr = conn->hdr;
+    tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+    freed = false;
+
+    for (budget = IMC_SHM_BATCH; budget > 0;)
+    {
+        head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            /* Going to sleep: ask for a kick, then look again */
+            __atomic_store_n(&hdr->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+            head = __atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST);
+            if (head == tail) break;
+
+            __atomic_store_n(&hdr->consumer_waiting, 0, __ATOMIC_RELAXED);
+        }
+
+        if (head - tail > conn->size) return -1;
+
+        offset = tail & (conn->size - 1);
+        rec = (struct imc_shm_rec *)(hdr->data + offset);
+
+        /* The client can rewrite the length, validate and use a single read */
+        len = __atomic_load_n(&rec->len, __ATOMIC_RELAXED);
+        if (len == IMC_SHM_REC_PAD)
+        {
+            reclen = conn->size - offset;
+        }
+        else
+        {
+            if (len > conn->size - offset - sizeof(*rec)) return -1;
+
+            reclen = sizeof(*rec) + IMC_SHM_ALIGN(len);
+            if (head - tail < reclen) return -1;
+
+            conn->context->recv_fn(rec + 1, len);
+            budget--;
+        }
+
+        tail += reclen;
+        __atomic_store_n(&hdr->tail, tail, __ATOMIC_SEQ_CST);
+        freed = true;
+    }
+
+    /* Space was released, unblock the client if it is waiting */
+    if (freed && __atomic_load_n(&hdr->producer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&hdr->producer_waiting, 0, __ATOMIC_SEQ_CST))
+    {
+        imc_shm_kick(conn->efd_space);
+    }
+
+    return (budget == 0);
+}
+
+
+static void
+imc_shm_data_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct imc_shm_conn *conn;
+    int rc;
+
+    conn = w->data;
+
+    /* The ring is the source of truth, just reset the wake up counter */
+    imc_shm_clear(conn->efd_data);
+
+    rc = imc_shm_drain(conn);
+    if (rc < 0)
+    {
+        LOGE("%s: %s: corrupted ring, dropping client", __func__,
+             conn->context->endpoint);
+        imc_shm_conn_close(conn);
+        return;
+    }
+
+    /* Budget exhausted, resume on the next loop iteration */
+    if (rc > 0) ev_feed_event(loop, &conn->w_data, EV_READ);
+}
+
+
+/**
+ * @brief maps the ring a client passed along with its connection
+ */
+static int
+imc_shm_recv_ring(struct imc_shm_conn *conn)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct imc_shm_hdr *hdr;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    struct stat st;
+    int fds[3];
+    int seals;
+    char hello;
+    ssize_t n;
+    void *map;
+    int memfd;
+    size_t i;
+
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    n = recvmsg(conn->sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n < 0 && errno == EAGAIN) return 0;
+    if (n <= 0) return -1;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        LOGE("%s: no descriptors from client", __func__);
+        return -1;
+    }
+
+    if (cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        LOGE("%s: unexpected descriptors from client", __func__);
+        for (i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++)
+        {
+            memcpy(&memfd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(memfd);
+        }
+        return -1;
+    }
+
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    memfd = fds[0];
+    conn->efd_data = fds[1];
+    conn->efd_space = fds[2];
+
+    /* A ring the client could shrink under our feet would SIGBUS us */
+    seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(memfd, &st) != 0 ||
+        (size_t)st.st_size <= sizeof(*hdr))
+    {
+        LOGE("%s: invalid ring from client", __func__);
+        close(memfd);
+        return -1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);
+    if (map == MAP_FAILED)
+    {
+        LOGE("%s: mmap failed: %s", __func__, strerror(errno));
+        return -1;
+    }
+
+    conn->hdr = map;
+    conn->map_size = st.st_size;
+
+    hdr = conn->hdr;
+    conn->size = hdr->size;
+    if (hdr->magic != IMC_SHM_MAGIC || hdr->version != IMC_SHM_VERSION ||
+        conn->size < 64 || (conn->size & (conn->size - 1)) != 0 ||
+        sizeof(*hdr) + conn->size != conn->map_size)
+    {
+        LOGE("%s: invalid ring header from client", __func__);
+        return -1;
+    }
+
+    ev_io_init(&conn->w_data, imc_shm_data_cb, conn->efd_data, EV_READ);
+    conn->w_data.data = conn;
+    ev_io_start(conn->context->loop, &conn->w_data);
+
+    /* Pick up what was sent before the connection was accepted */
+    ev_feed_event(conn->context->loop, &conn->w_data, EV_READ);
+
+    return 0;
+}
+
+
+static void
+imc_shm_peer_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct imc_shm_conn *conn;
+    char buf[16];
+    ssize_t n;
+    int rc;
+
+    conn = w->data;
+
+    if (conn->hdr == NULL)
+    {
+        rc = imc_shm_recv_ring(conn);
+        if (rc != 0) imc_shm_conn_close(conn);
+        return;
+    }
+
+    /* Past the handshake the client does not talk, this is EOF or an error */
+    n = recv(conn->sock, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0 || (n < 0 && errno == EAGAIN)) return;
+
+    /* Deliver what the client left behind before releasing the ring */
+    do
+    {
+        rc = imc_shm_drain(conn);
+    } while (rc > 0);
+
+    imc_shm_conn_close(conn);
+}
+
+
+static void
+imc_shm_accept_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct imc_context *server;
+    struct imc_shm_conn *conn;
+    int sock;
+
+    server = w->data;
+
+    sock = accept4(server->shm->sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (sock < 0)
+    {
+        LOGE("%s: accept failed: %s", __func__, strerror(errno));
+        return;
+    }
+
+    conn = imc_shm_conn_alloc(server);
+    if (conn == NULL)
+    {
+        close(sock);
+        return;
+    }
+
+    conn->sock = sock;
+    ev_io_init(&conn->w_sock, imc_shm_peer_cb, sock, EV_READ);
+    conn->w_sock.data = conn;
+    ev_io_start(loop, &conn->w_sock);
+
+    ds_dlist_insert_tail(&server->shm->conns, conn);
+}
+
+
+/**
+ * @brief initiates a shared memory imc server
+ *
+ * @param server the server context
+ * @param loop the ev loop
+ * @param recv_cb user provided data processing routine
+ */
+int
+imc_shm_init_server(struct imc_context *server, struct ev_loop *loop,
+                    imc_recv recv_cb)
+{
+    struct imc_shm *shm;
+    int rc;
+
+    shm = imc_shm_alloc(server);
+    if (shm == NULL) return -1;
+
+    shm->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (shm->sock < 0)
+    {
+        LOGE("%s: socket failed: %s", __func__, strerror(errno));
+        goto err_free_shm;
+    }
+
+    /* Remove the socket of a previous instance */
+    unlink(shm->addr.sun_path);
+
+    rc = bind(shm->sock, (struct sockaddr *)&shm->addr, sizeof(shm->addr));
+    if (rc == 0) rc = listen(shm->sock, 8);
+    if (rc != 0)
+    {
+        LOGE("%s: failed to listen on %s: %s", __func__,
+             shm->addr.sun_path, strerror(errno));
+        goto err_close_sock;
+    }
+
+    server->shm = shm;
+    server->recv_fn = recv_cb;
+    server->events = EV_READ;
+    server->loop = loop;
+
+    ev_io_init(&shm->w_listen, imc_shm_accept_cb, shm->sock, EV_READ);
+    shm->w_listen.data = server;
+    ev_io_start(loop, &shm->w_listen);
+
+    server->initialized = true;
+
+    return 0;
+
+err_close_sock:
+    close(shm->sock);
+
+err_free_shm:
+    free(shm);
+
+    return -1;
+}
+
+
+/**
+ * @brief terminates a shared memory imc server and releases its clients
+ *
+ * @param server the server to terminate
+ */
+void
+imc_shm_terminate_server(struct imc_context *server)
+{
+    struct imc_shm_conn *conn;
+    struct imc_shm *shm;
+
+    shm = server->shm;
+    if (shm == NULL) return;
+
+    ev_io_stop(server->loop, &shm->w_listen);
+    close(shm->sock);
+    unlink(shm->addr.sun_path);
+
+    while ((conn = ds_dlist_head(&shm->conns)) != NULL)
+    {
+        imc_shm_conn_close(conn);
+    }
+
+    free(shm);
+    server->shm = NULL;
+    server->initialized = false;
+}
+
+
+/*
+ * ===========================================================================
+ *  Client
+ * ===========================================================================
+ */
+
+/**
+ * @brief creates a ring and hands it over to the server
+ */
+static struct imc_shm_conn *
+imc_shm_connect(struct imc_context *client)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct imc_shm_conn *conn;
+    struct imc_shm_hdr *hdr;
+    struct cmsghdr *cmsg;
+    struct imc_shm *shm;
+    struct msghdr msg;
+    struct iovec iov;
+    char hello = 0;
+    void *map;
+    int memfd;
+    int fds[3];
+    int rc;
+
+    shm = client->shm;
+    memfd = -1;
+
+    conn = imc_shm_conn_alloc(client);
+    if (conn == NULL) return NULL;
+
+    conn->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->sock < 0) goto err;
+
+    rc = connect(conn->sock, (struct sockaddr *)&shm->addr, sizeof(shm->addr));
+    if (rc != 0)
+    {
+        LOGD("%s: %s: %s", __func__, client->endpoint, strerror(errno));
+        goto err;
+    }
+
+    conn->size = IMC_SHM_RING_SIZE;
+    conn->map_size = sizeof(*hdr) + conn->size;
+
+    memfd = imc_shm_memfd_create("imc_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) goto err_log;
+
+    rc = ftruncate(memfd, conn->map_size);
+    if (rc == 0) rc = fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    if (rc != 0) goto err_log;
+
+    map = mmap(NULL, conn->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (map == MAP_FAILED) goto err_log;
+    conn->hdr = map;
+
+    hdr = conn->hdr;
+    hdr->magic = IMC_SHM_MAGIC;
+    hdr->version = IMC_SHM_VERSION;
+    hdr->size = conn->size;
+    /* The server is idle until told otherwise */
+    hdr->consumer_waiting = 1;
+
+    conn->efd_data = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    conn->efd_space = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (conn->efd_data < 0 || conn->efd_space < 0) goto err_log;
+
+    fds[0] = memfd;
+    fds[1] = conn->efd_data;
+    fds[2] = conn->efd_space;
+
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(conn->sock, &msg, MSG_NOSIGNAL) != sizeof(hello)) goto err_log;
+
+    close(memfd);
+
+    LOGI("%s: connected to %s", __func__, client->endpoint);
+
+    return conn;
+
+err_log:
+    LOGE("%s: failed to set up a ring to %s: %s", __func__,
+         client->endpoint, strerror(errno));
+
+err:
+    if (memfd >= 0) close(memfd);
+    imc_shm_conn_free(conn);
+
+    return NULL;
+}
+
+
+/**
+ * @brief tells whether the server still serves the client's ring
+ *
+ * A server that crashed or was killed never marks the ring closed, but the
+ * kernel closes its end of the socket. The socket is checked at most every
+ * IMC_SHM_PEER_CHECK_MS so that sending stays free of system calls.
+ */
+static bool
+imc_shm_peer_alive(struct imc_shm_conn *conn)
+{
+    uint64_t now;
+    ssize_t n;
+    char c;
+
+    if (__atomic_load_n(&conn->hdr->closed, __ATOMIC_ACQUIRE)) return false;
+
+    now = imc_shm_clock_ms();
+    if (now - conn->checked < IMC_SHM_PEER_CHECK_MS) return true;
+    conn->checked = now;
+
+    /* The server never writes to the socket, readable means closed */
+    n = recv(conn->sock, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT);
+
+    return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+
+/**
+ * @brief returns the client's ring, reconnecting if needed
+ */
+static struct imc_shm_conn *
+imc_shm_client_conn(struct imc_context *client)
+{
+    struct imc_shm_conn *conn;
+    struct imc_shm *shm;
+    uint64_t now;
+
+    shm = client->shm;
+    conn = shm->conn;
+
+    if (conn != NULL && !imc_shm_peer_alive(conn))
+    {
+        LOGI("%s: %s went away", __func__, client->endpoint);
+        imc_shm_conn_free(conn);
+        shm->conn = NULL;
+        shm->retry = 0;
+    }
+
+    if (shm->conn != NULL) return shm->conn;
+
+    now = imc_shm_clock_ms();
+    if (now < shm->retry) return NULL;
+
+    shm->retry = now + IMC_SHM_RETRY_MS;
+    shm->conn = imc_shm_connect(client);
+
+    return shm->conn;
+}
+
+
+/**
+ * @brief waits for the server to release space in the ring
+ *
+ * @return -1 if the server went away, 0 otherwise
+ */
+static int
+imc_shm_wait(struct imc_shm_conn *conn, int timeout_ms)
+{
+    struct pollfd pfd[2];
+    int rc;
+
+    pfd[0].fd = conn->efd_space;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    /* The server never writes to the socket, readable means closed */
+    pfd[1].fd = conn->sock;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+
+    rc = poll(pfd, 2, timeout_ms);
+    if (rc < 0 && errno != EINTR) return -1;
+    if (pfd[1].revents != 0) return -1;
+
+    if (pfd[0].revents & POLLIN) imc_shm_clear(conn->efd_space);
+
+    return 0;
+}
+
+
+/**
+ * @brief initiates a shared memory imc client
+ *
+ * As with zmq_connect(), the server does not need to be up yet; the client
+ * connects, and reconnects after the server restarts, from imc_send().
+ *
+ * @param client the client context
+ * @param free_snd_msg callback routine freeing the transmitted message
+ * @param free_msg_hint argument passed to the free_snd_msg() callback
+ */
+int
+imc_shm_init_client(struct imc_context *client, imc_free_sndmsg free_snd_msg,
+                    void *free_msg_hint)
+{
+    struct imc_shm *shm;
+
+    shm = imc_shm_alloc(client);
+    if (shm == NULL) return -1;
+
+    client->shm = shm;
+    client->imc_free_sndmsg = free_snd_msg;
+    client->free_msg_hint = free_msg_hint;
+
+    shm->retry = imc_shm_clock_ms() + IMC_SHM_RETRY_MS;
+    shm->conn = imc_shm_connect(client);
+
+    client->initialized = true;
+
+    return 0;
+}
+
+
+/**
+ * @brief terminates a shared memory imc client
+ *
+ * @param client the client context
+ */
+void
+imc_shm_terminate_client(struct imc_context *client)
+{
+    struct imc_shm *shm;
+
+    shm = client->shm;
+    if (shm == NULL) return;
+
+    if (shm->conn != NULL) imc_shm_conn_free(shm->conn);
+
+    free(shm);
+    client->shm = NULL;
+    client->initialized = false;
+}
+
+
+/**
+ * @brief copies a message into the ring
+ *
+ * The message is freed through the client's free callback whether it was
+ * sent or not. When the ring is full, the call waits up to
+ * IMC_SHM_SEND_TIMEOUT_MS for the server to catch up, or not at all with
+ * IMC_DONTWAIT. A message dropped because the server is not up or not
+ * keeping up fails with errno set to EAGAIN.
+ *
+ * @param client the client context
+ * @param buf the buffer to send
+ * @param buflen the buffer size
+ * @param flags IMC_DONTWAIT or 0
+ */
+int
+imc_shm_send(struct imc_context *client, void *buf, size_t buflen, int flags)
+{
+    struct imc_shm_conn *conn;
+    struct imc_shm_hdr *hdr;
+    struct imc_shm_rec *rec;
+    struct imc_shm *shm;
+    uint64_t deadline;
+    uint32_t offset;
+    uint32_t contig;
+    uint64_t head;
+    uint64_t tail;
+    size_t reclen;
+    uint64_t now;
+    size_t need;
+    int err;
+
+    shm = client->shm;
+
+    conn = imc_shm_client_conn(client);
+    if (conn == NULL)
+    {
+        err = EAGAIN;
+        goto err_drop;
+    }
+
+    reclen = sizeof(*rec) + IMC_SHM_ALIGN(buflen);
+    if (reclen > conn->size / 2)
+    {
+        LOGE("%s: message too large: %zu bytes", __func__, buflen);
+        err = EMSGSIZE;
+        goto err_drop;
+    }
+
+    hdr = conn->hdr;
+    head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    offset = head & (conn->size - 1);
+    contig = conn->size - offset;
+
+    /* A record that does not fit before the end of the ring is preceded by a pad */
+    need = (contig < reclen) ? contig + reclen : reclen;
+
+    deadline = 0;
+    for (;;)
+    {
+        tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+        if (conn->size - (head - tail) >= need) break;
+
+        if (flags & IMC_DONTWAIT)
+        {
+            err = EAGAIN;
+            goto err_drop;
+        }
+
+        /* Full: ask for a kick, then look again before sleeping */
+        __atomic_store_n(&hdr->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&hdr->tail, __ATOMIC_SEQ_CST);
+        if (conn->size - (head - tail) >= need) break;
+
+        now = imc_shm_clock_ms();
+        if (deadline == 0) deadline = now + IMC_SHM_SEND_TIMEOUT_MS;
+        if (now >= deadline)
+        {
+            err = EAGAIN;
+            goto err_drop;
+        }
+
+        if (imc_shm_wait(conn, deadline - now) != 0)
+        {
+            LOGI("%s: %s went away", __func__, client->endpoint);
+            imc_shm_conn_free(conn);
+            shm->conn = NULL;
+            shm->retry = 0;
+            err = EAGAIN;
+            goto err_drop;
+        }
+    }
+
+    if (contig < reclen)
+    {
+        rec = (struct imc_shm_rec *)(hdr->data + offset);
+        rec->len = IMC_SHM_REC_PAD;
+        head += contig;
+        offset = 0;
+    }
+
+    rec = (struct imc_shm_rec *)(hdr->data + offset);
+    rec->len = buflen;
+    rec->reserved = 0;
+    memcpy(rec + 1, buf, buflen);
+
+    __atomic_store_n(&hdr->head, head + reclen, __ATOMIC_SEQ_CST);
+
+    /* Only wake the server up if it went to sleep */
+    if (__atomic_load_n(&hdr->consumer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&hdr->consumer_waiting, 0, __ATOMIC_SEQ_CST))
+    {
+        imc_shm_kick(conn->efd_data);
+    }
+
+    if (shm->drops != 0)
+    {
+        LOGI("%s: %s: resumed after dropping %" PRIu64 " messages", __func__,
+             client->endpoint, shm->drops);
+        shm->drops = 0;
+    }
+
+    if (client->imc_free_sndmsg != NULL) client->imc_free_sndmsg(buf, client->free_msg_hint);
+
+    return 0;
+
+err_drop:
+    if (shm->drops++ == 0)
+    {
+        LOGW("%s: %s: dropping messages: %s", __func__,
+             client->endpoint, strerror(err));
+    }
+
+    if (client->imc_free_sndmsg != NULL) client->imc_free_sndmsg(buf, client->free_msg_hint);
+
+    errno = err;
+    return -1;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef IMC_SHM_H_INCLUDED
+#define IMC_SHM_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "imc.h"
+
+/*
+ * Shared memory ring transport, selected by an IMC_SHM_SCHEME endpoint.
+ * Same semantics as the zeromq PUSH/PULL pair: the client owns the message
+ * handed to imc_send() and the server receive callback gets a buffer that is
+ * only valid for the duration of the call.
+ */
+
+bool
+imc_shm_endpoint(const char *endpoint);
+
+int
+imc_shm_init_server(struct imc_context *server, struct ev_loop *loop,
+                    imc_recv recv_cb);
+
+void
+imc_shm_terminate_server(struct imc_context *server);
+
+int
+imc_shm_init_client(struct imc_context *client, imc_free_sndmsg free_snd_msg,
+                    void *free_msg_hint);
+
+void
+imc_shm_terminate_client(struct imc_context *client);
+
+int
+imc_shm_send(struct imc_context *client, void *buf, size_t buflen, int flags);
+
+#endif /* IMC_SHM_H_INCLUDED */
@@ -40,6 +40,7 @@ else
 endif
 
 UNIT_SRC := src/imc.c
+UNIT_SRC += src/imc_shm.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 
@@ -50,4 +51,5 @@ UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 
 UNIT_DEPS := src/lib/const
 UNIT_DEPS += src/lib/log
+UNIT_DEPS += src/lib/ds
 UNIT_DEPS += src/lib/ovsdb
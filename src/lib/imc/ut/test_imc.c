@@ -24,9 +24,15 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
 #include <ev.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <zmq.h>
 
 #include "imc.h"
@@ -42,8 +48,15 @@ struct test_mgr
     struct ev_loop *loop;
     ev_timer timeout_watcher;
     int64_t val;
+    uint64_t sent;
+    uint64_t dropped;
+    uint64_t received;
 } g_test_mgr;
 
+#define TEST_SHM_MSG_LEN 40  /* Not a divider of the ring size: forces a wrap */
+#define TEST_SHM_BURST 30000 /* More than the ring holds */
+#define TEST_SHM_RESTART_MSGS 10
+
 
 /**
  * @brief breaks the ev loop to terminate a test
@@ -64,6 +77,9 @@ setUp(void)
     ev_timer *p_timeout_watcher;
 
     g_test_mgr.val = 0x123456789abcdef;
+    g_test_mgr.sent = 0;
+    g_test_mgr.dropped = 0;
+    g_test_mgr.received = 0;
     g_test_mgr.loop = EV_DEFAULT;
 
     /* Set up the timer killing the ev loop, indicating the end of the test */
@@ -246,6 +262,270 @@ test_basic_send_recv(void)
 }
 
 
+/**
+ * @brief checks that shared memory ring messages arrive in order
+ */
+static void
+test_shm_recv_cb(void *data, size_t len)
+{
+    uint64_t seq;
+
+    TEST_ASSERT_EQUAL_INT(TEST_SHM_MSG_LEN, len);
+
+    memcpy(&seq, data, sizeof(seq));
+    TEST_ASSERT_EQUAL_UINT64(g_test_mgr.received, seq);
+    g_test_mgr.received++;
+}
+
+
+/**
+ * @brief sends more messages than the ring holds without waiting
+ */
+static void
+send_burst_cb(EV_P_ ev_timer *w, int revents)
+{
+    struct imc_context *client;
+    uint8_t *data;
+    int rc;
+    int i;
+
+    client = w->data;
+    for (i = 0; i < TEST_SHM_BURST; i++)
+    {
+        data = calloc(1, TEST_SHM_MSG_LEN);
+        TEST_ASSERT_NOT_NULL(data);
+        memcpy(data, &g_test_mgr.sent, sizeof(g_test_mgr.sent));
+
+        rc = imc_send(client, data, TEST_SHM_MSG_LEN, IMC_DONTWAIT);
+        if (rc == 0)
+        {
+            g_test_mgr.sent++;
+            continue;
+        }
+
+        TEST_ASSERT_EQUAL_INT(EAGAIN, errno);
+        g_test_mgr.dropped++;
+    }
+}
+
+
+/**
+ * @brief test send/receive over the shared memory ring, with backpressure
+ */
+void
+test_shm_send_recv(void)
+{
+    struct imc_context server;
+    struct imc_context client;
+    ev_timer burst1;
+    ev_timer burst2;
+    struct ev_loop *loop;
+    int rc;
+
+    loop = g_test_mgr.loop;
+
+    /* The client does not need the server to be up */
+    memset(&client, 0, sizeof(client));
+    client.ztype = IMC_PUSH;
+    client.endpoint = strdup(IMC_SHM_SCHEME "/tmp/test_imc_shm");
+    TEST_ASSERT_NOT_NULL(client.endpoint);
+
+    unlink("/tmp/test_imc_shm");
+    rc = imc_init_client(&client, free_send_msg, NULL);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+    TEST_ASSERT_NOT_NULL(client.shm);
+
+    memset(&server, 0, sizeof(server));
+    server.ztype = IMC_PULL;
+    server.endpoint = strdup(IMC_SHM_SCHEME "/tmp/test_imc_shm");
+    TEST_ASSERT_NOT_NULL(server.endpoint);
+
+    rc = imc_init_server(&server, loop, test_shm_recv_cb);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+
+    /* Two bursts: the first one fills the ring, the second one wraps */
+    ev_timer_init(&burst1, send_burst_cb, 1.1, 0);
+    burst1.data = &client;
+    ev_timer_start(loop, &burst1);
+
+    ev_timer_init(&burst2, send_burst_cb, 1.3, 0);
+    burst2.data = &client;
+    ev_timer_start(loop, &burst2);
+
+    /* Reconnection is rate limited, leave room for it */
+    ev_timer_stop(loop, &g_test_mgr.timeout_watcher);
+    ev_timer_set(&g_test_mgr.timeout_watcher, 1.6, 0.);
+    ev_timer_start(loop, &g_test_mgr.timeout_watcher);
+
+    ev_run(loop, 0);
+
+    TEST_ASSERT_TRUE(g_test_mgr.dropped > 0);
+    TEST_ASSERT_TRUE(g_test_mgr.sent > TEST_SHM_BURST);
+    TEST_ASSERT_EQUAL_UINT64(g_test_mgr.sent, g_test_mgr.received);
+
+    imc_terminate_client(&client);
+    imc_terminate_server(&server);
+
+    free(client.endpoint);
+    free(server.endpoint);
+}
+
+
+/*
+ * Shared memory server running in a child process, so that it can be killed.
+ * It reports that it is listening on @ready, then the number of messages it
+ * received on @report once it got @expected of them or timed out.
+ */
+static uint64_t g_child_received;
+static uint64_t g_child_expected;
+
+static void
+child_recv_cb(void *data, size_t len)
+{
+    (void)data;
+    (void)len;
+
+    g_child_received++;
+}
+
+static void
+child_check_cb(EV_P_ ev_check *w, int revents)
+{
+    if (g_child_received >= g_child_expected) ev_break(EV_A_ EVBREAK_ALL);
+}
+
+static pid_t
+start_shm_server(const char *endpoint, uint64_t expected, int report)
+{
+    struct imc_context server;
+    struct ev_loop *loop;
+    ev_timer timeout;
+    ev_check check;
+    int ready[2];
+    pid_t pid;
+    char c;
+
+    TEST_ASSERT_EQUAL_INT(0, pipe(ready));
+
+    pid = fork();
+    TEST_ASSERT_TRUE(pid >= 0);
+
+    if (pid > 0)
+    {
+        close(ready[1]);
+        TEST_ASSERT_EQUAL_INT(1, read(ready[0], &c, 1));
+        close(ready[0]);
+        return pid;
+    }
+
+    close(ready[0]);
+    loop = ev_loop_new(EVFLAG_AUTO);
+    g_child_received = 0;
+    g_child_expected = expected;
+
+    memset(&server, 0, sizeof(server));
+    server.ztype = IMC_PULL;
+    server.endpoint = strdup(endpoint);
+    if (imc_init_server(&server, loop, child_recv_cb) != 0) _exit(1);
+
+    ev_check_init(&check, child_check_cb);
+    ev_check_start(loop, &check);
+    ev_timer_init(&timeout, timeout_cb, 3.0, 0.);
+    ev_timer_start(loop, &timeout);
+
+    c = 0;
+    if (write(ready[1], &c, 1) != 1) _exit(1);
+
+    ev_run(loop, 0);
+
+    if (report >= 0 &&
+        write(report, &g_child_received, sizeof(g_child_received)) != sizeof(g_child_received))
+    {
+        _exit(1);
+    }
+
+    imc_terminate_server(&server);
+    _exit(0);
+}
+
+
+static int
+shm_send_one(struct imc_context *client)
+{
+    uint8_t *data;
+
+    data = calloc(1, TEST_SHM_MSG_LEN);
+    TEST_ASSERT_NOT_NULL(data);
+
+    return imc_send(client, data, TEST_SHM_MSG_LEN, IMC_DONTWAIT);
+}
+
+
+/**
+ * @brief a killed server is detected and the client moves to its successor
+ */
+void
+test_shm_server_restart(void)
+{
+    struct imc_context client;
+    struct pollfd pfd;
+    uint64_t received;
+    int report[2];
+    pid_t pid;
+    int status;
+    int rc;
+    int i;
+
+    unlink("/tmp/test_imc_shm_restart");
+
+    pid = start_shm_server(IMC_SHM_SCHEME "/tmp/test_imc_shm_restart", UINT64_MAX, -1);
+
+    memset(&client, 0, sizeof(client));
+    client.ztype = IMC_PUSH;
+    client.endpoint = strdup(IMC_SHM_SCHEME "/tmp/test_imc_shm_restart");
+    TEST_ASSERT_NOT_NULL(client.endpoint);
+
+    rc = imc_init_client(&client, free_send_msg, NULL);
+    TEST_ASSERT_EQUAL_INT(0, rc);
+    TEST_ASSERT_EQUAL_INT(0, shm_send_one(&client));
+
+    /* The killed server never marks the ring closed */
+    kill(pid, SIGKILL);
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+
+    /* Past the socket check interval, sending no longer goes to the orphaned ring */
+    usleep(50 * 1000);
+    rc = shm_send_one(&client);
+    TEST_ASSERT_EQUAL_INT(-1, rc);
+    TEST_ASSERT_EQUAL_INT(EAGAIN, errno);
+
+    TEST_ASSERT_EQUAL_INT(0, pipe(report));
+    pid = start_shm_server(IMC_SHM_SCHEME "/tmp/test_imc_shm_restart",
+                           TEST_SHM_RESTART_MSGS, report[1]);
+    close(report[1]);
+
+    /* Reconnection is rate limited */
+    usleep(1100 * 1000);
+    for (i = 0; i < TEST_SHM_RESTART_MSGS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, shm_send_one(&client));
+    }
+
+    pfd.fd = report[0];
+    pfd.events = POLLIN;
+    TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 5000));
+    TEST_ASSERT_EQUAL_INT(sizeof(received), read(report[0], &received, sizeof(received)));
+    TEST_ASSERT_EQUAL_UINT64(TEST_SHM_RESTART_MSGS, received);
+    close(report[0]);
+
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    imc_terminate_client(&client);
+    free(client.endpoint);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -260,6 +540,8 @@ main(int argc, char *argv[])
     RUN_TEST(test_start_terminate_server);
     RUN_TEST(test_start_terminate_client);
     RUN_TEST(test_basic_send_recv);
+    RUN_TEST(test_shm_send_recv);
+    RUN_TEST(test_shm_server_restart);
 
     return UNITY_END();
 }
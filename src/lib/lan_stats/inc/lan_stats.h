@@ -27,6 +27,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef LAN_STATS_H_INCLUDED
 #define LAN_STATS_H_INCLUDED
 
+#include <stdbool.h>
+#include <time.h>
+
+#include "os_types.h"
+
 #define MAC_ADDR_STR_LEN     (18)
 #define OVS_DPCTL_DUMP_FLOWS "ovs-dpctl dump-flows"
 #define LINE_BUFF_LEN        (2048)
@@ -49,6 +54,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define OVS_DUMP_VLAN_ETH_TYPE_PREFIX_LEN  (15) // Length of "encap(eth_type("
 #define MAX_HISTOGRAMS               (1)
 
+#define LAN_STATS_DP_BUF_SZ          (64 * 1024) // Datapath netlink receive buffer
+#define LAN_STATS_DP_MAX             (8)         // Maximum number of OVS datapaths
+
 typedef struct dp_ctl_stats_
 {
     char            smac_addr[MAC_ADDR_STR_LEN];
@@ -65,4 +73,25 @@ typedef struct dp_ctl_stats_
     time_t          stime;
 } dp_ctl_stats_t;
 
+typedef void lan_stats_dp_flow_fn_t(void *ctx, dp_ctl_stats_t *stats);
+
+/**
+ * @brief dump all OVS datapath flows over generic netlink
+ *
+ * The callback is invoked for each decoded flow. The netlink socket and
+ * receive buffer are kept open between calls.
+ *
+ * @param fn per-flow callback
+ * @param ctx opaque context passed to fn
+ * @param nflows number of flows passed to fn, also set on failure
+ * @return true if the dump completed, false if the OVS datapath is not
+ *         reachable over netlink or the dump was interrupted
+ */
+bool lan_stats_dp_dump_flows(lan_stats_dp_flow_fn_t *fn, void *ctx, size_t *nflows);
+
+/**
+ * @brief release the datapath netlink socket and receive buffer
+ */
+void lan_stats_dp_fini(void);
+
 #endif /* LAN_STATS_H_INCLUDED */
@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 static char *dflt_fltr_name = "none";
 static char *collect_cmd = OVS_DPCTL_DUMP_FLOWS;
+static bool drop_interval = false;
 
 static unsigned int get_eth_type(char *eth)
 {
@@ -296,22 +297,70 @@ static void lan_stats_send_report_cb(fcm_collect_plugin_t *collector)
 
     //collector->plugin_fcm_ctx = mqtt_report;
    close_window(collector);
-   send_aggr_report(collector);
+   if (drop_interval)
+   {
+       /* A datapath dump failed midway, the window holds a partial view */
+       LOGI("lan_stats: dropping report interval after a partial datapath dump\n");
+       net_md_reset_aggregator(collector->plugin_ctx);
+       drop_interval = false;
+   }
+   else
+   {
+       send_aggr_report(collector);
+   }
    activate_window(collector);
 }
 
-static void lan_stats_collect_cb(fcm_collect_plugin_t *collector)
+static void lan_stats_process_flow(void *ctx, dp_ctl_stats_t *stats)
 {
-    FILE *fp = NULL;
-    char line_buf[LINE_BUFF_LEN] = {0,};
-    dp_ctl_stats_t stats;
+    fcm_collect_plugin_t *collector = ctx;
     fcm_filter_l2_info_t l2_filter_info;
     fcm_filter_stats_t   l2_filter_pkts;
     bool allow = false;
 
-    collect_cmd  = collector->fcm_plugin_ctx;
-    if (collect_cmd == NULL)
-        collect_cmd = OVS_DPCTL_DUMP_FLOWS;
+    set_filter_info(&l2_filter_info, &l2_filter_pkts, stats);
+    if (collector->filters.collect != NULL)
+    {
+        fcm_filter_layer2_apply(collector->filters.collect,
+                              &l2_filter_info, &l2_filter_pkts, &allow);
+        if (allow)
+        {
+            LOGD("Flow collect allowed: filter_name: %s, smac: %s, " \
+                 "dmac: %s, vlan_id: %d, eth_type: %d, pks: %ld, " \
+                 "bytes: %ld\n",\
+                  collector->filters.collect ?
+                  collector->filters.collect : dflt_fltr_name,
+                  stats->smac_addr,
+                  stats->dmac_addr, stats->vlan_id, stats->eth_val,
+                  stats->pkts, stats->bytes);
+            aggr_add_sample(collector, stats);
+        }
+        else
+            LOGD("Flow collect dropped: filter_name: %s, smac: %s, "\
+                 "dmac: %s, vlan_id: %d, eth_type: %d, pks: %ld, "\
+                 "bytes: %ld\n",\
+                  collector->filters.collect ?
+                  collector->filters.collect : dflt_fltr_name,
+                  stats->smac_addr, stats->dmac_addr,
+                  stats->vlan_id, stats->eth_val, stats->pkts, stats->bytes);
+    }
+    else
+    {
+        LOGD("Aggr add sample\n");
+        aggr_add_sample(collector, stats);
+    }
+}
+
+/*
+ * Fallback collection method, used when the OVS datapath cannot be
+ * reached over generic netlink (custom collect command, userspace datapath)
+ */
+static void lan_stats_collect_dpctl(fcm_collect_plugin_t *collector)
+{
+    FILE *fp = NULL;
+    char line_buf[LINE_BUFF_LEN] = {0,};
+    dp_ctl_stats_t stats;
+
     if ((fp = popen(collect_cmd, "r")) == NULL)
     {
         LOGE("popen error");
@@ -323,43 +372,42 @@ static void lan_stats_collect_cb(fcm_collect_plugin_t *collector)
         LOGD("ovs-dpctl dump line %s", line_buf);
         memset(&stats, 0, sizeof(stats));
         parse_flows(line_buf, &stats);
-        set_filter_info(&l2_filter_info, &l2_filter_pkts, &stats);
-        if (collector->filters.collect != NULL)
-        {
-            fcm_filter_layer2_apply(collector->filters.collect,
-                                  &l2_filter_info, &l2_filter_pkts, &allow);
-            if (allow)
-            {
-                LOGD("Flow collect allowed: filter_name: %s, smac: %s, " \
-                     "dmac: %s, vlan_id: %d, eth_type: %d, pks: %ld, " \
-                     "bytes: %ld\n",\
-                      collector->filters.collect ?
-                      collector->filters.collect : dflt_fltr_name,
-                      stats.smac_addr,
-                      stats.dmac_addr, stats.vlan_id, stats.eth_val,
-                      stats.pkts, stats.bytes);
-                aggr_add_sample(collector, &stats);
-            }
-            else
-                LOGD("Flow collect dropped: filter_name: %s, smac: %s, "\
-                     "dmac: %s, vlan_id: %d, eth_type: %d, pks: %ld, "\
-                     "bytes: %ld\n",\
-                      collector->filters.collect ?
-                      collector->filters.collect : dflt_fltr_name,
-                      stats.smac_addr, stats.dmac_addr,
-                      stats.vlan_id, stats.eth_val, stats.pkts, stats.bytes);
-        }
-        else
-        {
-            LOGD("Aggr add sample\n");
-            aggr_add_sample(collector, &stats);
-        }
+        lan_stats_process_flow(collector, &stats);
         memset(line_buf, 0, sizeof(line_buf));
     }
     pclose(fp);
     fp = NULL;
 }
 
+static void lan_stats_collect_cb(fcm_collect_plugin_t *collector)
+{
+    size_t nflows;
+
+    collect_cmd  = collector->fcm_plugin_ctx;
+    if (collect_cmd == NULL)
+    {
+        /* Read the datapath flows directly from the kernel */
+        if (lan_stats_dp_dump_flows(lan_stats_process_flow, collector, &nflows)) return;
+
+        /*
+         * Flows already delivered would be counted again by ovs-dpctl, only
+         * fall back if the datapath could not be reached at all
+         */
+        if (nflows > 0)
+        {
+            LOGW("lan_stats: datapath dump interrupted after %zu flows, dropping interval\n",
+                 nflows);
+            drop_interval = true;
+            return;
+        }
+
+        LOGD("Datapath netlink dump failed, falling back to %s\n", OVS_DPCTL_DUMP_FLOWS);
+        collect_cmd = OVS_DPCTL_DUMP_FLOWS;
+    }
+
+    lan_stats_collect_dpctl(collector);
+}
+
 
 void lan_stats_plugin_close_cb(fcm_collect_plugin_t *collector)
 {
@@ -373,6 +421,7 @@ void lan_stats_plugin_close_cb(fcm_collect_plugin_t *collector)
     }
     close_window(collector);
     net_md_free_aggregator(aggr);
+    lan_stats_dp_fini();
 }
 
 
@@ -0,0 +1,445 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Datapath flow collection over the OVS generic netlink interface.
+ *
+ * Flows are dumped directly from the kernel datapath ("ovs_datapath" and
+ * "ovs_flow" genetlink families) and decoded from their binary attributes,
+ * which replaces running and text-parsing "ovs-dpctl dump-flows".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/openvswitch.h>
+
+#include "os_types.h"
+#include "os.h"
+#include "log.h"
+#include "lan_stats.h"
+#include "util.h"
+
+/* Generic netlink message header including the OVS header */
+#define LAN_STATS_DP_HDRLEN \
+    (NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(sizeof(struct ovs_header)))
+
+struct lan_stats_dp
+{
+    int             sock;           /* Generic netlink socket */
+    uint32_t        seq;            /* Request sequence number */
+    uint16_t        dp_family;      /* "ovs_datapath" family id */
+    uint16_t        flow_family;    /* "ovs_flow" family id */
+    uint8_t        *buf;            /* Reusable receive buffer */
+};
+
+static struct lan_stats_dp lan_stats_dp =
+{
+    .sock = -1,
+};
+
+typedef bool lan_stats_dp_msg_fn_t(void *ctx, struct nlmsghdr *nh);
+
+/*
+ * Iterate attributes; struct rtattr has the same layout as struct nlattr
+ */
+#define LAN_STATS_DP_ATTR_TYPE(rta) ((rta)->rta_type & NLA_TYPE_MASK)
+
+static void lan_stats_dp_close(void)
+{
+    if (lan_stats_dp.sock >= 0)
+    {
+        close(lan_stats_dp.sock);
+    }
+
+    lan_stats_dp.sock = -1;
+    lan_stats_dp.dp_family = 0;
+    lan_stats_dp.flow_family = 0;
+}
+
+/*
+ * Send a request and process all response messages with fn.
+ */
+static bool lan_stats_dp_request(struct nlmsghdr *req, lan_stats_dp_msg_fn_t *fn, void *ctx)
+{
+    struct sockaddr_nl nladdr;
+    struct nlmsghdr *nh;
+    struct nlmsgerr *err;
+    size_t len;
+    ssize_t rc;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    req->nlmsg_seq = ++lan_stats_dp.seq;
+
+    rc = sendto(lan_stats_dp.sock, req, req->nlmsg_len, 0,
+                (struct sockaddr *)&nladdr, sizeof(nladdr));
+    if (rc < 0)
+    {
+        LOGE("%s: send failed: %s", __func__, strerror(errno));
+        goto error;
+    }
+
+    for (;;)
+    {
+        rc = recv(lan_stats_dp.sock, lan_stats_dp.buf, LAN_STATS_DP_BUF_SZ, 0);
+        if (rc < 0)
+        {
+            if (errno == EINTR) continue;
+            LOGE("%s: recv failed: %s", __func__, strerror(errno));
+            goto error;
+        }
+
+        for (nh = (struct nlmsghdr *)lan_stats_dp.buf, len = (size_t)rc;
+             NLMSG_OK(nh, len);
+             nh = NLMSG_NEXT(nh, len))
+        {
+            if (nh->nlmsg_seq != req->nlmsg_seq) continue;
+
+            if (nh->nlmsg_type == NLMSG_DONE) return true;
+
+            if (nh->nlmsg_type == NLMSG_ERROR)
+            {
+                err = NLMSG_DATA(nh);
+                if (err->error == 0) return true;
+                LOGD("%s: request failed: %s", __func__, strerror(-err->error));
+                return false;
+            }
+
+            if (!fn(ctx, nh)) return false;
+
+            /* Non-dump requests are answered with a single message */
+            if (!(nh->nlmsg_flags & NLM_F_MULTI)) return true;
+        }
+    }
+
+error:
+    lan_stats_dp_close();
+    return false;
+}
+
+static bool lan_stats_dp_family_fn(void *ctx, struct nlmsghdr *nh)
+{
+    struct genlmsghdr *genl;
+    struct rtattr *rta;
+    uint16_t *family;
+    int len;
+
+    family = ctx;
+    genl = NLMSG_DATA(nh);
+    len = nh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+    for (rta = (struct rtattr *)((uint8_t *)genl + GENL_HDRLEN);
+         RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len))
+    {
+        if (LAN_STATS_DP_ATTR_TYPE(rta) == CTRL_ATTR_FAMILY_ID)
+        {
+            *family = *(uint16_t *)RTA_DATA(rta);
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Resolve a generic netlink family name to its id
+ */
+static uint16_t lan_stats_dp_family_get(const char *name)
+{
+    struct
+    {
+        struct nlmsghdr     nh;
+        struct genlmsghdr   genl;
+        uint8_t             attr[NLA_HDRLEN + NLA_ALIGN(GENL_NAMSIZ)];
+    } req;
+    struct rtattr *rta;
+    uint16_t family = 0;
+    size_t nlen;
+
+    nlen = strlen(name) + 1;
+    if (nlen > GENL_NAMSIZ) return 0;
+
+    memset(&req, 0, sizeof(req));
+    req.genl.cmd = CTRL_CMD_GETFAMILY;
+    req.genl.version = 1;
+
+    rta = (struct rtattr *)req.attr;
+    rta->rta_type = CTRL_ATTR_FAMILY_NAME;
+    rta->rta_len = RTA_LENGTH(nlen);
+    memcpy(RTA_DATA(rta), name, nlen);
+
+    req.nh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + RTA_SPACE(nlen);
+    req.nh.nlmsg_type = GENL_ID_CTRL;
+    req.nh.nlmsg_flags = NLM_F_REQUEST;
+
+    if (!lan_stats_dp_request(&req.nh, lan_stats_dp_family_fn, &family)) return 0;
+
+    return family;
+}
+
+static bool lan_stats_dp_open(void)
+{
+    struct sockaddr_nl nladdr;
+
+    if (lan_stats_dp.sock >= 0) return true;
+
+    if (lan_stats_dp.buf == NULL)
+    {
+        lan_stats_dp.buf = malloc(LAN_STATS_DP_BUF_SZ);
+        if (lan_stats_dp.buf == NULL)
+        {
+            LOGE("%s: unable to allocate receive buffer", __func__);
+            return false;
+        }
+    }
+
+    lan_stats_dp.sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (lan_stats_dp.sock < 0)
+    {
+        LOGE("%s: unable to create generic netlink socket: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    if (bind(lan_stats_dp.sock, (struct sockaddr *)&nladdr, sizeof(nladdr)) != 0)
+    {
+        LOGE("%s: unable to bind generic netlink socket: %s", __func__, strerror(errno));
+        lan_stats_dp_close();
+        return false;
+    }
+
+    lan_stats_dp.dp_family = lan_stats_dp_family_get(OVS_DATAPATH_FAMILY);
+    lan_stats_dp.flow_family = lan_stats_dp_family_get(OVS_FLOW_FAMILY);
+    if (lan_stats_dp.dp_family == 0 || lan_stats_dp.flow_family == 0)
+    {
+        LOGN("%s: OVS datapath generic netlink families not available", __func__);
+        lan_stats_dp_close();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Build a dump request for the OVS family/command on datapath dp_ifindex
+ */
+static void lan_stats_dp_dump_req(struct nlmsghdr *nh, uint16_t family,
+                                  uint8_t cmd, uint8_t version, int dp_ifindex)
+{
+    struct genlmsghdr *genl;
+    struct ovs_header *ovsh;
+
+    memset(nh, 0, LAN_STATS_DP_HDRLEN);
+    nh->nlmsg_len = LAN_STATS_DP_HDRLEN;
+    nh->nlmsg_type = family;
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+    genl = NLMSG_DATA(nh);
+    genl->cmd = cmd;
+    genl->version = version;
+
+    ovsh = (struct ovs_header *)((uint8_t *)genl + GENL_HDRLEN);
+    ovsh->dp_ifindex = dp_ifindex;
+}
+
+/*
+ * Decode the OVS_FLOW_ATTR_KEY attribute; nested VLAN encapsulation is
+ * handled recursively (OVS_KEY_ATTR_ENCAP)
+ */
+static void lan_stats_dp_key_parse(struct rtattr *key, int len, dp_ctl_stats_t *stats, bool encap)
+{
+    struct ovs_key_ethernet *eth;
+    struct rtattr *rta;
+    uint16_t tci;
+
+    for (rta = key; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        switch (LAN_STATS_DP_ATTR_TYPE(rta))
+        {
+            case OVS_KEY_ATTR_ETHERNET:
+                if (RTA_PAYLOAD(rta) < sizeof(*eth)) break;
+                eth = RTA_DATA(rta);
+                memcpy(stats->smac_key.addr, eth->eth_src, sizeof(stats->smac_key.addr));
+                memcpy(stats->dmac_key.addr, eth->eth_dst, sizeof(stats->dmac_key.addr));
+                break;
+
+            case OVS_KEY_ATTR_ETHERTYPE:
+                if (RTA_PAYLOAD(rta) < sizeof(uint16_t)) break;
+                if (encap)
+                    stats->vlan_eth_val = ntohs(*(uint16_t *)RTA_DATA(rta));
+                else
+                    stats->eth_val = ntohs(*(uint16_t *)RTA_DATA(rta));
+                break;
+
+            case OVS_KEY_ATTR_VLAN:
+                if (RTA_PAYLOAD(rta) < sizeof(uint16_t)) break;
+                tci = ntohs(*(uint16_t *)RTA_DATA(rta));
+                stats->vlan_id = tci & 0x0fff;
+                break;
+
+            case OVS_KEY_ATTR_ENCAP:
+                if (encap) break;
+                lan_stats_dp_key_parse(RTA_DATA(rta), RTA_PAYLOAD(rta), stats, true);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+struct lan_stats_dp_flow_ctx
+{
+    lan_stats_dp_flow_fn_t     *fn;
+    void                       *ctx;
+    time_t                      now;
+    size_t                      nflows;
+};
+
+static bool lan_stats_dp_flow_fn(void *_ctx, struct nlmsghdr *nh)
+{
+    struct lan_stats_dp_flow_ctx *fctx = _ctx;
+    struct ovs_flow_stats ofs;
+    dp_ctl_stats_t stats;
+    struct rtattr *rta;
+    int len;
+
+    if (nh->nlmsg_len < LAN_STATS_DP_HDRLEN) return true;
+
+    memset(&stats, 0, sizeof(stats));
+
+    len = nh->nlmsg_len - LAN_STATS_DP_HDRLEN;
+    for (rta = (struct rtattr *)((uint8_t *)nh + LAN_STATS_DP_HDRLEN);
+         RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len))
+    {
+        switch (LAN_STATS_DP_ATTR_TYPE(rta))
+        {
+            case OVS_FLOW_ATTR_KEY:
+                lan_stats_dp_key_parse(RTA_DATA(rta), RTA_PAYLOAD(rta), &stats, false);
+                break;
+
+            case OVS_FLOW_ATTR_STATS:
+                /* The attribute is only 4-byte aligned, copy it out */
+                if (RTA_PAYLOAD(rta) < sizeof(ofs)) break;
+                memcpy(&ofs, RTA_DATA(rta), sizeof(ofs));
+                stats.pkts = ofs.n_packets;
+                stats.bytes = ofs.n_bytes;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    snprintf(stats.smac_addr, sizeof(stats.smac_addr), PRI(os_macaddr_lower_t),
+             FMT(os_macaddr_t, stats.smac_key));
+    snprintf(stats.dmac_addr, sizeof(stats.dmac_addr), PRI(os_macaddr_lower_t),
+             FMT(os_macaddr_t, stats.dmac_key));
+    stats.stime = fctx->now;
+
+    fctx->fn(fctx->ctx, &stats);
+    fctx->nflows++;
+
+    return true;
+}
+
+struct lan_stats_dp_list
+{
+    int     dp_ifindex[LAN_STATS_DP_MAX];
+    int     dp_num;
+};
+
+static bool lan_stats_dp_list_fn(void *ctx, struct nlmsghdr *nh)
+{
+    struct lan_stats_dp_list *dpl = ctx;
+    struct ovs_header *ovsh;
+
+    if (nh->nlmsg_len < LAN_STATS_DP_HDRLEN) return true;
+    if (dpl->dp_num >= LAN_STATS_DP_MAX) return true;
+
+    ovsh = (struct ovs_header *)((uint8_t *)NLMSG_DATA(nh) + GENL_HDRLEN);
+    dpl->dp_ifindex[dpl->dp_num++] = ovsh->dp_ifindex;
+
+    return true;
+}
+
+bool lan_stats_dp_dump_flows(lan_stats_dp_flow_fn_t *fn, void *ctx, size_t *nflows)
+{
+    struct lan_stats_dp_flow_ctx fctx;
+    struct lan_stats_dp_list dpl;
+    uint8_t req[LAN_STATS_DP_HDRLEN];
+    struct nlmsghdr *nh;
+    int ii;
+
+    *nflows = 0;
+    if (!lan_stats_dp_open()) return false;
+
+    nh = (struct nlmsghdr *)req;
+
+    /* Enumerate datapaths (usually there's only "ovs-system") */
+    memset(&dpl, 0, sizeof(dpl));
+    lan_stats_dp_dump_req(nh, lan_stats_dp.dp_family, OVS_DP_CMD_GET, OVS_DATAPATH_VERSION, 0);
+    if (!lan_stats_dp_request(nh, lan_stats_dp_list_fn, &dpl)) return false;
+
+    fctx.fn = fn;
+    fctx.ctx = ctx;
+    fctx.now = time(NULL);
+    fctx.nflows = 0;
+
+    for (ii = 0; ii < dpl.dp_num; ii++)
+    {
+        lan_stats_dp_dump_req(nh, lan_stats_dp.flow_family, OVS_FLOW_CMD_GET,
+                              OVS_FLOW_VERSION, dpl.dp_ifindex[ii]);
+        if (!lan_stats_dp_request(nh, lan_stats_dp_flow_fn, &fctx))
+        {
+            *nflows = fctx.nflows;
+            return false;
+        }
+    }
+
+    *nflows = fctx.nflows;
+    return true;
+}
+
+void lan_stats_dp_fini(void)
+{
+    lan_stats_dp_close();
+
+    free(lan_stats_dp.buf);
+    lan_stats_dp.buf = NULL;
+}
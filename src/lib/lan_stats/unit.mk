@@ -36,6 +36,7 @@ UNIT_TYPE := SHLIB
 UNIT_DIR := lib
 
 UNIT_SRC := src/lan_stats.c
+UNIT_SRC += src/lan_stats_dp.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/fcm/inc
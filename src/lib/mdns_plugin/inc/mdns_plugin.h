@@ -71,6 +71,7 @@ struct mdnsd_context
     int                   mcast_fd;
     char                 *srcip;
     char                 *txintf;
+    size_t                cache_budget;
     struct timeval        sleep_tv;
     ev_io                 read;
     ev_timer              timer;
@@ -185,6 +186,9 @@ mdnsd_ctxt_get_mcast_fd(void);
 bool
 mdnsd_ctxt_set_srcip(struct mdns_session *md_session);
 
+void
+mdnsd_ctxt_set_cache_budget(struct mdns_session *md_session);
+
 bool
 mdnsd_ctxt_set_txintf(struct mdns_session *md_session);
 
@@ -102,6 +102,9 @@ mdnsd_ctxt_update(struct mdns_session *md_session)
         mdnsd_log_level("notice");
     }
 
+    // Get the latest cache memory budget.
+    mdnsd_ctxt_set_cache_budget(md_session);
+
     // Get the latest mdns sip.
     rc = mdnsd_ctxt_set_srcip(md_session);
     // Get the latest mdns txintf.
@@ -163,6 +166,7 @@ mdnsd_ctxt_start(struct mdnsd_context *pctxt)
       */
     pctxt->dmn = mdnsd_new(QCLASS_IN, 1400);
     if (!pctxt->dmn) return false;
+    mdnsd_set_cache_budget(pctxt->dmn, pctxt->cache_budget);
     // Register callback to read the rcvd records.
     mdnsd_register_receive_callback(pctxt->dmn, mdnsd_record_received, NULL);
 
@@ -401,6 +405,31 @@ mdnsd_ctxt_set_txintf(struct mdns_session *md_session)
     return true;
 }
 
+void
+mdnsd_ctxt_set_cache_budget(struct mdns_session *md_session)
+{
+    char *budget = NULL;
+    struct fsm_session  *session = NULL;
+    struct mdns_plugin_mgr *mgr = mdns_get_mgr();
+    struct mdnsd_context *pctxt =  mgr->ctxt;
+
+    if (!md_session || !pctxt) return;
+
+    session = md_session->session;
+    if (session->ops.get_config != NULL)
+    {
+        budget = session->ops.get_config(session, "mdns_cache_budget");
+    }
+
+    // The budget is configured in KiB, unset or 0 means the default.
+    pctxt->cache_budget = budget ? strtoul(budget, NULL, 10) * 1024 : 0;
+    if (!pctxt->dmn) return;
+
+    LOGD("mdns_daemon: Setting cache budget to %zu bytes%s", pctxt->cache_budget,
+         pctxt->cache_budget ? "" : " (default)");
+    mdnsd_set_cache_budget(pctxt->dmn, pctxt->cache_budget);
+}
+
 bool
 mdnsd_ctxt_set_srcip(struct mdns_session *md_session)
 {
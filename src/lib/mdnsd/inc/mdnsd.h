@@ -101,6 +101,12 @@ void mdnsd_log(int severity, const char *fmt, ...);
  */
 mdns_daemon_t *mdnsd_new(int class, int frame);
 
+/**
+ * Cap the memory used by cached answers, least recently used entries are
+ * evicted first once the cache grows past it. 0 restores the default.
+ */
+void mdnsd_set_cache_budget(mdns_daemon_t *d, size_t budget);
+
 /* Create a new record, or update an existing one */
 mdns_record_t *mdnsd_set_record(mdns_daemon_t *d, int shared, char *host,
                                 const char *name, unsigned short type,
@@ -31,8 +31,11 @@
 #include <time.h>
 #include <errno.h>
 
-#define SPRIME 108      /* Size of query/publish hashes */
-#define LPRIME 1009     /* Size of cache hash */
+#define SPRIME 128      /* Initial size of query/publish hashes */
+#define LPRIME 1024     /* Initial size of cache hash */
+#define HLOAD  2        /* Grow a hash once its average chain exceeds this */
+
+#define CACHE_BUDGET (512 * 1024)   /* Default cache memory cap, in bytes */
 
 #define GC 86400                /* Brute force garbage cleanup
                  * frequency, rarely needed (daily
@@ -52,6 +55,7 @@
 
 struct query {
     char *name;
+    unsigned int hash;
     int type;
     unsigned long int nexttry;
     int tries;
@@ -71,7 +75,10 @@ struct unicast {
 struct cached {
     struct mdns_answer rr;
     struct query *q;
+    unsigned int hash;
+    size_t size;
     struct cached *next;
+    struct cached *lru_prev, *lru_next;
 };
 
 struct mdns_record {
@@ -82,6 +89,7 @@ struct mdns_record {
     void (*conflict)(char *, int, void *);
     void *arg;
     struct timeval last_sent;
+    unsigned int hash;
     struct mdns_record *next, *list;
 };
 
@@ -90,10 +98,15 @@ struct mdns_daemon {
     unsigned long int expireall, checkqlist;
     struct timeval now, sleep, pause, probe, publish;
     int class, frame;
-    struct cached *cache[LPRIME];
-    struct mdns_record *published[SPRIME], *probing, *a_now, *a_pause, *a_publish;
+    struct cached **cache;
+    unsigned int cache_size, cache_count;
+    size_t cache_mem, cache_budget;
+    struct cached *lru_head, *lru_tail;   /* Least recently used first */
+    struct mdns_record **published, *probing, *a_now, *a_pause, *a_publish;
+    unsigned int published_size, published_count;
     struct unicast *uanswers;
-    struct query *queries[SPRIME], *qlist;
+    struct query **queries, *qlist;
+    unsigned int queries_size, queries_count;
 
     struct in_addr addr;
 
@@ -101,26 +114,64 @@ struct mdns_daemon {
     void *received_callback_data;
 };
 
-static int _namehash(const char *s)
+/*
+ * FNV-1a over the name. DNS names are case insensitive on the wire but
+ * every lookup here is a strcmp(), so hash the bytes as they are.
+ */
+static unsigned int _namehash(const char *s)
 {
     const unsigned char *name = (const unsigned char *)s;
-    unsigned long h = 0, g;
+    unsigned int h = 2166136261U;
 
-    while (*name) {     /* do some fancy bitwanking on the string */
-        h = (h << 4) + (unsigned long)(*name++);
-        if ((g = (h & 0xF0000000UL)) != 0)
-            h ^= (g >> 24);
-        h &= ~g;
+    while (*name) {
+        h ^= *name++;
+        h *= 16777619U;
     }
 
-    return (int)h;
+    /* Fold the high bits in, buckets are picked with a power of 2 mask */
+    return h ^ (h >> 16);
+}
+
+/*
+ * All hashes are power of 2 sized and only ever grow: once the average
+ * chain is longer than HLOAD the table is doubled and its entries are
+ * relinked using the hash stored in each of them.
+ */
+#define HASH_GROW(type, table, size)                                    \
+static int _##table##_grow(mdns_daemon_t *d)                            \
+{                                                                       \
+    unsigned int i, nsize = d->size * 2;                                \
+    type **ntable, *cur, *next;                                         \
+                                                                        \
+    ntable = calloc(nsize, sizeof(*ntable));                            \
+    if (!ntable)                                                        \
+        return 1;                                                       \
+                                                                        \
+    for (i = 0; i < d->size; i++) {                                     \
+        for (cur = d->table[i]; cur; cur = next) {                      \
+            next = cur->next;                                           \
+            cur->next = ntable[cur->hash & (nsize - 1)];                \
+            ntable[cur->hash & (nsize - 1)] = cur;                      \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    free(d->table);                                                     \
+    d->table = ntable;                                                  \
+    d->size = nsize;                                                    \
+    return 0;                                                           \
 }
 
+HASH_GROW(struct query, queries, queries_size)
+HASH_GROW(struct mdns_record, published, published_size)
+HASH_GROW(struct cached, cache, cache_size)
+
+#define HASH_BUCKET(d, table, hash) (&(d)->table[(hash) & ((d)->table##_size - 1)])
+
 /* Basic linked list and hash primitives */
 static struct query *_q_next(mdns_daemon_t *d, struct query *q, const char *host, int type)
 {
     if (q == 0)
-        q = d->queries[_namehash(host) % SPRIME];
+        q = *HASH_BUCKET(d, queries, _namehash(host));
     else
         q = q->next;
 
@@ -132,10 +183,42 @@ static struct query *_q_next(mdns_daemon_t *d, struct query *q, const char *host
     return 0;
 }
 
+/* Mark a cache entry as most recently used */
+static void _c_lru_unlink(mdns_daemon_t *d, struct cached *c)
+{
+    if (c->lru_prev)
+        c->lru_prev->lru_next = c->lru_next;
+    else
+        d->lru_head = c->lru_next;
+
+    if (c->lru_next)
+        c->lru_next->lru_prev = c->lru_prev;
+    else
+        d->lru_tail = c->lru_prev;
+
+    c->lru_prev = c->lru_next = NULL;
+}
+
+static void _c_lru_touch(mdns_daemon_t *d, struct cached *c)
+{
+    if (d->lru_tail == c)
+        return;
+
+    if (c->lru_prev || c->lru_next || d->lru_head == c)
+        _c_lru_unlink(d, c);
+
+    c->lru_prev = d->lru_tail;
+    if (d->lru_tail)
+        d->lru_tail->lru_next = c;
+    else
+        d->lru_head = c;
+    d->lru_tail = c;
+}
+
 static struct cached *_c_next(mdns_daemon_t *d, struct cached *c,const char *host, int type)
 {
     if (c == 0)
-        c = d->cache[_namehash(host) % LPRIME];
+        c = *HASH_BUCKET(d, cache, _namehash(host));
     else
         c = c->next;
 
@@ -147,10 +230,20 @@ static struct cached *_c_next(mdns_daemon_t *d, struct cached *c,const char *hos
     return 0;
 }
 
+/* Same as _c_next(), for lookups on behalf of the user: refreshes the LRU */
+static struct cached *_c_lookup(mdns_daemon_t *d, struct cached *c, const char *host, int type)
+{
+    c = _c_next(d, c, host, type);
+    if (c)
+        _c_lru_touch(d, c);
+
+    return c;
+}
+
 static mdns_record_t *_r_next(mdns_daemon_t *d, mdns_record_t *r, const char *host, int type)
 {
     if (r == NULL)
-        r = d->published[_namehash(host) % SPRIME];
+        r = *HASH_BUCKET(d, published, _namehash(host));
     else
         r = r->next;
 
@@ -343,9 +436,9 @@ static void _q_reset(mdns_daemon_t *d, struct query *q)
 /* No more queries, update all its cached entries, remove from lists */
 static void _q_done(mdns_daemon_t *d, struct query *q)
 {
+    struct query **bucket = HASH_BUCKET(d, queries, q->hash);
     struct cached *c = 0;
     struct query *cur;
-    int i = _namehash(q->name) % LPRIME;
 
     while ((c = _c_next(d, c, q->name, q->type)))
         c->q = 0;
@@ -358,23 +451,28 @@ static void _q_done(mdns_daemon_t *d, struct query *q)
         cur->list = q->list;
     }
 
-    if (d->queries[i] == q) {
-        d->queries[i] = q->next;
+    if (*bucket == q) {
+        *bucket = q->next;
     } else {
-        for (cur = d->queries[i]; cur->next != q; cur = cur->next)
+        for (cur = *bucket; cur->next != q; cur = cur->next)
             ;
         cur->next = q->next;
     }
+    d->queries_count--;
 
     free(q->name);
     free(q);
 }
 
-static void _free_cached(struct cached *c)
+static void _free_cached(mdns_daemon_t *d, struct cached *c)
 {
     if (!c)
         return;
 
+    _c_lru_unlink(d, c);
+    d->cache_mem -= c->size;
+    d->cache_count--;
+
     if (c->rr.name)
         free(c->rr.name);
     if (c->rr.rdata)
@@ -401,20 +499,23 @@ static void _free_record(mdns_record_t *r)
 /* buh-bye, remove from hash and free */
 static void _r_done(mdns_daemon_t *d, mdns_record_t *r)
 {
+    mdns_record_t **bucket;
     mdns_record_t *cur = 0;
-    int i;
 
     if (!r || !r->rr.name)
         return;
 
-    i = _namehash(r->rr.name) % SPRIME;
-    if (d->published[i] == r) {
-        d->published[i] = r->next;
+    bucket = HASH_BUCKET(d, published, r->hash);
+    if (*bucket == r) {
+        *bucket = r->next;
+        d->published_count--;
     } else {
-        for (cur = d->published[i]; cur && cur->next != r; cur = cur->next)
+        for (cur = *bucket; cur && cur->next != r; cur = cur->next)
             ;
-        if (cur)
+        if (cur) {
             cur->next = r->next;
+            d->published_count--;
+        }
     }
 
     _free_record(r);
@@ -456,7 +557,7 @@ static void _c_expire(mdns_daemon_t *d, struct cached **list)
             if (cur->q)
                 _q_answer(d, cur);
 
-            _free_cached(cur);
+            _free_cached(d, cur);
         } else {
             last = cur;
         }
@@ -467,9 +568,9 @@ static void _c_expire(mdns_daemon_t *d, struct cached **list)
 /* Brute force expire any old cached records */
 static void _gc(mdns_daemon_t *d)
 {
-    int i;
+    unsigned int i;
 
-    for (i = 0; i < LPRIME; i++) {
+    for (i = 0; i < d->cache_size; i++) {
         if (d->cache[i])
             _c_expire(d, &d->cache[i]);
     }
@@ -477,16 +578,50 @@ static void _gc(mdns_daemon_t *d)
     d->expireall = (unsigned long)(d->now.tv_sec + GC);
 }
 
+/*
+ * Drop least recently used entries until the cache fits its budget. As with
+ * an expiry, the query an entry answered is told it is gone.
+ */
+static void _c_evict(mdns_daemon_t *d, struct cached *keep)
+{
+    struct cached **bucket, *c, *cur;
+
+    while (d->cache_mem > d->cache_budget && (c = d->lru_head) != NULL) {
+        if (c == keep) {
+            if (!c->lru_next)
+                break;
+            c = c->lru_next;
+        }
+
+        bucket = HASH_BUCKET(d, cache, c->hash);
+        if (*bucket == c) {
+            *bucket = c->next;
+        } else {
+            for (cur = *bucket; cur->next != c; cur = cur->next)
+                ;
+            cur->next = c->next;
+        }
+
+        DBG("Cache over budget, evicting %s type %d", c->rr.name, c->rr.type);
+        if (c->q) {
+            c->rr.ttl = 0;
+            _q_answer(d, c);
+        }
+        _free_cached(d, c);
+    }
+}
+
 static int _cache(mdns_daemon_t *d, struct resource *r)
 {
     struct cached *c = 0;
-    int i = _namehash(r->name) % LPRIME;
+    struct cached **bucket;
+    unsigned int hash = _namehash(r->name);
 
     /* Cache flush for unique entries */
     if (r->class == 32768 + d->class) {
         while ((c = _c_next(d, c, r->name, r->type)))
             c->rr.ttl = 0;
-        _c_expire(d, &d->cache[i]);
+        _c_expire(d, HASH_BUCKET(d, cache, hash));
     }
 
     /* Process deletes */
@@ -494,7 +629,7 @@ static int _cache(mdns_daemon_t *d, struct resource *r)
         while ((c = _c_next(d, c, r->name, r->type))) {
             if (_a_match(r, &c->rr)) {
                 c->rr.ttl = 0;
-                _c_expire(d, &d->cache[i]);
+                _c_expire(d, HASH_BUCKET(d, cache, hash));
                 c = NULL;
             }
         }
@@ -550,8 +685,21 @@ static int _cache(mdns_daemon_t *d, struct resource *r)
         break;
     }
 
-    c->next = d->cache[i];
-    d->cache[i] = c;
+    c->hash = hash;
+    c->size = sizeof(*c) + strlen(c->rr.name) + 1 + c->rr.rdlen;
+    if (c->rr.rdname)
+        c->size += strlen(c->rr.rdname) + 1;
+
+    if (d->cache_count >= d->cache_size * HLOAD)
+        _cache_grow(d);
+
+    bucket = HASH_BUCKET(d, cache, hash);
+    c->next = *bucket;
+    *bucket = c;
+    d->cache_count++;
+    d->cache_mem += c->size;
+    _c_lru_touch(d, c);
+    _c_evict(d, c);
 
     if ((c->q = _q_next(d, 0, r->name, r->type)))
         _q_answer(d, c);
@@ -635,18 +783,39 @@ mdns_daemon_t *mdnsd_new(int class, int frame)
     d->class = class;
     d->frame = frame;
     d->received_callback = NULL;
+    d->cache_budget = CACHE_BUDGET;
+
+    d->queries_size = SPRIME;
+    d->published_size = SPRIME;
+    d->cache_size = LPRIME;
+    d->queries = calloc(d->queries_size, sizeof(*d->queries));
+    d->published = calloc(d->published_size, sizeof(*d->published));
+    d->cache = calloc(d->cache_size, sizeof(*d->cache));
+    if (!d->queries || !d->published || !d->cache) {
+        free(d->queries);
+        free(d->published);
+        free(d->cache);
+        free(d);
+        return NULL;
+    }
 
     return d;
 }
 
+void mdnsd_set_cache_budget(mdns_daemon_t *d, size_t budget)
+{
+    d->cache_budget = budget ? budget : CACHE_BUDGET;
+    _c_evict(d, NULL);
+}
+
 void mdnsd_set_address(mdns_daemon_t *d, struct in_addr addr)
 {
-    int i;
+    unsigned int i;
 
     if (!memcmp(&d->addr, &addr, sizeof(d->addr)))
         return;     /* No change */
 
-    for (i = 0; i < SPRIME; i++) {
+    for (i = 0; i < d->published_size; i++) {
         mdns_record_t *r, *next;
 
         r = d->published[i];
@@ -671,11 +840,11 @@ struct in_addr mdnsd_get_address(mdns_daemon_t *d)
 /* Shutting down, zero out ttl and push out all records */
 void mdnsd_shutdown(mdns_daemon_t *d)
 {
-    int i;
+    unsigned int i;
     mdns_record_t *cur, *next;
 
     d->a_now = 0;
-    for (i = 0; i < SPRIME; i++) {
+    for (i = 0; i < d->published_size; i++) {
         for (cur = d->published[i]; cur != 0;) {
             next = cur->next;
             cur->rr.ttl = 0;
@@ -701,22 +870,21 @@ void mdnsd_flush(mdns_daemon_t *d)
 void mdnsd_free(mdns_daemon_t *d)
 {
     struct unicast *u;
-    int i;
+    unsigned int i;
 
-    for (i = 0; i< LPRIME; i++) {
+    for (i = 0; i < d->cache_size; i++) {
         struct cached *cur = d->cache[i];
 
         while (cur) {
             struct cached *next = cur->next;
 
-            _free_cached(cur);
+            _free_cached(d, cur);
             cur = next;
         }
     }
 
-    for (i = 0; i< SPRIME; i++) {
+    for (i = 0; i < d->published_size; i++) {
         struct mdns_record *cur = d->published[i];
-        struct query *curq;
 
         while (cur) {
             struct mdns_record *next = cur->next;
@@ -724,8 +892,11 @@ void mdnsd_free(mdns_daemon_t *d)
             _free_record(cur);
             cur = next;
         }
+    }
+
+    for (i = 0; i < d->queries_size; i++) {
+        struct query *curq = d->queries[i];
 
-        curq = d->queries[i];
         while (curq) {
             struct query *next = curq->next;
 
@@ -743,6 +914,9 @@ void mdnsd_free(mdns_daemon_t *d)
         u = next;
     }
 
+    free(d->cache);
+    free(d->published);
+    free(d->queries);
     free(d);
 }
 
@@ -1034,7 +1208,7 @@ int mdnsd_out(mdns_daemon_t *d, struct message *m, unsigned long int *ip, unsign
 
             /* Done retrying, expire and reset */
             if (q->tries == 3) {
-                _c_expire(d, &d->cache[_namehash(q->name) % LPRIME]);
+                _c_expire(d, HASH_BUCKET(d, cache, q->hash));
                 _q_reset(d, q);
                 continue;
             }
@@ -1119,7 +1293,7 @@ struct timeval *mdnsd_sleep(mdns_daemon_t *d)
     if (expire < 0)
         RET;
 
-    for (i = 0; i < SPRIME; i++) {
+    for (i = 0; i < (int)d->published_size; i++) {
         mdns_record_t *r;
         time_t next;
 
@@ -1146,23 +1320,29 @@ struct timeval *mdnsd_sleep(mdns_daemon_t *d)
 
 void mdnsd_query(mdns_daemon_t *d, const char *host, int type, int (*answer)(mdns_answer_t *a, void *arg), void *arg)
 {
+    struct query **bucket;
     struct query *q;
     struct cached *cur = 0;
-    int i = _namehash(host) % SPRIME;
 
     if (!(q = _q_next(d, 0, host, type))) {
         if (!answer)
             return;
 
+        if (d->queries_count >= d->queries_size * HLOAD)
+            _queries_grow(d);
+
         q = calloc(1, sizeof(struct query));
         q->name = strdup(host);
+        q->hash = _namehash(host);
         q->type = type;
-        q->next = d->queries[i];
+        bucket = HASH_BUCKET(d, queries, q->hash);
+        q->next = *bucket;
         q->list = d->qlist;
-        d->qlist = d->queries[i] = q;
+        d->qlist = *bucket = q;
+        d->queries_count++;
 
         /* Any cached entries should be associated */
-        while ((cur = _c_next(d, cur, q->name, q->type)))
+        while ((cur = _c_lookup(d, cur, q->name, q->type)))
             cur->q = q;
         _q_reset(d, q);
 
@@ -1182,7 +1362,7 @@ void mdnsd_query(mdns_daemon_t *d, const char *host, int type, int (*answer)(mdn
 
 mdns_answer_t *mdnsd_list(mdns_daemon_t *d,const char *host, int type, mdns_answer_t *last)
 {
-    return (mdns_answer_t *)_c_next(d, (struct cached *)last, host, type);
+    return (mdns_answer_t *)_c_lookup(d, (struct cached *)last, host, type);
 }
 
 mdns_record_t *mdnsd_record_next(const mdns_record_t* r)
@@ -1197,15 +1377,21 @@ const mdns_answer_t *mdnsd_record_data(const mdns_record_t* r)
 
 mdns_record_t *mdnsd_shared(mdns_daemon_t *d, const char *host, unsigned short type, unsigned long ttl)
 {
-    int i = _namehash(host) % SPRIME;
+    mdns_record_t **bucket;
     mdns_record_t *r;
 
+    if (d->published_count >= d->published_size * HLOAD)
+        _published_grow(d);
+
     r = calloc(1, sizeof(struct mdns_record));
     r->rr.name = strdup(host);
     r->rr.type = type;
     r->rr.ttl = ttl;
-    r->next = d->published[i];
-    d->published[i] = r;
+    r->hash = _namehash(host);
+    bucket = HASH_BUCKET(d, published, r->hash);
+    r->next = *bucket;
+    *bucket = r;
+    d->published_count++;
 
     return r;
 }
@@ -1232,12 +1418,12 @@ mdns_record_t *mdnsd_unique(mdns_daemon_t *d, const char *host, unsigned short t
 
 mdns_record_t *mdnsd_get_published(mdns_daemon_t *d, const char *host)
 {
-    return d->published[_namehash(host) % SPRIME];
+    return *HASH_BUCKET(d, published, _namehash(host));
 }
 
 int mdnsd_has_query(mdns_daemon_t *d, const char *host)
 {
-    return d->queries[_namehash(host) % SPRIME] != NULL;
+    return *HASH_BUCKET(d, queries, _namehash(host)) != NULL;
 }
 
 mdns_record_t *mdnsd_find(mdns_daemon_t *d, const char *name, unsigned short type)
@@ -0,0 +1,197 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "1035.h"
+#include "mdnsd.h"
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "mdnsd_cache_tests";
+
+#define MAX_EVENTS 16
+
+/* Answers delivered to the queries, in order */
+struct answer_event
+{
+    char name[64];
+    unsigned long ttl;
+};
+
+static struct answer_event g_events[MAX_EVENTS];
+static int g_nevents;
+static mdns_daemon_t *g_d;
+
+static int answer_cb(mdns_answer_t *a, void *arg)
+{
+    (void)arg;
+
+    TEST_ASSERT_TRUE(g_nevents < MAX_EVENTS);
+    snprintf(g_events[g_nevents].name, sizeof(g_events[g_nevents].name), "%s", a->name);
+    g_events[g_nevents].ttl = a->ttl;
+    g_nevents++;
+
+    return 0;
+}
+
+/* Hands the daemon a response holding a single A record */
+static void receive_a(const char *name, const char *ip)
+{
+    struct resource res;
+    struct message m;
+
+    memset(&res, 0, sizeof(res));
+    res.name = (char *)name;
+    res.type = QTYPE_A;
+    res.class = QCLASS_IN;
+    res.ttl = 120;
+    res.rdlength = 4;
+    inet_pton(AF_INET, ip, &res.known.a.ip);
+    res.rdata = (unsigned char *)&res.known.a.ip;
+
+    memset(&m, 0, sizeof(m));
+    m.header.qr = 1;
+    m.ancount = 1;
+    m.an = &res;
+
+    TEST_ASSERT_EQUAL_INT(0, mdnsd_in(g_d, &m, 0, 5353));
+}
+
+/* Removals reported to the queries, in order */
+static int removals(const char **names, int max)
+{
+    int n = 0;
+    int i;
+
+    for (i = 0; i < g_nevents && n < max; i++)
+    {
+        if (g_events[i].ttl == 0) names[n++] = g_events[i].name;
+    }
+
+    return n;
+}
+
+void setUp(void)
+{
+    memset(g_events, 0, sizeof(g_events));
+    g_nevents = 0;
+
+    g_d = mdnsd_new(QCLASS_IN, 1400);
+    TEST_ASSERT_NOT_NULL(g_d);
+}
+
+void tearDown(void)
+{
+    mdnsd_free(g_d);
+    g_d = NULL;
+}
+
+/* An evicted entry is reported to its query like an expired one */
+void test_evict_notifies_query(void)
+{
+    const char *gone[MAX_EVENTS];
+
+    mdnsd_query(g_d, "a.local", QTYPE_A, answer_cb, NULL);
+    receive_a("a.local", "192.168.1.10");
+
+    TEST_ASSERT_EQUAL_INT(1, g_nevents);
+    TEST_ASSERT_TRUE(g_events[0].ttl != 0);
+    TEST_ASSERT_NOT_NULL(mdnsd_list(g_d, "a.local", QTYPE_A, NULL));
+
+    mdnsd_set_cache_budget(g_d, 1);
+
+    TEST_ASSERT_NULL(mdnsd_list(g_d, "a.local", QTYPE_A, NULL));
+    TEST_ASSERT_EQUAL_INT(1, removals(gone, MAX_EVENTS));
+    TEST_ASSERT_EQUAL_STRING("a.local", gone[0]);
+}
+
+/*
+ * Sending the queries walks the cache for known answers, which must not
+ * refresh the entries: only the user lookup does
+ */
+void test_lru_order(void)
+{
+    const char *gone[MAX_EVENTS];
+    struct message m;
+    unsigned long ip;
+    unsigned short port;
+
+    mdnsd_query(g_d, "a.local", QTYPE_A, answer_cb, NULL);
+    mdnsd_query(g_d, "b.local", QTYPE_A, answer_cb, NULL);
+    mdnsd_query(g_d, "c.local", QTYPE_A, answer_cb, NULL);
+    receive_a("a.local", "192.168.1.10");
+    receive_a("b.local", "192.168.1.11");
+    receive_a("c.local", "192.168.1.12");
+
+    memset(&m, 0, sizeof(m));
+    TEST_ASSERT_TRUE(mdnsd_out(g_d, &m, &ip, &port) > 0);
+
+    TEST_ASSERT_NOT_NULL(mdnsd_list(g_d, "a.local", QTYPE_A, NULL));
+
+    mdnsd_set_cache_budget(g_d, 1);
+
+    TEST_ASSERT_EQUAL_INT(3, removals(gone, MAX_EVENTS));
+    TEST_ASSERT_EQUAL_STRING("b.local", gone[0]);
+    TEST_ASSERT_EQUAL_STRING("c.local", gone[1]);
+    TEST_ASSERT_EQUAL_STRING("a.local", gone[2]);
+}
+
+/* A budget of 0 restores the default one */
+void test_budget_default(void)
+{
+    mdnsd_set_cache_budget(g_d, 1);
+    receive_a("a.local", "192.168.1.10");
+    receive_a("b.local", "192.168.1.11");
+    TEST_ASSERT_NULL(mdnsd_list(g_d, "a.local", QTYPE_A, NULL));
+
+    mdnsd_set_cache_budget(g_d, 0);
+    receive_a("a.local", "192.168.1.10");
+    receive_a("b.local", "192.168.1.11");
+    TEST_ASSERT_NOT_NULL(mdnsd_list(g_d, "a.local", QTYPE_A, NULL));
+    TEST_ASSERT_NOT_NULL(mdnsd_list(g_d, "b.local", QTYPE_A, NULL));
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_evict_notifies_query);
+    RUN_TEST(test_lru_order);
+    RUN_TEST(test_budget_default);
+
+    return UNITY_END();
+}
@@ -0,0 +1,278 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "ds_dlist.h"
+
+struct ev_loop;
+
+/*
+ * ===========================================================================
+ *  Manager self-measurement
+ * ===========================================================================
+ *
+ * Counters, gauges and latency histograms a manager keeps about itself.
+ * A metric is a plain structure; updating it is a few integer operations
+ * and never allocates. Metrics join the process-wide list on their first
+ * update, so they are usually declared statically next to the code they
+ * measure:
+ *
+ *  static metrics_t qm_send_us = METRICS_HIST_INIT("qm.send_us");
+ *
+ *  uint64_t t0 = metrics_clock();
+ *  ...
+ *  metrics_hist_since(&qm_send_us, t0);
+ *
+ * Histograms hold microseconds in log2 buckets. Reading the clock is the only
+ * cost that is not negligible, so metrics_clock() returns 0 and histograms
+ * stay empty until the metrics are read for the first time, either through
+ * the local socket (metrics_server_start()) or by serializing a report
+ * (metrics_serialize_report()). Counters and gauges are always maintained.
+ *
+ * Metrics are not thread safe and must be updated from the manager's main
+ * loop thread.
+ */
+
+/** Number of log2 histogram buckets; the last one also holds larger samples */
+#define METRICS_HIST_BUCKETS        32
+
+/** Directory of the per-manager metrics sockets */
+#define METRICS_SOCK_DIR            "/tmp/plume/"
+
+typedef enum
+{
+    METRICS_COUNTER,
+    METRICS_GAUGE,
+    METRICS_HIST,
+} metrics_type_t;
+
+typedef struct metrics metrics_t;
+
+struct metrics
+{
+    const char         *m_name;         /**< Dotted metric name                 */
+    metrics_type_t      m_type;         /**< Metric type                        */
+    bool                m_init;         /**< Registered in the global list      */
+    char               *m_name_buf;     /**< Owned name of run-time metrics     */
+    uint64_t            m_count;        /**< Counter value or histogram samples */
+    int64_t             m_gauge;        /**< Gauge value                        */
+    uint64_t            m_sum;          /**< Sum of histogram samples           */
+    uint64_t            m_max;          /**< Largest histogram sample           */
+    uint64_t            m_bucket[METRICS_HIST_BUCKETS];
+    ds_dlist_node_t     m_dnode;        /**< Global list of metrics             */
+};
+
+/**
+ * Static initializers
+ */
+#define METRICS_INIT(name, type)    \
+{                                   \
+    .m_name = (name),               \
+    .m_type = (type),               \
+}
+
+#define METRICS_COUNTER_INIT(name)  METRICS_INIT(name, METRICS_COUNTER)
+#define METRICS_GAUGE_INIT(name)    METRICS_INIT(name, METRICS_GAUGE)
+#define METRICS_HIST_INIT(name)     METRICS_INIT(name, METRICS_HIST)
+
+/**
+ * Set when the metrics were read at least once; enables histogram sampling
+ */
+extern bool metrics_active;
+
+/**
+ * Run-time initializer, @p name is copied. Use for metrics whose name is
+ * only known at run time, e.g. per FSM session. Release with metrics_fini().
+ */
+void metrics_init(metrics_t *m, const char *name, metrics_type_t type);
+
+/**
+ * Remove @p m from the global list
+ */
+void metrics_fini(metrics_t *m);
+
+/**
+ * Add @p m to the global list; called implicitly on the first update
+ */
+void metrics_register(metrics_t *m);
+
+/**
+ * Enable histogram sampling; called implicitly by the readers
+ */
+void metrics_activate(void);
+
+/**
+ * Add a sample of @p us microseconds to histogram @p m
+ */
+void metrics_hist_add(metrics_t *m, uint64_t us);
+
+/**
+ * Upper bound, in microseconds, of the bucket holding the @p pct percentile
+ * of histogram @p m, capped by the largest sample
+ */
+uint64_t metrics_hist_percentile(const metrics_t *m, unsigned pct);
+
+/**
+ * Call @p fn for each registered metric
+ */
+void metrics_foreach(void (*fn)(metrics_t *m, void *ctx), void *ctx);
+
+/**
+ * Print all registered metrics to @p buf, one per line
+ *
+ * @return
+ * Number of characters that would have been written with a large enough
+ * buffer, as for snprintf()
+ */
+size_t metrics_dump(char *buf, size_t sz);
+
+/**
+ * Monotonic time in microseconds
+ */
+static inline uint64_t metrics_clock_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Start time for metrics_hist_since(), 0 while histograms are not sampled
+ */
+static inline uint64_t metrics_clock(void)
+{
+    if (!metrics_active) return 0;
+
+    return metrics_clock_us();
+}
+
+/**
+ * Add the time elapsed since @p start, as returned by metrics_clock()
+ */
+static inline void metrics_hist_since(metrics_t *m, uint64_t start)
+{
+    if (start == 0) return;
+
+    metrics_hist_add(m, metrics_clock_us() - start);
+}
+
+static inline void metrics_counter_add(metrics_t *m, uint64_t n)
+{
+    if (!m->m_init) metrics_register(m);
+
+    m->m_count += n;
+}
+
+static inline void metrics_counter_inc(metrics_t *m)
+{
+    metrics_counter_add(m, 1);
+}
+
+static inline void metrics_gauge_set(metrics_t *m, int64_t value)
+{
+    if (!m->m_init) metrics_register(m);
+
+    m->m_gauge = value;
+}
+
+static inline void metrics_gauge_add(metrics_t *m, int64_t delta)
+{
+    if (!m->m_init) metrics_register(m);
+
+    m->m_gauge += delta;
+}
+
+/*
+ * ===========================================================================
+ *  Local export
+ * ===========================================================================
+ *
+ * Each manager that calls metrics_server_start() listens on
+ * METRICS_SOCK_DIR "metrics-<name>.sock". A client that connects receives
+ * the metrics_dump() output and the connection is closed:
+ *
+ *  socat - UNIX-CONNECT:/tmp/plume/metrics-FSM.sock
+ */
+
+/**
+ * Start listening on the metrics socket of manager @p name
+ */
+bool metrics_server_start(struct ev_loop *loop, const char *name);
+
+/**
+ * Stop listening and remove the socket
+ */
+void metrics_server_stop(void);
+
+/*
+ * ===========================================================================
+ *  Protobuf report
+ * ===========================================================================
+ */
+
+/**
+ * Report header, all fields may be NULL
+ */
+struct metrics_report
+{
+    const char         *node_id;
+    const char         *location_id;
+    const char         *process;        /**< Reporting manager                */
+};
+
+/**
+ * Container of protobuf serialization output
+ */
+struct metrics_packed_buffer
+{
+    size_t              len;            /**< Length of the serialized report  */
+    void               *buf;            /**< Dynamically allocated buffer     */
+};
+
+/**
+ * Serialize all registered metrics as an opensync_metrics.proto Report.
+ * The caller frees the result with metrics_free_packed_buffer().
+ *
+ * @return
+ * Serialized report or NULL on error
+ */
+struct metrics_packed_buffer *metrics_serialize_report(struct metrics_report *report);
+
+/**
+ * Free a buffer returned by metrics_serialize_report(); NULL is ignored
+ */
+void metrics_free_packed_buffer(struct metrics_packed_buffer *pb);
+
+#endif /* METRICS_H_INCLUDED */
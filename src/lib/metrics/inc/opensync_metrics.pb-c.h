@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Generated by the protocol buffer compiler.  DO NOT EDIT! */
+/* Generated from: opensync_metrics.proto */
+
+#ifndef PROTOBUF_C_opensync_5fmetrics_2eproto__INCLUDED
+#define PROTOBUF_C_opensync_5fmetrics_2eproto__INCLUDED
+
+#include <protobuf-c/protobuf-c.h>
+
+PROTOBUF_C__BEGIN_DECLS
+
+#if PROTOBUF_C_VERSION_NUMBER < 1000000
+# error This file was generated by a newer version of protoc-c which is incompatible with your libprotobuf-c headers. Please update your headers.
+#elif 1003001 < PROTOBUF_C_MIN_COMPILER_VERSION
+# error This file was generated by an older version of protoc-c which is incompatible with your libprotobuf-c headers. Please regenerate this file with a newer version of protoc-c.
+#endif
+
+
+typedef struct _Metrics__Histogram Metrics__Histogram;
+typedef struct _Metrics__Metric Metrics__Metric;
+typedef struct _Metrics__Report Metrics__Report;
+
+
+/* --- enums --- */
+
+
+/* --- messages --- */
+
+/*
+ * Latency histogram, all values in microseconds
+ */
+struct  _Metrics__Histogram
+{
+  ProtobufCMessage base;
+  /*
+   * number of samples
+   */
+  protobuf_c_boolean has_count;
+  uint64_t count;
+  /*
+   * sum of all samples
+   */
+  protobuf_c_boolean has_sum;
+  uint64_t sum;
+  /*
+   * largest sample
+   */
+  protobuf_c_boolean has_max;
+  uint64_t max;
+  /*
+   * buckets[0] counts samples below 1 us, buckets[i] counts samples
+   * in [2^(i-1), 2^i) us. Trailing empty buckets are omitted.
+   */
+  size_t n_buckets;
+  uint64_t *buckets;
+};
+#define METRICS__HISTOGRAM__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&metrics__histogram__descriptor) \
+    , 0, 0, 0, 0, 0, 0, 0,NULL }
+
+
+struct  _Metrics__Metric
+{
+  ProtobufCMessage base;
+  /*
+   * dotted metric name, e.g. "qm.send_us"
+   */
+  char *name;
+  /*
+   * monotonic counter value
+   */
+  protobuf_c_boolean has_counter;
+  uint64_t counter;
+  /*
+   * gauge value
+   */
+  protobuf_c_boolean has_gauge;
+  int64_t gauge;
+  Metrics__Histogram *histogram;
+};
+#define METRICS__METRIC__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&metrics__metric__descriptor) \
+    , NULL, 0, 0, 0, 0, NULL }
+
+
+struct  _Metrics__Report
+{
+  ProtobufCMessage base;
+  char *nodeid;
+  char *locationid;
+  /*
+   * reporting manager, e.g. "FSM"
+   */
+  char *process;
+  /*
+   * report time in milliseconds since epoch
+   */
+  protobuf_c_boolean has_timestamp;
+  uint64_t timestamp;
+  /*
+   * cumulative values since the manager started
+   */
+  size_t n_metrics;
+  Metrics__Metric **metrics;
+};
+#define METRICS__REPORT__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&metrics__report__descriptor) \
+    , NULL, NULL, NULL, 0, 0, 0,NULL }
+
+
+/* Metrics__Histogram methods */
+void   metrics__histogram__init
+                     (Metrics__Histogram         *message);
+size_t metrics__histogram__get_packed_size
+                     (const Metrics__Histogram   *message);
+size_t metrics__histogram__pack
+                     (const Metrics__Histogram   *message,
+                      uint8_t             *out);
+size_t metrics__histogram__pack_to_buffer
+                     (const Metrics__Histogram   *message,
+                      ProtobufCBuffer     *buffer);
+Metrics__Histogram *
+       metrics__histogram__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   metrics__histogram__free_unpacked
+                     (Metrics__Histogram *message,
+                      ProtobufCAllocator *allocator);
+/* Metrics__Metric methods */
+void   metrics__metric__init
+                     (Metrics__Metric         *message);
+size_t metrics__metric__get_packed_size
+                     (const Metrics__Metric   *message);
+size_t metrics__metric__pack
+                     (const Metrics__Metric   *message,
+                      uint8_t             *out);
+size_t metrics__metric__pack_to_buffer
+                     (const Metrics__Metric   *message,
+                      ProtobufCBuffer     *buffer);
+Metrics__Metric *
+       metrics__metric__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   metrics__metric__free_unpacked
+                     (Metrics__Metric *message,
+                      ProtobufCAllocator *allocator);
+/* Metrics__Report methods */
+void   metrics__report__init
+                     (Metrics__Report         *message);
+size_t metrics__report__get_packed_size
+                     (const Metrics__Report   *message);
+size_t metrics__report__pack
+                     (const Metrics__Report   *message,
+                      uint8_t             *out);
+size_t metrics__report__pack_to_buffer
+                     (const Metrics__Report   *message,
+                      ProtobufCBuffer     *buffer);
+Metrics__Report *
+       metrics__report__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   metrics__report__free_unpacked
+                     (Metrics__Report *message,
+                      ProtobufCAllocator *allocator);
+/* --- per-message closures --- */
+
+typedef void (*Metrics__Histogram_Closure)
+                 (const Metrics__Histogram *message,
+                  void *closure_data);
+typedef void (*Metrics__Metric_Closure)
+                 (const Metrics__Metric *message,
+                  void *closure_data);
+typedef void (*Metrics__Report_Closure)
+                 (const Metrics__Report *message,
+                  void *closure_data);
+
+/* --- services --- */
+
+
+/* --- descriptors --- */
+
+extern const ProtobufCMessageDescriptor metrics__histogram__descriptor;
+extern const ProtobufCMessageDescriptor metrics__metric__descriptor;
+extern const ProtobufCMessageDescriptor metrics__report__descriptor;
+
+PROTOBUF_C__END_DECLS
+
+
+#endif  /* PROTOBUF_C_opensync_5fmetrics_2eproto__INCLUDED */
@@ -0,0 +1,232 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "log.h"
+#include "metrics.h"
+
+bool metrics_active = false;
+
+static ds_dlist_t metrics_list = DS_DLIST_INIT(metrics_t, m_dnode);
+
+static const char *metrics_type_str[] =
+{
+    [METRICS_COUNTER]   = "counter",
+    [METRICS_GAUGE]     = "gauge",
+    [METRICS_HIST]      = "hist",
+};
+
+/*
+ * ===========================================================================
+ *  Registry
+ * ===========================================================================
+ */
+
+void metrics_init(metrics_t *m, const char *name, metrics_type_t type)
+{
+    memset(m, 0, sizeof(*m));
+
+    m->m_name_buf = strdup(name);
+    m->m_name = m->m_name_buf != NULL ? m->m_name_buf : "(nomem)";
+    m->m_type = type;
+
+    metrics_register(m);
+}
+
+void metrics_fini(metrics_t *m)
+{
+    if (m->m_init)
+    {
+        ds_dlist_remove(&metrics_list, m);
+        m->m_init = false;
+    }
+
+    free(m->m_name_buf);
+    m->m_name_buf = NULL;
+}
+
+void metrics_register(metrics_t *m)
+{
+    if (m->m_init) return;
+
+    /* Zeroed run-time metric that was never passed to metrics_init() */
+    if (m->m_name == NULL) return;
+
+    ds_dlist_insert_tail(&metrics_list, m);
+    m->m_init = true;
+}
+
+void metrics_activate(void)
+{
+    if (metrics_active) return;
+
+    LOGI("metrics: Histogram sampling enabled.");
+    metrics_active = true;
+}
+
+void metrics_foreach(void (*fn)(metrics_t *m, void *ctx), void *ctx)
+{
+    metrics_t *m;
+
+    ds_dlist_foreach(&metrics_list, m)
+    {
+        fn(m, ctx);
+    }
+}
+
+/*
+ * ===========================================================================
+ *  Histograms
+ * ===========================================================================
+ */
+
+/*
+ * Bucket 0 holds samples below 1 us, bucket i samples in [2^(i-1), 2^i) us
+ */
+static inline unsigned metrics_hist_bucket(uint64_t us)
+{
+    unsigned b;
+
+    if (us == 0) return 0;
+
+    b = 64 - __builtin_clzll(us);
+    if (b >= METRICS_HIST_BUCKETS) b = METRICS_HIST_BUCKETS - 1;
+
+    return b;
+}
+
+void metrics_hist_add(metrics_t *m, uint64_t us)
+{
+    if (!m->m_init) metrics_register(m);
+
+    m->m_count++;
+    m->m_sum += us;
+    if (us > m->m_max) m->m_max = us;
+
+    m->m_bucket[metrics_hist_bucket(us)]++;
+}
+
+uint64_t metrics_hist_percentile(const metrics_t *m, unsigned pct)
+{
+    uint64_t rank;
+    uint64_t seen;
+    unsigned b;
+
+    if (m->m_count == 0) return 0;
+
+    /* Rank of the sample, rounded up */
+    rank = (m->m_count * pct + 99) / 100;
+    if (rank == 0) rank = 1;
+
+    seen = 0;
+    for (b = 0; b < METRICS_HIST_BUCKETS - 1; b++)
+    {
+        seen += m->m_bucket[b];
+        if (seen >= rank) break;
+    }
+
+    if (b >= METRICS_HIST_BUCKETS - 1) return m->m_max;
+
+    return ((1ULL << b) < m->m_max) ? (1ULL << b) : m->m_max;
+}
+
+/*
+ * ===========================================================================
+ *  Text dump
+ * ===========================================================================
+ */
+
+struct metrics_dump_ctx
+{
+    char       *buf;
+    size_t      sz;
+    size_t      len;
+};
+
+static void metrics_dump_printf(struct metrics_dump_ctx *ctx, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void metrics_dump_printf(struct metrics_dump_ctx *ctx, const char *fmt, ...)
+{
+    va_list ap;
+    int rc;
+
+    va_start(ap, fmt);
+    rc = vsnprintf(
+            ctx->len < ctx->sz ? ctx->buf + ctx->len : NULL,
+            ctx->len < ctx->sz ? ctx->sz - ctx->len : 0,
+            fmt,
+            ap);
+    va_end(ap);
+
+    if (rc > 0) ctx->len += rc;
+}
+
+static void metrics_dump_one(metrics_t *m, void *data)
+{
+    struct metrics_dump_ctx *ctx = data;
+
+    switch (m->m_type)
+    {
+        case METRICS_COUNTER:
+            metrics_dump_printf(ctx, "%s %s %" PRIu64 "\n",
+                    m->m_name, metrics_type_str[m->m_type], m->m_count);
+            break;
+
+        case METRICS_GAUGE:
+            metrics_dump_printf(ctx, "%s %s %" PRId64 "\n",
+                    m->m_name, metrics_type_str[m->m_type], m->m_gauge);
+            break;
+
+        case METRICS_HIST:
+            metrics_dump_printf(ctx,
+                    "%s %s count=%" PRIu64 " sum=%" PRIu64 " max=%" PRIu64
+                    " p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 "\n",
+                    m->m_name, metrics_type_str[m->m_type],
+                    m->m_count, m->m_sum, m->m_max,
+                    metrics_hist_percentile(m, 50),
+                    metrics_hist_percentile(m, 90),
+                    metrics_hist_percentile(m, 99));
+            break;
+    }
+}
+
+size_t metrics_dump(char *buf, size_t sz)
+{
+    struct metrics_dump_ctx ctx = { .buf = buf, .sz = sz, .len = 0 };
+
+    metrics_activate();
+
+    if (sz > 0) buf[0] = '\0';
+    metrics_foreach(metrics_dump_one, &ctx);
+
+    return ctx.len;
+}
@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "opensync_metrics.pb-c.h"
+
+/* Protobuf containers for one report, allocated in one go */
+struct metrics_pb
+{
+    Metrics__Report         report;
+    Metrics__Metric       **pmetrics;
+    Metrics__Metric        *metrics;
+    Metrics__Histogram     *hists;
+    size_t                  nmetrics;
+};
+
+static void metrics_count_one(metrics_t *m, void *ctx)
+{
+    (void)m;
+
+    (*(size_t *)ctx)++;
+}
+
+static void metrics_set_one(metrics_t *m, void *ctx)
+{
+    struct metrics_pb *pb = ctx;
+    Metrics__Histogram *hist;
+    Metrics__Metric *metric;
+    size_t nbuckets;
+
+    metric = &pb->metrics[pb->nmetrics];
+    metrics__metric__init(metric);
+    metric->name = (char *)m->m_name;
+
+    switch (m->m_type)
+    {
+        case METRICS_COUNTER:
+            metric->has_counter = true;
+            metric->counter = m->m_count;
+            break;
+
+        case METRICS_GAUGE:
+            metric->has_gauge = true;
+            metric->gauge = m->m_gauge;
+            break;
+
+        case METRICS_HIST:
+            hist = &pb->hists[pb->nmetrics];
+            metrics__histogram__init(hist);
+
+            hist->has_count = true;
+            hist->count = m->m_count;
+            hist->has_sum = true;
+            hist->sum = m->m_sum;
+            hist->has_max = true;
+            hist->max = m->m_max;
+
+            /* Trailing empty buckets are not sent */
+            nbuckets = METRICS_HIST_BUCKETS;
+            while (nbuckets > 0 && m->m_bucket[nbuckets - 1] == 0) nbuckets--;
+
+            hist->n_buckets = nbuckets;
+            hist->buckets = m->m_bucket;
+
+            metric->histogram = hist;
+            break;
+    }
+
+    pb->pmetrics[pb->nmetrics] = metric;
+    pb->nmetrics++;
+}
+
+static void metrics_free_pb(struct metrics_pb *pb)
+{
+    free(pb->pmetrics);
+    free(pb->metrics);
+    free(pb->hists);
+}
+
+/**
+ * @brief Fills a report protobuf from the registered metrics
+ *
+ * Names and histogram buckets point into the metrics themselves, the
+ * report must be packed before control returns to the main loop.
+ */
+static bool metrics_set_pb(struct metrics_pb *pb, struct metrics_report *report)
+{
+    struct timespec ts;
+    size_t count = 0;
+
+    memset(pb, 0, sizeof(*pb));
+    metrics__report__init(&pb->report);
+
+    pb->report.nodeid = (char *)report->node_id;
+    pb->report.locationid = (char *)report->location_id;
+    pb->report.process = (char *)report->process;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    pb->report.has_timestamp = true;
+    pb->report.timestamp = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    metrics_foreach(metrics_count_one, &count);
+    if (count == 0) return true;
+
+    pb->pmetrics = calloc(count, sizeof(*pb->pmetrics));
+    pb->metrics = calloc(count, sizeof(*pb->metrics));
+    pb->hists = calloc(count, sizeof(*pb->hists));
+    if (pb->pmetrics == NULL || pb->metrics == NULL || pb->hists == NULL)
+    {
+        LOGE("metrics: Unable to allocate report for %zu metrics.", count);
+        metrics_free_pb(pb);
+        return false;
+    }
+
+    metrics_foreach(metrics_set_one, pb);
+
+    pb->report.n_metrics = pb->nmetrics;
+    pb->report.metrics = pb->pmetrics;
+
+    return true;
+}
+
+struct metrics_packed_buffer *metrics_serialize_report(struct metrics_report *report)
+{
+    struct metrics_packed_buffer *serialized;
+    struct metrics_pb pb;
+    size_t len;
+    void *buf;
+
+    if (report == NULL) return NULL;
+
+    metrics_activate();
+
+    /* Allocate serialization output structure */
+    serialized = calloc(1, sizeof(*serialized));
+    if (serialized == NULL) return NULL;
+
+    if (!metrics_set_pb(&pb, report)) goto err_free_serialized;
+
+    /* Get serialization length */
+    len = metrics__report__get_packed_size(&pb.report);
+    if (len == 0) goto err_free_pb;
+
+    /* Allocate space for the serialized buffer */
+    buf = malloc(len);
+    if (buf == NULL) goto err_free_pb;
+
+    serialized->len = metrics__report__pack(&pb.report, buf);
+    serialized->buf = buf;
+
+    metrics_free_pb(&pb);
+
+    return serialized;
+
+err_free_pb:
+    metrics_free_pb(&pb);
+
+err_free_serialized:
+    free(serialized);
+
+    return NULL;
+}
+
+void metrics_free_packed_buffer(struct metrics_packed_buffer *pb)
+{
+    if (pb == NULL) return;
+
+    free(pb->buf);
+    free(pb);
+}
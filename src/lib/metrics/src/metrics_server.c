@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Local metrics export: every connection on the manager's metrics socket
+ * receives the current metrics_dump() output, then it is closed.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <ev.h>
+
+#include "log.h"
+#include "util.h"
+#include "metrics.h"
+
+#define METRICS_SOCK_MAX_PENDING    4
+
+static struct ev_loop  *metrics_server_loop;
+static ev_io            metrics_server_watcher;
+static char             metrics_server_path[108];
+
+static void metrics_server_send(int fd)
+{
+    size_t len;
+    size_t off;
+    ssize_t nwr;
+    char *buf;
+
+    /* Size the dump first, metrics may be added while a manager runs */
+    len = metrics_dump(NULL, 0);
+    buf = malloc(len + 1);
+    if (buf == NULL)
+    {
+        LOGE("metrics: Unable to allocate %zu bytes for the dump.", len + 1);
+        return;
+    }
+
+    len = metrics_dump(buf, len + 1);
+
+    off = 0;
+    while (off < len)
+    {
+        nwr = send(fd, buf + off, len - off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nwr < 0 && errno == EINTR) continue;
+        if (nwr <= 0)
+        {
+            LOGD("metrics: Client closed or stalled, %zu of %zu bytes sent.", off, len);
+            break;
+        }
+
+        off += nwr;
+    }
+
+    free(buf);
+}
+
+static void metrics_server_accept_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    int fd;
+
+    (void)loop;
+    (void)revents;
+
+    fd = accept(w->fd, NULL, NULL);
+    if (fd < 0)
+    {
+        LOGD("metrics: accept() failed: %s", strerror(errno));
+        return;
+    }
+
+    metrics_server_send(fd);
+    close(fd);
+}
+
+bool metrics_server_start(struct ev_loop *loop, const char *name)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (metrics_server_loop != NULL) return true;
+
+    snprintf(metrics_server_path, sizeof(metrics_server_path),
+             METRICS_SOCK_DIR "metrics-%s.sock", name);
+
+    mkdir(METRICS_SOCK_DIR, 0755);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+    {
+        LOGE("metrics: socket() failed: %s", strerror(errno));
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    STRSCPY(addr.sun_path, metrics_server_path);
+    unlink(metrics_server_path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOGE("metrics: bind(%s) failed: %s", metrics_server_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    if (listen(fd, METRICS_SOCK_MAX_PENDING) < 0)
+    {
+        LOGE("metrics: listen(%s) failed: %s", metrics_server_path, strerror(errno));
+        close(fd);
+        unlink(metrics_server_path);
+        return false;
+    }
+
+    metrics_server_loop = loop;
+    ev_io_init(&metrics_server_watcher, metrics_server_accept_cb, fd, EV_READ);
+    ev_io_start(loop, &metrics_server_watcher);
+
+    LOGI("metrics: Listening on %s", metrics_server_path);
+
+    return true;
+}
+
+void metrics_server_stop(void)
+{
+    if (metrics_server_loop == NULL) return;
+
+    ev_io_stop(metrics_server_loop, &metrics_server_watcher);
+    close(metrics_server_watcher.fd);
+    unlink(metrics_server_path);
+
+    metrics_server_loop = NULL;
+}
@@ -0,0 +1,414 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Generated by the protocol buffer compiler.  DO NOT EDIT! */
+/* Generated from: opensync_metrics.proto */
+
+/* Do not generate deprecated warnings for self */
+#ifndef PROTOBUF_C__NO_DEPRECATED
+#define PROTOBUF_C__NO_DEPRECATED
+#endif
+
+#include "opensync_metrics.pb-c.h"
+void   metrics__histogram__init
+                     (Metrics__Histogram         *message)
+{
+  static const Metrics__Histogram init_value = METRICS__HISTOGRAM__INIT;
+  *message = init_value;
+}
+size_t metrics__histogram__get_packed_size
+                     (const Metrics__Histogram *message)
+{
+  assert(message->base.descriptor == &metrics__histogram__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t metrics__histogram__pack
+                     (const Metrics__Histogram *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &metrics__histogram__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t metrics__histogram__pack_to_buffer
+                     (const Metrics__Histogram *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &metrics__histogram__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+Metrics__Histogram *
+       metrics__histogram__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (Metrics__Histogram *)
+     protobuf_c_message_unpack (&metrics__histogram__descriptor,
+                                allocator, len, data);
+}
+void   metrics__histogram__free_unpacked
+                     (Metrics__Histogram *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &metrics__histogram__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
+void   metrics__metric__init
+                     (Metrics__Metric         *message)
+{
+  static const Metrics__Metric init_value = METRICS__METRIC__INIT;
+  *message = init_value;
+}
+size_t metrics__metric__get_packed_size
+                     (const Metrics__Metric *message)
+{
+  assert(message->base.descriptor == &metrics__metric__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t metrics__metric__pack
+                     (const Metrics__Metric *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &metrics__metric__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t metrics__metric__pack_to_buffer
+                     (const Metrics__Metric *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &metrics__metric__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+Metrics__Metric *
+       metrics__metric__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (Metrics__Metric *)
+     protobuf_c_message_unpack (&metrics__metric__descriptor,
+                                allocator, len, data);
+}
+void   metrics__metric__free_unpacked
+                     (Metrics__Metric *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &metrics__metric__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
+void   metrics__report__init
+                     (Metrics__Report         *message)
+{
+  static const Metrics__Report init_value = METRICS__REPORT__INIT;
+  *message = init_value;
+}
+size_t metrics__report__get_packed_size
+                     (const Metrics__Report *message)
+{
+  assert(message->base.descriptor == &metrics__report__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t metrics__report__pack
+                     (const Metrics__Report *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &metrics__report__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t metrics__report__pack_to_buffer
+                     (const Metrics__Report *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &metrics__report__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+Metrics__Report *
+       metrics__report__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (Metrics__Report *)
+     protobuf_c_message_unpack (&metrics__report__descriptor,
+                                allocator, len, data);
+}
+void   metrics__report__free_unpacked
+                     (Metrics__Report *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &metrics__report__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
+static const ProtobufCFieldDescriptor metrics__histogram__field_descriptors[4] =
+{
+  {
+    "count",
+    1,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Histogram, has_count),
+    offsetof(Metrics__Histogram, count),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "sum",
+    2,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Histogram, has_sum),
+    offsetof(Metrics__Histogram, sum),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "max",
+    3,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Histogram, has_max),
+    offsetof(Metrics__Histogram, max),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "buckets",
+    4,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Histogram, n_buckets),
+    offsetof(Metrics__Histogram, buckets),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned metrics__histogram__field_indices_by_name[] = {
+  3,   /* field[3] = buckets */
+  0,   /* field[0] = count */
+  2,   /* field[2] = max */
+  1,   /* field[1] = sum */
+};
+static const ProtobufCIntRange metrics__histogram__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 4 }
+};
+const ProtobufCMessageDescriptor metrics__histogram__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "metrics.Histogram",
+  "Histogram",
+  "Metrics__Histogram",
+  "metrics",
+  sizeof(Metrics__Histogram),
+  4,
+  metrics__histogram__field_descriptors,
+  metrics__histogram__field_indices_by_name,
+  1,  metrics__histogram__number_ranges,
+  (ProtobufCMessageInit) metrics__histogram__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor metrics__metric__field_descriptors[4] =
+{
+  {
+    "name",
+    1,
+    PROTOBUF_C_LABEL_REQUIRED,
+    PROTOBUF_C_TYPE_STRING,
+    0,   /* quantifier_offset */
+    offsetof(Metrics__Metric, name),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "counter",
+    2,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Metric, has_counter),
+    offsetof(Metrics__Metric, counter),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "gauge",
+    3,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_INT64,
+    offsetof(Metrics__Metric, has_gauge),
+    offsetof(Metrics__Metric, gauge),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "histogram",
+    4,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_MESSAGE,
+    0,   /* quantifier_offset */
+    offsetof(Metrics__Metric, histogram),
+    &metrics__histogram__descriptor,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned metrics__metric__field_indices_by_name[] = {
+  1,   /* field[1] = counter */
+  2,   /* field[2] = gauge */
+  3,   /* field[3] = histogram */
+  0,   /* field[0] = name */
+};
+static const ProtobufCIntRange metrics__metric__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 4 }
+};
+const ProtobufCMessageDescriptor metrics__metric__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "metrics.Metric",
+  "Metric",
+  "Metrics__Metric",
+  "metrics",
+  sizeof(Metrics__Metric),
+  4,
+  metrics__metric__field_descriptors,
+  metrics__metric__field_indices_by_name,
+  1,  metrics__metric__number_ranges,
+  (ProtobufCMessageInit) metrics__metric__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor metrics__report__field_descriptors[5] =
+{
+  {
+    "nodeId",
+    1,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_STRING,
+    0,   /* quantifier_offset */
+    offsetof(Metrics__Report, nodeid),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "locationId",
+    2,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_STRING,
+    0,   /* quantifier_offset */
+    offsetof(Metrics__Report, locationid),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "process",
+    3,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_STRING,
+    0,   /* quantifier_offset */
+    offsetof(Metrics__Report, process),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "timestamp",
+    4,
+    PROTOBUF_C_LABEL_OPTIONAL,
+    PROTOBUF_C_TYPE_UINT64,
+    offsetof(Metrics__Report, has_timestamp),
+    offsetof(Metrics__Report, timestamp),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "metrics",
+    5,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_MESSAGE,
+    offsetof(Metrics__Report, n_metrics),
+    offsetof(Metrics__Report, metrics),
+    &metrics__metric__descriptor,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned metrics__report__field_indices_by_name[] = {
+  1,   /* field[1] = locationId */
+  4,   /* field[4] = metrics */
+  0,   /* field[0] = nodeId */
+  2,   /* field[2] = process */
+  3,   /* field[3] = timestamp */
+};
+static const ProtobufCIntRange metrics__report__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 5 }
+};
+const ProtobufCMessageDescriptor metrics__report__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "metrics.Report",
+  "Report",
+  "Metrics__Report",
+  "metrics",
+  sizeof(Metrics__Report),
+  5,
+  metrics__report__field_descriptors,
+  metrics__report__field_indices_by_name,
+  1,  metrics__report__number_ranges,
+  (ProtobufCMessageInit) metrics__report__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "metrics_tests";
+
+static metrics_t test_counter = METRICS_COUNTER_INIT("test.counter");
+static metrics_t test_gauge = METRICS_GAUGE_INIT("test.gauge");
+static metrics_t test_hist = METRICS_HIST_INIT("test.hist_us");
+
+static void test_count_cb(metrics_t *m, void *ctx)
+{
+    (void)m;
+
+    (*(int *)ctx)++;
+}
+
+static int test_count(void)
+{
+    int count = 0;
+
+    metrics_foreach(test_count_cb, &count);
+
+    return count;
+}
+
+/**
+ * @brief setUp() is called by the Unity framework before each test
+ */
+void
+setUp(void)
+{
+    return;
+}
+
+/**
+ * @brief tearDown() is called by the Unity framework after each test
+ */
+void
+tearDown(void)
+{
+    return;
+}
+
+/**
+ * @brief static metrics register on first update
+ */
+void
+test_metrics_basic(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, test_count());
+
+    metrics_counter_inc(&test_counter);
+    metrics_counter_add(&test_counter, 41);
+    TEST_ASSERT_EQUAL_UINT64(42, test_counter.m_count);
+    TEST_ASSERT_EQUAL_INT(1, test_count());
+
+    metrics_gauge_set(&test_gauge, 10);
+    metrics_gauge_add(&test_gauge, -15);
+    TEST_ASSERT_EQUAL_INT64(-5, test_gauge.m_gauge);
+    TEST_ASSERT_EQUAL_INT(2, test_count());
+}
+
+/**
+ * @brief histograms are sampled only after the first read
+ */
+void
+test_metrics_hist(void)
+{
+    char buf[512];
+    uint64_t t0;
+    int ii;
+
+    t0 = metrics_clock();
+    TEST_ASSERT_EQUAL_UINT64(0, t0);
+    metrics_hist_since(&test_hist, t0);
+    TEST_ASSERT_EQUAL_UINT64(0, test_hist.m_count);
+
+    TEST_ASSERT_TRUE(metrics_dump(buf, sizeof(buf)) < sizeof(buf));
+    TEST_ASSERT_TRUE(metrics_active);
+    TEST_ASSERT_NOT_NULL(strstr(buf, "test.counter counter 42\n"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "test.gauge gauge -5\n"));
+
+    t0 = metrics_clock();
+    TEST_ASSERT_NOT_EQUAL(0, t0);
+    metrics_hist_since(&test_hist, t0);
+    TEST_ASSERT_EQUAL_UINT64(1, test_hist.m_count);
+
+    /* 0 us goes to bucket 0, 1 us to bucket 1, 2-3 us to bucket 2, ... */
+    memset(test_hist.m_bucket, 0, sizeof(test_hist.m_bucket));
+    test_hist.m_count = test_hist.m_sum = test_hist.m_max = 0;
+
+    metrics_hist_add(&test_hist, 0);
+    metrics_hist_add(&test_hist, 1);
+    metrics_hist_add(&test_hist, 3);
+    metrics_hist_add(&test_hist, UINT64_MAX);
+    TEST_ASSERT_EQUAL_UINT64(1, test_hist.m_bucket[0]);
+    TEST_ASSERT_EQUAL_UINT64(1, test_hist.m_bucket[1]);
+    TEST_ASSERT_EQUAL_UINT64(1, test_hist.m_bucket[2]);
+    TEST_ASSERT_EQUAL_UINT64(1, test_hist.m_bucket[METRICS_HIST_BUCKETS - 1]);
+
+    memset(test_hist.m_bucket, 0, sizeof(test_hist.m_bucket));
+    test_hist.m_count = test_hist.m_sum = test_hist.m_max = 0;
+
+    /* 90 samples of 100 us and 10 of 5000 us */
+    for (ii = 0; ii < 90; ii++) metrics_hist_add(&test_hist, 100);
+    for (ii = 0; ii < 10; ii++) metrics_hist_add(&test_hist, 5000);
+
+    TEST_ASSERT_EQUAL_UINT64(100, test_hist.m_count);
+    TEST_ASSERT_EQUAL_UINT64(90 * 100 + 10 * 5000, test_hist.m_sum);
+    TEST_ASSERT_EQUAL_UINT64(5000, test_hist.m_max);
+    TEST_ASSERT_EQUAL_UINT64(128, metrics_hist_percentile(&test_hist, 50));
+    TEST_ASSERT_EQUAL_UINT64(128, metrics_hist_percentile(&test_hist, 90));
+    TEST_ASSERT_EQUAL_UINT64(5000, metrics_hist_percentile(&test_hist, 99));
+}
+
+/**
+ * @brief run-time metrics own their name and leave the list on fini
+ */
+void
+test_metrics_runtime(void)
+{
+    char name[32];
+    metrics_t m;
+    int count;
+
+    count = test_count();
+
+    snprintf(name, sizeof(name), "test.%s.pkts", "session");
+    metrics_init(&m, name, METRICS_COUNTER);
+    memset(name, 0, sizeof(name));
+
+    TEST_ASSERT_EQUAL_STRING("test.session.pkts", m.m_name);
+    TEST_ASSERT_EQUAL_INT(count + 1, test_count());
+
+    metrics_fini(&m);
+    TEST_ASSERT_EQUAL_INT(count, test_count());
+}
+
+/**
+ * @brief the dump reports the size needed for a truncated buffer
+ */
+void
+test_metrics_dump_truncated(void)
+{
+    char small[8];
+    size_t len;
+    char *buf;
+
+    len = metrics_dump(NULL, 0);
+    TEST_ASSERT_TRUE(len > 0);
+
+    TEST_ASSERT_EQUAL_UINT(len, metrics_dump(small, sizeof(small)));
+    TEST_ASSERT_EQUAL_INT(sizeof(small) - 1, strlen(small));
+
+    buf = malloc(len + 1);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL_UINT(len, metrics_dump(buf, len + 1));
+    TEST_ASSERT_EQUAL_UINT(len, strlen(buf));
+    free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_metrics_basic);
+    RUN_TEST(test_metrics_hist);
+    RUN_TEST(test_metrics_runtime);
+    RUN_TEST(test_metrics_dump_truncated);
+
+    return UNITY_END();
+}
@@ -81,6 +81,9 @@ struct net_md_stats_accumulator
     int dpi_done;                          /* All dpi engines are done */
     int refcnt;                            /* # of entities accessing the acc */
     bool report;                           /* send a report */
+    uint32_t dpi_ct_mark;                  /* last conntrack mark applied */
+    bool dpi_ct_mark_set;                  /* dpi_ct_mark is valid */
+    time_t dpi_ct_mark_ts;                 /* when dpi_ct_mark was applied */
 };
 
 
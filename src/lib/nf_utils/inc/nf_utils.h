@@ -85,5 +85,29 @@ int nf_ct_set_mark_timeout(nf_flow_t *flow, uint32_t timeout);
 
 int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16_t zone);
 
+/*
+ * Batched mark updates. The updates are queued and sent together when the
+ * batch is full, on nf_ct_batch_flush(), or before the event loop blocks.
+ * The ACKs are processed from the event loop, and the outcome of each
+ * update is reported to its callback: 0 or a negative errno. -ENOBUFS means
+ * the ACK was dropped and the outcome is unknown. When too many updates are
+ * in flight, the queued ACKs are read from within nf_ct_batch_set_*(), so
+ * callbacks may run from there too.
+ */
+typedef void (*nf_ct_mark_cb)(int error, void *ctx);
+
+int nf_ct_batch_set_mark(nf_flow_t *flow, nf_ct_mark_cb cb, void *ctx);
+
+int nf_ct_batch_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark,
+                              uint16_t zone, nf_ct_mark_cb cb, void *ctx);
+
+int nf_ct_batch_flush(void);
+
+void nf_ct_batch_cancel(nf_ct_mark_cb cb, bool (*match)(void *ctx, void *arg), void *arg);
+
+int nf_util_neigh_init(struct ev_loop *loop);
+
+void nf_util_neigh_exit(void);
+
 bool nf_util_get_macaddr(struct neighbour_entry *req);
 #endif /* NF_UTILS_H_INCLUDED */
@@ -24,6 +24,9 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip_icmp.h>
 #include <netinet/icmp6.h>
@@ -41,17 +44,133 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PROTO_NUM_ICMPV6  (58)
 #define ICMP_ECHO_REQUEST (8)
 
+#define NF_CT_MSG_SIZE     (512)
+#define NF_CT_MAX_PENDING  (1024)  /* Power of 2 */
+#define NF_CT_PENDING_HIWAT (NF_CT_MAX_PENDING / 2)
+#define NF_CT_RCVBUF_SIZE  (512 * 1024)
+
 // extern int cb_dump_data(const struct nlmsghdr *nlh, void *data);
 
+/* A batched update waiting for its ACK, slotted by sequence number */
+struct nf_ct_pending
+{
+    uint32_t seq;
+    bool in_use;
+    bool sent;
+    nf_ct_mark_cb cb;
+    void *ctx;
+};
+
 static struct nf_ct
 {
     struct ev_loop *loop;
     struct ev_io wmnl;
     struct mnl_socket *mnl;
     int fd;
+    struct ev_prepare wflush;
+    struct mnl_nlmsg_batch *batch;
+    char *batch_buf;
+    struct nf_ct_pending pending[NF_CT_MAX_PENDING];
+    size_t n_pending;
+    uint32_t seq;
 } nf_ct;
 
 
+static void nf_ct_pending_done(struct nf_ct_pending *pending, int error)
+{
+    nf_ct_mark_cb cb = pending->cb;
+    void *ctx = pending->ctx;
+
+    pending->in_use = false;
+    pending->sent = false;
+    pending->cb = NULL;
+    pending->ctx = NULL;
+    nf_ct.n_pending--;
+
+    cb(error, ctx);
+}
+
+static void nf_ct_pending_add(uint32_t seq, nf_ct_mark_cb cb, void *ctx)
+{
+    struct nf_ct_pending *pending;
+
+    /*
+     * The queued ACKs were drained before this update was built, an update
+     * still holding the slot had its ACK lost
+     */
+    pending = &nf_ct.pending[seq & (NF_CT_MAX_PENDING - 1)];
+    if (pending->in_use)
+    {
+        LOGD("%s: no ACK received for seq %u", __func__, pending->seq);
+        nf_ct_pending_done(pending, -ETIMEDOUT);
+    }
+
+    pending->seq = seq;
+    pending->cb = cb;
+    pending->ctx = ctx;
+    pending->in_use = true;
+    nf_ct.n_pending++;
+}
+
+static void nf_ct_pending_ack(uint32_t seq, int error)
+{
+    struct nf_ct_pending *pending;
+
+    pending = &nf_ct.pending[seq & (NF_CT_MAX_PENDING - 1)];
+    if (!pending->in_use || pending->seq != seq) return;
+
+    nf_ct_pending_done(pending, error);
+}
+
+static void nf_ct_pending_sent(uint32_t seq)
+{
+    struct nf_ct_pending *pending;
+
+    pending = &nf_ct.pending[seq & (NF_CT_MAX_PENDING - 1)];
+    if (pending->in_use && pending->seq == seq) pending->sent = true;
+}
+
+/* Completes the pending updates, or only those already sent if @sent */
+static void nf_ct_pending_flush(int error, bool sent)
+{
+    struct nf_ct_pending *pending;
+    size_t i;
+
+    for (i = 0; i < NF_CT_MAX_PENDING && nf_ct.n_pending; i++)
+    {
+        pending = &nf_ct.pending[i];
+        if (!pending->in_use) continue;
+        if (sent && !pending->sent) continue;
+
+        nf_ct_pending_done(pending, error);
+    }
+}
+
+/**
+ * nf_ct_batch_cancel: completes pending updates with -ECANCELED
+ * @cb: only the updates reported to this callback are cancelled
+ * @match: selects the updates by their context, may be NULL to cancel all
+ * @arg: passed to match
+ *
+ * Used when the objects referenced by the callback contexts go away before
+ * the ACKs are read. The callbacks run synchronously.
+ */
+void nf_ct_batch_cancel(nf_ct_mark_cb cb, bool (*match)(void *ctx, void *arg), void *arg)
+{
+    struct nf_ct_pending *pending;
+    size_t i;
+
+    for (i = 0; i < NF_CT_MAX_PENDING && nf_ct.n_pending; i++)
+    {
+        pending = &nf_ct.pending[i];
+        if (!pending->in_use || pending->cb != cb) continue;
+        if (match != NULL && !match(pending->ctx, arg)) continue;
+
+        nf_ct_pending_done(pending, -ECANCELED);
+    }
+}
+
+
 
 static int
 cb_err(const struct nlmsghdr *nlh, void *data)
@@ -60,6 +179,7 @@ cb_err(const struct nlmsghdr *nlh, void *data)
     if (err->error != 0)
         LOGD("message with seq %u has failed: %s\n",
             nlh->nlmsg_seq, strerror(-err->error));
+    nf_ct_pending_ack(nlh->nlmsg_seq, err->error);
     return MNL_CB_OK;
 }
 
@@ -76,22 +196,22 @@ static mnl_cb_t cb_ctl_array[NLMSG_MIN_TYPE] = {
     [NLMSG_OVERRUN] = cb_overrun,
 };
 
-static void read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher,
-                         int revents)
+/*
+ * Reads one datagram of ACKs from the non-blocking socket.
+ * Returns 1 if one was processed, 0 if none is queued or a negative errno.
+ */
+static int nf_ct_recv(void)
 {
     char rcv_buf[MNL_SOCKET_BUFFER_SIZE];
     int ret = 0, portid = 0;
-    if (EV_ERROR & revents)
-    {
-        LOGE("Invalid mnl socket event");
-        return;
-    }
-    LOGD("MNL socket read callback");
+
     ret = mnl_socket_recvfrom(nf_ct.mnl, rcv_buf, sizeof(rcv_buf));
     if (ret == -1)
     {
-        LOGE("%s: mnl_socket_recvfrom\n", __func__);
-        return;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+
+        LOGE("%s: mnl_socket_recvfrom: %s\n", __func__, strerror(errno));
+        return -errno;
     }
     portid = mnl_socket_get_portid(nf_ct.mnl);
     LOGD("MNL ACK message received");
@@ -107,6 +227,45 @@ static void read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher,
 #endif
     if (ret == -1)
         LOGE("%s: mnl_cb_run\n", __func__);
+
+    return 1;
+}
+
+/*
+ * The socket overran and some ACKs were dropped. The ACKs still queued are
+ * valid, so they are read first. The updates sent but still pending after
+ * that lost their ACK: their outcome is unknown and they are completed with
+ * -ENOBUFS. Updates not sent yet are left alone.
+ */
+static void nf_ct_resync(void)
+{
+    while (nf_ct_recv() > 0);
+
+    LOGI("%s: ACKs dropped, the outcome of the sent mark updates is unknown",
+         __func__);
+    nf_ct_pending_flush(-ENOBUFS, true);
+}
+
+/* Sends the queued updates and reads the ACKs already available */
+static void nf_ct_drain(void)
+{
+    int ret;
+
+    nf_ct_batch_flush();
+    while ((ret = nf_ct_recv()) > 0);
+    if (ret == -ENOBUFS) nf_ct_resync();
+}
+
+static void read_mnl_socket_cbk(struct ev_loop *loop, struct ev_io *watcher,
+                         int revents)
+{
+    if (EV_ERROR & revents)
+    {
+        LOGE("Invalid mnl socket event");
+        return;
+    }
+    LOGD("MNL socket read callback");
+    if (nf_ct_recv() == -ENOBUFS) nf_ct_resync();
 }
 
 static int build_ipv4_addr(
@@ -290,13 +449,12 @@ static struct nlmsghdr * nf_build_nl_msg_hdr(
 
     struct nlmsghdr *nlh = NULL;
     struct nfgenmsg *nfh = NULL;
-    static unsigned int seq = 0;
 
     nlh = mnl_nlmsg_put_header(buf);
 
     nlh->nlmsg_type = type;
     nlh->nlmsg_flags = flags;
-    nlh->nlmsg_seq = ++seq;
+    nlh->nlmsg_seq = ++nf_ct.seq;
     nlh->nlmsg_pid = mnl_socket_get_portid(nf_ct.mnl);
 
     nfh = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nfgenmsg));
@@ -455,20 +613,18 @@ static void nf_ct_timeout_cbk(EV_P_ ev_timer *timer, int revents)
 }
 
 
-int nf_ct_set_mark(nf_flow_t *flow)
+static struct nlmsghdr * nf_build_mark_msg(char *buf, nf_flow_t *flow)
 {
     uint8_t proto = 0;
     uint16_t family = 0;
     uint32_t mark = 0;
     uint16_t zone = 0;
-    char buf[512];
     struct nlmsghdr *nlh = NULL;
-    int res = 0;
 
     if (flow == NULL)
     {
         LOGE("Empty flow");
-        return -1;
+        return NULL;
     }
     proto  = flow->proto;
     family = flow->family;
@@ -477,9 +633,8 @@ int nf_ct_set_mark(nf_flow_t *flow)
     if (family != AF_INET && family != AF_INET6)
     {
         LOGE("Unknown protocol family");
-        return -1;
+        return NULL;
     }
-    memset(buf, 0, sizeof(buf));
     if (proto == PROTO_NUM_ICMPV4 || proto == PROTO_NUM_ICMPV6)
     {
 
@@ -503,6 +658,17 @@ int nf_ct_set_mark(nf_flow_t *flow)
                       mark,
                       zone);
     }
+    return nlh;
+}
+
+int nf_ct_set_mark(nf_flow_t *flow)
+{
+    char buf[512];
+    struct nlmsghdr *nlh = NULL;
+    int res = 0;
+
+    memset(buf, 0, sizeof(buf));
+    nlh = nf_build_mark_msg(buf, flow);
     if (nlh == NULL)
         return -1;
     res = mnl_socket_sendto(nf_ct.mnl, nlh, nlh->nlmsg_len);
@@ -663,13 +829,16 @@ static struct nlmsghdr * nf_build_icmp_nl_msg_alt(
 
 
 
-int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16_t zone)
+static struct nlmsghdr * nf_build_flow_mark_msg(
+        char *buf,
+        struct net_header_parser *net_pkt,
+        uint32_t mark,
+        uint16_t zone
+)
 {
     uint8_t proto = 0;
     uint16_t family = 0;
-    char buf[512];
     struct nlmsghdr *nlh = NULL;
-    int res = 0;
     struct iphdr *ipv4hdr = NULL;
     struct ip6_hdr *ipv6hdr = NULL;
     void *src_ip = NULL;
@@ -685,7 +854,7 @@ int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16
     if (net_pkt == NULL)
     {
         LOGE("Empty flow");
-        return -1;
+        return NULL;
     }
 
     proto  = net_pkt->ip_protocol;
@@ -708,9 +877,8 @@ int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16
     if (family != AF_INET && family != AF_INET6)
     {
         LOGE("Unknown protocol family");
-        return -1;
+        return NULL;
     }
-    memset(buf, 0, sizeof(buf));
 
     switch (net_pkt->ip_protocol)
     {
@@ -775,6 +943,17 @@ int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16
                       zone,
                       true);
     }
+    return nlh;
+}
+
+int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16_t zone)
+{
+    char buf[512];
+    struct nlmsghdr *nlh = NULL;
+    int res = 0;
+
+    memset(buf, 0, sizeof(buf));
+    nlh = nf_build_flow_mark_msg(buf, net_pkt, mark, zone);
     if (nlh == NULL)
         return -1;
     res = mnl_socket_sendto(nf_ct.mnl, nlh, nlh->nlmsg_len);
@@ -783,9 +962,142 @@ int nf_ct_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark, uint16
 }
 
 
+/**
+ * nf_ct_batch_flush: sends the queued mark updates
+ *
+ * The updates are sent as a single multi-message netlink write. Their
+ * ACKs are processed from the event loop.
+ */
+int nf_ct_batch_flush(void)
+{
+    struct nlmsghdr *nlh;
+    size_t len;
+    int left;
+    int res;
+
+    if (nf_ct.batch == NULL) return -1;
+    if (mnl_nlmsg_batch_is_empty(nf_ct.batch)) return 0;
+
+    len = mnl_nlmsg_batch_size(nf_ct.batch);
+    res = mnl_socket_sendto(nf_ct.mnl, mnl_nlmsg_batch_head(nf_ct.batch), len);
+    LOGD("%s: batch len = %zu res = %d", __func__, len, res);
+    if (res < 0)
+    {
+        LOGE("%s: sending %zu bytes of mark updates failed: %s", __func__,
+             len, strerror(errno));
+        res = -errno;
+    }
+
+    /* No ACK will come for the updates of a failed batch */
+    left = (int)len;
+    nlh = mnl_nlmsg_batch_head(nf_ct.batch);
+    while (mnl_nlmsg_ok(nlh, left))
+    {
+        if (res < 0)
+            nf_ct_pending_ack(nlh->nlmsg_seq, res);
+        else
+            nf_ct_pending_sent(nlh->nlmsg_seq);
+        nlh = mnl_nlmsg_next(nlh, &left);
+    }
+
+    /* Keeps the message that overflowed the batch, if any */
+    mnl_nlmsg_batch_reset(nf_ct.batch);
+    if (mnl_nlmsg_batch_is_empty(nf_ct.batch))
+        ev_prepare_stop(nf_ct.loop, &nf_ct.wflush);
+
+    return res < 0 ? -1 : 0;
+}
+
+static void nf_ct_flush_cbk(EV_P_ ev_prepare *w, int revents)
+{
+    nf_ct_batch_flush();
+}
+
+static int nf_ct_batch_queue(struct nlmsghdr *nlh, nf_ct_mark_cb cb, void *ctx)
+{
+    if (cb != NULL) nf_ct_pending_add(nlh->nlmsg_seq, cb, ctx);
+
+    /* The batch is full, send what precedes this message */
+    if (!mnl_nlmsg_batch_next(nf_ct.batch)) nf_ct_batch_flush();
+
+    /* Sent at the latest before the event loop blocks */
+    ev_prepare_start(nf_ct.loop, &nf_ct.wflush);
+    return 0;
+}
+
+static char * nf_ct_batch_msg_buf(void)
+{
+    char *buf;
+
+    if (nf_ct.batch == NULL) return NULL;
+
+    /*
+     * Bound the updates in flight, and read the queued ACKs before the slot
+     * of the next sequence number is reused. Nothing is half built here, so
+     * the batch can be sent.
+     */
+    if (nf_ct.n_pending >= NF_CT_PENDING_HIWAT ||
+        nf_ct.pending[(nf_ct.seq + 1) & (NF_CT_MAX_PENDING - 1)].in_use)
+    {
+        nf_ct_drain();
+    }
+
+    buf = mnl_nlmsg_batch_current(nf_ct.batch);
+    memset(buf, 0, NF_CT_MSG_SIZE);
+    return buf;
+}
+
+/**
+ * nf_ct_batch_set_mark: queues a mark update of a flow
+ * @flow: the flow and its mark
+ * @cb: called with 0 or a negative errno once the update is acknowledged,
+ *      may be NULL
+ * @ctx: passed to the callback
+ */
+int nf_ct_batch_set_mark(nf_flow_t *flow, nf_ct_mark_cb cb, void *ctx)
+{
+    struct nlmsghdr *nlh = NULL;
+    char *buf;
+
+    buf = nf_ct_batch_msg_buf();
+    if (buf == NULL) return -1;
+
+    nlh = nf_build_mark_msg(buf, flow);
+    if (nlh == NULL) return -1;
+
+    return nf_ct_batch_queue(nlh, cb, ctx);
+}
+
+/**
+ * nf_ct_batch_set_flow_mark: queues a mark update of a parsed packet's flow
+ * @net_pkt: the parsed packet
+ * @mark: the mark to set
+ * @zone: the conntrack zone
+ * @cb: called with 0 or a negative errno once the update is acknowledged,
+ *      may be NULL
+ * @ctx: passed to the callback
+ */
+int nf_ct_batch_set_flow_mark(struct net_header_parser *net_pkt, uint32_t mark,
+                              uint16_t zone, nf_ct_mark_cb cb, void *ctx)
+{
+    struct nlmsghdr *nlh = NULL;
+    char *buf;
+
+    buf = nf_ct_batch_msg_buf();
+    if (buf == NULL) return -1;
+
+    nlh = nf_build_flow_mark_msg(buf, net_pkt, mark, zone);
+    if (nlh == NULL) return -1;
+
+    return nf_ct_batch_queue(nlh, cb, ctx);
+}
+
 int nf_ct_init(struct ev_loop *loop)
 {
     struct mnl_socket *nl = NULL;
+    socklen_t len;
+    int rcvbuf;
+    int flags;
     nl = mnl_socket_open(NETLINK_NETFILTER);
     if (nl == NULL)
     {
@@ -800,14 +1112,67 @@ int nf_ct_init(struct ev_loop *loop)
     nf_ct.mnl = nl;
     nf_ct.loop = loop;
     nf_ct.fd = mnl_socket_get_fd(nl);
+
+    /* ACKs are also drained outside of the event loop */
+    flags = fcntl(nf_ct.fd, F_GETFL);
+    if (flags < 0 || fcntl(nf_ct.fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        LOGE("%s: failed to make the socket non-blocking: %s", __func__,
+             strerror(errno));
+        mnl_socket_close(nl);
+        nf_ct.mnl = NULL;
+        return -1;
+    }
+
+    /*
+     * Room for the ACKs of large batches. SO_RCVBUF is capped by
+     * net.core.rmem_max, SO_RCVBUFFORCE is not but needs CAP_NET_ADMIN.
+     */
+    rcvbuf = NF_CT_RCVBUF_SIZE;
+    if (setsockopt(nf_ct.fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0 &&
+        setsockopt(nf_ct.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+    {
+        LOGW("%s: failed to set the receive buffer size: %s", __func__,
+             strerror(errno));
+    }
+    len = sizeof(rcvbuf);
+    if (getsockopt(nf_ct.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0)
+    {
+        LOGI("%s: receive buffer size %d bytes", __func__, rcvbuf);
+    }
+
+    nf_ct.batch_buf = calloc(2, MNL_SOCKET_BUFFER_SIZE);
+    if (nf_ct.batch_buf != NULL)
+    {
+        nf_ct.batch = mnl_nlmsg_batch_start(nf_ct.batch_buf,
+                                            MNL_SOCKET_BUFFER_SIZE);
+    }
+    if (nf_ct.batch == NULL) LOGW("%s: batched mark updates disabled", __func__);
+
     ev_io_init(&nf_ct.wmnl, read_mnl_socket_cbk, nf_ct.fd, EV_READ);
     ev_io_start(loop, &nf_ct.wmnl);
+    ev_prepare_init(&nf_ct.wflush, nf_ct_flush_cbk);
     LOGD("nf_ct initialized");
     return 0;
 }
 
 int nf_ct_exit(void)
 {
+    nf_ct_drain();
+    nf_ct_pending_flush(-ECANCELED, false);
+
+    if (nf_ct.loop != NULL)
+    {
+        ev_prepare_stop(nf_ct.loop, &nf_ct.wflush);
+        ev_io_stop(nf_ct.loop, &nf_ct.wmnl);
+    }
+
+    if (nf_ct.batch != NULL) mnl_nlmsg_batch_stop(nf_ct.batch);
+    nf_ct.batch = NULL;
+    free(nf_ct.batch_buf);
+    nf_ct.batch_buf = NULL;
+
     mnl_socket_close(nf_ct.mnl);
+    nf_ct.mnl = NULL;
     return 0;
 }
@@ -27,10 +27,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* This example is placed in the public domain. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <arpa/inet.h>
+#include <ev.h>
 
 #include <libmnl/libmnl.h>
+#include <net/if.h>
 #include <linux/if.h>
 #include <linux/if_link.h>
 #include <linux/rtnetlink.h>
@@ -39,6 +43,47 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "log.h"
 #include "neigh_table.h"
+#include "nf_utils.h"
+
+#define NF_NEIGH_HASH_INIT      (256)   /* Power of 2 */
+#define NF_NEIGH_RCVBUF_SIZE    (256 * 1024)
+#define NF_NEIGH_RESYNC_DELAY   (0.5)   /* Seconds, coalesces overruns */
+
+/* Neighbour states the MAC can be trusted in */
+#define NF_NEIGH_USABLE_STATES  (NUD_PERMANENT | NUD_REACHABLE | NUD_STALE)
+
+struct nf_neigh_entry
+{
+    struct nf_neigh_entry *next;
+    uint32_t hash;
+    int family;
+    int ifindex;
+    uint8_t addr[16];
+    os_macaddr_t mac;
+    bool mac_valid;
+    uint16_t state;
+    uint32_t gen;
+};
+
+/*
+ * Neighbour cache, filled from a RTM_GETNEIGH dump and kept up to date
+ * from the RTM_NEWNEIGH/RTM_DELNEIGH notifications. An address is cached
+ * once per interface it is a neighbour on, all of them in the same bucket.
+ */
+static struct nf_neigh_cache
+{
+    bool initialized;
+    struct ev_loop *loop;
+    struct ev_io wmnl;
+    struct ev_timer wresync;
+    struct mnl_socket *mnl;
+    unsigned int portid;
+    unsigned int seq;
+    struct nf_neigh_entry **buckets;
+    size_t size;
+    size_t count;
+    uint32_t gen;   /* Bumped by each dump, to sweep vanished entries */
+} nf_neigh;
 
 static int util_data_attr_cb(const struct nlattr *attr, void *data)
 {
@@ -148,6 +193,413 @@ static int util_data_cb(const struct nlmsghdr *nlh, void *data)
     return MNL_CB_STOP;
 }
 
+static size_t nf_neigh_addr_len(int family)
+{
+    if (family == AF_INET) return 4;
+    if (family == AF_INET6) return 16;
+    return 0;
+}
+
+static uint32_t nf_neigh_hash(int family, const uint8_t *addr)
+{
+    uint32_t hash = 2166136261u;
+    size_t len = nf_neigh_addr_len(family);
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= addr[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool nf_neigh_match(struct nf_neigh_entry *entry, uint32_t hash,
+                           int family, const uint8_t *addr)
+{
+    return entry->hash == hash && entry->family == family &&
+           !memcmp(entry->addr, addr, nf_neigh_addr_len(family));
+}
+
+static struct nf_neigh_entry **nf_neigh_slot(int family, const uint8_t *addr,
+                                             int ifindex)
+{
+    struct nf_neigh_entry **slot;
+    uint32_t hash;
+
+    hash = nf_neigh_hash(family, addr);
+    slot = &nf_neigh.buckets[hash & (nf_neigh.size - 1)];
+    while (*slot != NULL)
+    {
+        if (nf_neigh_match(*slot, hash, family, addr) &&
+            (*slot)->ifindex == ifindex)
+        {
+            break;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void nf_neigh_grow(void)
+{
+    struct nf_neigh_entry **buckets;
+    struct nf_neigh_entry *entry;
+    struct nf_neigh_entry *next;
+    size_t size;
+    size_t i;
+
+    size = nf_neigh.size * 2;
+    buckets = calloc(size, sizeof(*buckets));
+    if (buckets == NULL) return;
+
+    for (i = 0; i < nf_neigh.size; i++)
+    {
+        for (entry = nf_neigh.buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+        }
+    }
+
+    free(nf_neigh.buckets);
+    nf_neigh.buckets = buckets;
+    nf_neigh.size = size;
+}
+
+static void nf_neigh_update(int family, const uint8_t *addr, int ifindex,
+                            const uint8_t *mac, uint16_t state)
+{
+    struct nf_neigh_entry **slot;
+    struct nf_neigh_entry *entry;
+
+    slot = nf_neigh_slot(family, addr, ifindex);
+    entry = *slot;
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(*entry));
+        if (entry == NULL) return;
+
+        entry->hash = nf_neigh_hash(family, addr);
+        entry->family = family;
+        entry->ifindex = ifindex;
+        memcpy(entry->addr, addr, nf_neigh_addr_len(family));
+        *slot = entry;
+        nf_neigh.count++;
+    }
+
+    if (mac != NULL)
+    {
+        memcpy(&entry->mac, mac, sizeof(entry->mac));
+        entry->mac_valid = true;
+    }
+    entry->state = state;
+    entry->gen = nf_neigh.gen;
+
+    if (nf_neigh.count > nf_neigh.size) nf_neigh_grow();
+}
+
+static void nf_neigh_remove(int family, const uint8_t *addr, int ifindex)
+{
+    struct nf_neigh_entry **slot;
+    struct nf_neigh_entry *entry;
+
+    slot = nf_neigh_slot(family, addr, ifindex);
+    entry = *slot;
+    if (entry == NULL) return;
+
+    *slot = entry->next;
+    free(entry);
+    nf_neigh.count--;
+}
+
+/* Drops the entries a dump did not report */
+static void nf_neigh_sweep(uint32_t gen)
+{
+    struct nf_neigh_entry **slot;
+    struct nf_neigh_entry *entry;
+    size_t i;
+
+    for (i = 0; i < nf_neigh.size; i++)
+    {
+        slot = &nf_neigh.buckets[i];
+        while ((entry = *slot) != NULL)
+        {
+            if (entry->gen == gen)
+            {
+                slot = &entry->next;
+                continue;
+            }
+            *slot = entry->next;
+            free(entry);
+            nf_neigh.count--;
+        }
+    }
+}
+
+static int nf_neigh_attr_cb(const struct nlattr *attr, void *data)
+{
+    const struct nlattr **tb = data;
+
+    /* skip unsupported attribute in user-space */
+    if (mnl_attr_type_valid(attr, NDA_MAX) < 0) return MNL_CB_OK;
+
+    tb[mnl_attr_get_type(attr)] = attr;
+    return MNL_CB_OK;
+}
+
+static int nf_neigh_data_cb(const struct nlmsghdr *nlh, void *data)
+{
+    struct nlattr *tb[NDA_MAX + 1] = {};
+    struct ndmsg *ndm;
+    uint8_t *mac = NULL;
+    uint8_t *addr;
+    int family;
+
+    if (nlh->nlmsg_type != RTM_NEWNEIGH && nlh->nlmsg_type != RTM_DELNEIGH)
+    {
+        return MNL_CB_OK;
+    }
+
+    ndm = mnl_nlmsg_get_payload(nlh);
+    family = ndm->ndm_family;
+    if (nf_neigh_addr_len(family) == 0) return MNL_CB_OK;
+
+    mnl_attr_parse(nlh, sizeof(*ndm), nf_neigh_attr_cb, tb);
+    if (!tb[NDA_DST]) return MNL_CB_OK;
+    if (mnl_attr_get_payload_len(tb[NDA_DST]) != nf_neigh_addr_len(family))
+    {
+        return MNL_CB_OK;
+    }
+    addr = mnl_attr_get_payload(tb[NDA_DST]);
+
+    if (nlh->nlmsg_type == RTM_DELNEIGH)
+    {
+        nf_neigh_remove(family, addr, ndm->ndm_ifindex);
+        return MNL_CB_OK;
+    }
+
+    if (tb[NDA_LLADDR] &&
+        mnl_attr_get_payload_len(tb[NDA_LLADDR]) == sizeof(os_macaddr_t))
+    {
+        mac = mnl_attr_get_payload(tb[NDA_LLADDR]);
+    }
+
+    nf_neigh_update(family, addr, ndm->ndm_ifindex, mac, ndm->ndm_state);
+    return MNL_CB_OK;
+}
+
+/**
+ * nf_neigh_dump: (re)loads the neighbour cache from the kernel
+ *
+ * Notifications received meanwhile are processed along with the dump.
+ */
+static bool nf_neigh_dump(void)
+{
+    char buf[MNL_SOCKET_BUFFER_SIZE];
+    struct nlmsghdr *nlh;
+    struct rtgenmsg *rt;
+    unsigned int seq;
+    int ret;
+
+    nlh = mnl_nlmsg_put_header(buf);
+    nlh->nlmsg_type = RTM_GETNEIGH;
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    nlh->nlmsg_seq = seq = ++nf_neigh.seq;
+
+    rt = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtgenmsg));
+    rt->rtgen_family = AF_UNSPEC;
+
+    nf_neigh.gen++;
+    if (mnl_socket_sendto(nf_neigh.mnl, nlh, nlh->nlmsg_len) < 0)
+    {
+        LOGE("nf_util: Failed to send the neighbour dump request: %s",
+             strerror(errno));
+        return false;
+    }
+
+    while ((ret = mnl_socket_recvfrom(nf_neigh.mnl, buf, sizeof(buf))) > 0)
+    {
+        ret = mnl_cb_run(buf, ret, seq, nf_neigh.portid, nf_neigh_data_cb, NULL);
+        if (ret <= MNL_CB_STOP) break;
+    }
+    if (ret < 0)
+    {
+        LOGE("nf_util: Failed to dump the neighbour table: %s", strerror(errno));
+        return false;
+    }
+
+    nf_neigh_sweep(nf_neigh.gen);
+    LOGD("nf_util: %zu neighbours cached", nf_neigh.count);
+    return true;
+}
+
+static void nf_neigh_read_cbk(struct ev_loop *loop, struct ev_io *watcher,
+                              int revents)
+{
+    char buf[MNL_SOCKET_BUFFER_SIZE];
+    int ret;
+
+    if (EV_ERROR & revents)
+    {
+        LOGE("Invalid neighbour socket event");
+        return;
+    }
+
+    ret = mnl_socket_recvfrom(nf_neigh.mnl, buf, sizeof(buf));
+    if (ret == -1)
+    {
+        /*
+         * Notifications were dropped, resynchronize. The dump waits for
+         * its reply, so it runs from a timer rather than from here.
+         */
+        if (errno == ENOBUFS && !ev_is_active(&nf_neigh.wresync))
+        {
+            LOGI("nf_util: Neighbour notifications lost, scheduling a resync");
+            ev_timer_start(loop, &nf_neigh.wresync);
+        }
+        return;
+    }
+
+    mnl_cb_run(buf, ret, 0, 0, nf_neigh_data_cb, NULL);
+}
+
+static void nf_neigh_resync_cbk(struct ev_loop *loop, struct ev_timer *watcher,
+                                int revents)
+{
+    nf_neigh_dump();
+}
+
+static bool nf_neigh_usable(struct nf_neigh_entry *entry)
+{
+    os_macaddr_t zeromac;
+
+    if (!entry->mac_valid) return false;
+    if (!(entry->state & NF_NEIGH_USABLE_STATES)) return false;
+
+    /* Same as the kernel dump, an all zero MAC is not an answer */
+    memset(&zeromac, 0, sizeof(zeromac));
+    return memcmp(&entry->mac, &zeromac, sizeof(zeromac)) != 0;
+}
+
+/*
+ * Looks the address up on the request's interface if it names one, else
+ * on any interface it is a usable neighbour on
+ */
+static bool nf_neigh_lookup(struct neighbour_entry *req)
+{
+    struct sockaddr_storage *ss = req->ipaddr;
+    struct nf_neigh_entry *entry;
+    unsigned int ifindex = 0;
+    uint8_t *addr;
+    uint32_t hash;
+
+    if (ss->ss_family == AF_INET)
+        addr = (uint8_t *)&((struct sockaddr_in *)ss)->sin_addr;
+    else if (ss->ss_family == AF_INET6)
+        addr = (uint8_t *)&((struct sockaddr_in6 *)ss)->sin6_addr;
+    else
+        return false;
+
+    if (req->ifname != NULL && req->ifname[0] != '\0')
+        ifindex = if_nametoindex(req->ifname);
+
+    hash = nf_neigh_hash(ss->ss_family, addr);
+    for (entry = nf_neigh.buckets[hash & (nf_neigh.size - 1)];
+         entry != NULL; entry = entry->next)
+    {
+        if (!nf_neigh_match(entry, hash, ss->ss_family, addr)) continue;
+        if (ifindex != 0 && entry->ifindex != (int)ifindex) continue;
+        if (!nf_neigh_usable(entry)) continue;
+
+        memcpy(req->mac, &entry->mac, sizeof(os_macaddr_t));
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * nf_util_neigh_init: starts the neighbour cache
+ * @loop: the event loop the notifications are processed from
+ *
+ * Until it is started, nf_util_get_macaddr() dumps the kernel table.
+ * Returns 0 on success, -1 otherwise.
+ */
+int nf_util_neigh_init(struct ev_loop *loop)
+{
+    int rcvbuf;
+
+    if (nf_neigh.initialized) return 0;
+
+    nf_neigh.mnl = mnl_socket_open(NETLINK_ROUTE);
+    if (nf_neigh.mnl == NULL)
+    {
+        LOGE("nf_util: Failed to open mnl socket.");
+        return -1;
+    }
+
+    if (mnl_socket_bind(nf_neigh.mnl, RTMGRP_NEIGH, MNL_SOCKET_AUTOPID) < 0)
+    {
+        LOGE("nf_util: Failed to bind mnl socket.");
+        goto err_close;
+    }
+    nf_neigh.portid = mnl_socket_get_portid(nf_neigh.mnl);
+
+    rcvbuf = NF_NEIGH_RCVBUF_SIZE;
+    if (setsockopt(mnl_socket_get_fd(nf_neigh.mnl), SOL_SOCKET, SO_RCVBUF,
+                   &rcvbuf, sizeof(rcvbuf)) < 0)
+    {
+        LOGW("nf_util: Failed to set the receive buffer size: %s",
+             strerror(errno));
+    }
+
+    nf_neigh.size = NF_NEIGH_HASH_INIT;
+    nf_neigh.buckets = calloc(nf_neigh.size, sizeof(*nf_neigh.buckets));
+    if (nf_neigh.buckets == NULL) goto err_close;
+
+    if (!nf_neigh_dump()) goto err_free;
+
+    nf_neigh.loop = loop;
+    ev_io_init(&nf_neigh.wmnl, nf_neigh_read_cbk,
+               mnl_socket_get_fd(nf_neigh.mnl), EV_READ);
+    ev_io_start(loop, &nf_neigh.wmnl);
+    ev_timer_init(&nf_neigh.wresync, nf_neigh_resync_cbk,
+                  NF_NEIGH_RESYNC_DELAY, 0);
+
+    nf_neigh.initialized = true;
+    return 0;
+
+err_free:
+    nf_neigh_sweep(nf_neigh.gen + 1);
+    free(nf_neigh.buckets);
+    nf_neigh.buckets = NULL;
+    nf_neigh.size = 0;
+
+err_close:
+    mnl_socket_close(nf_neigh.mnl);
+    nf_neigh.mnl = NULL;
+    return -1;
+}
+
+void nf_util_neigh_exit(void)
+{
+    if (!nf_neigh.initialized) return;
+
+    ev_io_stop(nf_neigh.loop, &nf_neigh.wmnl);
+    ev_timer_stop(nf_neigh.loop, &nf_neigh.wresync);
+    mnl_socket_close(nf_neigh.mnl);
+    nf_neigh.mnl = NULL;
+
+    /* No entry belongs to a future generation */
+    nf_neigh_sweep(nf_neigh.gen + 1);
+    free(nf_neigh.buckets);
+    nf_neigh.buckets = NULL;
+    nf_neigh.size = 0;
+    nf_neigh.initialized = false;
+}
+
 bool nf_util_get_macaddr(struct neighbour_entry *req)
 {
     struct mnl_socket *nl;
@@ -160,6 +612,12 @@ bool nf_util_get_macaddr(struct neighbour_entry *req)
     os_macaddr_t zeromac;
     struct sockaddr *ss = (struct sockaddr *)req->ipaddr;
 
+    if (nf_neigh.initialized)
+    {
+        memset(req->mac, 0, sizeof(os_macaddr_t));
+        return nf_neigh_lookup(req);
+    }
+
     nlh = mnl_nlmsg_put_header(buf);
     nlh->nlmsg_type = RTM_GETNEIGH;
     nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
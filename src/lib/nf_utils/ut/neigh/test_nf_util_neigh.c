@@ -0,0 +1,327 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ev.h>
+#include <libmnl/libmnl.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include "log.h"
+#include "nf_utils.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "nf_util_neigh_tests";
+
+#define MAX_RX      16
+#define MAX_KERNEL  8
+#define RX_BUF_SIZE 8192
+
+/*
+ * Netlink emulation: a dump request is answered with the entries of the
+ * emulated kernel table, notifications are queued by the tests
+ */
+struct rx_entry
+{
+    int error;                  /* recvfrom() failure, no datagram */
+    size_t len;
+    char buf[RX_BUF_SIZE];
+};
+
+struct kernel_neigh
+{
+    const char *ip;
+    int ifindex;
+    uint8_t mac[6];
+};
+
+static struct rx_entry g_rx[MAX_RX];
+static size_t g_rx_head;
+static size_t g_rx_tail;
+static struct kernel_neigh g_kernel[MAX_KERNEL];
+static size_t g_kernel_count;
+static int g_dumps;
+static struct mnl_socket *g_nl;
+
+static const uint8_t g_mac_a[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0a };
+static const uint8_t g_mac_b[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0b };
+static const uint8_t g_mac_zero[6];
+
+struct mnl_socket *__real_mnl_socket_open(int bus);
+
+struct mnl_socket *__wrap_mnl_socket_open(int bus)
+{
+    g_nl = __real_mnl_socket_open(bus);
+    return g_nl;
+}
+
+static struct rx_entry *rx_push(void)
+{
+    struct rx_entry *rx;
+
+    TEST_ASSERT_TRUE(g_rx_tail - g_rx_head < MAX_RX);
+    rx = &g_rx[g_rx_tail++ % MAX_RX];
+    memset(rx, 0, sizeof(*rx));
+
+    return rx;
+}
+
+static void rx_put_neigh(struct rx_entry *rx, uint16_t type, uint32_t seq,
+                         const char *ip, int ifindex, const uint8_t *mac)
+{
+    struct nlmsghdr *nlh;
+    struct ndmsg *ndm;
+    struct in_addr addr;
+
+    TEST_ASSERT_EQUAL_INT(1, inet_pton(AF_INET, ip, &addr));
+    TEST_ASSERT_TRUE(rx->len + 128 <= sizeof(rx->buf));
+
+    nlh = mnl_nlmsg_put_header(rx->buf + rx->len);
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_seq = seq;
+    ndm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ndm));
+    ndm->ndm_family = AF_INET;
+    ndm->ndm_ifindex = ifindex;
+    ndm->ndm_state = NUD_REACHABLE;
+    mnl_attr_put(nlh, NDA_DST, sizeof(addr), &addr);
+    if (mac != NULL) mnl_attr_put(nlh, NDA_LLADDR, 6, mac);
+    rx->len += nlh->nlmsg_len;
+}
+
+static void rx_put_done(struct rx_entry *rx, uint32_t seq)
+{
+    struct nlmsghdr *nlh;
+
+    nlh = mnl_nlmsg_put_header(rx->buf + rx->len);
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_flags = NLM_F_MULTI;
+    nlh->nlmsg_seq = seq;
+    mnl_nlmsg_put_extra_header(nlh, sizeof(int));
+    rx->len += nlh->nlmsg_len;
+}
+
+static void kernel_add(const char *ip, int ifindex, const uint8_t *mac)
+{
+    struct kernel_neigh *neigh;
+
+    TEST_ASSERT_TRUE(g_kernel_count < MAX_KERNEL);
+    neigh = &g_kernel[g_kernel_count++];
+    neigh->ip = ip;
+    neigh->ifindex = ifindex;
+    memcpy(neigh->mac, mac, sizeof(neigh->mac));
+}
+
+/* Queues a RTM_NEWNEIGH or RTM_DELNEIGH notification */
+static void notify(uint16_t type, const char *ip, int ifindex, const uint8_t *mac)
+{
+    rx_put_neigh(rx_push(), type, 0, ip, ifindex, mac);
+}
+
+ssize_t __wrap_mnl_socket_sendto(const struct mnl_socket *nl, const void *buf, size_t len)
+{
+    const struct nlmsghdr *nlh = buf;
+    struct rx_entry *rx;
+    size_t i;
+
+    (void)nl;
+
+    TEST_ASSERT_EQUAL_INT(RTM_GETNEIGH, nlh->nlmsg_type);
+    g_dumps++;
+
+    rx = rx_push();
+    for (i = 0; i < g_kernel_count; i++)
+    {
+        rx_put_neigh(rx, RTM_NEWNEIGH, nlh->nlmsg_seq, g_kernel[i].ip,
+                     g_kernel[i].ifindex, g_kernel[i].mac);
+    }
+    rx_put_done(rx, nlh->nlmsg_seq);
+
+    return len;
+}
+
+ssize_t __wrap_mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf, size_t bufsiz)
+{
+    struct rx_entry *rx;
+
+    (void)nl;
+
+    if (g_rx_head == g_rx_tail)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    rx = &g_rx[g_rx_head++ % MAX_RX];
+    if (rx->error != 0)
+    {
+        errno = rx->error;
+        return -1;
+    }
+
+    TEST_ASSERT_TRUE(rx->len <= bufsiz);
+    memcpy(buf, rx->buf, rx->len);
+    return rx->len;
+}
+
+/* Lets the event loop process one readable event of the socket */
+static void socket_readable(void)
+{
+    struct ev_loop *loop = EV_DEFAULT;
+
+    ev_feed_fd_event(loop, mnl_socket_get_fd(g_nl), EV_READ);
+    ev_invoke_pending(loop);
+}
+
+static bool lookup(const char *ip, char *ifname, os_macaddr_t *mac)
+{
+    struct sockaddr_storage ss;
+    struct sockaddr_in *in4 = (struct sockaddr_in *)&ss;
+    struct neighbour_entry req;
+
+    memset(&ss, 0, sizeof(ss));
+    in4->sin_family = AF_INET;
+    TEST_ASSERT_EQUAL_INT(1, inet_pton(AF_INET, ip, &in4->sin_addr));
+
+    memset(&req, 0, sizeof(req));
+    req.ipaddr = &ss;
+    req.mac = mac;
+    req.ifname = ifname;
+
+    return nf_util_get_macaddr(&req);
+}
+
+void setUp(void)
+{
+    g_rx_head = g_rx_tail = 0;
+    g_kernel_count = 0;
+    g_dumps = 0;
+}
+
+void tearDown(void)
+{
+    nf_util_neigh_exit();
+}
+
+/*
+ * An address known on two interfaces survives its removal from one of them,
+ * and is only reported on the interface it is still a neighbour on
+ */
+void test_same_addr_two_ifaces(void)
+{
+    char lo[] = "lo";
+    os_macaddr_t mac;
+    int lo_index;
+
+    lo_index = if_nametoindex(lo);
+    TEST_ASSERT_TRUE(lo_index > 0);
+
+    kernel_add("10.0.0.2", lo_index, g_mac_a);
+    kernel_add("10.0.0.2", lo_index + 100, g_mac_a);
+    TEST_ASSERT_EQUAL_INT(0, nf_util_neigh_init(EV_DEFAULT));
+
+    TEST_ASSERT_TRUE(lookup("10.0.0.2", lo, &mac));
+    TEST_ASSERT_EQUAL_MEMORY(g_mac_a, &mac, sizeof(mac));
+
+    notify(RTM_DELNEIGH, "10.0.0.2", lo_index, NULL);
+    socket_readable();
+
+    TEST_ASSERT_TRUE(lookup("10.0.0.2", NULL, &mac));
+    TEST_ASSERT_EQUAL_MEMORY(g_mac_a, &mac, sizeof(mac));
+    TEST_ASSERT_FALSE(lookup("10.0.0.2", lo, &mac));
+
+    notify(RTM_DELNEIGH, "10.0.0.2", lo_index + 100, NULL);
+    socket_readable();
+    TEST_ASSERT_FALSE(lookup("10.0.0.2", NULL, &mac));
+}
+
+/* A neighbour with an all zero MAC is not an answer */
+void test_zero_mac(void)
+{
+    os_macaddr_t mac;
+
+    TEST_ASSERT_EQUAL_INT(0, nf_util_neigh_init(EV_DEFAULT));
+
+    notify(RTM_NEWNEIGH, "10.0.0.3", 2, g_mac_zero);
+    socket_readable();
+    TEST_ASSERT_FALSE(lookup("10.0.0.3", NULL, &mac));
+
+    notify(RTM_NEWNEIGH, "10.0.0.3", 2, g_mac_b);
+    socket_readable();
+    TEST_ASSERT_TRUE(lookup("10.0.0.3", NULL, &mac));
+    TEST_ASSERT_EQUAL_MEMORY(g_mac_b, &mac, sizeof(mac));
+}
+
+/* Lost notifications trigger a deferred dump, not one in the io callback */
+void test_enobufs_resync(void)
+{
+    struct ev_loop *loop = EV_DEFAULT;
+    os_macaddr_t mac;
+    int i;
+
+    kernel_add("10.0.0.4", 2, g_mac_a);
+    TEST_ASSERT_EQUAL_INT(0, nf_util_neigh_init(loop));
+    TEST_ASSERT_EQUAL_INT(1, g_dumps);
+
+    rx_push()->error = ENOBUFS;
+    socket_readable();
+    TEST_ASSERT_EQUAL_INT(1, g_dumps);
+
+    /* The table changed while the notifications were lost */
+    g_kernel_count = 0;
+    kernel_add("10.0.0.5", 2, g_mac_b);
+
+    for (i = 0; i < 100 && g_dumps == 1; i++) ev_run(loop, EVRUN_ONCE);
+    TEST_ASSERT_EQUAL_INT(2, g_dumps);
+
+    TEST_ASSERT_FALSE(lookup("10.0.0.4", NULL, &mac));
+    TEST_ASSERT_TRUE(lookup("10.0.0.5", NULL, &mac));
+    TEST_ASSERT_EQUAL_MEMORY(g_mac_b, &mac, sizeof(mac));
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_same_addr_two_ifaces);
+    RUN_TEST(test_zero_mac);
+    RUN_TEST(test_enobufs_resync);
+
+    return UNITY_END();
+}
@@ -0,0 +1,343 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <ev.h>
+#include <libmnl/libmnl.h>
+
+#include "log.h"
+#include "nf_utils.h"
+#include "target.h"
+#include "unity.h"
+
+const char *test_name = "nf_utils_tests";
+
+/* Size of the pending table of nf_conn_mark.c */
+#define MAX_PENDING 1024
+
+#define MAX_UPDATES (4 * MAX_PENDING)
+#define MAX_RX      64
+#define RX_BUF_SIZE 8192
+
+/*
+ * Netlink emulation: sent batches are parsed, and the ACKs handed to the
+ * library are queued by the tests, or by the send itself in auto ACK mode
+ */
+struct rx_entry
+{
+    int error;                  /* recvfrom() failure, no datagram */
+    size_t len;
+    char buf[RX_BUF_SIZE];
+};
+
+static struct rx_entry g_rx[MAX_RX];
+static size_t g_rx_head;
+static size_t g_rx_tail;
+static bool g_auto_ack;
+static uint32_t g_last_seq;
+static struct mnl_socket *g_nl;
+
+struct mnl_socket *__real_mnl_socket_open(int bus);
+
+struct mnl_socket *__wrap_mnl_socket_open(int bus)
+{
+    g_nl = __real_mnl_socket_open(bus);
+    return g_nl;
+}
+
+static struct rx_entry *rx_push(void)
+{
+    struct rx_entry *rx;
+
+    TEST_ASSERT_TRUE(g_rx_tail - g_rx_head < MAX_RX);
+    rx = &g_rx[g_rx_tail++ % MAX_RX];
+    memset(rx, 0, sizeof(*rx));
+
+    return rx;
+}
+
+static void rx_push_ack(struct rx_entry *rx, uint32_t seq, int error)
+{
+    struct nlmsgerr *err;
+    struct nlmsghdr *nlh;
+
+    TEST_ASSERT_TRUE(rx->len + MNL_ALIGN(NLMSG_LENGTH(sizeof(*err))) <= sizeof(rx->buf));
+
+    nlh = mnl_nlmsg_put_header(rx->buf + rx->len);
+    nlh->nlmsg_type = NLMSG_ERROR;
+    nlh->nlmsg_seq = seq;
+    err = mnl_nlmsg_put_extra_header(nlh, sizeof(*err));
+    err->error = error;
+    rx->len += nlh->nlmsg_len;
+}
+
+ssize_t __wrap_mnl_socket_sendto(const struct mnl_socket *nl, const void *buf, size_t len)
+{
+    const struct nlmsghdr *nlh = buf;
+    struct rx_entry *rx = NULL;
+    int left = (int)len;
+
+    (void)nl;
+
+    if (g_auto_ack) rx = rx_push();
+    while (mnl_nlmsg_ok(nlh, left))
+    {
+        g_last_seq = nlh->nlmsg_seq;
+        if (rx != NULL) rx_push_ack(rx, nlh->nlmsg_seq, 0);
+        nlh = mnl_nlmsg_next(nlh, &left);
+    }
+
+    return len;
+}
+
+ssize_t __wrap_mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf, size_t bufsiz)
+{
+    struct rx_entry *rx;
+
+    (void)nl;
+
+    if (g_rx_head == g_rx_tail)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    rx = &g_rx[g_rx_head++ % MAX_RX];
+    if (rx->error != 0)
+    {
+        errno = rx->error;
+        return -1;
+    }
+
+    TEST_ASSERT_TRUE(rx->len <= bufsiz);
+    memcpy(buf, rx->buf, rx->len);
+    return rx->len;
+}
+
+/* Outcome of each update, the callback context is its index */
+struct update
+{
+    int error;
+    int calls;
+};
+
+static struct update g_updates[MAX_UPDATES];
+static size_t g_queued;
+static size_t g_completed;
+static size_t g_max_in_flight;
+
+static void update_cb(int error, void *ctx)
+{
+    struct update *update = &g_updates[(intptr_t)ctx];
+
+    update->error = error;
+    update->calls++;
+    g_completed++;
+}
+
+static uint32_t queue_update(void)
+{
+    nf_flow_t flow;
+    size_t id;
+
+    memset(&flow, 0, sizeof(flow));
+    flow.family = AF_INET;
+    flow.proto = IPPROTO_TCP;
+    flow.addr.src_ip.ipv4.s_addr = htonl(0xc0a80002);
+    flow.addr.dst_ip.ipv4.s_addr = htonl(0x08080808);
+    flow.fields.port.src_port = htons(40000);
+    flow.fields.port.dst_port = htons(443);
+    flow.mark = 2;
+
+    id = g_queued++;
+    TEST_ASSERT_TRUE(id < MAX_UPDATES);
+    TEST_ASSERT_EQUAL_INT(0, nf_ct_batch_set_mark(&flow, update_cb, (void *)(intptr_t)id));
+
+    if (g_queued - g_completed > g_max_in_flight)
+        g_max_in_flight = g_queued - g_completed;
+
+    return id;
+}
+
+/* Lets the event loop process one readable event of the socket */
+static void socket_readable(void)
+{
+    struct ev_loop *loop = EV_DEFAULT;
+
+    ev_feed_fd_event(loop, mnl_socket_get_fd(g_nl), EV_READ);
+    ev_invoke_pending(loop);
+}
+
+void setUp(void)
+{
+    memset(g_updates, 0, sizeof(g_updates));
+    g_queued = 0;
+    g_completed = 0;
+    g_max_in_flight = 0;
+    g_rx_head = 0;
+    g_rx_tail = 0;
+    g_auto_ack = true;
+
+    TEST_ASSERT_EQUAL_INT(0, nf_ct_init(EV_DEFAULT));
+}
+
+void tearDown(void)
+{
+    nf_ct_exit();
+}
+
+void test_batch_ack(void)
+{
+    size_t i;
+
+    for (i = 0; i < 3; i++) queue_update();
+    TEST_ASSERT_EQUAL_INT(0, g_completed);
+
+    TEST_ASSERT_EQUAL_INT(0, nf_ct_batch_flush());
+    socket_readable();
+
+    for (i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, g_updates[i].calls);
+        TEST_ASSERT_EQUAL_INT(0, g_updates[i].error);
+    }
+}
+
+/*
+ * Many more updates than table slots without returning to the loop: the
+ * queued ACKs are read before a slot is reused, nothing times out
+ */
+void test_slot_reuse(void)
+{
+    size_t i;
+
+    for (i = 0; i < 3 * MAX_PENDING; i++) queue_update();
+
+    TEST_ASSERT_TRUE(g_max_in_flight <= MAX_PENDING);
+
+    nf_ct_batch_flush();
+    while (g_rx_head != g_rx_tail) socket_readable();
+
+    for (i = 0; i < g_queued; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, g_updates[i].calls);
+        TEST_ASSERT_EQUAL_INT(0, g_updates[i].error);
+    }
+}
+
+/* Only an update whose ACK never comes times out when its slot is reused */
+void test_slot_reuse_lost_ack(void)
+{
+    size_t lost;
+    size_t i;
+
+    g_auto_ack = false;
+    lost = queue_update();
+    nf_ct_batch_flush();
+    g_auto_ack = true;
+
+    for (i = 0; i < MAX_PENDING; i++) queue_update();
+
+    nf_ct_batch_flush();
+    while (g_rx_head != g_rx_tail) socket_readable();
+
+    TEST_ASSERT_EQUAL_INT(1, g_updates[lost].calls);
+    TEST_ASSERT_EQUAL_INT(-ETIMEDOUT, g_updates[lost].error);
+    for (i = lost + 1; i < g_queued; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, g_updates[i].calls);
+        TEST_ASSERT_EQUAL_INT(0, g_updates[i].error);
+    }
+}
+
+/*
+ * ACKs dropped by the kernel: the ACKs still queued are applied, the sent
+ * updates left without one are reported as unknown and the update not sent
+ * yet is kept
+ */
+void test_enobufs(void)
+{
+    struct rx_entry *rx;
+    uint32_t first;
+    size_t unsent;
+
+    g_auto_ack = false;
+    queue_update();
+    queue_update();
+    queue_update();
+    nf_ct_batch_flush();
+    first = g_last_seq - 2;
+
+    rx = rx_push();
+    rx_push_ack(rx, first, 0);
+    rx = rx_push();
+    rx->error = ENOBUFS;
+    rx = rx_push();
+    rx_push_ack(rx, first + 1, -ENOENT);
+
+    unsent = queue_update();
+
+    socket_readable();
+    TEST_ASSERT_EQUAL_INT(1, g_updates[0].calls);
+    TEST_ASSERT_EQUAL_INT(0, g_updates[0].error);
+    TEST_ASSERT_EQUAL_INT(0, g_updates[1].calls);
+
+    socket_readable();
+    TEST_ASSERT_EQUAL_INT(1, g_updates[1].calls);
+    TEST_ASSERT_EQUAL_INT(-ENOENT, g_updates[1].error);
+    TEST_ASSERT_EQUAL_INT(1, g_updates[2].calls);
+    TEST_ASSERT_EQUAL_INT(-ENOBUFS, g_updates[2].error);
+    TEST_ASSERT_EQUAL_INT(0, g_updates[unsent].calls);
+
+    g_auto_ack = true;
+    nf_ct_batch_flush();
+    socket_readable();
+    TEST_ASSERT_EQUAL_INT(1, g_updates[unsent].calls);
+    TEST_ASSERT_EQUAL_INT(0, g_updates[unsent].error);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_batch_ack);
+    RUN_TEST(test_slot_reuse);
+    RUN_TEST(test_slot_reuse_lost_ack);
+    RUN_TEST(test_enobufs);
+
+    return UNITY_END();
+}
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -34,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "execsh.h"
 
 #include "lnx_ip.h"
+#include "lnx_rtnl.h"
 
 #define LNX_IP_REALLOC_GROW    16
 
@@ -52,18 +54,19 @@ struct lnx_ip_route_gw_node
 
 static bool lnx_ip_addr_flush(lnx_ip_t *self);
 static bool lnx_ip_route_flush(lnx_ip_t *self);
+static void lnx_ip_status_resync(lnx_ip_t *self);
+static bool lnx_ip_addr_from_nlmsg(struct nlmsghdr *msg, int ifindex, osn_ip_addr_t *addr);
+static void lnx_ip_status_addr_update(lnx_ip_t *self, int type, const osn_ip_addr_t *addr);
 
 /* execsh commands */
-static char lnx_ip_addr_add_cmd[] = _S(ip address add "$2/$3" broadcast "+" dev "$1");
-static char lnx_ip_addr_flush_cmd[] = _S([ ! -e "/sys/class/net/$1" ] || ip -4 address flush dev "$1");
-
 static char lnx_ip_route_gw_add_cmd[] = _S(ip route add "$2" via "$3" dev "$1");
 
 /* Scope global doesn't flush "local" or "link" routes */
 static char lnx_ip_route_gw_flush_cmd[] = _S([ ! -e "/sys/class/net/$1" ] || ip -4 route flush dev "$1" scope global);
 
 static lnx_netlink_fn_t lnx_ip_nl_fn;
-static execsh_fn_t lnx_ip_addr_parse;
+static lnx_netlink_msg_fn_t lnx_ip_nl_msg_fn;
+static lnx_rtnl_dump_fn_t lnx_ip_addr_dump_fn;
 
 /*
  * Initialize Linux IP object instance
@@ -99,15 +102,23 @@ bool lnx_ip_init(lnx_ip_t *self, const char *ifname)
     }
 
     /* Install netlink filters */
-    lnx_netlink_set_events(&self->ip_nl, LNX_NETLINK_IP4ADDR);
+    lnx_netlink_set_events(&self->ip_nl, LNX_NETLINK_IP4ADDR | LNX_NETLINK_RESYNC);
     lnx_netlink_set_ifname(&self->ip_nl, self->ip_ifname);
+    lnx_netlink_set_msg_fn(&self->ip_nl, lnx_ip_nl_msg_fn);
 
+    /*
+     * Listen before dumping: changes that happen during the dump are queued
+     * on the netlink socket and applied incrementally on top of it
+     */
     if (!lnx_netlink_start(&self->ip_nl))
     {
         LOG(ERR, "ip: %s: Unable to start netlink object.", self->ip_ifname);
         return false;
     }
 
+    /* Acquire the initial address list */
+    lnx_ip_status_resync(self);
+
     return true;
 }
 
@@ -156,6 +167,12 @@ bool lnx_ip_fini(lnx_ip_t *self)
         free(rnode);
     }
 
+    /* Free status structure */
+    if (self->ip_status.is_addr != NULL)
+    {
+        free(self->ip_status.is_addr);
+    }
+
     return retval;
 }
 
@@ -182,10 +199,13 @@ bool lnx_ip_route_flush(lnx_ip_t *self)
  */
 bool lnx_ip_addr_flush(lnx_ip_t *self)
 {
-    int rc;
+    int ifindex;
 
-    rc = execsh_log(LOG_SEVERITY_DEBUG, lnx_ip_addr_flush_cmd, self->ip_ifname);
-    if (rc != 0)
+    /* Nothing to flush if the interface doesn't exist */
+    ifindex = if_nametoindex(self->ip_ifname);
+    if (ifindex == 0) return true;
+
+    if (!lnx_rtnl_addr_flush(AF_INET, ifindex))
     {
         LOG(WARN, "ip: %s: Unable to flush IPv4 addresses.", self->ip_ifname);
         return false;
@@ -201,10 +221,12 @@ bool lnx_ip_apply(lnx_ip_t *self)
 {
     struct lnx_ip_addr_node *node;
     struct lnx_ip_route_gw_node *rnode;
+    struct in_addr *pbrd;
+    struct in_addr brd;
 
     char saddr[OSN_IP_ADDR_LEN];
     char sgw[OSN_IP_ADDR_LEN];
-    char spref[C_INT32_LEN];
+    int ifindex;
     int rc;
 
     /* Start by issuing a flush */
@@ -212,18 +234,31 @@ bool lnx_ip_apply(lnx_ip_t *self)
     lnx_ip_route_flush(self);
 
     /* First apply IPv4 addresses */
+    ifindex = if_nametoindex(self->ip_ifname);
+    if (ifindex == 0 && ds_tree_head(&self->ip_addr_list) != NULL)
+    {
+        LOG(WARN, "ip: %s: Interface does not exist, unable to add IPv4 addresses.", self->ip_ifname);
+    }
+
     ds_tree_foreach(&self->ip_addr_list, node)
     {
-        if (inet_ntop(AF_INET, &node->addr.ia_addr, saddr, sizeof(saddr)) == NULL)
+        if (ifindex == 0) break;
+
+        /* Equivalent of "broadcast +" -- no broadcast address for /31 and /32 subnets */
+        pbrd = NULL;
+        if (node->addr.ia_prefix > 0 && node->addr.ia_prefix < 31)
         {
-            LOG(ERR, "ip: %s: Unable to convert IPv4 address, skipping add.", self->ip_ifname);
-            continue;
+            brd.s_addr = node->addr.ia_addr.s_addr | htonl(~(UINT32_MAX << (32 - node->addr.ia_prefix)));
+            pbrd = &brd;
         }
 
-        snprintf(spref, sizeof(spref), "%d", node->addr.ia_prefix);
-
-        rc = execsh_log(LOG_SEVERITY_DEBUG, lnx_ip_addr_add_cmd, self->ip_ifname, saddr, spref);
-        if (rc != 0)
+        if (!lnx_rtnl_addr_set(
+                RTM_NEWADDR,
+                AF_INET,
+                ifindex,
+                &node->addr.ia_addr,
+                node->addr.ia_prefix,
+                pbrd))
         {
             LOG(WARN, "ip: %s: Unable to add IPv4 address: "PRI_osn_ip_addr,
                     self->ip_ifname,
@@ -372,12 +407,12 @@ void lnx_ip_status_notify(lnx_ip_t *self, lnx_ip_status_fn_t *fn)
 }
 
 /*
- * Poll current interface status and call the set callback
+ * Re-read the full list of IPv4 addresses from the kernel using a RTM_GETADDR
+ * dump. This is done at initialization time and each time netlink events may
+ * have been lost; otherwise the address list is updated incrementally.
  */
-void lnx_ip_status_poll(lnx_ip_t *self)
+void lnx_ip_status_resync(lnx_ip_t *self)
 {
-    int rc;
-
     if (self->ip_status.is_addr != NULL)
     {
         free(self->ip_status.is_addr);
@@ -386,70 +421,95 @@ void lnx_ip_status_poll(lnx_ip_t *self)
     self->ip_status.is_addr = NULL;
     self->ip_status.is_addr_len = 0;
 
-    /*
-     * Execute the "ip -4 -o addr show IFNAME" command.
-     * The -o switch yields a more compact and easier to parse format.
-     */
-    rc = execsh_fn(lnx_ip_addr_parse, self, _S(ip -4 -o addr show dev "$1"), self->ip_ifname);
-    if (rc != 0)
+    /* The interface doesn't exist (yet), so it doesn't have any addresses */
+    self->ip_ifindex = if_nametoindex(self->ip_ifname);
+    if (self->ip_ifindex == 0) return;
+
+    if (!lnx_rtnl_dump(RTM_GETADDR, AF_INET, lnx_ip_addr_dump_fn, self))
     {
-        LOG(DEBUG, "ip: %s: Unable to acquire interface IPv4 address list. Exit code: %d",
-                self->ip_ifname,
-                rc);
+        LOG(DEBUG, "ip: %s: Unable to acquire interface IPv4 address list.", self->ip_ifname);
     }
 
     LOG(INFO, "ip: %s: Found %zu IPv4 address(es).", self->ip_ifname, self->ip_status.is_addr_len);
-
-    if (self->ip_status_fn != NULL)
-    {
-        self->ip_status_fn(self, &self->ip_status);
-    }
 }
 
 /**
- * Parse a single line of a "ip -o -4 addr show dev IF" output.
+ * Callback for the RTM_GETADDR dump
  */
-bool lnx_ip_addr_parse(void *data, int type, const char *line)
+bool lnx_ip_addr_dump_fn(void *ctx, struct nlmsghdr *msg)
 {
-    char buf[256];
-    char *pbuf;
-    char *sip4;
+    osn_ip_addr_t addr;
 
-    lnx_ip_t *self = data;
+    lnx_ip_t *self = ctx;
 
-    LOG(DEBUG, "ip: %s: ip_addr_show%s %s",
-            self->ip_ifname,
-            type == EXECSH_PIPE_STDOUT ? ">" : "|",
-            line);
+    if (!lnx_ip_addr_from_nlmsg(msg, self->ip_ifindex, &addr)) return true;
 
-    if (type != EXECSH_PIPE_STDOUT) return true;
+    lnx_ip_status_addr_update(self, RTM_NEWADDR, &addr);
 
-    STRSCPY(buf, line);
+    return true;
+}
 
-    /*
-     * Example output:
-     *
-     * # ip -o -4 addr show
-     * 20: br-wan    inet 10.77.204.196/24 brd 10.77.204.255 scope global br-wan\       valid_lft forever preferred_lft forever
-     * 21: br-home    inet 192.168.40.1/24 brd 192.168.40.255 scope global br-home\       valid_lft forever preferred_lft forever
-     */
+/**
+ * Convert a RTM_NEWADDR or RTM_DELADDR message to an osn_ip_addr_t structure.
+ * Returns false if the message is not an IPv4 address message or if it
+ * doesn't belong to the interface with index ifindex (if non-zero).
+ */
+bool lnx_ip_addr_from_nlmsg(struct nlmsghdr *msg, int ifindex, osn_ip_addr_t *addr)
+{
+    struct rtattr *tb[IFA_MAX + 1];
+    struct ifaddrmsg *ifa;
+    struct rtattr *rta;
 
-    /* Skip interface index */
-    strtok_r(buf, " ", &pbuf);
+    if (msg->nlmsg_type != RTM_NEWADDR && msg->nlmsg_type != RTM_DELADDR) return false;
+    if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa))) return false;
 
-    /* Skip interface name */
-    strtok_r(NULL, " ", &pbuf);
+    ifa = NLMSG_DATA(msg);
+    if (ifa->ifa_family != AF_INET) return false;
+    if (ifindex != 0 && (int)ifa->ifa_index != ifindex) return false;
 
-    /* Skip "inet" */
-    strtok_r(NULL, " ", &pbuf);
+    lnx_rtnl_attr_parse(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(msg));
 
-    /* IPv4 address, includes the netmask (prefix) */
-    sip4 = strtok_r(NULL, " ", &pbuf);
+    /* IFA_LOCAL is the interface address, IFA_ADDRESS is the peer address on point-to-point links */
+    rta = tb[IFA_LOCAL] != NULL ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    if (rta == NULL || RTA_PAYLOAD(rta) < sizeof(addr->ia_addr)) return false;
+
+    *addr = OSN_IP_ADDR_INIT;
+    memcpy(&addr->ia_addr, RTA_DATA(rta), sizeof(addr->ia_addr));
+    addr->ia_prefix = ifa->ifa_prefixlen;
+
+    return true;
+}
+
+/*
+ * Add (RTM_NEWADDR) or remove (RTM_DELADDR) an address from the status
+ * address list
+ */
+void lnx_ip_status_addr_update(lnx_ip_t *self, int type, const osn_ip_addr_t *addr)
+{
+    size_t ii;
 
     struct osn_ip_status *is = &self->ip_status;
 
+    for (ii = 0; ii < is->is_addr_len; ii++)
+    {
+        if (osn_ip_addr_cmp(&is->is_addr[ii], (void *)addr) == 0) break;
+    }
+
+    if (type == RTM_DELADDR)
+    {
+        if (ii >= is->is_addr_len) return;
+
+        /* Order is not important, move the last element into the free slot */
+        is->is_addr[ii] = is->is_addr[is->is_addr_len - 1];
+        is->is_addr_len--;
+        return;
+    }
+
+    /* Address already present */
+    if (ii < is->is_addr_len) return;
+
     /*
-     * Resize array in OSN_IP_REALLOC_GROW increments
+     * Resize array in LNX_IP_REALLOC_GROW increments
      */
     if ((is->is_addr_len % LNX_IP_REALLOC_GROW) == 0)
     {
@@ -458,19 +518,30 @@ bool lnx_ip_addr_parse(void *data, int type, const char *line)
                 (is->is_addr_len + LNX_IP_REALLOC_GROW) * sizeof(is->is_addr[0]));
     }
 
-    if (!osn_ip_addr_from_str(&is->is_addr[is->is_addr_len], sip4))
-    {
-        LOG(WARN, "ip: %s: Error parsing IPv4 addresses -- invalid IPv4 address \"%s\" on line: %s",
-                self->ip_ifname,
-                sip4,
-                line);
+    is->is_addr[is->is_addr_len++] = *addr;
+}
 
-        return true;
-    }
+/*
+ * Raw netlink message callback -- apply address changes to the status
+ * structure as they arrive. The status callback is invoked later from the
+ * (debounced) lnx_ip_nl_fn() callback.
+ */
+void lnx_ip_nl_msg_fn(lnx_netlink_t *nl, uint64_t event, struct nlmsghdr *msg)
+{
+    osn_ip_addr_t addr;
 
-    is->is_addr_len++;
+    (void)event;
 
-    return true;
+    lnx_ip_t *self = CONTAINER_OF(nl, lnx_ip_t, ip_nl);
+
+    if (!lnx_ip_addr_from_nlmsg(msg, 0, &addr)) return;
+
+    LOG(DEBUG, "ip: %s: IPv4 address %s: "PRI_osn_ip_addr,
+            self->ip_ifname,
+            msg->nlmsg_type == RTM_NEWADDR ? "added" : "removed",
+            FMT_osn_ip_addr(addr));
+
+    lnx_ip_status_addr_update(self, msg->nlmsg_type, &addr);
 }
 
 /*
@@ -480,9 +551,17 @@ bool lnx_ip_addr_parse(void *data, int type, const char *line)
 void lnx_ip_nl_fn(lnx_netlink_t *nl, uint64_t event, const char *ifname)
 {
     (void)ifname;
-    (void)event;
 
     lnx_ip_t *self = CONTAINER_OF(nl, lnx_ip_t, ip_nl);
 
-    lnx_ip_status_poll(self);
+    /* Netlink messages may have been lost, re-read the full address list */
+    if (event & LNX_NETLINK_RESYNC)
+    {
+        lnx_ip_status_resync(self);
+    }
+
+    if (self->ip_status_fn != NULL)
+    {
+        self->ip_status_fn(self, &self->ip_status);
+    }
 }
@@ -46,6 +46,7 @@ typedef void lnx_ip_status_fn_t(lnx_ip_t *ip, struct osn_ip_status *status);
 struct lnx_ip
 {
     char                    ip_ifname[C_IFNAME_LEN];        /* Interface name */
+    int                     ip_ifindex;                     /* Interface index at last resync */
     ds_tree_t               ip_addr_list;                   /* List of IPv4 addresses */
     ds_tree_t               ip_dns_list;                    /* List of DNS addresses */
     ds_tree_t               ip_route_gw_list;               /* Gateway routes */
@@ -25,14 +25,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/neighbour.h>
 #include <stdlib.h>
 #include <errno.h>
 
 #include "log.h"
 #include "util.h"
-#include "execsh.h"
 
 #include "lnx_ip6.h"
+#include "lnx_rtnl.h"
 
 /*
  * Specify the increment by which dynamic arrays are grown each time they
@@ -40,6 +42,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #define LNX_IP6_REALLOC_GROW    16
 
+/* Netlink representation of an infinite address lifetime */
+#define LNX_IP6_INFINITY_LFT    0xFFFFFFFFU
+
 struct lnx_ip6_addr_node
 {
     osn_ip6_addr_t          addr;                       /* IPv6 address */
@@ -49,11 +54,15 @@ struct lnx_ip6_addr_node
 };
 
 static bool lnx_ip6_addr_flush(lnx_ip6_t *self);
-static bool lnx_ip6_ipaddr_parse(void *_self, int type, const char *line);
-static void lnx_ip6_status_ipaddr_update(lnx_ip6_t *self);
-static bool lnx_ip6_neigh_parse(void *_self, int type, const char *line);
-static void lnx_ip6_status_neigh_update(lnx_ip6_t *self);
+static void lnx_ip6_status_resync(lnx_ip6_t *self);
+static bool lnx_ip6_addr_from_nlmsg(struct nlmsghdr *msg, int ifindex, osn_ip6_addr_t *addr);
+static bool lnx_ip6_neigh_from_nlmsg(struct nlmsghdr *msg, int ifindex, struct osn_ip6_neigh *neigh, bool *valid);
+static void lnx_ip6_status_addr_update(lnx_ip6_t *self, bool add, const osn_ip6_addr_t *addr);
+static void lnx_ip6_status_neigh_update(lnx_ip6_t *self, bool add, const struct osn_ip6_neigh *neigh);
+static lnx_rtnl_dump_fn_t lnx_ip6_addr_dump_fn;
+static lnx_rtnl_dump_fn_t lnx_ip6_neigh_dump_fn;
 static lnx_netlink_fn_t lnx_ip6_nl_fn;
+static lnx_netlink_msg_fn_t lnx_ip6_nl_msg_fn;
 
 /*
  * Initialize new Linux IPv6 object
@@ -80,8 +89,9 @@ bool lnx_ip6_init(lnx_ip6_t *self, const char *ifname)
 
     /* Initialize the netlink event object */
     lnx_netlink_init(&self->ip6_nl, lnx_ip6_nl_fn);
-    lnx_netlink_set_events(&self->ip6_nl, LNX_NETLINK_IP6ADDR | LNX_NETLINK_IP6NEIGH);
+    lnx_netlink_set_events(&self->ip6_nl, LNX_NETLINK_IP6ADDR | LNX_NETLINK_IP6NEIGH | LNX_NETLINK_RESYNC);
     lnx_netlink_set_ifname(&self->ip6_nl, ifname);
+    lnx_netlink_set_msg_fn(&self->ip6_nl, lnx_ip6_nl_msg_fn);
 
     /* Start listening to netlink events */
     lnx_netlink_start(&self->ip6_nl);
@@ -141,9 +151,6 @@ bool lnx_ip6_fini(lnx_ip6_t *self)
     return true;
 }
 
-static char ip6_del_cmd[] = _S(ip -6 address del "$2/$3" dev "$1");
-static char ip6_add_cmd[] = _S(ip -6 address add "$2/$3" dev "$1");
-
 /*
  * Flush all configured IPv6 interfaces
  *
@@ -154,10 +161,10 @@ static char ip6_add_cmd[] = _S(ip -6 address add "$2/$3" dev "$1");
 bool lnx_ip6_addr_flush(lnx_ip6_t *self)
 {
     struct lnx_ip6_addr_node *node;
-    char saddr[OSN_IP6_ADDR_LEN];
-    char spref[C_INT32_LEN];
     ds_tree_iter_t iter;
-    int rc;
+    int ifindex;
+
+    ifindex = if_nametoindex(self->ip6_ifname);
 
     ds_tree_foreach_iter(&self->ip6_addr_list, node, &iter)
     {
@@ -171,17 +178,14 @@ bool lnx_ip6_addr_flush(lnx_ip6_t *self)
          */
         if (node->active)
         {
-            /* Remove IP from the system */
-            //snprintf(saddr, sizeof(saddr),  PRI(in6_addr), FMT(in6_addr, node->addr.ia6_addr));
-            if (inet_ntop(AF_INET6, &node->addr.ia6_addr, saddr, sizeof(saddr)) == NULL)
-            {
-                LOG(ERR, "ip6: %s: Unable to convert IPv6 address, skipping delete.", self->ip6_ifname);
-            }
-
-            snprintf(spref, sizeof(spref), "%d", node->addr.ia6_prefix);
-
-            rc = execsh_log(LOG_SEVERITY_DEBUG, ip6_del_cmd, self->ip6_ifname, saddr, spref);
-            if (rc != 0)
+            /* Remove IP from the system; if the interface is gone, so is the address */
+            if (ifindex != 0 && !lnx_rtnl_addr_set(
+                    RTM_DELADDR,
+                    AF_INET6,
+                    ifindex,
+                    &node->addr.ia6_addr,
+                    node->addr.ia6_prefix,
+                    NULL))
             {
                 LOG(WARN, "ip6: %s: Unable to remove IPv6 address: "PRI_osn_ip6_addr,
                         self->ip6_ifname,
@@ -208,25 +212,27 @@ bool lnx_ip6_addr_flush(lnx_ip6_t *self)
 bool lnx_ip6_apply(lnx_ip6_t *self)
 {
     struct lnx_ip6_addr_node *node;
-    char saddr[C_IPV6ADDR_LEN];
-    char spref[C_INT32_LEN];
-    int rc;
+    int ifindex;
 
     /* Start by issuing a flush */
     lnx_ip6_addr_flush(self);
 
-    ds_tree_foreach(&self->ip6_addr_list, node)
+    ifindex = if_nametoindex(self->ip6_ifname);
+    if (ifindex == 0 && ds_tree_head(&self->ip6_addr_list) != NULL)
     {
-        if (inet_ntop(AF_INET6, &node->addr.ia6_addr, saddr, sizeof(saddr)) == NULL)
-        {
-            LOG(ERR, "ip6: %s: Unable to convert IPv6 address, skipping add.", self->ip6_ifname);
-            continue;
-        }
-
-        snprintf(spref, sizeof(spref), "%d", node->addr.ia6_prefix);
+        LOG(WARN, "ip6: %s: Interface does not exist, unable to add IPv6 addresses.", self->ip6_ifname);
+        return true;
+    }
 
-        rc = execsh_log(LOG_SEVERITY_DEBUG, ip6_add_cmd, self->ip6_ifname, saddr, spref);
-        if (rc != 0)
+    ds_tree_foreach(&self->ip6_addr_list, node)
+    {
+        if (!lnx_rtnl_addr_set(
+                RTM_NEWADDR,
+                AF_INET6,
+                ifindex,
+                &node->addr.ia6_addr,
+                node->addr.ia6_prefix,
+                NULL))
         {
             LOG(WARN, "ip6: %s: Unable to add IPv6 address: "PRI_osn_ip6_addr,
                     self->ip6_ifname,
@@ -300,258 +306,296 @@ bool lnx_ip6_dns_del(lnx_ip6_t *ip6, const osn_ip6_addr_t *addr)
     return false;
 }
 
-/**
- * Parse a single line of a "ip -o -6 addr show dev IF" output.
+/*
+ * Re-read the full list of IPv6 addresses and neighbors from the kernel using
+ * RTM_GETADDR and RTM_GETNEIGH dumps. This is done when the status callback
+ * is registered and each time netlink events may have been lost; otherwise
+ * the status is updated incrementally from netlink events.
  */
-bool lnx_ip6_ipaddr_parse(void *_self, int type, const char *line)
+void lnx_ip6_status_resync(lnx_ip6_t *self)
 {
-    char *svalid_lft;
-    char *spref_lft;
-    char buf[256];
-    char *pbuf;
-    char *sip6;
-    int lft;
+    if (self->ip6_status.is6_addr != NULL)
+    {
+        free(self->ip6_status.is6_addr);
+    }
+    self->ip6_status.is6_addr_len = 0;
+    self->ip6_status.is6_addr = NULL;
+
+    if (self->ip6_status.is6_neigh != NULL)
+    {
+        free(self->ip6_status.is6_neigh);
+    }
+    self->ip6_status.is6_neigh_len = 0;
+    self->ip6_status.is6_neigh = NULL;
 
-    lnx_ip6_t *self = _self;
+    /* The interface doesn't exist (yet), it cannot have addresses or neighbors */
+    self->ip6_ifindex = if_nametoindex(self->ip6_ifname);
+    if (self->ip6_ifindex == 0) return;
+
+    if (!lnx_rtnl_dump(RTM_GETADDR, AF_INET6, lnx_ip6_addr_dump_fn, self))
+    {
+        LOG(DEBUG, "ip6: %s: Unable to acquire IPv6 address list.", self->ip6_ifname);
+    }
+
+    if (!lnx_rtnl_dump(RTM_GETNEIGH, AF_INET6, lnx_ip6_neigh_dump_fn, self))
+    {
+        LOG(DEBUG, "ip6: %s: Unable to acquire IPv6 neighbor list. Neighbor report may be incomplete.",
+                self->ip6_ifname);
+    }
 
-    LOG(DEBUG, "ip6: %s: ip_addr_show%s %s",
+    LOG(INFO, "ip6: %s: Found %zu IPv6 address(es) and %zu neighbor(s).",
             self->ip6_ifname,
-            type == EXECSH_PIPE_STDOUT ? ">" : "|",
-            line);
+            self->ip6_status.is6_addr_len,
+            self->ip6_status.is6_neigh_len);
+}
 
-    if (type != EXECSH_PIPE_STDOUT) return true;
+bool lnx_ip6_addr_dump_fn(void *ctx, struct nlmsghdr *msg)
+{
+    osn_ip6_addr_t addr;
 
-    STRSCPY(buf, line);
+    lnx_ip6_t *self = ctx;
 
-    /*
-     * Example output:
-     *
-     * # ip -o -6 addr show dev br-wan
-     * 20: br-wan    inet6 2a00:ee2:1704:9901::2000/128 scope global dynamic \       valid_lft 237sec preferred_lft 124sec
-     * 20: br-wan    inet6 fe80::62b4:f7ff:fef0:15c8/64 scope link \       valid_lft forever preferred_lft forever
-     */
+    if (!lnx_ip6_addr_from_nlmsg(msg, self->ip6_ifindex, &addr)) return true;
 
-    /* Skip interface index */
-    strtok_r(buf, " ", &pbuf);
+    lnx_ip6_status_addr_update(self, true, &addr);
 
-    /* Skip interface name */
-    strtok_r(NULL, " ", &pbuf);
+    return true;
+}
 
-    /* Skip "inet6" */
-    strtok_r(NULL, " ", &pbuf);
+bool lnx_ip6_neigh_dump_fn(void *ctx, struct nlmsghdr *msg)
+{
+    struct osn_ip6_neigh neigh;
+    bool valid;
 
-    /* IPv6 address, includes the prefix */
-    sip6 = strtok_r(NULL, " ", &pbuf);
+    lnx_ip6_t *self = ctx;
 
-    /*
-     * It seems that there's a variable amount of keywords after the IPv6 address
-     * Skip all keywords until we encounter the "valid_lft" string
-     */
-    while ((svalid_lft = strtok_r(NULL, " ", &pbuf)) != NULL)
-    {
-        if (strcmp(svalid_lft, "valid_lft") == 0) break;
-    }
+    if (!lnx_ip6_neigh_from_nlmsg(msg, self->ip6_ifindex, &neigh, &valid)) return true;
+    if (!valid) return true;
 
-    /* Parse the vlaid_lft value */
-    svalid_lft = strtok_r(NULL, " ", &pbuf);
+    lnx_ip6_status_neigh_update(self, true, &neigh);
 
-    /* Skip "preferred_lft" */
-    strtok_r(NULL, " ", &pbuf);
+    return true;
+}
 
-    /* Skip "preferred_lft" */
-    spref_lft = strtok_r(NULL, " ", &pbuf);
+/*
+ * Convert a netlink address lifetime to the osn_ip6_addr_t representation:
+ * negative means infinite, INT_MIN means expired/unknown.
+ */
+static int lnx_ip6_lft(uint32_t lft)
+{
+    if (lft == LNX_IP6_INFINITY_LFT) return -1;
+    if (lft == 0 || lft > INT_MAX) return INT_MIN;
+    return (int)lft;
+}
 
-    struct osn_ip6_status *is = &self->ip6_status;
+/**
+ * Convert a RTM_NEWADDR or RTM_DELADDR message to an osn_ip6_addr_t structure.
+ * Returns false if the message is not an IPv6 address message or if it
+ * doesn't belong to the interface with index ifindex (if non-zero).
+ */
+bool lnx_ip6_addr_from_nlmsg(struct nlmsghdr *msg, int ifindex, osn_ip6_addr_t *addr)
+{
+    struct rtattr *tb[IFA_MAX + 1];
+    struct ifa_cacheinfo *ci;
+    struct ifaddrmsg *ifa;
+    struct rtattr *rta;
 
-    /*
-     * Resize array in OSN_IP6_REALLOC_GROW increments
-     */
-    if ((is->is6_addr_len % LNX_IP6_REALLOC_GROW) == 0)
-    {
-        is->is6_addr = realloc(
-                is->is6_addr,
-                (is->is6_addr_len + LNX_IP6_REALLOC_GROW) * sizeof(is->is6_addr[0]));
-    }
+    if (msg->nlmsg_type != RTM_NEWADDR && msg->nlmsg_type != RTM_DELADDR) return false;
+    if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa))) return false;
 
-    if (!osn_ip6_addr_from_str(&is->is6_addr[is->is6_addr_len], sip6))
-    {
-        LOG(WARN, "ip6: %s: Error parsing IPv6 addresses -- invalid IPv6 address \"%s\" on line: %s",
-                self->ip6_ifname,
-                sip6,
-                line);
-        return true;
-    }
+    ifa = NLMSG_DATA(msg);
+    if (ifa->ifa_family != AF_INET6) return false;
+    if (ifindex != 0 && (int)ifa->ifa_index != ifindex) return false;
 
-    if (strcmp(svalid_lft, "infinite") == 0)
-    {
-        is->is6_addr[is->is6_addr_len].ia6_valid_lft = -1;
-    }
-    else
-    {
-        lft = atol(svalid_lft);
-        if (lft == 0) lft = INT_MIN;
-        is->is6_addr[is->is6_addr_len].ia6_valid_lft = lft;
-    }
+    lnx_rtnl_attr_parse(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(msg));
 
-    if (strcmp(spref_lft, "infinite") == 0)
-    {
-        is->is6_addr[is->is6_addr_len].ia6_pref_lft = -1;
-    }
-    else
-    {
-        lft = atol(spref_lft);
-        if (lft == 0) lft = INT_MIN;
-        is->is6_addr[is->is6_addr_len].ia6_pref_lft = lft;
-    }
+    rta = tb[IFA_LOCAL] != NULL ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    if (rta == NULL || RTA_PAYLOAD(rta) < sizeof(addr->ia6_addr)) return false;
 
-    LOG(DEBUG, "ip6: %s: IPv6 address = "PRI_osn_ip6_addr,
-            self->ip6_ifname,
-            FMT_osn_ip6_addr(is->is6_addr[is->is6_addr_len]));
+    *addr = OSN_IP6_ADDR_INIT;
+    memcpy(&addr->ia6_addr, RTA_DATA(rta), sizeof(addr->ia6_addr));
+    addr->ia6_prefix = ifa->ifa_prefixlen;
 
-    is->is6_addr_len++;
+    if (tb[IFA_CACHEINFO] != NULL && RTA_PAYLOAD(tb[IFA_CACHEINFO]) >= sizeof(*ci))
+    {
+        ci = RTA_DATA(tb[IFA_CACHEINFO]);
+        addr->ia6_pref_lft = lnx_ip6_lft(ci->ifa_prefered);
+        addr->ia6_valid_lft = lnx_ip6_lft(ci->ifa_valid);
+    }
 
     return true;
 }
 
-void lnx_ip6_status_ipaddr_update(lnx_ip6_t *self)
+/**
+ * Convert a RTM_NEWNEIGH or RTM_DELNEIGH message to a osn_ip6_neigh
+ * structure. `valid` is set to false if the entry was deleted or is not
+ * reachable (FAILED, INCOMPLETE or without a link-layer address).
+ */
+bool lnx_ip6_neigh_from_nlmsg(
+        struct nlmsghdr *msg,
+        int ifindex,
+        struct osn_ip6_neigh *neigh,
+        bool *valid)
 {
-    int rc;
+    struct rtattr *tb[NDA_MAX + 1];
+    struct ndmsg *ndm;
 
-    if (self->ip6_status.is6_addr != NULL)
-    {
-        free(self->ip6_status.is6_addr);
-    }
-    self->ip6_status.is6_addr_len = 0;
-    self->ip6_status.is6_addr = NULL;
+    if (msg->nlmsg_type != RTM_NEWNEIGH && msg->nlmsg_type != RTM_DELNEIGH) return false;
+    if (msg->nlmsg_len < NLMSG_LENGTH(sizeof(*ndm))) return false;
+
+    ndm = NLMSG_DATA(msg);
+    if (ndm->ndm_family != AF_INET6) return false;
+    if (ifindex != 0 && ndm->ndm_ifindex != ifindex) return false;
 
-    rc = execsh_fn(lnx_ip6_ipaddr_parse, self, _S(ip -6 -o addr show dev "$1"), self->ip6_ifname);
-    if (rc != 0)
+    lnx_rtnl_attr_parse(tb, NDA_MAX, RTM_RTA(ndm), RTM_PAYLOAD(msg));
+
+    if (tb[NDA_DST] == NULL || RTA_PAYLOAD(tb[NDA_DST]) < sizeof(neigh->i6n_ipaddr.ia6_addr)) return false;
+
+    neigh->i6n_ipaddr = OSN_IP6_ADDR_INIT;
+    neigh->i6n_hwaddr = OSN_MAC_ADDR_INIT;
+    memcpy(&neigh->i6n_ipaddr.ia6_addr, RTA_DATA(tb[NDA_DST]), sizeof(neigh->i6n_ipaddr.ia6_addr));
+
+    /* Same filtering as "ip -6 neigh show" -- skip FAILED, INCOMPLETE and NOARP entries */
+    *valid = msg->nlmsg_type == RTM_NEWNEIGH &&
+            !(ndm->ndm_state & (NUD_FAILED | NUD_INCOMPLETE | NUD_NOARP)) &&
+            tb[NDA_LLADDR] != NULL &&
+            RTA_PAYLOAD(tb[NDA_LLADDR]) == sizeof(neigh->i6n_hwaddr.ma_addr);
+
+    if (*valid)
     {
-        LOG(DEBUG, "ip6: %s: Unable to acquire IPv6 address list. Exit code: %d",
-                self->ip6_ifname,
-                rc);
+        memcpy(neigh->i6n_hwaddr.ma_addr, RTA_DATA(tb[NDA_LLADDR]), sizeof(neigh->i6n_hwaddr.ma_addr));
     }
 
-    LOG(INFO, "ip6: %s: Found %zu IPv6 address(es).", self->ip6_ifname, self->ip6_status.is6_addr_len);
+    return true;
 }
-/**
- * Parse a single line of a "ip -6 neigh show" output.
+
+/*
+ * Add/update or remove an address in the status address list
  */
-bool lnx_ip6_neigh_parse(void *_self, int type, const char *line)
+void lnx_ip6_status_addr_update(lnx_ip6_t *self, bool add, const osn_ip6_addr_t *addr)
 {
-    char buf[256];
-    char *pbuf;
-    char *saddr;
-    char *smac;
-    char *sll;
+    size_t ii;
 
-    lnx_ip6_t *self = _self;
+    struct osn_ip6_status *is = &self->ip6_status;
 
-    LOG(DEBUG, "ip6: %s: ip_neigh_show%s %s",
-            self->ip6_ifname,
-            type == EXECSH_PIPE_STDOUT ? ">" : "|",
-            line);
-
-    if (type != EXECSH_PIPE_STDOUT) return true;
-
-    STRSCPY(buf, line);
-
-    /*
-     * Example output:
-     *
-     * fe80::ae1f:6bff:feb0:55ef lladdr ac:1f:6b:b0:55:ef router STALE
-     */
-    saddr = strtok_r(buf, " ", &pbuf);
-
-    /*
-     * The next string may contain "lladdr" or "FAILED" -- skip this whole line
-     * if the next entry is not "lladdr"
-     */
-    sll = strtok_r(NULL, " ", &pbuf);
-    if (strcmp(sll, "lladdr") != 0)
+    for (ii = 0; ii < is->is6_addr_len; ii++)
     {
-        /* Skip this entry */
-        return true;
+        if (osn_ip6_addr_nolft_cmp(&is->is6_addr[ii], (void *)addr) == 0) break;
     }
 
-    /* Parse the MAC */
-    smac = strtok_r(NULL, " ", &pbuf);
-
-    if (smac == NULL || saddr == NULL)
+    if (!add)
     {
-        LOG(WARN, "ip6: %s: Error parsing IPv6 neighbor output: %s",
-                self->ip6_ifname,
-                line);
-        return true;
+        if (ii >= is->is6_addr_len) return;
+
+        /* Order is not important, move the last element into the free slot */
+        is->is6_addr[ii] = is->is6_addr[is->is6_addr_len - 1];
+        is->is6_addr_len--;
+        return;
     }
 
-    if (strcmp(smac, "FAILED") == 0)
+    if (ii >= is->is6_addr_len)
     {
-        /* ip -6 neigh flush may trigger this condition */
-        return true;
+        /*
+         * Resize array in LNX_IP6_REALLOC_GROW increments
+         */
+        if ((is->is6_addr_len % LNX_IP6_REALLOC_GROW) == 0)
+        {
+            is->is6_addr = realloc(
+                    is->is6_addr,
+                    (is->is6_addr_len + LNX_IP6_REALLOC_GROW) * sizeof(is->is6_addr[0]));
+        }
+
+        is->is6_addr_len++;
     }
 
+    /* Insert new entry or update lifetimes of an existing one */
+    is->is6_addr[ii] = *addr;
+}
+
+/*
+ * Add/update or remove a neighbor in the status neighbor list
+ */
+void lnx_ip6_status_neigh_update(lnx_ip6_t *self, bool add, const struct osn_ip6_neigh *neigh)
+{
+    size_t ii;
+
     struct osn_ip6_status *is = &self->ip6_status;
 
-    /*
-     * Resize array in OSN_IP6_REALLOC_GROW increments
-     */
-    if ((is->is6_neigh_len % LNX_IP6_REALLOC_GROW) == 0)
+    for (ii = 0; ii < is->is6_neigh_len; ii++)
     {
-        is->is6_neigh = realloc(
-                is->is6_neigh,
-                (is->is6_neigh_len + LNX_IP6_REALLOC_GROW) * sizeof(is->is6_neigh[0]));
+        if (memcmp(&is->is6_neigh[ii].i6n_ipaddr.ia6_addr,
+                    &neigh->i6n_ipaddr.ia6_addr,
+                    sizeof(neigh->i6n_ipaddr.ia6_addr)) == 0)
+        {
+            break;
+        }
     }
 
-    if (!osn_ip6_addr_from_str(&is->is6_neigh[is->is6_neigh_len].i6n_ipaddr, saddr))
+    if (!add)
     {
-        LOG(WARN, "ip6: %s: Error parsing IPv6 neighbor report -- invalid IPv6 address \"%s\" on line: %s",
-                self->ip6_ifname,
-                saddr,
-                line);
-        return true;
+        if (ii >= is->is6_neigh_len) return;
+
+        is->is6_neigh[ii] = is->is6_neigh[is->is6_neigh_len - 1];
+        is->is6_neigh_len--;
+        return;
     }
 
-    if (!osn_mac_addr_from_str(&is->is6_neigh[is->is6_neigh_len].i6n_hwaddr, smac))
+    if (ii >= is->is6_neigh_len)
     {
-        LOG(WARN, "ip6: %s: Error parsing IPv6 neighbor report -- invalid MAC \"%s\" on line: %s",
-                self->ip6_ifname,
-                smac,
-                line);
-        return true;
-    }
+        if ((is->is6_neigh_len % LNX_IP6_REALLOC_GROW) == 0)
+        {
+            is->is6_neigh = realloc(
+                    is->is6_neigh,
+                    (is->is6_neigh_len + LNX_IP6_REALLOC_GROW) * sizeof(is->is6_neigh[0]));
+        }
 
-    is->is6_neigh_len++;
+        is->is6_neigh_len++;
+    }
 
-    return true;
+    /* Insert new entry or update the MAC address of an existing one */
+    is->is6_neigh[ii] = *neigh;
 }
 
-void lnx_ip6_status_neigh_update(lnx_ip6_t *self)
+/**
+ * Raw netlink message callback. Address and neighbor changes are applied to
+ * the status structure as they arrive; the status callback is invoked later
+ * from the (debounced) lnx_ip6_nl_fn() callback.
+ */
+void lnx_ip6_nl_msg_fn(lnx_netlink_t *nl, uint64_t event, struct nlmsghdr *msg)
 {
-    int rc;
+    struct osn_ip6_neigh neigh;
+    osn_ip6_addr_t addr;
+    bool valid;
 
-    if (self->ip6_status.is6_neigh != NULL)
-    {
-        free(self->ip6_status.is6_neigh);
-    }
-    self->ip6_status.is6_neigh_len = 0;
-    self->ip6_status.is6_neigh = NULL;
+    lnx_ip6_t *self = CONTAINER_OF(nl, lnx_ip6_t, ip6_nl);
 
-    rc = execsh_fn(lnx_ip6_neigh_parse, self, _S(ip -6 neigh show dev "$1"), self->ip6_ifname);
-    if (rc != 0)
+    if (event & LNX_NETLINK_IP6ADDR)
     {
-        LOG(DEBUG, "ip6: %s: \"ip -6 neigh show\" returned error %d. Neighbor report may be incomplete.",
+        if (!lnx_ip6_addr_from_nlmsg(msg, 0, &addr)) return;
+
+        LOG(DEBUG, "ip6: %s: IPv6 address %s: "PRI_osn_ip6_addr,
                 self->ip6_ifname,
-                rc);
+                msg->nlmsg_type == RTM_NEWADDR ? "added" : "removed",
+                FMT_osn_ip6_addr(addr));
+
+        lnx_ip6_status_addr_update(self, msg->nlmsg_type == RTM_NEWADDR, &addr);
     }
 
-    LOG(INFO, "ip6: %s: Found %zu neighbor(s).", self->ip6_ifname, self->ip6_status.is6_neigh_len);
+    if (event & LNX_NETLINK_IP6NEIGH)
+    {
+        if (!lnx_ip6_neigh_from_nlmsg(msg, 0, &neigh, &valid)) return;
+
+        lnx_ip6_status_neigh_update(self, valid, &neigh);
+    }
 }
 
 /**
  * Netlink event callback. This function is subscribed to the following events:
  *      - LNX_NETLINK_IP6ADDR
  *      - LNX_NETLINK_IP6NEIGH
+ *      - LNX_NETLINK_RESYNC
+ *
+ * Address and neighbor changes were already applied by lnx_ip6_nl_msg_fn().
  *
  * This callback actually triggers the status notification callback of the
  * osn_ip6_t object.
@@ -564,18 +608,11 @@ void lnx_ip6_nl_fn(lnx_netlink_t *nl, uint64_t event, const char *ifname)
 
     if (self->ip6_status_fn == NULL) return;
 
-    if (event & LNX_NETLINK_IP6ADDR)
-    {
-        /* Update IPv6 addresses */
-        LOG(DEBUG, "ip6: %s: Updating IPv6 addresses.", self->ip6_ifname);
-        lnx_ip6_status_ipaddr_update(self);
-    }
-
-    if (event & LNX_NETLINK_IP6NEIGH)
+    /* Netlink messages may have been lost, re-read the full state */
+    if (event & LNX_NETLINK_RESYNC)
     {
-        /* Update IPv6 neighbors */
-        LOG(DEBUG, "ip6: %s: Update IPv6 neighbors.", self->ip6_ifname);
-        lnx_ip6_status_neigh_update(self);
+        LOG(DEBUG, "ip6: %s: Resyncing IPv6 addresses and neighbors.", self->ip6_ifname);
+        lnx_ip6_status_resync(self);
     }
 
     self->ip6_status_fn(self, &self->ip6_status);
@@ -588,8 +625,7 @@ void lnx_ip6_status_notify(lnx_ip6_t *self, lnx_ip6_status_fn_t *fn)
     if (self->ip6_status_fn == NULL) return;
 
     /* Update interface status and call the callback right away */
-    lnx_ip6_status_ipaddr_update(self);
-    lnx_ip6_status_neigh_update(self);
+    lnx_ip6_status_resync(self);
 
     self->ip6_status_fn(self, &self->ip6_status);
 }
@@ -40,6 +40,7 @@ typedef void lnx_ip6_status_fn_t(lnx_ip6_t *self, struct osn_ip6_status *status)
 struct lnx_ip6
 {
     char                    ip6_ifname[C_IFNAME_LEN];   /* Interface name */
+    int                     ip6_ifindex;                /* Interface index at last resync */
     ds_tree_t               ip6_addr_list;              /* List of IPv6 addresses */
     ds_tree_t               ip6_dns_list;               /* List of DNS addresses */
     lnx_netlink_t           ip6_nl;                     /* Netlink event object */
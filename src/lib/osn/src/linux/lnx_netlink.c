@@ -68,6 +68,8 @@ static void lnx_netlink_sock_fn(struct ev_loop *loop, ev_io *ev, int revent);
 
 /* Schedule an event to be dispatched */
 static bool lnx_netlink_dispatch(uint64_t nl_event, const char *ifname);
+/* Immediately forward a raw message to listeners that registered a message callback */
+static void lnx_netlink_dispatch_msg(uint64_t nl_event, const char *ifname, struct nlmsghdr *nl_msg);
 /* Handler of the debounce timer -- this will actually dispatch pending events */
 static void lnx_netlink_dispatch_fn(struct ev_loop *loop, ev_debounce *ev, int revent);
 /* Filter out unwanted netlink messages as they cause too many  updates */
@@ -125,6 +127,11 @@ void lnx_netlink_set_ifname(lnx_netlink_t *self, const char *ifname)
     STRSCPY(self->nl_ifname, ifname);
 }
 
+void lnx_netlink_set_msg_fn(lnx_netlink_t *self, lnx_netlink_msg_fn_t *fn)
+{
+    self->nl_msg_fn = fn;
+}
+
 /*
  * Global initialization
  */
@@ -313,12 +320,14 @@ void lnx_netlink_sock_fn(struct ev_loop *loop, ev_io *w, int revent)
                     case AF_INET:
                         LOG(DEBUG, "netlink: LNX_NETLINK_IP4ADDR event on interface: %s",
                                 pifname == NULL ? "(null)" : pifname);
+                        lnx_netlink_dispatch_msg(LNX_NETLINK_IP4ADDR, pifname, nl_msg);
                         lnx_netlink_dispatch(LNX_NETLINK_IP4ADDR, pifname);
                         break;
 
                     case AF_INET6:
                         LOG(DEBUG, "netlink: LNX_NETLINK_IP6ADDR event on interface: %s",
                                 pifname == NULL ? "(null)" : pifname);
+                        lnx_netlink_dispatch_msg(LNX_NETLINK_IP6ADDR, pifname, nl_msg);
                         lnx_netlink_dispatch(LNX_NETLINK_IP6ADDR, pifname);
                         break;
 
@@ -352,12 +361,14 @@ void lnx_netlink_sock_fn(struct ev_loop *loop, ev_io *w, int revent)
                     case AF_INET:
                         LOG(DEBUG, "netlink: LNX_NETLINK_IP4NEIGH event on interface: %s",
                                 pifname == NULL ? "(null)" : pifname);
+                        lnx_netlink_dispatch_msg(LNX_NETLINK_IP4NEIGH, pifname, nl_msg);
                         lnx_netlink_dispatch(LNX_NETLINK_IP4NEIGH, pifname);
                         break;
 
                     case AF_INET6:
                         LOG(DEBUG, "netlink: LNX_NETLINK_IP6NEIGH event on interface: %s",
                                 pifname == NULL ? "(null)" : pifname);
+                        lnx_netlink_dispatch_msg(LNX_NETLINK_IP6NEIGH, pifname, nl_msg);
                         lnx_netlink_dispatch(LNX_NETLINK_IP6NEIGH, pifname);
                         break;
 
@@ -448,23 +459,61 @@ bool lnx_netlink_weed_out(struct nlmsghdr *nh)
     return false;
 }
 
-bool lnx_netlink_dispatch(uint64_t events, const char *ifname)
+/*
+ * Check if the listener is interested in the event on interface ifname
+ */
+static bool lnx_netlink_match(lnx_netlink_t *nl, uint64_t events, const char *ifname)
+{
+    if ((nl->nl_events & events) == 0) return false;
+
+    /* If ifname is NULL or empty, disregard the nl->nl_ifname filter */
+    if (ifname != NULL &&
+            ifname[0] != '\0' &&
+            nl->nl_ifname[0] != '\0')
+    {
+        if (strcmp(ifname, nl->nl_ifname) != 0) return false;
+    }
+
+    return true;
+}
+
+void lnx_netlink_dispatch_msg(uint64_t events, const char *ifname, struct nlmsghdr *nl_msg)
 {
     lnx_netlink_t *nl;
 
-    /* Traverse list of registered listeners and do a delayed dispatch */
     ds_dlist_foreach(&lnx_netlink_list, nl)
     {
-        if ((nl->nl_events & events) == 0) continue;
-
-        /* If ifname is NULL or empty, disregard the nl->nl_ifname filter */
-        if (ifname != NULL &&
-                ifname[0] != '\0' &&
-                nl->nl_ifname[0] != '\0')
+        if (nl->nl_msg_fn == NULL) continue;
+
+        /*
+         * The interface index could not be resolved (typically the interface
+         * was just deleted) so the message cannot be matched against the
+         * interface filter -- request a full refresh instead.
+         */
+        if (ifname == NULL)
         {
-            if (strcmp(ifname, nl->nl_ifname) != 0) continue;
+            if (nl->nl_events & events)
+            {
+                nl->nl_pending |= nl->nl_events & LNX_NETLINK_RESYNC;
+            }
+            continue;
         }
 
+        if (!lnx_netlink_match(nl, events, ifname)) continue;
+
+        nl->nl_msg_fn(nl, events, nl_msg);
+    }
+}
+
+bool lnx_netlink_dispatch(uint64_t events, const char *ifname)
+{
+    lnx_netlink_t *nl;
+
+    /* Traverse list of registered listeners and do a delayed dispatch */
+    ds_dlist_foreach(&lnx_netlink_list, nl)
+    {
+        if (!lnx_netlink_match(nl, events, ifname)) continue;
+
         nl->nl_pending |= nl->nl_events & events;
     }
 
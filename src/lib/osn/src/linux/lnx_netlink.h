@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <linux/netlink.h>
 
 #include "const.h"
 #include "ds_tree.h"
@@ -41,11 +42,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LNX_NETLINK_IP6ROUTE    (1 << 4)    /* IPv6 route events */
 #define LNX_NETLINK_IP4NEIGH    (1 << 5)    /* IPv4 neighbor report */
 #define LNX_NETLINK_IP6NEIGH    (1 << 6)    /* IPv6 neighbor report */
+#define LNX_NETLINK_RESYNC      (1 << 7)    /* Events may have been lost, full state refresh required */
 #define LNX_NETLINK_ALL         UINT64_MAX
 
 typedef struct lnx_netlink lnx_netlink_t;
 
 typedef void lnx_netlink_fn_t(lnx_netlink_t *nl, uint64_t event, const char *ifname);
+typedef void lnx_netlink_msg_fn_t(lnx_netlink_t *nl, uint64_t event, struct nlmsghdr *msg);
 
 struct lnx_netlink
 {
@@ -54,6 +57,7 @@ struct lnx_netlink
     uint64_t            nl_events;                  /* Subscribed events */
     char                nl_ifname[C_IFNAME_LEN];    /* Filter events for this interface */
     lnx_netlink_fn_t   *nl_fn;                      /* Callback */
+    lnx_netlink_msg_fn_t *nl_msg_fn;                /* Raw message callback (not debounced) */
     ds_tree_node_t      nl_tnode;
 };
 
@@ -76,6 +80,18 @@ void lnx_netlink_set_events(lnx_netlink_t *self, uint64_t events);
  */
 void lnx_netlink_set_ifname(lnx_netlink_t *self, const char *ifname);
 
+/**
+ * Install a raw message callback. The callback is invoked immediately (not
+ * debounced) for each RTM_NEWADDR/RTM_DELADDR/RTM_NEWNEIGH/RTM_DELNEIGH
+ * message that matches the event and interface filters. This allows
+ * listeners to apply changes incrementally instead of re-polling the full
+ * state on each event.
+ *
+ * Listeners using this callback should also subscribe to LNX_NETLINK_RESYNC;
+ * this event is raised when netlink messages may have been lost.
+ */
+void lnx_netlink_set_msg_fn(lnx_netlink_t *self, lnx_netlink_msg_fn_t *fn);
+
 /**
  * Start receiving events
  */
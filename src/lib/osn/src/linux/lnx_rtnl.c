@@ -0,0 +1,401 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * ===========================================================================
+ *  This module implements synchronous RTNETLINK requests (address
+ *  manipulation and table dumps) over a persistent NETLINK socket. It
+ *  replaces the iproute2 shell-outs that were previously used by the
+ *  lnx_ip and lnx_ip6 modules.
+ *
+ *  This is an private module and is not part of the OpenSync Networking API.
+ * ===========================================================================
+ */
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "log.h"
+#include "util.h"
+
+#include "lnx_rtnl.h"
+
+/*
+ * Size of the receive buffer; the kernel uses up to 32kB per message batch
+ * when dumping tables
+ */
+#define LNX_RTNL_RECV_BUF_SZ    32768
+
+/* Maximum size of a single request (header + address attributes) */
+#define LNX_RTNL_REQ_SZ         256
+
+/* Array grow increment for address flush lists */
+#define LNX_RTNL_REALLOC_GROW   16
+
+/* Persistent RTNETLINK request socket */
+static int lnx_rtnl_sock = -1;
+/* Request sequence number */
+static uint32_t lnx_rtnl_seq = 0;
+/* Receive buffer */
+static uint8_t lnx_rtnl_buf[LNX_RTNL_RECV_BUF_SZ];
+
+/*
+ * Address entry, used to collect addresses during a dump before flushing them
+ */
+struct lnx_rtnl_addr
+{
+    int                     ra_prefix;
+    uint8_t                 ra_addr[sizeof(struct in6_addr)];
+};
+
+struct lnx_rtnl_flush_ctx
+{
+    int                     fc_family;
+    int                     fc_ifindex;
+    struct lnx_rtnl_addr   *fc_addr;
+    size_t                  fc_addr_len;
+};
+
+static bool lnx_rtnl_sock_open(void);
+static void lnx_rtnl_sock_close(void);
+static bool lnx_rtnl_request(struct nlmsghdr *nh, lnx_rtnl_dump_fn_t *fn, void *ctx);
+static bool lnx_rtnl_attr_add(struct nlmsghdr *nh, size_t maxlen, int type, const void *data, size_t len);
+static lnx_rtnl_dump_fn_t lnx_rtnl_addr_flush_fn;
+
+bool lnx_rtnl_dump(int type, int family, lnx_rtnl_dump_fn_t *fn, void *ctx)
+{
+    struct
+    {
+        struct nlmsghdr     nh;
+        struct rtgenmsg     gen;
+    }
+    req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.gen));
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.gen.rtgen_family = family;
+
+    return lnx_rtnl_request(&req.nh, fn, ctx);
+}
+
+bool lnx_rtnl_addr_set(
+        int type,
+        int family,
+        int ifindex,
+        const void *addr,
+        int prefix,
+        const void *brd)
+{
+    struct nlmsghdr *nh;
+    struct ifaddrmsg *ifa;
+    size_t alen;
+
+    uint8_t req[NLMSG_SPACE(LNX_RTNL_REQ_SZ)];
+
+    switch (family)
+    {
+        case AF_INET:
+            alen = sizeof(struct in_addr);
+            break;
+
+        case AF_INET6:
+            alen = sizeof(struct in6_addr);
+            break;
+
+        default:
+            LOG(ERR, "rtnl: Unsupported address family: %d", family);
+            return false;
+    }
+
+    memset(req, 0, sizeof(req));
+
+    nh = (struct nlmsghdr *)req;
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    nh->nlmsg_type = type;
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (type == RTM_NEWADDR)
+    {
+        /* Behave like "ip address replace" so re-adding an address is not an error */
+        nh->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+    }
+
+    ifa = NLMSG_DATA(nh);
+    ifa->ifa_family = family;
+    ifa->ifa_prefixlen = prefix;
+    ifa->ifa_index = ifindex;
+    ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+
+    if (!lnx_rtnl_attr_add(nh, sizeof(req), IFA_LOCAL, addr, alen) ||
+            !lnx_rtnl_attr_add(nh, sizeof(req), IFA_ADDRESS, addr, alen))
+    {
+        return false;
+    }
+
+    if (brd != NULL && !lnx_rtnl_attr_add(nh, sizeof(req), IFA_BROADCAST, brd, alen))
+    {
+        return false;
+    }
+
+    return lnx_rtnl_request(nh, NULL, NULL);
+}
+
+bool lnx_rtnl_addr_flush(int family, int ifindex)
+{
+    struct lnx_rtnl_flush_ctx fc;
+    size_t ii;
+
+    bool retval = true;
+
+    memset(&fc, 0, sizeof(fc));
+    fc.fc_family = family;
+    fc.fc_ifindex = ifindex;
+
+    /*
+     * Collect the addresses first -- new requests cannot be issued on the
+     * socket while a dump is in progress
+     */
+    if (!lnx_rtnl_dump(RTM_GETADDR, family, lnx_rtnl_addr_flush_fn, &fc))
+    {
+        LOG(ERR, "rtnl: Error dumping addresses of interface index %d.", ifindex);
+        retval = false;
+        goto exit;
+    }
+
+    for (ii = 0; ii < fc.fc_addr_len; ii++)
+    {
+        if (!lnx_rtnl_addr_set(
+                RTM_DELADDR,
+                family,
+                ifindex,
+                fc.fc_addr[ii].ra_addr,
+                fc.fc_addr[ii].ra_prefix,
+                NULL))
+        {
+            retval = false;
+        }
+    }
+
+exit:
+    if (fc.fc_addr != NULL) free(fc.fc_addr);
+
+    return retval;
+}
+
+void lnx_rtnl_attr_parse(struct rtattr *tb[], int max, struct rtattr *rta, int len)
+{
+    memset(tb, 0, sizeof(struct rtattr *) * (max + 1));
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type > max) continue;
+        tb[rta->rta_type] = rta;
+    }
+}
+
+/*
+ * ===========================================================================
+ *  Private functions
+ * ===========================================================================
+ */
+bool lnx_rtnl_sock_open(void)
+{
+    struct sockaddr_nl nladdr;
+
+    if (lnx_rtnl_sock >= 0) return true;
+
+    lnx_rtnl_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (lnx_rtnl_sock < 0)
+    {
+        LOG(ERR, "rtnl: Error creating NETLINK socket: %s", strerror(errno));
+        return false;
+    }
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    if (bind(lnx_rtnl_sock, (struct sockaddr *)&nladdr, sizeof(nladdr)) != 0)
+    {
+        LOG(ERR, "rtnl: Error binding NETLINK socket: %s", strerror(errno));
+        lnx_rtnl_sock_close();
+        return false;
+    }
+
+    return true;
+}
+
+void lnx_rtnl_sock_close(void)
+{
+    if (lnx_rtnl_sock < 0) return;
+
+    close(lnx_rtnl_sock);
+    lnx_rtnl_sock = -1;
+}
+
+/*
+ * Send a request and process the response. If fn is NULL, the request is
+ * expected to return an ACK, otherwise fn is called for each message in
+ * the (multi-part) response.
+ */
+bool lnx_rtnl_request(struct nlmsghdr *nh, lnx_rtnl_dump_fn_t *fn, void *ctx)
+{
+    struct sockaddr_nl nladdr;
+    struct nlmsghdr *msg;
+    struct nlmsgerr *err;
+    size_t msg_len;
+    ssize_t rc;
+
+    bool retval = true;
+
+    if (!lnx_rtnl_sock_open()) return false;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    nh->nlmsg_seq = ++lnx_rtnl_seq;
+
+    rc = sendto(lnx_rtnl_sock, nh, nh->nlmsg_len, 0, (struct sockaddr *)&nladdr, sizeof(nladdr));
+    if (rc < 0)
+    {
+        LOG(ERR, "rtnl: Error sending request: %s", strerror(errno));
+        goto error;
+    }
+
+    for (;;)
+    {
+        rc = recv(lnx_rtnl_sock, lnx_rtnl_buf, sizeof(lnx_rtnl_buf), 0);
+        if (rc < 0)
+        {
+            if (errno == EINTR) continue;
+            LOG(ERR, "rtnl: Error receiving response: %s", strerror(errno));
+            goto error;
+        }
+
+        for (msg = (void *)lnx_rtnl_buf, msg_len = (size_t)rc;
+                NLMSG_OK(msg, msg_len);
+                msg = NLMSG_NEXT(msg, msg_len))
+        {
+            /* Skip stale responses from previous (aborted) requests */
+            if (msg->nlmsg_seq != nh->nlmsg_seq) continue;
+
+            switch (msg->nlmsg_type)
+            {
+                case NLMSG_DONE:
+                    return retval;
+
+                case NLMSG_ERROR:
+                    err = NLMSG_DATA(msg);
+                    if (err->error == 0) return retval;
+
+                    errno = -err->error;
+                    LOG(DEBUG, "rtnl: Request type %d failed: %s", nh->nlmsg_type, strerror(errno));
+                    return false;
+
+                default:
+                    /* If the callback aborted the dump, keep draining the socket until NLMSG_DONE */
+                    if (fn != NULL && retval)
+                    {
+                        retval = fn(ctx, msg);
+                    }
+                    break;
+            }
+        }
+    }
+
+error:
+    /* The socket may contain partial responses, start fresh on next request */
+    lnx_rtnl_sock_close();
+    return false;
+}
+
+bool lnx_rtnl_attr_add(struct nlmsghdr *nh, size_t maxlen, int type, const void *data, size_t len)
+{
+    struct rtattr *rta;
+
+    if (NLMSG_ALIGN(nh->nlmsg_len) + RTA_SPACE(len) > maxlen)
+    {
+        LOG(ERR, "rtnl: Request buffer too small, unable to add attribute %d.", type);
+        return false;
+    }
+
+    rta = (struct rtattr *)((uint8_t *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_SPACE(len);
+
+    return true;
+}
+
+bool lnx_rtnl_addr_flush_fn(void *ctx, struct nlmsghdr *msg)
+{
+    struct rtattr *tb[IFA_MAX + 1];
+    struct lnx_rtnl_flush_ctx *fc;
+    struct lnx_rtnl_addr *addr;
+    struct ifaddrmsg *ifa;
+    struct rtattr *rta;
+
+    fc = ctx;
+
+    if (msg->nlmsg_type != RTM_NEWADDR) return true;
+
+    ifa = NLMSG_DATA(msg);
+    if (ifa->ifa_family != fc->fc_family) return true;
+    if ((int)ifa->ifa_index != fc->fc_ifindex) return true;
+
+    lnx_rtnl_attr_parse(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(msg));
+
+    rta = tb[IFA_LOCAL] != NULL ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+    if (rta == NULL || RTA_PAYLOAD(rta) > sizeof(fc->fc_addr[0].ra_addr)) return true;
+
+    if ((fc->fc_addr_len % LNX_RTNL_REALLOC_GROW) == 0)
+    {
+        addr = realloc(
+                fc->fc_addr,
+                (fc->fc_addr_len + LNX_RTNL_REALLOC_GROW) * sizeof(fc->fc_addr[0]));
+        if (addr == NULL)
+        {
+            /* Abort the dump, the addresses collected so far are freed by the caller */
+            LOG(ERR, "rtnl: Error allocating the address flush list.");
+            return false;
+        }
+        fc->fc_addr = addr;
+    }
+
+    memcpy(fc->fc_addr[fc->fc_addr_len].ra_addr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+    fc->fc_addr[fc->fc_addr_len].ra_prefix = ifa->ifa_prefixlen;
+    fc->fc_addr_len++;
+
+    return true;
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * ===========================================================================
+ *  Synchronous RTNETLINK request helpers
+ *
+ *  This is an private module and is not part of the OpenSync Networking API.
+ * ===========================================================================
+ */
+#ifndef LNX_RTNL_H_INCLUDED
+#define LNX_RTNL_H_INCLUDED
+
+#include <stdbool.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * Callback invoked for each message received as a response to a dump
+ * request. Returning false aborts the dump.
+ */
+typedef bool lnx_rtnl_dump_fn_t(void *ctx, struct nlmsghdr *msg);
+
+/**
+ * Dump a RTNETLINK table. @p type should be one of the RTM_GET* messages that
+ * support the NLM_F_DUMP flag (RTM_GETADDR, RTM_GETNEIGH, ...), @p family is
+ * the address family (AF_INET, AF_INET6, AF_UNSPEC).
+ *
+ * The @p fn callback is invoked for each message in the response.
+ */
+bool lnx_rtnl_dump(int type, int family, lnx_rtnl_dump_fn_t *fn, void *ctx);
+
+/**
+ * Add (RTM_NEWADDR) or remove (RTM_DELADDR) an IP address on the interface
+ * with index @p ifindex. @p addr must point to a struct in_addr or
+ * struct in6_addr, depending on @p family.
+ *
+ * If @p brd is not NULL it's used as the IPv4 broadcast address.
+ */
+bool lnx_rtnl_addr_set(
+        int type,
+        int family,
+        int ifindex,
+        const void *addr,
+        int prefix,
+        const void *brd);
+
+/**
+ * Remove all addresses of family @p family from interface @p ifindex.
+ */
+bool lnx_rtnl_addr_flush(int family, int ifindex);
+
+/**
+ * Parse a list of RTNETLINK attributes into a table indexed by attribute
+ * type. Attributes with types greater than @p max are ignored.
+ */
+void lnx_rtnl_attr_parse(struct rtattr *tb[], int max, struct rtattr *rta, int len);
+
+#endif /* LNX_RTNL_H_INCLUDED */
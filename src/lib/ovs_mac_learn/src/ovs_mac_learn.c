@@ -25,12 +25,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <regex.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <jansson.h>
 
 #include "const.h"
 #include "log.h"
 #include "ds_tree.h"
+#include "ds_dlist.h"
 #include "os_regex.h"
 #include "os_util.h"
 #include "os_nif.h"
@@ -42,7 +50,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MODULE_ID LOG_MODULE_ID_MAIN
 
-#define OVSMAC_PERIODIC_TIMER   5000                    /**< Periodic timer in ms */
+#define OVSMAC_PERIODIC_TIMER   1000                    /**< Periodic timer in ms */
+
+#if !defined(OVSMAC_OVS_RUNDIR)
+#define OVSMAC_OVS_RUNDIR       "/var/run/openvswitch"  /**< ovs-vswitchd run-time directory */
+#endif
+
+#define OVSMAC_CTL_BUF_GROW     4096                    /**< unixctl receive buffer grow increment */
+#define OVSMAC_CTL_REQ_TIMEOUT  5.0                     /**< unixctl request deadline in seconds */
+
+/*
+ * Pending fdb/show request on the ovs-vswitchd unixctl connection
+ */
+struct ovsmac_ctl_req
+{
+    int                         rq_id;                  /**< JSON-RPC request id */
+    char                        rq_brname[128];         /**< Bridge name */
+    ev_tstamp                   rq_deadline;            /**< Reply deadline */
+    ds_dlist_node_t             rq_node;
+};
 
 
 static ovsdb_update_monitor_t   bridge_mon;
@@ -56,6 +82,24 @@ static ovsdb_update_cbk_t       iface_mon_fn;
 static ev_timer                 ovsmac_timer;                   /* Periodic refresh timer */
 static regex_t                  ovs_appctl_re;
 static bool                     ovsmac_scan_br(char *brif);
+static void                     ovsmac_parse_line(char *brif, char *line);
+
+/* Persistent unixctl JSON-RPC connection to ovs-vswitchd */
+static int                      ovsmac_ctl_fd = -1;
+static ev_io                    ovsmac_ctl_io;
+static int                      ovsmac_ctl_id = 0;
+static char                    *ovsmac_ctl_buf = NULL;
+static size_t                   ovsmac_ctl_buf_len = 0;
+static size_t                   ovsmac_ctl_buf_sz = 0;
+static ds_dlist_t               ovsmac_ctl_req_list = DS_DLIST_INIT(struct ovsmac_ctl_req, rq_node);
+
+static bool ovsmac_ctl_open(void);
+static void ovsmac_ctl_close(void);
+static void ovsmac_ctl_check_timeout(void);
+static bool ovsmac_ctl_fdb_show(char *brif);
+static void ovsmac_ctl_read_fn(struct ev_loop *loop, ev_io *w, int revents);
+static size_t ovsmac_ctl_msg_len(const char *buf, size_t len);
+static void ovsmac_ctl_reply(json_t *jrpc);
 
 static ds_key_cmp_t ovsmac_cmp_fn;                              /* Key function for ovsmac_node structure s*/
 
@@ -66,13 +110,14 @@ static void  ovsmac_timer_fn(
 
 static char *ovsmac_find_ofport_name(char *brif, int ofport);
 
-static void ovsmac_node_reset();
+static void ovsmac_node_reset(const char *brname);
 static void ovsmac_node_update(
         char *brname,
         char *ifname,
         int vlan,
         os_macaddr_t macaddr);
-static void ovsmac_node_flush();
+static void ovsmac_node_flush(const char *brname);
+static void ovsmac_node_prune(void);
 static bool ovsmac_check_iface_flt(char *iface);
 static bool ovsmac_check_bridge_flt(char *bridge);
 
@@ -220,15 +265,34 @@ void ovsmac_timer_fn(struct ev_loop *loop, ev_timer *w, int revents)
 
     LOG(DEBUG, "OVSMAC: Periodic.");
 
-    ovsmac_node_reset();
+    /* Remove entries of bridges that are no longer scanned */
+    ovsmac_node_prune();
 
-    ds_tree_foreach(&bridge_list, br)
+    /* A stuck ovs-vswitchd connection is dropped and reopened below */
+    ovsmac_ctl_check_timeout();
+
+    /*
+     * Query ovs-vswitchd over the persistent unixctl connection; replies are
+     * processed asynchronously by ovsmac_ctl_read_fn(). If ovs-vswitchd cannot
+     * be reached this way, revert to running ovs-appctl.
+     */
+    if (!ovsmac_ctl_open())
     {
-        if (true == ovsmac_check_bridge_flt(br->br_bridge.name))
-            ovsmac_scan_br(br->br_bridge.name);
+        LOG(DEBUG, "OVSMAC: unixctl connection not available, using ovs-appctl.");
     }
 
-    ovsmac_node_flush();
+    ds_tree_foreach(&bridge_list, br)
+    {
+        if (!ovsmac_check_bridge_flt(br->br_bridge.name)) continue;
+
+        if (ovsmac_ctl_fd >= 0 && ovsmac_ctl_fdb_show(br->br_bridge.name)) continue;
+
+        ovsmac_node_reset(br->br_bridge.name);
+        if (ovsmac_scan_br(br->br_bridge.name))
+        {
+            ovsmac_node_flush(br->br_bridge.name);
+        }
+    }
 }
 
 bool ovsmac_scan_br(char *brif)
@@ -260,75 +324,426 @@ bool ovsmac_scan_br(char *brif)
 
     while (fgets(buf, sizeof(buf), ovs_appctl) != NULL)
     {
-        char *ifname;
-        char sofport[16];
-        char svlan[16];
-        char smac[18];
+        ovsmac_parse_line(brif, buf);
+    }
+
+    ret = true;
+err_close:
+    pclose(ovs_appctl);
+    return ret;
+}
+
+/**
+ * Parse a single line of the "fdb/show" output and update the cache.
+ *
+ * Example output:
+ *
+ *  port  VLAN  MAC                Age
+ *     1     0  60:b4:f7:f0:15:c8    4
+ * LOCAL     0  60:b4:f7:f0:15:c9    1
+ */
+void ovsmac_parse_line(char *brif, char *buf)
+{
+    char *ifname;
+    char sofport[16];
+    char svlan[16];
+    char smac[18];
 
-        regmatch_t rem[16];
+    regmatch_t rem[16];
 
-        if (regexec(&ovs_appctl_re, buf, ARRAY_LEN(rem), rem, 0) != 0)
+    if (regexec(&ovs_appctl_re, buf, ARRAY_LEN(rem), rem, 0) != 0)
+    {
+        LOG(ERR, "Error parsing ovs-appctl output: %s\n", buf);
+        return;
+    }
+
+    os_reg_match_cpy(sofport, sizeof(sofport), buf, rem[1]);
+    os_reg_match_cpy(svlan, sizeof(svlan), buf, rem[2]);
+    os_reg_match_cpy(smac, sizeof(smac), buf, rem[3]);
+
+    long ofport;
+    long vlan;
+    os_macaddr_t mac;
+
+    if (!os_atol(svlan, &vlan))
+    {
+        LOG(ERR, "OVSMAC: ovs-appctl: Invalid VLAN: %s", svlan);
+        return;
+    }
+
+    if (!os_nif_macaddr_from_str(&mac, smac))
+    {
+        LOG(ERR, "OVSMAC: Invalid MAC addres: %s", smac);
+        return;
+    }
+
+    if (strcmp(sofport, "LOCAL") == 0)
+    {
+        ifname = brif;
+    }
+    else
+    {
+        if (!os_atol(sofport, &ofport))
         {
-            LOG(ERR, "Error parsing ovs-appctl output: %s\n", buf);
-            continue;
+            LOG(ERR, "OVSMAC: ovs-appctl: Invalid ofport: %s", sofport);
+            return;
         }
 
-        os_reg_match_cpy(sofport, sizeof(sofport), buf, rem[1]);
-        os_reg_match_cpy(svlan, sizeof(svlan), buf, rem[2]);
-        os_reg_match_cpy(smac, sizeof(smac), buf, rem[3]);
+        ifname = ovsmac_find_ofport_name(brif, ofport);
+        if (ifname == NULL)
+        {
+            LOG(ERR, "OVSMAC: Unknown ofport %ld in bridge: %s", ofport, brif);
+            return;
+        }
+    }
+
+    LOG(DEBUG, "bridge:%s ofport:%s vlan:%s mac:%s\n", brif, ifname, svlan, smac);
+
+    /*
+     * Check if given interface is in interface filter list
+     * Ethernet clients are connected to eth0 interface
+     */
+    if (true == ovsmac_check_iface_flt(ifname))
+    {
+        ovsmac_node_update(brif, ifname, vlan, mac);
+    }
+}
+
+/*
+ * ===========================================================================
+ *  ovs-vswitchd unixctl (JSON-RPC) connection
+ * ===========================================================================
+ */
+
+/**
+ * Connect to the ovs-vswitchd control socket, OVSMAC_OVS_RUNDIR/ovs-vswitchd.PID.ctl
+ */
+bool ovsmac_ctl_open(void)
+{
+    struct sockaddr_un addr;
+    char pidfile[256];
+    FILE *fpid;
+    long pid;
+    int fd;
+
+    if (ovsmac_ctl_fd >= 0) return true;
+
+    snprintf(pidfile, sizeof(pidfile), "%s/ovs-vswitchd.pid", OVSMAC_OVS_RUNDIR);
+
+    fpid = fopen(pidfile, "r");
+    if (fpid == NULL)
+    {
+        LOG(DEBUG, "OVSMAC: Unable to open ovs-vswitchd pid file: %s", pidfile);
+        return false;
+    }
+
+    if (fscanf(fpid, "%ld", &pid) != 1)
+    {
+        LOG(DEBUG, "OVSMAC: Invalid ovs-vswitchd pid file: %s", pidfile);
+        fclose(fpid);
+        return false;
+    }
+    fclose(fpid);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/ovs-vswitchd.%ld.ctl", OVSMAC_OVS_RUNDIR, pid) >=
+            (int)sizeof(addr.sun_path))
+    {
+        LOG(ERR, "OVSMAC: unixctl socket path too long.");
+        return false;
+    }
 
-        long ofport;
-        long vlan;
-        os_macaddr_t mac;
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG(ERR, "OVSMAC: Unable to create unixctl socket: %s", strerror(errno));
+        return false;
+    }
 
-        if (!os_atol(svlan, &vlan))
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        LOG(DEBUG, "OVSMAC: Unable to connect to %s: %s", addr.sun_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        LOG(ERR, "OVSMAC: Unable to set unixctl socket to non-blocking mode: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    ovsmac_ctl_fd = fd;
+    ovsmac_ctl_buf_len = 0;
+
+    ev_io_init(&ovsmac_ctl_io, ovsmac_ctl_read_fn, ovsmac_ctl_fd, EV_READ);
+    ev_io_start(EV_DEFAULT, &ovsmac_ctl_io);
+
+    LOG(INFO, "OVSMAC: Connected to ovs-vswitchd: %s", addr.sun_path);
+
+    return true;
+}
+
+void ovsmac_ctl_close(void)
+{
+    struct ovsmac_ctl_req *rq;
+    ds_dlist_iter_t iter;
+
+    if (ovsmac_ctl_fd < 0) return;
+
+    ev_io_stop(EV_DEFAULT, &ovsmac_ctl_io);
+    close(ovsmac_ctl_fd);
+    ovsmac_ctl_fd = -1;
+    ovsmac_ctl_buf_len = 0;
+
+    /* Drop pending requests, the cache is left as is until the next successful scan */
+    for (rq = ds_dlist_ifirst(&iter, &ovsmac_ctl_req_list); rq != NULL; rq = ds_dlist_inext(&iter))
+    {
+        ds_dlist_iremove(&iter);
+        free(rq);
+    }
+
+    LOG(INFO, "OVSMAC: Disconnected from ovs-vswitchd.");
+}
+
+/**
+ * Close the connection if the oldest pending request has not been answered
+ * within OVSMAC_CTL_REQ_TIMEOUT; replies are sent in request order so the
+ * head of the list is the one to check.
+ */
+void ovsmac_ctl_check_timeout(void)
+{
+    struct ovsmac_ctl_req *rq;
+
+    rq = ds_dlist_head(&ovsmac_ctl_req_list);
+    if (rq == NULL || ev_now(EV_DEFAULT) < rq->rq_deadline) return;
+
+    LOG(WARNING, "OVSMAC: fdb/show %s timed out, resetting unixctl connection.", rq->rq_brname);
+    ovsmac_ctl_close();
+}
+
+/**
+ * Send a "fdb/show BRIDGE" request. At most one request per bridge is kept
+ * in flight.
+ */
+bool ovsmac_ctl_fdb_show(char *brif)
+{
+    struct ovsmac_ctl_req *rq;
+    json_t *jrpc;
+    char *srpc;
+    ssize_t rc;
+    size_t len;
+
+    ds_dlist_foreach(&ovsmac_ctl_req_list, rq)
+    {
+        /* Previous request still pending */
+        if (strcmp(rq->rq_brname, brif) == 0) return true;
+    }
+
+    rq = calloc(1, sizeof(*rq));
+    if (rq == NULL)
+    {
+        LOG(ERR, "OVSMAC: Unable to allocate unixctl request.");
+        return false;
+    }
+
+    rq->rq_id = ++ovsmac_ctl_id;
+    rq->rq_deadline = ev_now(EV_DEFAULT) + OVSMAC_CTL_REQ_TIMEOUT;
+    STRSCPY(rq->rq_brname, brif);
+
+    jrpc = json_pack("{s:s, s:[s], s:i}", "method", "fdb/show", "params", brif, "id", rq->rq_id);
+    srpc = jrpc != NULL ? json_dumps(jrpc, JSON_COMPACT) : NULL;
+    json_decref(jrpc);
+
+    if (srpc == NULL)
+    {
+        LOG(ERR, "OVSMAC: Unable to create unixctl request.");
+        free(rq);
+        return false;
+    }
+
+    len = strlen(srpc);
+    rc = send(ovsmac_ctl_fd, srpc, len, MSG_NOSIGNAL);
+    free(srpc);
+
+    if (rc != (ssize_t)len)
+    {
+        LOG(ERR, "OVSMAC: Error sending unixctl request: %s", rc < 0 ? strerror(errno) : "short write");
+        free(rq);
+        ovsmac_ctl_close();
+        return false;
+    }
+
+    ds_dlist_insert_tail(&ovsmac_ctl_req_list, rq);
+
+    return true;
+}
+
+void ovsmac_ctl_read_fn(struct ev_loop *loop, ev_io *w, int revents)
+{
+    json_error_t jerr;
+    json_t *jrpc;
+    size_t mlen;
+    ssize_t rc;
+    char *buf;
+
+    (void)loop;
+    (void)w;
+    (void)revents;
+
+    if (ovsmac_ctl_buf_sz - ovsmac_ctl_buf_len < OVSMAC_CTL_BUF_GROW)
+    {
+        buf = realloc(ovsmac_ctl_buf, ovsmac_ctl_buf_sz + OVSMAC_CTL_BUF_GROW);
+        if (buf == NULL)
         {
-            LOG(ERR, "OVSMAC: ovs-appctl: Invalid VLAN: %s", svlan);
-            continue;
+            /* The partial reply cannot be completed, start over on a new connection */
+            LOG(ERR, "OVSMAC: Unable to grow the unixctl receive buffer.");
+            ovsmac_ctl_close();
+            return;
         }
+        ovsmac_ctl_buf = buf;
+        ovsmac_ctl_buf_sz += OVSMAC_CTL_BUF_GROW;
+    }
 
-        if (!os_nif_macaddr_from_str(&mac, smac))
+    rc = recv(ovsmac_ctl_fd, ovsmac_ctl_buf + ovsmac_ctl_buf_len, ovsmac_ctl_buf_sz - ovsmac_ctl_buf_len, 0);
+    if (rc < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (rc <= 0)
+    {
+        LOG(NOTICE, "OVSMAC: unixctl connection closed: %s", rc < 0 ? strerror(errno) : "EOF");
+        ovsmac_ctl_close();
+        return;
+    }
+
+    ovsmac_ctl_buf_len += rc;
+
+    /* JSON-RPC messages are not delimited, process all complete objects in the buffer */
+    while ((mlen = ovsmac_ctl_msg_len(ovsmac_ctl_buf, ovsmac_ctl_buf_len)) > 0)
+    {
+        jrpc = json_loadb(ovsmac_ctl_buf, mlen, 0, &jerr);
+
+        ovsmac_ctl_buf_len -= mlen;
+        memmove(ovsmac_ctl_buf, ovsmac_ctl_buf + mlen, ovsmac_ctl_buf_len);
+
+        if (jrpc == NULL)
         {
-            LOG(ERR, "OVSMAC: Invalid MAC addres: %s", smac);
-            continue;
+            LOG(ERR, "OVSMAC: Error parsing unixctl reply: %s", jerr.text);
+            ovsmac_ctl_close();
+            return;
         }
 
-        if (strcmp(sofport, "LOCAL") == 0)
+        ovsmac_ctl_reply(jrpc);
+        json_decref(jrpc);
+
+        /* ovsmac_ctl_reply() may close the connection */
+        if (ovsmac_ctl_fd < 0) return;
+    }
+}
+
+/**
+ * Return the length of the first complete JSON object in buf, or 0 if the
+ * object is not complete yet. Leading whitespace is included in the length.
+ */
+size_t ovsmac_ctl_msg_len(const char *buf, size_t len)
+{
+    bool instr = false;
+    bool esc = false;
+    int depth = 0;
+    size_t ii;
+
+    for (ii = 0; ii < len; ii++)
+    {
+        if (instr)
         {
-            ifname = brif;
+            if (esc)
+                esc = false;
+            else if (buf[ii] == '\\')
+                esc = true;
+            else if (buf[ii] == '"')
+                instr = false;
+            continue;
         }
-        else
+
+        switch (buf[ii])
         {
-            if (!os_atol(sofport, &ofport))
-            {
-                LOG(ERR, "OVSMAC: ovs-appctl: Invalid ofport: %s", sofport);
-                continue;
-            }
+            case '"':
+                instr = true;
+                break;
 
-            ifname = ovsmac_find_ofport_name(brif, ofport);
-            if (ifname == NULL)
-            {
-                LOG(ERR, "OVSMAC: Unknown ofport %ld in bridge: %s", ofport, brif);
-                continue;
-            }
+            case '{':
+            case '[':
+                depth++;
+                break;
+
+            case '}':
+            case ']':
+                if (--depth == 0) return ii + 1;
+                break;
         }
+    }
 
-        LOG(DEBUG, "bridge:%s ofport:%s vlan:%s mac:%s\n", brif, ifname, svlan, smac);
+    return 0;
+}
 
-        /*
-         * Check if given interface is in interface filter list
-         * Ethernet clients are connected to eth0 interface
-         */
-        if (true == ovsmac_check_iface_flt(ifname))
-        {
-            ovsmac_node_update(brif, ifname, vlan, mac);
-        }
+/**
+ * Process a single unixctl reply: {"id":N,"result":"...","error":null}
+ */
+void ovsmac_ctl_reply(json_t *jrpc)
+{
+    struct ovsmac_ctl_req *rq;
+    json_t *jresult;
+    json_t *jerror;
+    json_t *jid;
+    char *result;
+    char *line;
+    char *pline;
+
+    jid = json_object_get(jrpc, "id");
+    rq = ds_dlist_head(&ovsmac_ctl_req_list);
+
+    /* Replies are sent in request order */
+    if (rq == NULL || !json_is_integer(jid) || json_integer_value(jid) != rq->rq_id)
+    {
+        LOG(ERR, "OVSMAC: Unexpected unixctl reply, resetting connection.");
+        ovsmac_ctl_close();
+        return;
     }
 
-    ret = true;
-err_close:
-    pclose(ovs_appctl);
-    return ret;
+    ds_dlist_remove(&ovsmac_ctl_req_list, rq);
+
+    jerror = json_object_get(jrpc, "error");
+    jresult = json_object_get(jrpc, "result");
+    if ((jerror != NULL && !json_is_null(jerror)) || !json_is_string(jresult))
+    {
+        LOG(ERR, "OVSMAC: fdb/show %s failed: %s",
+                rq->rq_brname,
+                json_is_string(jerror) ? json_string_value(jerror) : "invalid reply");
+        free(rq);
+        return;
+    }
+
+    result = strdup(json_string_value(jresult));
+    if (result == NULL)
+    {
+        free(rq);
+        return;
+    }
+
+    /* Diff against the cache: entries of this bridge that are not reported are removed */
+    ovsmac_node_reset(rq->rq_brname);
+
+    /* Skip the first line (header) */
+    strtok_r(result, "\n", &pline);
+    while ((line = strtok_r(NULL, "\n", &pline)) != NULL)
+    {
+        ovsmac_parse_line(rq->rq_brname, line);
+    }
+
+    ovsmac_node_flush(rq->rq_brname);
+
+    free(result);
+    free(rq);
 }
 
 /**
@@ -387,15 +802,16 @@ char *ovsmac_find_ofport_name(char *brif, int ofport)
 
 
 /**
- * Reset the OVS MAC learning cache -- flag all nodes for deletion. If the node is not updated,
- * a call to ovsmac_node_flush() will permanently delete it from the cache and OVSDB.
+ * Reset the OVS MAC learning cache of bridge brname -- flag all nodes for deletion. If the node is
+ * not updated, a call to ovsmac_node_flush() will permanently delete it from the cache and OVSDB.
  */
-void ovsmac_node_reset(void)
+void ovsmac_node_reset(const char *brname)
 {
     struct ovsmac_node *on;
 
     ds_tree_foreach(&ovsmac_list, on)
     {
+        if (strcmp(on->mac.brname, brname) != 0) continue;
         on->mac_flags = 0;
     }
 }
@@ -444,9 +860,9 @@ void ovsmac_node_update(char *brname, char *ifname, int vlan, os_macaddr_t macad
 }
 
 /**
- * Flush all nodes that are not flagged with OVSMAC_FLAG_ACTIVE
+ * Flush all nodes of bridge brname that are not flagged with OVSMAC_FLAG_ACTIVE
  */
-void ovsmac_node_flush(void)
+void ovsmac_node_flush(const char *brname)
 {
     struct ovsmac_node *on;
 
@@ -454,6 +870,8 @@ void ovsmac_node_flush(void)
 
     for (on = ds_tree_ifirst(&iter, &ovsmac_list); on != NULL; on = ds_tree_inext(&iter))
     {
+        if (strcmp(on->mac.brname, brname) != 0) continue;
+
         if (!(on->mac_flags & OVSMAC_FLAG_ACTIVE))
         {
             ds_tree_iremove(&iter);
@@ -464,6 +882,33 @@ void ovsmac_node_flush(void)
     }
 }
 
+/**
+ * Flush all nodes that belong to bridges that were removed or are no longer
+ * in the bridge filter list
+ */
+void ovsmac_node_prune(void)
+{
+    struct ovsmac_node *on;
+    struct bridge_node *br;
+
+    ds_tree_iter_t iter;
+
+    for (on = ds_tree_ifirst(&iter, &ovsmac_list); on != NULL; on = ds_tree_inext(&iter))
+    {
+        ds_tree_foreach(&bridge_list, br)
+        {
+            if (strcmp(br->br_bridge.name, on->mac.brname) == 0) break;
+        }
+
+        if (br != NULL && ovsmac_check_bridge_flt(on->mac.brname)) continue;
+
+        ds_tree_iremove(&iter);
+        /* Remove FROM OVSDB */
+        g_mac_learning_cb_t(&(on->mac), false);
+        free(on);
+    }
+}
+
 /**
  * ovsmac_node comparator
  */
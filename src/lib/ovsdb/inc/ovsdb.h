@@ -205,6 +205,13 @@ bool ovsdb_ready(const char *name);
 bool ovsdb_stop_loop(struct ev_loop *loop);
 bool ovsdb_stop(void);
 
+/*
+ * Signal readiness to DM (see mon_notify_ready()) as soon as the initial
+ * replies of all monitors requested so far, and of the monitors requested
+ * while processing them, have been received
+ */
+void ovsdb_notify_ready(void);
+
 /*
  * This function allows user to send 'raw' json request
  *
@@ -221,6 +228,11 @@ bool ovsdb_method_send(json_rpc_response_t *callback,
                        ovsdb_mt_t mt,
                        json_t * jparams);
 
+/*
+ * Drop the pending responses of callback, free_fn releases their data
+ */
+void ovsdb_method_cancel(json_rpc_response_t *callback, void (*free_fn)(void *data));
+
 /*
  * Sync version of method send function
  */
@@ -439,6 +451,8 @@ struct rpc_response_handler
     int                     rrh_id;                     /**< Response ID */
     json_rpc_response_t    *rrh_callback;               /**< Callback   */
     void                   *data;                       /**< User data  */
+    uint64_t                rrh_start;                  /**< Send time, see metrics_clock() */
+    bool                    rrh_monitor;                /**< Monitor request, see ovsdb_notify_ready() */
     ds_tree_node_t          rrh_node;                   /**< Node structure */
 };
 
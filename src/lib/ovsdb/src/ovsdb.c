@@ -41,7 +41,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os.h"
 #include "os_socket.h"
 #include "ovsdb.h"
+#include "ovsdb_priv.h"
 #include "json_util.h"
+#include "monitor.h"
+#include "metrics.h"
+#include "evx.h"
 
 /*****************************************************************************/
 
@@ -68,6 +72,10 @@ int json_rpc_fd = -1;
 //it's should be embedded in monitor transact
 static int json_update_monitor_id = 0;
 
+/* Monitor requests waiting for their initial reply */
+static int ovsdb_monitors_pending = 0;
+static bool ovsdb_ready_requested = false;
+
 /* JSON-RPC handler list */
 static ds_key_cmp_t rpc_response_handler_cmp;
 ds_tree_t json_rpc_handler_list = DS_TREE_INIT(rpc_response_handler_cmp, struct rpc_response_handler, rrh_node);
@@ -76,6 +84,11 @@ ds_tree_t json_rpc_handler_list = DS_TREE_INIT(rpc_response_handler_cmp, struct
 static ds_key_cmp_t rpc_update_handler_cmp;
 ds_tree_t json_rpc_update_handler_list = DS_TREE_INIT(rpc_update_handler_cmp, struct rpc_response_handler, rrh_node);
 
+/* Self-measurement */
+static metrics_t ovsdb_metrics_rpc_rtt = METRICS_HIST_INIT("ovsdb.rpc_rtt_us");
+static metrics_t ovsdb_metrics_update_us = METRICS_HIST_INIT("ovsdb.update_us");
+static metrics_t ovsdb_metrics_rx_bytes = METRICS_COUNTER_INIT("ovsdb.rx_bytes");
+
 /******************************************************************************
  *  PROTECTED declarations
  *****************************************************************************/
@@ -153,6 +166,8 @@ static void cb_ovsdb_read(struct ev_loop *loop, struct ev_io *watcher, int reven
         goto error;
     }
 
+    metrics_counter_add(&ovsdb_metrics_rx_bytes, nr);
+
     /* Pad the buffer with \0 */
     used_size += nr;
     ovs_buffer[used_size] = '\0';
@@ -415,6 +430,8 @@ static bool ovsdb_process_update(json_t *jsup)
 {
     int mon_id = 0;
     struct rpc_update_handler *rh;
+    uint64_t lag;
+    uint64_t t0;
 
     mon_id = json_integer_value(json_array_get(json_object_get(jsup,"params"),0));
 
@@ -425,7 +442,11 @@ static bool ovsdb_process_update(json_t *jsup)
         return false;
     }
 
+    t0 = metrics_clock();
+    lag = evx_lag_trace_begin();
     rh->rrh_callback(mon_id, jsup, rh->data);
+    evx_lag_trace_end((void *)rh->rrh_callback, lag);
+    metrics_hist_since(&ovsdb_metrics_update_us, t0);
 
     return true;
 }
@@ -433,6 +454,7 @@ static bool ovsdb_process_update(json_t *jsup)
 bool ovsdb_rpc_callback(int id, bool is_error, json_t *jsmsg)
 {
     struct rpc_response_handler *rh;
+    uint64_t lag;
 
     rh = ds_tree_find(&json_rpc_handler_list, &id);
     if (rh == NULL)
@@ -456,15 +478,50 @@ bool ovsdb_rpc_callback(int id, bool is_error, json_t *jsmsg)
         }
     }
 
+    metrics_hist_since(&ovsdb_metrics_rpc_rtt, rh->rrh_start);
+
+    lag = evx_lag_trace_begin();
     rh->rrh_callback(id, is_error, jsmsg, rh->data);
+    evx_lag_trace_end((void *)rh->rrh_callback, lag);
 
     /* Remove callback from the tree */
     ds_tree_remove(&json_rpc_handler_list, rh);
+    if (rh->rrh_monitor) ovsdb_monitor_synced();
     free(rh);
 
     return true;
 }
 
+void ovsdb_monitor_sent(void)
+{
+    ovsdb_monitors_pending++;
+}
+
+void ovsdb_monitor_synced(void)
+{
+    if (ovsdb_monitors_pending > 0) ovsdb_monitors_pending--;
+    if (ovsdb_monitors_pending > 0 || !ovsdb_ready_requested) return;
+
+    LOG(INFO, "OVSDB: Initial monitor replies received.");
+    ovsdb_ready_requested = false;
+    mon_notify_ready();
+}
+
+/**
+ * Signal readiness once the initial state of every monitored table is in
+ */
+void ovsdb_notify_ready(void)
+{
+    if (ovsdb_monitors_pending == 0)
+    {
+        mon_notify_ready();
+        return;
+    }
+
+    LOG(DEBUG, "OVSDB: Readiness deferred until %d monitor(s) are synced.", ovsdb_monitors_pending);
+    ovsdb_ready_requested = true;
+}
+
 /**
  * Compassion function used by the tree data structure -- simple string compare of the method member
  */
@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_util.h"
 #include "util.h"
 #include "json_util.h"
+#include "metrics.h"
 #include "const.h"
 
 #include "ovsdb_priv.h"
@@ -189,10 +190,14 @@ static json_t * ovsdb_mon_tbl_val(int mon_flags, int argc, char *argv[])
  */
 static int ovsdb_write_callback(const char *buf, size_t sz, void *data);
 
+static metrics_t ovsdb_metrics_rpc = METRICS_COUNTER_INIT("ovsdb.rpc");
+static metrics_t ovsdb_metrics_tx_bytes = METRICS_COUNTER_INIT("ovsdb.tx_bytes");
+
 static bool ovsdb_write(json_rpc_response_t *callback, void * data, json_t * js)
 {
     bool retval = false;
     struct rpc_response_handler *rh = NULL;
+    uint64_t t0 = metrics_clock();
 
     if (json_dump_callback(js, ovsdb_write_callback, NULL, JSON_COMPACT) != 0)
     {
@@ -200,6 +205,8 @@ static bool ovsdb_write(json_rpc_response_t *callback, void * data, json_t * js)
         goto error;
     }
 
+    metrics_counter_inc(&ovsdb_metrics_rpc);
+
     /* If we have a callback, insert it into the response tree */
     if (callback != NULL)
     {
@@ -223,8 +230,14 @@ static bool ovsdb_write(json_rpc_response_t *callback, void * data, json_t * js)
         rh->rrh_id = json_integer_value(jid);
         rh->rrh_callback = callback;
         rh->data = data;
+        rh->rrh_start = t0;
+
+        /* Monitors are tracked until their initial reply, see ovsdb_notify_ready() */
+        const char *method = json_string_value(json_object_get(js, "method"));
+        rh->rrh_monitor = method != NULL && strcmp(method, "monitor") == 0;
 
         ds_tree_insert(&json_rpc_handler_list, rh, &rh->rrh_id);
+        if (rh->rrh_monitor) ovsdb_monitor_sent();
     }
 
     retval = true;
@@ -253,6 +266,8 @@ int ovsdb_write_callback(const char *buf, size_t sz, void *data)
     }
     else
     {
+        metrics_counter_add(&ovsdb_metrics_tx_bytes, nwr);
+
         /* Following line makes log too verbose - commented it until better solution found */
         /* LOG(DEBUG, "JSON RPC.::json=%s", buf);   */
     }
@@ -325,6 +340,31 @@ bool ovsdb_method_send(json_rpc_response_t *callback,
     return retval;
 }
 
+/**
+ * Forget all pending responses that would be delivered to callback
+ *
+ * Used by code that is about to be unloaded: replies that still come are
+ * dropped by ovsdb_rpc_callback(). The user data of each cancelled request
+ * is passed to free_fn, which may be NULL.
+ */
+void ovsdb_method_cancel(json_rpc_response_t *callback, void (*free_fn)(void *data))
+{
+    struct rpc_response_handler *rh;
+    ds_tree_iter_t iter;
+
+    for (rh = ds_tree_ifirst(&iter, &json_rpc_handler_list);
+         rh != NULL;
+         rh = ds_tree_inext(&iter))
+    {
+        if (rh->rrh_callback != callback) continue;
+
+        ds_tree_iremove(&iter);
+        if (free_fn != NULL) free_fn(rh->data);
+        if (rh->rrh_monitor) ovsdb_monitor_synced();
+        free(rh);
+    }
+}
+
 
 /******************************************************************************
  * Public interface
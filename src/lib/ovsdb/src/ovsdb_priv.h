@@ -50,4 +50,8 @@ extern bool ovsdb_tran_comment(json_t *js_array, ovsdb_tro_t oper, json_t *where
 /* Return a transaction operation as JSON string */
 extern json_t *ovsdb_tran_operation(ovsdb_tro_t tran);
 
+/* Account for a monitor request sent, and for its initial reply or cancellation */
+extern void ovsdb_monitor_sent(void);
+extern void ovsdb_monitor_synced(void);
+
 #endif /* OVSDB_PRIV_H_INCLUDED */
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_socket.h"
 #include "log.h"
 #include "json_util.h"
+#include "metrics.h"
 
 #include "ovsdb.h"
 #include "ovsdb_priv.h"
@@ -50,6 +51,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* OVSDB response buffers can be HUGE */
 static char ovsdb_write_buf[256*1024];
 
+/* Synchronous calls block the caller's loop for the whole round trip */
+static metrics_t ovsdb_metrics_sync_rtt = METRICS_HIST_INIT("ovsdb.sync_rtt_us");
+
 /**
  * Callback for json_dump_callback() -- called from ovsb_write_s()
  *
@@ -82,6 +86,7 @@ json_t *ovsdb_write_s(json_t *jsdata)
 {
     int     ovs_fd = -1;
     json_t *retval = NULL;
+    uint64_t t0 = metrics_clock();
 
     /* Initiate new connection to OVSDB */
     ovs_fd = ovsdb_conn();
@@ -149,6 +154,8 @@ error:
         close(ovs_fd);
     }
 
+    metrics_hist_since(&ovsdb_metrics_sync_rtt, t0);
+
     return retval;
 }
 
@@ -51,3 +51,5 @@ UNIT_DEPS += src/lib/pjs
 UNIT_DEPS += src/lib/json_util
 UNIT_DEPS += src/lib/schema
 UNIT_DEPS += src/lib/const
+UNIT_DEPS += src/lib/metrics
+UNIT_DEPS += src/lib/evx
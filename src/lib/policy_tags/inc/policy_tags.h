@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POLICY_TAGS_H_INCLUDED
 
 #include "os.h"
+#include "os_types.h"
 #include "ovsdb.h"
 #include "ovsdb_update.h"
 #include "schema.h"
@@ -116,11 +117,33 @@ extern om_tag_list_entry_t *
 
 #define OM_TLE_VAR_FLAGS(x)     (x & (OM_TLE_FLAG_DEVICE | OM_TLE_FLAG_CLOUD))
 
+/*
+ * Binary view of the MAC and IP values of a tag, an open addressing hash
+ * rebuilt each time the tag's values change. The key length tells the
+ * value type apart: 6 for a MAC, 4 for IPv4, 16 for IPv6. If a rebuild
+ * fails the set is left empty and stale, and lookups walk the values list.
+ */
+#define OM_TAG_SET_KEY_LEN      16
+
+typedef struct {
+    uint8_t         len;    // 0 for an empty slot
+    uint8_t         flags;
+    uint8_t         key[OM_TAG_SET_KEY_LEN];
+} om_tag_set_entry_t;
+
+typedef struct {
+    om_tag_set_entry_t *entries;
+    size_t          size;   // Power of 2, 0 when no binary value
+    size_t          count;
+    bool            stale;  // Build failed, use the values list
+} om_tag_set_t;
+
 typedef struct {
     char            *name;
     bool            group;
 
     ds_tree_t       values; // Tree of om_tag_list_entry_t
+    om_tag_set_t    set;    // MAC/IP values, hashed
 
     ds_tree_node_t  dst_node;
 } om_tag_t;
@@ -146,6 +169,43 @@ struct tag_mgr {
 };
 
 extern void om_tag_init(struct tag_mgr *mgr);
+
+
+/******************************************************************************
+ * Tag Handle Definitions
+ *****************************************************************************/
+
+/*
+ * A tag reference, as found in configuration (${tag}, ${@tag}, $[group]...),
+ * parsed once. The handle is stable for as long as it is referenced, and
+ * tracks the tag as it gets added, updated or removed.
+ */
+typedef struct om_tag_handle {
+    char            *tag_name;      // Reference as configured, handle key
+    char            *name;          // Tag name, markers stripped
+    bool            group;
+    uint8_t         match_flags;
+    om_tag_t        *tag;           // NULL while the tag is not configured
+    int             refcount;
+
+    ds_tree_node_t  dst_node;
+} om_tag_handle_t;
+
+extern om_tag_handle_t *
+                om_tag_handle_get(const char *tag_name);
+extern void     om_tag_handle_put(om_tag_handle_t *handle);
+extern bool     om_tag_handle_in(om_tag_handle_t *handle, char *value);
+extern bool     om_tag_handle_in_mac(om_tag_handle_t *handle,
+                                     const os_macaddr_t *mac);
+extern bool     om_tag_handle_in_ip(om_tag_handle_t *handle,
+                                    int af, const void *ip);
+extern void     om_tag_handles_bind(om_tag_t *tag, bool bound);
+
+extern bool     om_tag_set_build(om_tag_t *tag);
+extern void     om_tag_set_free(om_tag_set_t *set);
+extern om_tag_set_entry_t *
+                om_tag_set_find(om_tag_set_t *set, const void *key, size_t len);
+
 /******************************************************************************
  * Tag Group Definitions
  *****************************************************************************/
@@ -181,6 +241,21 @@ extern om_tag_group_t *
 int om_tag_get_type(char *name);
 
 
+/**
+ * @brief parses a tag reference
+ *
+ * @param tag_name the reference, ${tag}, ${@tag}, $[#group]...
+ * @param name output buffer for the tag name, markers stripped
+ * @param len size of the name buffer
+ * @param group set to true if the reference is a group tag
+ * @param match_flags set to the value flags the reference is restricted to
+ * @return true if tag_name is a tag reference, false otherwise
+ */
+bool
+om_tag_parse_ref(char *tag_name, char *name, size_t len,
+                 bool *group, uint8_t *match_flags);
+
+
 /**
  * @brief checks if a string is included in an opensync tag
  *
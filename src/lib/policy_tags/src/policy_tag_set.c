@@ -0,0 +1,357 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Tag handles and binary (MAC/IP) tag value sets
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "policy_tags.h"
+
+/*****************************************************************************/
+
+#define MODULE_ID LOG_MODULE_ID_MAIN
+
+#define OM_TAG_SET_MIN_SIZE     8
+
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+static ds_tree_t om_tag_handles = DS_TREE_INIT((ds_key_cmp_t *)strcmp,
+                                               om_tag_handle_t, dst_node);
+
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// FNV-1a over the key length and bytes
+static uint32_t
+om_tag_set_hash(const uint8_t *key, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    h = (h ^ len) * 16777619U;
+    for (i = 0; i < len; i++) {
+        h = (h ^ key[i]) * 16777619U;
+    }
+
+    return h;
+}
+
+// Convert a tag value to its binary form, returns the key length or 0
+static size_t
+om_tag_set_key_from_str(const char *value, uint8_t *key)
+{
+    unsigned int m[6];
+    char c;
+    int i;
+
+    if (sscanf(value, "%2x:%2x:%2x:%2x:%2x:%2x%c",
+               &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &c) == 6) {
+        for (i = 0; i < 6; i++) {
+            key[i] = m[i];
+        }
+        return 6;
+    }
+
+    if (inet_pton(AF_INET, value, key) == 1) {
+        return 4;
+    }
+
+    if (inet_pton(AF_INET6, value, key) == 1) {
+        return 16;
+    }
+
+    return 0;
+}
+
+static om_tag_set_entry_t *
+om_tag_set_slot(om_tag_set_t *set, const void *key, size_t len)
+{
+    om_tag_set_entry_t *e;
+    size_t mask;
+    size_t i;
+
+    mask = set->size - 1;
+    i = om_tag_set_hash(key, len) & mask;
+    for (;;) {
+        e = &set->entries[i];
+        if (e->len == 0) return e;
+        if (e->len == len && !memcmp(e->key, key, len)) return e;
+        i = (i + 1) & mask;
+    }
+}
+
+// Look up a binary value in a tag's values, the slow path of a stale set
+static uint8_t
+om_tag_set_list_flags(om_tag_t *tag, const void *key, size_t len)
+{
+    uint8_t             value_key[OM_TAG_SET_KEY_LEN];
+    om_tag_list_entry_t *tle;
+    uint8_t             flags;
+
+    flags = 0;
+    ds_tree_foreach(&tag->values, tle) {
+        if (om_tag_set_key_from_str(tle->value, value_key) != len) continue;
+        if (memcmp(value_key, key, len)) continue;
+
+        flags |= OM_TLE_VAR_FLAGS(tle->flags);
+    }
+
+    return flags;
+}
+
+// Check if a binary value is in the referenced tag
+static bool
+om_tag_handle_in_key(om_tag_handle_t *handle, const void *key, size_t len)
+{
+    om_tag_set_entry_t  *e;
+    uint8_t             flags;
+
+    if (handle->tag->set.stale) {
+        flags = om_tag_set_list_flags(handle->tag, key, len);
+        if (!flags) return false;
+    } else {
+        e = om_tag_set_find(&handle->tag->set, key, len);
+        if (!e) return false;
+        flags = e->flags;
+    }
+
+    if (handle->match_flags && !(flags & handle->match_flags)) return false;
+
+    return true;
+}
+
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+// Free a tag's binary values set
+void
+om_tag_set_free(om_tag_set_t *set)
+{
+    free(set->entries);
+    memset(set, 0, sizeof(*set));
+}
+
+// Look up a binary value in a tag's set
+om_tag_set_entry_t *
+om_tag_set_find(om_tag_set_t *set, const void *key, size_t len)
+{
+    om_tag_set_entry_t *e;
+
+    if (set->size == 0) return NULL;
+
+    e = om_tag_set_slot(set, key, len);
+    return e->len ? e : NULL;
+}
+
+// (Re)build a tag's binary values set from its values list
+bool
+om_tag_set_build(om_tag_t *tag)
+{
+    uint8_t             key[OM_TAG_SET_KEY_LEN];
+    om_tag_list_entry_t *tle;
+    om_tag_set_entry_t  *e;
+    om_tag_set_t        set;
+    size_t              len;
+    size_t              n;
+
+    n = 0;
+    ds_tree_foreach(&tag->values, tle) {
+        n++;
+    }
+
+    // Keep the set at most half full
+    memset(&set, 0, sizeof(set));
+    set.size = OM_TAG_SET_MIN_SIZE;
+    while (set.size < 2 * n) {
+        set.size *= 2;
+    }
+
+    set.entries = calloc(set.size, sizeof(*set.entries));
+    if (!set.entries) {
+        LOGEM("[%s] Failed to allocate memory for tag values set", tag->name);
+        // Don't leave the old values around, lookups walk the list instead
+        om_tag_set_free(&tag->set);
+        tag->set.stale = true;
+        return false;
+    }
+
+    ds_tree_foreach(&tag->values, tle) {
+        len = om_tag_set_key_from_str(tle->value, key);
+        if (len == 0) continue;
+
+        e = om_tag_set_slot(&set, key, len);
+        if (e->len == 0) {
+            e->len = len;
+            memcpy(e->key, key, len);
+            set.count++;
+        }
+        e->flags |= OM_TLE_VAR_FLAGS(tle->flags);
+    }
+
+    om_tag_set_free(&tag->set);
+    if (set.count == 0) {
+        free(set.entries);
+        return true;
+    }
+
+    tag->set = set;
+    return true;
+}
+
+// Attach or detach handles referencing a tag
+void
+om_tag_handles_bind(om_tag_t *tag, bool bound)
+{
+    om_tag_handle_t     *handle;
+
+    ds_tree_foreach(&om_tag_handles, handle) {
+        if (handle->group != tag->group) continue;
+        if (strcmp(handle->name, tag->name)) continue;
+
+        handle->tag = bound ? tag : NULL;
+    }
+}
+
+// Get a handle on a tag reference, parsed once and shared by all users
+om_tag_handle_t *
+om_tag_handle_get(const char *tag_name)
+{
+    om_tag_handle_t     *handle;
+    uint8_t             match_flags;
+    char                name[256];
+    bool                group;
+
+    handle = ds_tree_find(&om_tag_handles, (void *)tag_name);
+    if (handle) {
+        handle->refcount++;
+        return handle;
+    }
+
+    if (!om_tag_parse_ref((char *)tag_name, name, sizeof(name),
+                          &group, &match_flags)) {
+        return NULL;
+    }
+
+    if (!(handle = calloc(1, sizeof(*handle)))) {
+        goto alloc_err;
+    }
+
+    handle->tag_name = strdup(tag_name);
+    handle->name = strdup(name);
+    if (!handle->tag_name || !handle->name) {
+        goto alloc_err;
+    }
+
+    handle->group = group;
+    handle->match_flags = match_flags;
+    handle->tag = om_tag_find_by_name(name, group);
+    handle->refcount = 1;
+    ds_tree_insert(&om_tag_handles, handle, handle->tag_name);
+
+    return handle;
+
+alloc_err:
+    LOGEM("Failed to allocate memory for tag handle '%s'", tag_name);
+
+    if (handle) {
+        free(handle->tag_name);
+        free(handle->name);
+        free(handle);
+    }
+
+    return NULL;
+}
+
+// Release a handle
+void
+om_tag_handle_put(om_tag_handle_t *handle)
+{
+    if (!handle) return;
+
+    if (--handle->refcount > 0) return;
+
+    ds_tree_remove(&om_tag_handles, handle);
+    free(handle->tag_name);
+    free(handle->name);
+    free(handle);
+}
+
+// Check if a string is one of the values of the referenced tag
+bool
+om_tag_handle_in(om_tag_handle_t *handle, char *value)
+{
+    om_tag_list_entry_t *e;
+
+    if (!handle || !handle->tag || !value) return false;
+
+    e = om_tag_list_entry_find_by_value(&handle->tag->values, value);
+    if (!e) return false;
+
+    if (handle->match_flags && !(e->flags & handle->match_flags)) return false;
+
+    return true;
+}
+
+// Check if a MAC address is one of the values of the referenced tag
+bool
+om_tag_handle_in_mac(om_tag_handle_t *handle, const os_macaddr_t *mac)
+{
+    if (!handle || !handle->tag || !mac) return false;
+
+    return om_tag_handle_in_key(handle, mac->addr, sizeof(mac->addr));
+}
+
+// Check if an IPv4 or IPv6 address is one of the values of the referenced tag
+bool
+om_tag_handle_in_ip(om_tag_handle_t *handle, int af, const void *ip)
+{
+    size_t              len;
+
+    if (!handle || !handle->tag || !ip) return false;
+
+    if (af == AF_INET) {
+        len = 4;
+    } else if (af == AF_INET6) {
+        len = 16;
+    } else {
+        return false;
+    }
+
+    return om_tag_handle_in_key(handle, ip, len);
+}
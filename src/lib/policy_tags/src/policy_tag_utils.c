@@ -69,47 +69,72 @@ om_tag_get_type(char *name)
 
 
 /**
- * @brief checks if a string is included in an opensync tag
+ * @brief parses a tag reference
  *
- * The tag can be a tag or a group tag
- * @param value the string checked for inclusion
- * @param tag_name the tag name to check
+ * @param tag_name the reference, ${tag}, ${@tag}, $[#group]...
+ * @param name output buffer for the tag name, markers stripped
+ * @param len size of the name buffer
+ * @param group set to true if the reference is a group tag
+ * @param match_flags set to the value flags the reference is restricted to
+ * @return true if tag_name is a tag reference, false otherwise
  */
 bool
-om_tag_in(char *value, char *tag_name)
+om_tag_parse_ref(char *tag_name, char *name, size_t len,
+                 bool *group, uint8_t *match_flags)
 {
-    om_tag_list_entry_t *e;
-    int match_flags;
-    char name[256];
-    om_tag_t *tag;
-    bool is_gtag;
     int tag_type;
     char *tag_s;
 
-    /* Sanity checks */
     if (tag_name == NULL) return false;
-    if (value == NULL) return false;
 
     tag_type = om_tag_get_type(tag_name);
     if (tag_type == NOT_A_OPENSYNC_TAG) return false;
 
-    match_flags = 0;
+    *match_flags = 0;
     tag_s = tag_name + 2;
     if (*tag_s == TEMPLATE_DEVICE_CHAR)
     {
-        match_flags = OM_TLE_FLAG_DEVICE;
+        *match_flags = OM_TLE_FLAG_DEVICE;
         tag_s += 1;
     }
     else if (*tag_s == TEMPLATE_CLOUD_CHAR)
     {
-        match_flags = OM_TLE_FLAG_CLOUD;
+        *match_flags = OM_TLE_FLAG_CLOUD;
         tag_s += 1;
     }
 
     /* Copy tag name, remove end marker */
-    STRSCPY_LEN(name, tag_s, -1);
+    strscpy_len(name, tag_s, len, -1);
+
+    *group = (tag_type == OPENSYNC_GROUP_TAG);
+
+    return true;
+}
+
+
+/**
+ * @brief checks if a string is included in an opensync tag
+ *
+ * The tag can be a tag or a group tag
+ * @param value the string checked for inclusion
+ * @param tag_name the tag name to check
+ */
+bool
+om_tag_in(char *value, char *tag_name)
+{
+    om_tag_list_entry_t *e;
+    uint8_t match_flags;
+    char name[256];
+    om_tag_t *tag;
+    bool is_gtag;
+    bool rc;
+
+    /* Sanity checks */
+    if (tag_name == NULL) return false;
+    if (value == NULL) return false;
 
-    is_gtag = (tag_type == OPENSYNC_GROUP_TAG);
+    rc = om_tag_parse_ref(tag_name, name, sizeof(name), &is_gtag, &match_flags);
+    if (!rc) return false;
 
     tag = om_tag_find_by_name(name, is_gtag);
     if (tag == NULL) return false;
@@ -145,6 +145,9 @@ om_tag_free(om_tag_t *tag)
             vp = ds_tree_inext(&iter);
         }
 
+        // Binary values set
+        om_tag_set_free(&tag->set);
+
         // Name
         free(tag->name);
 
@@ -198,6 +201,16 @@ om_tag_find_by_name(const char *name, bool group)
 {
     om_tag_t            *tag;
 
+    tag = ds_tree_find(&om_tags, (void *)name);
+    if (tag == NULL) {
+        return NULL;
+    }
+
+    if (tag->group == group) {
+        return tag;
+    }
+
+    // A tag and a group share the name, tell them apart
     ds_tree_foreach(&om_tags, tag) {
         if (!strcmp(tag->name, name) && tag->group == group) {
             return tag;
@@ -220,6 +233,8 @@ om_tag_add(om_tag_t *tag)
     }
 
     ds_tree_insert(&om_tags, tag, tag->name);
+    om_tag_set_build(tag);
+    om_tag_handles_bind(tag, true);
 
     om_tag_list_to_buf(&tag->values, 0, dbuf, sizeof(dbuf)-1);
     LOGN("[%s] %sTag added, values:%s",
@@ -242,6 +257,7 @@ om_tag_remove(om_tag_t *tag)
     char                dbuf[2048];
 
     ds_tree_remove(&om_tags, tag);
+    om_tag_handles_bind(tag, false);
 
     om_tag_list_to_buf(&tag->values, 0, dbuf, sizeof(dbuf)-1);
     LOGN("[%s] %sTag removed, values:%s",
@@ -292,6 +308,7 @@ om_tag_update(om_tag_t *tag, ds_tree_t *new_values)
         LOGE("[%s] Failed to allocate memory to apply diff for update", tag->name);
         ret = false;
     }
+    om_tag_set_build(tag);
 
     om_tag_list_diff_free(&diff);
 
@@ -24,6 +24,8 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <arpa/inet.h>
+
 #include "json_util.h"
 #include "log.h"
 #include "policy_tags.h"
@@ -33,6 +35,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 char *
 g_test_name = "test_policy_tags";
 
+/* Number of calloc() calls to let through before failing one, -1 never */
+static int g_calloc_fail_after = -1;
+
+void *__real_calloc(size_t nmemb, size_t size);
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+    if (g_calloc_fail_after >= 0 && g_calloc_fail_after-- == 0) {
+        return NULL;
+    }
+
+    return __real_calloc(nmemb, size);
+}
+
 
 struct schema_Openflow_Tag g_tags[] =
 {
@@ -284,6 +301,222 @@ void test_val_in_tag_group(void)
 }
 
 
+void test_handle_in_mac_ip(void)
+{
+    struct schema_Openflow_Tag addr_tag =
+    {
+        .name_exists = true,
+        .name = "addr_tag",
+        .device_value_len = 2,
+        .device_value =
+        {
+            "aa:bb:cc:dd:ee:01",
+            "10.1.0.2",
+        },
+        .cloud_value_len = 1,
+        .cloud_value =
+        {
+            "fe80::1",
+        },
+    };
+    os_macaddr_t mac = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x01 } };
+    os_macaddr_t other_mac = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x02 } };
+    om_tag_handle_t *handle;
+    om_tag_handle_t *dev_handle;
+    struct in6_addr ipv6;
+    struct in_addr ipv4;
+    bool ret;
+
+    inet_pton(AF_INET, "10.1.0.2", &ipv4);
+    inet_pton(AF_INET6, "fe80::1", &ipv6);
+
+    /* Handles can be taken before the tag exists */
+    handle = om_tag_handle_get("${addr_tag}");
+    TEST_ASSERT_NOT_NULL(handle);
+    TEST_ASSERT_NULL(handle->tag);
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &mac));
+
+    /* Same reference, same handle */
+    TEST_ASSERT_TRUE(handle == om_tag_handle_get("${addr_tag}"));
+    om_tag_handle_put(handle);
+
+    dev_handle = om_tag_handle_get("${@addr_tag}");
+    TEST_ASSERT_NOT_NULL(dev_handle);
+
+    /* Not a tag reference */
+    TEST_ASSERT_NULL(om_tag_handle_get("aa:bb:cc:dd:ee:01"));
+
+    ret = om_tag_add_from_schema(&addr_tag);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_NOT_NULL(handle->tag);
+
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &other_mac));
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(handle, AF_INET, &ipv4));
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(handle, AF_INET6, &ipv6));
+    TEST_ASSERT_TRUE(om_tag_handle_in(handle, "10.1.0.2"));
+
+    /* The IPv6 address is a cloud value */
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(dev_handle, AF_INET, &ipv4));
+    TEST_ASSERT_FALSE(om_tag_handle_in_ip(dev_handle, AF_INET6, &ipv6));
+
+    /* Removing the tag unbinds its handles */
+    ret = om_tag_remove_from_schema(&addr_tag);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_NULL(handle->tag);
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &mac));
+
+    om_tag_handle_put(dev_handle);
+    om_tag_handle_put(handle);
+}
+
+
+void test_handle_in_group_flattened(void)
+{
+    struct schema_Openflow_Tag mac_tags[] =
+    {
+        {
+            .name_exists = true,
+            .name = "mac_tag_1",
+            .device_value_len = 1,
+            .device_value = { "aa:bb:cc:dd:ee:01" },
+            .cloud_value_len = 1,
+            .cloud_value = { "10.1.0.1" },
+        },
+        {
+            .name_exists = true,
+            .name = "mac_tag_2",
+            .device_value_len = 1,
+            .device_value = { "aa:bb:cc:dd:ee:02" },
+        },
+    };
+    struct schema_Openflow_Tag_Group mac_group =
+    {
+        .name_exists = true,
+        .name = "mac_group",
+        .tags_len = 2,
+        .tags =
+        {
+            "mac_tag_1",
+            "@mac_tag_2",
+        },
+    };
+    os_macaddr_t mac_1 = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x01 } };
+    os_macaddr_t mac_2 = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x02 } };
+    os_macaddr_t mac_3 = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x03 } };
+    om_tag_handle_t *handle;
+    om_tag_handle_t *cloud_handle;
+    struct in_addr ipv4;
+    bool ret;
+    size_t i;
+
+    inet_pton(AF_INET, "10.1.0.1", &ipv4);
+
+    for (i = 0; i < ARRAY_SIZE(mac_tags); i++) {
+        ret = om_tag_add_from_schema(&mac_tags[i]);
+        TEST_ASSERT_TRUE(ret);
+    }
+    ret = om_tag_group_add_from_schema(&mac_group);
+    TEST_ASSERT_TRUE(ret);
+
+    handle = om_tag_handle_get("$[mac_group]");
+    TEST_ASSERT_NOT_NULL(handle);
+    TEST_ASSERT_NOT_NULL(handle->tag);
+    cloud_handle = om_tag_handle_get("$[#mac_group]");
+    TEST_ASSERT_NOT_NULL(cloud_handle);
+
+    /* The group's set holds the values of all of its members */
+    TEST_ASSERT_EQUAL_UINT(3, handle->tag->set.count);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac_1));
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac_2));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &mac_3));
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(handle, AF_INET, &ipv4));
+
+    /* Member value flags are carried over */
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(cloud_handle, AF_INET, &ipv4));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(cloud_handle, &mac_1));
+
+    /* A member update is reflected in the group's set */
+    mac_tags[1].device_value_len = 2;
+    STRSCPY(mac_tags[1].device_value[1], "aa:bb:cc:dd:ee:03");
+    ret = om_tag_update_from_schema(&mac_tags[1]);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac_3));
+
+    /* Removing a member drops its values from the group's set */
+    ret = om_tag_remove_from_schema(&mac_tags[1]);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac_1));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &mac_2));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &mac_3));
+
+    om_tag_handle_put(cloud_handle);
+    om_tag_handle_put(handle);
+
+    ret = om_tag_group_remove_from_schema(&mac_group);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_remove_from_schema(&mac_tags[0]);
+    TEST_ASSERT_TRUE(ret);
+}
+
+
+void test_handle_in_stale_set(void)
+{
+    struct schema_Openflow_Tag addr_tag =
+    {
+        .name_exists = true,
+        .name = "stale_tag",
+        .device_value_len = 2,
+        .device_value =
+        {
+            "aa:bb:cc:dd:ee:01",
+            "10.1.0.2",
+        },
+    };
+    os_macaddr_t mac = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x01 } };
+    os_macaddr_t other_mac = { { 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x02 } };
+    om_tag_handle_t *handle;
+    om_tag_handle_t *cloud_handle;
+    struct in_addr ipv4;
+    bool ret;
+
+    inet_pton(AF_INET, "10.1.0.2", &ipv4);
+
+    ret = om_tag_add_from_schema(&addr_tag);
+    TEST_ASSERT_TRUE(ret);
+
+    handle = om_tag_handle_get("${stale_tag}");
+    TEST_ASSERT_NOT_NULL(handle);
+    cloud_handle = om_tag_handle_get("${#stale_tag}");
+    TEST_ASSERT_NOT_NULL(cloud_handle);
+
+    /* A failed rebuild drops the set, lookups walk the values list */
+    g_calloc_fail_after = 0;
+    ret = om_tag_set_build(handle->tag);
+    g_calloc_fail_after = -1;
+    TEST_ASSERT_FALSE(ret);
+    TEST_ASSERT_TRUE(handle->tag->set.stale);
+    TEST_ASSERT_NULL(handle->tag->set.entries);
+
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(handle, &other_mac));
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(handle, AF_INET, &ipv4));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(cloud_handle, &mac));
+
+    /* The next successful rebuild brings the set back */
+    ret = om_tag_set_build(handle->tag);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_FALSE(handle->tag->set.stale);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(handle, &mac));
+
+    om_tag_handle_put(cloud_handle);
+    om_tag_handle_put(handle);
+
+    ret = om_tag_remove_from_schema(&addr_tag);
+    TEST_ASSERT_TRUE(ret);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -298,6 +531,9 @@ main(int argc, char *argv[])
     RUN_TEST(test_tag_type);
     RUN_TEST(test_val_in_tag);
     RUN_TEST(test_val_in_tag_group);
+    RUN_TEST(test_handle_in_mac_ip);
+    RUN_TEST(test_handle_in_group_flattened);
+    RUN_TEST(test_handle_in_stale_set);
 
     return UNITY_END();
 }
@@ -28,6 +28,9 @@ UNIT_TYPE := TEST_BIN
 
 UNIT_SRC := test_schema_tags.c
 
+# Allocation failures are injected by the test
+UNIT_LDFLAGS := -Wl,--wrap=calloc
+
 UNIT_DEPS := src/lib/log
 UNIT_DEPS += src/lib/common
 UNIT_DEPS += src/lib/json_util
@@ -153,6 +153,7 @@ typedef struct
   int                               always_restart; /* always restart the process */
   int                               restart_delay;  /* delay before restart */
   bool                              needs_plan_b;   /* Execute restart plan B */
+  char                             *depends_on;     /* comma separated managers to wait for */
 } target_managers_config_t;
 
 /**
@@ -176,6 +177,10 @@ typedef struct
  * The needs_plan_b parameter is part of the monitoring recovery mechanism
  * where DM restarts ALL managers (true) through target_managers_restart or
  * just particular managers (false).
+ *
+ * The optional depends_on parameter lists managers that must signal
+ * readiness (see mon_notify_ready()) before DM starts this one, for example
+ * .depends_on = "wm,nm".
  */
 extern target_managers_config_t     target_managers_config[];
 extern int                          target_managers_num;
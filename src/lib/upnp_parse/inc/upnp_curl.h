@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <curl/curl.h>
 #include <ev.h>
 
+#include "ds_dlist.h"
 #include "ds_tree.h"
 #include "fsm.h"
 #include "os_types.h"
@@ -40,7 +41,12 @@ struct upnp_curl
     struct ev_io fifo_event;
     struct ev_timer timer_event;
     CURLM *multi;
+    CURLSH *share;
     int still_running;
+    int active;           /* transfers handed over to the multi handle */
+    ds_dlist_t conns;     /* active transfers */
+    ds_dlist_t pending;   /* urls waiting for a transfer slot */
+    size_t n_pending;
 };
 
 typedef enum
@@ -63,6 +69,15 @@ struct upnp_key_val
 #define REPORT_UPNP_TTL 20*60
 #define PROBE_UPNP 20*60
 
+/* Description validity when the advertisement carries no max-age */
+#define UPNP_DEFAULT_MAX_AGE 1800
+
+/* Delay before retrying a failed or dropped description download */
+#define UPNP_RETRY_BACKOFF 60
+
+#define UPNP_CURL_MAX_TRANSFERS 4
+#define UPNP_CURL_MAX_PENDING 64
+
 
 /* The upnp spec defines most of the fields'lengths */
 struct upnp_device_url
@@ -70,6 +85,10 @@ struct upnp_device_url
     char url[FSM_UPNP_URL_MAX_SIZE];
     upnp_state_t state;
     time_t timestamp;
+    time_t expires;      /* no new download until then */
+    long max_age;        /* advertised validity of the description */
+    bool pending;
+    ds_dlist_node_t pending_node;
     char dev_type[FSM_UPNP_URL_MAX_SIZE];
     char friendly_name[64];
     char manufacturer[256];
@@ -114,6 +133,7 @@ struct conn_info
     char error[CURL_ERROR_SIZE];
     struct upnp_device_url *context;
     struct upnp_curl_buffer data;
+    ds_dlist_node_t conn_node;
 };
 
 
@@ -138,4 +158,7 @@ upnp_curl_exit(void);
 void
 new_conn(struct upnp_device_url *url);
 
+void
+upnp_curl_cancel(struct upnp_device_url *url);
+
 #endif /* UPNP_CURL_H_INCLUDED */
@@ -43,6 +43,7 @@ struct upnp_parser
     uint8_t *data;
     size_t parsed;
     char location[FSM_UPNP_URL_MAX_SIZE];
+    long max_age;
 };
 
 
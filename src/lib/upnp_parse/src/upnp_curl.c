@@ -195,6 +195,7 @@ upnp_scan_data(struct conn_info *conn)
     to_report.nelems = NUM_OF_ELEMENTS;
     to_report.url = url;
     url->timestamp = time(NULL);
+    url->expires = url->timestamp + url->max_age;
     report = jencode_upnp_report(url->session, &to_report);
     url->session->ops.send_report(url->session, report);
     url->state = PLM_UPNP_COMPLETE;
@@ -202,6 +203,7 @@ upnp_scan_data(struct conn_info *conn)
 
   fail:
     url->state = PLM_UPNP_INIT;
+    url->expires = time(NULL) + UPNP_RETRY_BACKOFF;
     return;
 }
 
@@ -218,6 +220,8 @@ upnp_curl_process_conn(struct conn_info *conn)
         return;
     }
     url = conn->context;
+    if (url == NULL) return;
+
     data = &conn->data;
     LOGT("%s: data for url %s:\n%s", __func__,
          url->url, data->buf);
@@ -239,9 +243,37 @@ upnp_free_conn(struct conn_info *conn)
         curl_multi_remove_handle(mgr->multi, conn->easy);
         curl_easy_cleanup(conn->easy);
     }
+    if (conn->global != NULL)
+    {
+        ds_dlist_remove(&mgr->conns, conn);
+        mgr->active--;
+    }
     free(conn);
 }
 
+
+/**
+ * @brief starts the transfers queued while the concurrency cap was hit
+ *
+ * @param mgr the curl manager
+ * @return none
+ */
+static void
+upnp_curl_start_pending(struct upnp_curl *mgr)
+{
+    struct upnp_device_url *url;
+
+    while (mgr->active < UPNP_CURL_MAX_TRANSFERS)
+    {
+        url = ds_dlist_remove_head(&mgr->pending);
+        if (url == NULL) return;
+
+        mgr->n_pending--;
+        url->pending = false;
+        new_conn(url);
+    }
+}
+
 void
 check_multi_info(struct upnp_curl *mgr)
 {
@@ -265,13 +297,16 @@ check_multi_info(struct upnp_curl *mgr)
         curl_easy_cleanup(easy);
         conn->easy = NULL;
         if (res == CURLE_OK) upnp_curl_process_conn(conn);
-        else
+        else if (conn->context != NULL)
         {
             struct upnp_device_url *url = conn->context;
             url->state = PLM_UPNP_INIT;
+            url->expires = time(NULL) + UPNP_RETRY_BACKOFF;
         }
         upnp_free_conn(conn);
     }
+
+    upnp_curl_start_pending(mgr);
 }
 
 
@@ -391,6 +426,15 @@ size_t write_cb(void *ptr, size_t size, size_t nmemb, void *data)
 }
 
 
+/**
+ * @brief fetches the description advertised by a device
+ *
+ * At most UPNP_CURL_MAX_TRANSFERS downloads run at once. Extra requests
+ * are queued, and dropped with a retry backoff once the queue is full.
+ *
+ * @param url the advertised url context
+ * @return none
+ */
 void
 new_conn(struct upnp_device_url *url)
 {
@@ -398,6 +442,25 @@ new_conn(struct upnp_device_url *url)
     struct conn_info *conn;
     CURLMcode rc;
 
+    if (url->pending) return;
+
+    if (mgr->active >= UPNP_CURL_MAX_TRANSFERS)
+    {
+        if (mgr->n_pending >= UPNP_CURL_MAX_PENDING)
+        {
+            LOGD("%s: too many pending downloads, dropping %s",
+                 __func__, url->url);
+            url->state = PLM_UPNP_INIT;
+            url->expires = time(NULL) + UPNP_RETRY_BACKOFF;
+            return;
+        }
+
+        ds_dlist_insert_tail(&mgr->pending, url);
+        mgr->n_pending++;
+        url->pending = true;
+        return;
+    }
+
     conn = calloc(1, sizeof(struct conn_info));
     if (conn == NULL) return;
 
@@ -409,11 +472,11 @@ new_conn(struct upnp_device_url *url)
     conn->easy = curl_easy_init();
     if (!conn->easy) goto err_free_conn;
 
-    conn->global = mgr;
     conn->url = url->url;
     conn->context = url;
 
     curl_easy_setopt(conn->easy, CURLOPT_URL, conn->url);
+    curl_easy_setopt(conn->easy, CURLOPT_SHARE, mgr->share);
     curl_easy_setopt(conn->easy, CURLOPT_WRITEFUNCTION, write_cb);
     curl_easy_setopt(conn->easy, CURLOPT_WRITEDATA, conn);
     curl_easy_setopt(conn->easy, CURLOPT_ERRORBUFFER, conn->error);
@@ -427,15 +490,49 @@ new_conn(struct upnp_device_url *url)
 
     rc = curl_multi_add_handle(mgr->multi, conn->easy);
     mcode_or_die("new_conn: curl_multi_add_handle", rc);
-    if (rc == CURLM_OK) return;
+    if (rc == CURLM_OK)
+    {
+        conn->global = mgr;
+        ds_dlist_insert_tail(&mgr->conns, conn);
+        mgr->active++;
+        return;
+    }
 
 err_free_conn:
     upnp_free_conn(conn);
+    url->state = PLM_UPNP_INIT;
+    url->expires = time(NULL) + UPNP_RETRY_BACKOFF;
 
     return;
 }
 
 
+/**
+ * @brief detaches a url context about to be freed from the fetcher
+ *
+ * @param url the url context
+ * @return none
+ */
+void
+upnp_curl_cancel(struct upnp_device_url *url)
+{
+    struct upnp_curl *mgr = get_curl_mgr();
+    struct conn_info *conn;
+
+    if (url->pending)
+    {
+        ds_dlist_remove(&mgr->pending, url);
+        mgr->n_pending--;
+        url->pending = false;
+    }
+
+    ds_dlist_foreach(&mgr->conns, conn)
+    {
+        if (conn->context == url) conn->context = NULL;
+    }
+}
+
+
 void
 upnp_curl_init(struct ev_loop *loop)
 {
@@ -445,6 +542,13 @@ upnp_curl_init(struct ev_loop *loop)
     memset(mgr, 0, sizeof(*mgr));
     mgr->loop = loop;
     mgr->multi = curl_multi_init();
+    ds_dlist_init(&mgr->conns, struct conn_info, conn_node);
+    ds_dlist_init(&mgr->pending, struct upnp_device_url, pending_node);
+
+    /* Share DNS lookups and connections across all downloads */
+    mgr->share = curl_share_init();
+    curl_share_setopt(mgr->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(mgr->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
 
     ev_timer_init(&mgr->timer_event, timer_cb, 0., 0.);
     mgr->timer_event.data = mgr;
@@ -453,6 +557,8 @@ upnp_curl_init(struct ev_loop *loop)
     curl_multi_setopt(mgr->multi, CURLMOPT_SOCKETDATA, mgr);
     curl_multi_setopt(mgr->multi, CURLMOPT_TIMERFUNCTION, multi_timer_cb);
     curl_multi_setopt(mgr->multi, CURLMOPT_TIMERDATA, mgr);
+    curl_multi_setopt(mgr->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                      (long)UPNP_CURL_MAX_TRANSFERS);
 }
 
 
@@ -460,7 +566,21 @@ void
 upnp_curl_exit(void)
 {
     struct upnp_curl *mgr = get_curl_mgr();
+    struct upnp_device_url *url;
+    struct conn_info *conn;
+
+    while ((url = ds_dlist_remove_head(&mgr->pending)) != NULL)
+    {
+        url->pending = false;
+    }
+    mgr->n_pending = 0;
+
+    while ((conn = ds_dlist_head(&mgr->conns)) != NULL)
+    {
+        upnp_free_conn(conn);
+    }
 
     curl_multi_cleanup(mgr->multi);
+    curl_share_cleanup(mgr->share);
     curl_global_cleanup();
 }
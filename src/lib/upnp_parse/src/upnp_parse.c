@@ -24,8 +24,10 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <strings.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -218,6 +220,89 @@ upnp_get_url(struct upnp_session *u_session)
 }
 
 
+/**
+ * @brief case-insensitive lookup of needle within [start, end)
+ *
+ * @param start beginning of the search window
+ * @param end end of the search window (excluded)
+ * @param needle the string to look for
+ * @return pointer to the first match, or NULL if not found
+ */
+static char *
+upnp_search_nocase(char *start, char *end, const char *needle)
+{
+    size_t len;
+
+    len = strlen(needle);
+    for (; start + len <= end; start++)
+    {
+        if (strncasecmp(start, needle, len) == 0) return start;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief retrieves the validity advertised in the CACHE-CONTROL header
+ *
+ * Only the CACHE-CONTROL header line is looked at, and the lookup never
+ * goes past the message boundary.
+ *
+ * @param parser the parsed data container
+ * @return the advertised max-age in seconds, or the default one
+ */
+static long
+upnp_parse_max_age(struct upnp_parser *parser)
+{
+    char *header = "cache-control:";
+    char *directive = "max-age";
+    char *data;
+    char *line;
+    char *eol;
+    char *end;
+    char *p;
+    long val;
+
+    data = (char *)parser->data;
+    end = data + parser->upnp_len;
+
+    /* Locate the header at the beginning of a line */
+    line = NULL;
+    p = data;
+    while (p < end)
+    {
+        line = upnp_search_nocase(p, end, header);
+        if (line == NULL) return UPNP_DEFAULT_MAX_AGE;
+        if (line == data || line[-1] == '\n') break;
+
+        p = line + 1;
+        line = NULL;
+    }
+    if (line == NULL) return UPNP_DEFAULT_MAX_AGE;
+
+    line += strlen(header);
+    for (eol = line; eol < end && *eol != '\r' && *eol != '\n'; eol++);
+
+    p = upnp_search_nocase(line, eol, directive);
+    if (p == NULL) return UPNP_DEFAULT_MAX_AGE;
+
+    p += strlen(directive);
+    while (p < eol && (*p == ' ' || *p == '=')) p++;
+
+    val = 0;
+    for (; p < eol && *p >= '0' && *p <= '9'; p++)
+    {
+        if (val > (LONG_MAX - 9) / 10) return UPNP_DEFAULT_MAX_AGE;
+        val = val * 10 + (*p - '0');
+    }
+
+    if (val <= 0) return UPNP_DEFAULT_MAX_AGE;
+
+    return val;
+}
+
+
 /**
  * @brief parses the received message content
  *
@@ -268,6 +353,8 @@ upnp_parse_content(struct upnp_parser *parser)
     ip_loc = strstr(parser->location, ip_buf);
     if (ip_loc == NULL) return 0;
 
+    parser->max_age = upnp_parse_max_age(parser);
+
     return parser->upnp_len;
 }
 
@@ -275,7 +362,8 @@ upnp_parse_content(struct upnp_parser *parser)
 /**
  * @brief process the parsed message
  *
- * Triggers an exchange with the advertizing device
+ * Triggers an exchange with the advertizing device, unless the description
+ * it advertizes is still valid per the last advertised max-age.
  *
  * @param u_session the demo session pointing to the parsed message
  * @return none
@@ -286,10 +374,15 @@ upnp_process_message(struct upnp_session *u_session)
     struct upnp_device_url *url;
 
     url = upnp_get_url(u_session);
+    if (url == NULL) return;
+
+    /* Download in progress */
+    if (url->state == PLM_UPNP_STARTED) return;
 
-    /* If this URL was seen, bail */
-    if (url->state != PLM_UPNP_INIT) return;
+    /* Description still valid, or failed recently */
+    if (time(NULL) < url->expires) return;
 
+    url->max_age = u_session->parser.max_age;
     url->state = PLM_UPNP_STARTED;
     new_conn(url);
 }
@@ -488,6 +581,7 @@ upnp_free_device(struct upnp_device *udev)
         remove = url;
         url = ds_tree_next(tree, url);
         ds_tree_remove(tree, remove);
+        upnp_curl_cancel(remove);
         free(remove);
     }
 
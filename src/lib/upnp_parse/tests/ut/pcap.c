@@ -31,7 +31,7 @@ static const unsigned char pkt322[316] = {
 0x01, 0x2e, 0x4e, 0xcb, 0x00, 0x00, 0x03, 0x11, /* ..N..... */
 0x6d, 0xc9, 0x0a, 0x01, 0x00, 0x30, 0xef, 0xff, /* m....0.. */
 0xff, 0xfa, 0x16, 0x0d, 0x07, 0x6c, 0x01, 0x1a, /* .....l.. */
-0x72, 0xce, 0x4e, 0x4f, 0x54, 0x49, 0x46, 0x59, /* r.NOTIFY */
+0xb0, 0xd0, 0x4e, 0x4f, 0x54, 0x49, 0x46, 0x59, /* ..NOTIFY */
 0x20, 0x2a, 0x20, 0x48, 0x54, 0x54, 0x50, 0x2f, /*  * HTTP/ */
 0x31, 0x2e, 0x31, 0x0d, 0x0a, 0x48, 0x4f, 0x53, /* 1.1..HOS */
 0x54, 0x3a, 0x20, 0x32, 0x33, 0x39, 0x2e, 0x32, /* T: 239.2 */
@@ -39,8 +39,8 @@ static const unsigned char pkt322[316] = {
 0x35, 0x30, 0x3a, 0x31, 0x39, 0x30, 0x30, 0x0d, /* 50:1900. */
 0x0a, 0x43, 0x41, 0x43, 0x48, 0x45, 0x2d, 0x43, /* .CACHE-C */
 0x4f, 0x4e, 0x54, 0x52, 0x4f, 0x4c, 0x3a, 0x20, /* ONTROL:  */
-0x6d, 0x61, 0x78, 0x2d, 0x61, 0x67, 0x65, 0x3d, /* max-age= */
-0x31, 0x38, 0x30, 0x30, 0x0d, 0x0a, 0x4c, 0x4f, /* 1800..LO */
+0x4d, 0x61, 0x78, 0x2d, 0x41, 0x67, 0x65, 0x3d, /* Max-Age= */
+0x33, 0x36, 0x30, 0x30, 0x0d, 0x0a, 0x4c, 0x4f, /* 3600..LO */
 0x43, 0x41, 0x54, 0x49, 0x4f, 0x4e, 0x3a, 0x20, /* CATION:  */
 0x68, 0x74, 0x74, 0x70, 0x3a, 0x2f, 0x2f, 0x31, /* http://1 */
 0x30, 0x2e, 0x31, 0x2e, 0x30, 0x2e, 0x34, 0x38, /* 0.1.0.48 */
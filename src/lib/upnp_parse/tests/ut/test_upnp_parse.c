@@ -286,6 +286,7 @@ void test_upnp_get_url(void)
     len = upnp_parse_message(parser);
     TEST_ASSERT_TRUE(len != 0);
     TEST_ASSERT_EQUAL_UINT(sizeof(pkt322), net_parser->packet_len);
+    TEST_ASSERT_EQUAL_INT(3600, parser->max_age);
 
     url = upnp_get_url(u_session);
     TEST_ASSERT_NOT_NULL(url);
@@ -116,6 +116,9 @@ int main(int argc, char ** argv)
 
     // Run
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     // Exit
@@ -87,6 +87,9 @@ int main(int argc, char **argv)
 	}
 	nfm_init(loop);
 
+	/* Signal readiness to DM once the initial OVSDB monitor replies are in */
+	ovsdb_notify_ready();
+
 	ev_run(loop, 0);
 
 	nfm_fini();
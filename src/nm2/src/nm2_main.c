@@ -112,6 +112,9 @@ int main(int argc, char ** argv)
     nm2_ipv6_routeadv_init();
     nm2_mcast_init();
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     if (!ovsdb_stop_loop(loop)) {
@@ -46,6 +46,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "target.h"
 #include "om.h"
+#include "ovsdb.h"
 
 /*****************************************************************************/
 #define MODULE_ID LOG_MODULE_ID_MAIN
@@ -107,6 +108,9 @@ int main( int argc, char **argv )
     log_register_dynamic_severity( ev_loop );
 
     // Run the main loop
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run( ev_loop, 0 );
 
     // Cleanup and Exit
@@ -147,6 +147,9 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     pm_deinit(loop);
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os.h"
 #include "os_time.h"
 #include "util.h"
+#include "metrics.h"
 #include "qm_conn.h"
 
 #define QM_SOCK_DIR "/tmp/plume/"
@@ -46,6 +47,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 extern const char *log_get_name();
 
+static metrics_t qm_conn_metrics_send_us = METRICS_HIST_INIT("qm.send_us");
+static metrics_t qm_conn_metrics_send_bytes = METRICS_COUNTER_INIT("qm.send_bytes");
+static metrics_t qm_conn_metrics_send_errors = METRICS_COUNTER_INIT("qm.send_errors");
+
 // server
 bool qm_conn_server(int *pfd)
 {
@@ -477,6 +482,7 @@ bool qm_conn_send_fd(int fd, qm_request_t *req, char *topic, void *data, int dat
     bool result = false;
     qm_response_t res1;
     int ll = LOG_SEVERITY_TRACE;
+    uint64_t t0 = metrics_clock();
 
     if (!req) return false;
     if (!res) res = &res1;
@@ -524,6 +530,15 @@ out:
                 data_size, qm_data_type_str(req->data_type));
     }
 
+    if (req->cmd == QM_CMD_SEND) {
+        metrics_hist_since(&qm_conn_metrics_send_us, t0);
+        if (result) {
+            metrics_counter_add(&qm_conn_metrics_send_bytes, data_size);
+        } else {
+            metrics_counter_inc(&qm_conn_metrics_send_errors);
+        }
+    }
+
     return result;
 }
 
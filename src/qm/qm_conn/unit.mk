@@ -42,4 +42,5 @@ UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
 UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 
 UNIT_DEPS += src/lib/common
+UNIT_DEPS += src/lib/metrics
 
@@ -103,6 +103,9 @@ int main(int argc, char ** argv)
 
     qm_event_init();
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
     // exit:
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <limits.h>
 
 #include "sm.h"
+#include "ds_hash.h"
 
 #define MODULE_ID LOG_MODULE_ID_MAIN
 
@@ -46,12 +47,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define sm_client_report_stat_delta(n, o) ((n) - (o))
 
+/* Client record key: binary MAC and radio type (zero padded, hashed as
+   raw memory) */
 typedef struct
 {
+    mac_address_t                   mac;
+    uint8_t                         pad[2];
+    radio_type_t                    type;
+} sm_client_key_t;
+
+/* Client record, samples are folded into entry stats as they arrive */
+typedef struct
+{
+    sm_client_key_t                 key;
     dpp_client_record_t             entry;
-    ds_dlist_t                      result_list;
     target_client_record_t          cache;
-    ds_dlist_node_t                 node;
+
+    /* Client list state used by disconnect detection */
+    uint32_t                        seen_gen;
+    uint32_t                        seen_count;
+    bool                            seen_found;
+    bool                            seen_stop;
+
+    ds_hash_node_t                  hnode;
 } sm_client_record_t;
 
 static inline sm_client_record_t * sm_client_record_alloc()
@@ -61,6 +79,11 @@ static inline sm_client_record_t * sm_client_record_alloc()
     record = malloc(sizeof(sm_client_record_t));
     if (record) {
         memset(record, 0, sizeof(sm_client_record_t));
+
+        ds_dlist_init(&record->entry.stats_rx, dpp_client_stats_rx_t, node);
+        ds_dlist_init(&record->entry.stats_tx, dpp_client_stats_tx_t, node);
+        ds_dlist_init(&record->entry.tid_record_list,
+                      dpp_client_tid_record_list_t, node);
     }
 
     return record;
@@ -93,10 +116,11 @@ typedef struct
     /* Structure pointing to upper layer client storage */
     dpp_client_report_data_t        report;
 
-    /* Structure containing cached client sampling records
-       (sm_client_record_t) */
-    ds_dlist_t                      record_list;
+    /* Structure containing cached client records (sm_client_record_t)
+       indexed by sm_client_key_t */
+    ds_hash_t                       record_table;
     uint32_t                        record_qty;
+    uint32_t                        record_gen;
 
     /* target client temporary list for deriving records */
     ds_dlist_t                      client_list;
@@ -285,6 +309,22 @@ bool dpp_client_tid_records_clear(
     return true;
 }
 
+static
+void sm_client_record_stats_clear(
+        sm_client_ctx_t            *client_ctx,
+        dpp_client_record_t        *record_entry)
+{
+    dpp_client_stats_rx_records_clear(
+            client_ctx,
+            &record_entry->stats_rx);
+    dpp_client_stats_tx_records_clear(
+            client_ctx,
+            &record_entry->stats_tx);
+    dpp_client_tid_records_clear(
+            client_ctx,
+            &record_entry->tid_record_list);
+}
+
 static
 bool sm_client_record_clear(
         sm_client_ctx_t            *client_ctx,
@@ -297,15 +337,9 @@ bool sm_client_record_clear(
             record != NULL;
             record = ds_dlist_inext(&record_iter))
     {
-        dpp_client_stats_rx_records_clear(
-                client_ctx,
-                &record->stats_rx);
-        dpp_client_stats_tx_records_clear(
-                client_ctx,
-                &record->stats_tx);
-        dpp_client_tid_records_clear(
+        sm_client_record_stats_clear(
                 client_ctx,
-                &record->tid_record_list);
+                record);
 
         ds_dlist_iremove(&record_iter);
         dpp_client_record_free(record);
@@ -317,25 +351,26 @@ bool sm_client_record_clear(
 
 static
 bool sm_client_sm_records_clear(
-        sm_client_ctx_t            *client_ctx,
-        ds_dlist_t                 *record_list)
+        sm_client_ctx_t            *client_ctx)
 {
     sm_client_record_t             *record = NULL;
-    ds_dlist_iter_t                 record_iter;
+    ds_hash_iter_t                  record_iter;
 
-    for (   record = ds_dlist_ifirst(&record_iter, record_list);
+    for (   record = ds_hash_ifirst(&record_iter, &client_ctx->record_table);
             record != NULL;
-            record = ds_dlist_inext(&record_iter))
+            record = ds_hash_inext(&record_iter))
     {
-        sm_client_record_clear(
+        sm_client_record_stats_clear(
                 client_ctx,
-                &record->result_list);
+                &record->entry);
 
-        ds_dlist_iremove(&record_iter);
+        ds_hash_iremove(&record_iter);
         sm_client_record_free(record);
         record = NULL;
     }
 
+    ds_hash_fini(&client_ctx->record_table);
+
     return true;
 }
 
@@ -359,35 +394,39 @@ bool sm_client_target_clear(
     return true;
 }
 
+static
+uint32_t sm_client_key_hash(void *key)
+{
+    return ds_hash_mem(key, sizeof(sm_client_key_t), 0);
+}
+
+static
+int sm_client_key_cmp(void *a, void *b)
+{
+    return memcmp(a, b, sizeof(sm_client_key_t));
+}
+
+static inline
+void sm_client_key_set(
+        sm_client_key_t            *key,
+        dpp_client_info_t          *info)
+{
+    memset(key, 0, sizeof(*key));
+    memcpy(key->mac, info->mac, sizeof(key->mac));
+    key->type = info->type;
+}
+
 static
 sm_client_record_t *sm_client_records_mac_find(
         sm_client_ctx_t            *client_ctx,
         target_client_record_t     *client_entry)
 {
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
-    sm_client_record_t             *record = NULL;
-    dpp_client_record_t            *record_entry = NULL;
-    ds_dlist_iter_t                 record_iter;
+    sm_client_key_t                 key;
 
-    /* Find current client in existing list */
-    for (   record = ds_dlist_ifirst(&record_iter, record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
-    {
-        record_entry = &record->entry;
+    /* Find current client in existing table */
+    sm_client_key_set(&key, &client_entry->info);
 
-        if (!memcmp(
-                    record_entry->info.mac,
-                    client_entry->info.mac,
-                    sizeof(record_entry->info.mac))
-             && (record_entry->info.type == client_entry->info.type)
-           ) {
-            return record;
-        }
-    }
-
-    return NULL;
+    return ds_hash_find(&client_ctx->record_table, &key);
 }
 
 static
@@ -437,183 +476,120 @@ void sm_client_report_calculate_duration (
     client_ctx->duration_ts = timestamp_ms;
 }
 
+/* Rx and tx rate stats share the same base struct; samples either add to
+   an existing (mcs, nss, bw) bucket or are moved over as a new bucket */
 static
-bool sm_client_report_rx_stats_calculate_average(
+void sm_client_rate_stats_fold(
         sm_client_ctx_t            *client_ctx,
-        ds_dlist_t                 *stats_record_list,
-        ds_dlist_t                 *stats_report_list)
+        ds_dlist_t                 *sample_list,
+        ds_dlist_t                 *stats_list,
+        bool                        rx)
 {
-    dpp_client_stats_rx_t          *record = NULL;
-    ds_dlist_iter_t                 record_iter;
-    dpp_client_stats_rx_t          *report = NULL;
-    ds_dlist_iter_t                 report_iter;
-    bool                            found = false;
-
-    radio_entry_t                  *radio_cfg_ctx =
-        client_ctx->radio_cfg;
-
-    /* Find the record and if exists update it otherwise create new! */
-    for (   record = ds_dlist_ifirst(&record_iter, stats_record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
+    dpp_client_stats_rx_t          *sample = NULL;
+    ds_dlist_iter_t                 sample_iter;
+    dpp_client_stats_rx_t          *stats = NULL;
+    ds_dlist_iter_t                 stats_iter;
+
+    for (   sample = ds_dlist_ifirst(&sample_iter, sample_list);
+            sample != NULL;
+            sample = ds_dlist_inext(&sample_iter))
     {
-        for (   report = ds_dlist_ifirst(&report_iter, stats_report_list);
-                report != NULL;
-                report = ds_dlist_inext(&report_iter))
+        for (   stats = ds_dlist_ifirst(&stats_iter, stats_list);
+                stats != NULL;
+                stats = ds_dlist_inext(&stats_iter))
         {
-            found = false;
-            if (    (report->mcs == record->mcs)
-                 && (report->nss == record->nss)
-                 && (report->bw == record->bw)
+            if (    (stats->mcs == sample->mcs)
+                 && (stats->nss == sample->nss)
+                 && (stats->bw == sample->bw)
                )
             {
-                found = true;
                 break;
             }
         }
 
         /* Add new measurement */
-        if (!found) {
-            report =
-                dpp_client_stats_rx_record_alloc();
-            if (NULL == report) {
-                LOG(ERR,
-                    "Sending %s client report "
-                    "(Failed to allocate rx stats memory)",
-                    radio_get_name_from_cfg(radio_cfg_ctx));
-                return false;
+        if (NULL == stats) {
+            ds_dlist_iremove(&sample_iter);
+            if (!rx) {
+                sample->rssi = 0;
             }
-
-            report->mcs = record->mcs;
-            report->nss = record->nss;
-            report->bw  = record->bw;
+            ds_dlist_insert_tail(stats_list, sample);
+            continue;
         }
 
-        report->bytes   += record->bytes;
-        report->msdu    += record->msdu;
-        report->mpdu    += record->mpdu;
-        report->ppdu    += record->ppdu;
-        report->retries += record->retries;
-        report->errors  += record->errors;
-        report->rssi     = record->rssi;
-
-        if (!found) {
-            ds_dlist_insert_tail(stats_report_list, report);
+        stats->bytes   += sample->bytes;
+        stats->msdu    += sample->msdu;
+        stats->mpdu    += sample->mpdu;
+        stats->ppdu    += sample->ppdu;
+        stats->retries += sample->retries;
+        stats->errors  += sample->errors;
+        if (rx) {
+            stats->rssi = sample->rssi;
         }
     }
-
-    return true;
 }
 
+/* TID sojourn samples are summed per (tid, ac) into a single record
+   carrying the timestamp of the last sample */
 static
-bool sm_client_report_tx_stats_calculate_average(
+void sm_client_tid_stats_fold(
         sm_client_ctx_t            *client_ctx,
-        ds_dlist_t                 *stats_record_list,
-        ds_dlist_t                 *stats_report_list)
+        ds_dlist_t                 *sample_list,
+        ds_dlist_t                 *tid_list)
 {
-    dpp_client_stats_tx_t          *record = NULL;
-    ds_dlist_iter_t                 record_iter;
-    dpp_client_stats_tx_t          *report = NULL;
-    ds_dlist_iter_t                 report_iter;
-    bool                            found = false;
-
-    radio_entry_t                  *radio_cfg_ctx =
-        client_ctx->radio_cfg;
-
-    for (   record = ds_dlist_ifirst(&record_iter, stats_record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
+    dpp_client_tid_record_list_t   *sample = NULL;
+    ds_dlist_iter_t                 sample_iter;
+    dpp_client_tid_record_list_t   *stats = NULL;
+    dpp_client_stats_tid_t         *sample_tid = NULL;
+    dpp_client_stats_tid_t         *stats_tid = NULL;
+    int                             i;
+    int                             j;
+
+    for (   sample = ds_dlist_ifirst(&sample_iter, sample_list);
+            sample != NULL;
+            sample = ds_dlist_inext(&sample_iter))
     {
-        for (   report = ds_dlist_ifirst(&report_iter, stats_report_list);
-                report != NULL;
-                report = ds_dlist_inext(&report_iter))
-        {
-            found = false;
-            if (    (report->mcs == record->mcs)
-                 && (report->nss == record->nss)
-                 && (report->bw == record->bw)
-               )
-            {
-                found = true;
-                break;
-            }
+        stats = ds_dlist_head(tid_list);
+        if (NULL == stats) {
+            ds_dlist_iremove(&sample_iter);
+            ds_dlist_insert_tail(tid_list, sample);
+            continue;
         }
 
-        /* Add new measurement */
-        if (!found) {
-            report =
-                dpp_client_stats_tx_record_alloc();
-            if (NULL == report) {
-                LOG(ERR,
-                    "Sending %s client report "
-                    "(Failed to allocate tx stats memory)",
-                    radio_get_name_from_cfg(radio_cfg_ctx));
-                return false;
+        for (i = 0; i < CLIENT_MAX_TID_RECORDS; i++) {
+            sample_tid = &sample->entry[i];
+            if (!sample_tid->num_msdus) {
+                continue;
             }
 
-            report->mcs = record->mcs;
-            report->nss = record->nss;
-            report->bw  = record->bw;
-        }
-
-        report->bytes   += record->bytes;
-        report->msdu    += record->msdu;
-        report->mpdu    += record->mpdu;
-        report->ppdu    += record->ppdu;
-        report->retries += record->retries;
-        report->errors  += record->errors;
-
-        if (!found) {
-            ds_dlist_insert_tail(stats_report_list, report);
-        }
-    }
-
-    return true;
-}
-
-static
-bool sm_client_report_tid_stats_calculate_average(
-        sm_client_ctx_t            *client_ctx,
-        ds_dlist_t                 *tid_record_list,
-        ds_dlist_t                 *tid_report_list)
-{
-    dpp_client_tid_record_list_t   *record = NULL;
-    ds_dlist_iter_t                 record_iter;
-
-    sm_stats_request_t             *request_ctx =
-        &client_ctx->request;
-    radio_entry_t                  *radio_cfg_ctx =
-        client_ctx->radio_cfg;
+            /* Matching entry or the first unused one; used entries
+               are kept at the front of the table */
+            for (j = 0; j < CLIENT_MAX_TID_RECORDS; j++) {
+                stats_tid = &stats->entry[j];
+                if (!stats_tid->num_msdus) {
+                    break;
+                }
+                if (    (stats_tid->tid == sample_tid->tid)
+                     && (stats_tid->ac == sample_tid->ac)) {
+                    break;
+                }
+            }
+            if (j == CLIENT_MAX_TID_RECORDS) {
+                continue;
+            }
 
-    dpp_client_tid_record_list_t   *report = NULL;
+            if (!stats_tid->num_msdus) {
+                memcpy(stats_tid, sample_tid, sizeof(*stats_tid));
+                continue;
+            }
 
-    for (   record = ds_dlist_ifirst(&record_iter, tid_record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
-    {
-        /* Add new measurement */
-        report =
-            dpp_client_tid_record_alloc();
-        if (NULL == report) {
-            LOG(ERR,
-                "Sending %s client report "
-                "(Failed to allocate tid stats memory)",
-                radio_get_name_from_cfg(radio_cfg_ctx));
-            return false;
+            stats_tid->ewma_time_ms  = sample_tid->ewma_time_ms;
+            stats_tid->sum_time_ms  += sample_tid->sum_time_ms;
+            stats_tid->num_msdus    += sample_tid->num_msdus;
         }
 
-        /* Copy tid records */
-        memcpy(&report->entry, &record->entry, sizeof(record->entry));
-
-        /* Adjust timestamp */
-        report->timestamp_ms =
-            request_ctx->reporting_timestamp - client_ctx->report_ts +
-            record->timestamp_ms;
-
-        ds_dlist_insert_tail(tid_report_list, report);
+        stats->timestamp_ms = sample->timestamp_ms;
     }
-
-    return true;
 }
 
 static inline double
@@ -655,48 +631,99 @@ void sm_client_report_stats_calculate_average (
     report->errors_tx   += record->errors_tx;
 }
 
+static
+void sm_client_record_fold (
+        sm_client_ctx_t            *client_ctx,
+        sm_client_record_t         *record,
+        dpp_client_record_t        *sample_entry)
+{
+    dpp_client_record_t            *record_entry =
+        &record->entry;
+
+    sm_client_report_stats_calculate_average(
+            client_ctx,
+            &sample_entry->stats,
+            &record_entry->stats);
+
+    /* Copy uAPSD info (Debug purpose only) */
+    record_entry->uapsd |= sample_entry->uapsd;
+
+    sm_client_rate_stats_fold(
+            client_ctx,
+            &sample_entry->stats_rx,
+            &record_entry->stats_rx,
+            true);
+
+    sm_client_rate_stats_fold(
+            client_ctx,
+            &sample_entry->stats_tx,
+            &record_entry->stats_tx,
+            false);
+
+    sm_client_tid_stats_fold(
+            client_ctx,
+            &sample_entry->tid_record_list,
+            &record_entry->tid_record_list);
+}
+
+static
+void sm_client_report_stats_list_move(
+        ds_dlist_t                 *src,
+        ds_dlist_t                 *dst)
+{
+    void                           *entry = NULL;
+    ds_dlist_iter_t                 entry_iter;
+
+    for (   entry = ds_dlist_ifirst(&entry_iter, src);
+            entry != NULL;
+            entry = ds_dlist_inext(&entry_iter))
+    {
+        ds_dlist_iremove(&entry_iter);
+        ds_dlist_insert_tail(dst, entry);
+    }
+}
+
 static
 void sm_client_report_calculate_average (
         sm_client_ctx_t            *client_ctx,
         sm_client_record_t         *record,
         dpp_client_record_t        *report_entry)
 {
-    dpp_client_record_t            *record_entry = NULL;
-    ds_dlist_iter_t                 record_iter;
+    dpp_client_record_t            *record_entry =
+        &record->entry;
+    dpp_client_tid_record_list_t   *tid = NULL;
+    ds_dlist_iter_t                 tid_iter;
 
+    sm_stats_request_t             *request_ctx =
+        &client_ctx->request;
     radio_entry_t                  *radio_cfg_ctx =
         client_ctx->radio_cfg;
 
-    for (   record_entry = ds_dlist_ifirst(&record_iter, &record->result_list);
-            record_entry != NULL;
-            record_entry = ds_dlist_inext(&record_iter))
+    /* Samples were already aggregated on arrival, hand the running
+       aggregates over to the report */
+    memcpy(&report_entry->stats,
+           &record_entry->stats,
+           sizeof(report_entry->stats));
+    report_entry->uapsd = record_entry->uapsd;
+
+    sm_client_report_stats_list_move(
+            &record_entry->stats_rx,
+            &report_entry->stats_rx);
+    sm_client_report_stats_list_move(
+            &record_entry->stats_tx,
+            &report_entry->stats_tx);
+    sm_client_report_stats_list_move(
+            &record_entry->tid_record_list,
+            &report_entry->tid_record_list);
+
+    /* Adjust timestamp */
+    for (   tid = ds_dlist_ifirst(&tid_iter, &report_entry->tid_record_list);
+            tid != NULL;
+            tid = ds_dlist_inext(&tid_iter))
     {
-        /* Copy stats rx list stats */
-        sm_client_report_stats_calculate_average(
-                client_ctx,
-                &record_entry->stats,
-                &report_entry->stats);
-
-        /* Copy uAPSD info (Debug purpose only) */
-        report_entry->uapsd |= record_entry->uapsd;
-
-        /* Copy stats rx list stats */
-        sm_client_report_rx_stats_calculate_average(
-                client_ctx,
-                &record_entry->stats_rx,
-                &report_entry->stats_rx);
-
-        /* Copy stats tx list stats */
-        sm_client_report_tx_stats_calculate_average(
-                client_ctx,
-                &record_entry->stats_tx,
-                &report_entry->stats_tx);
-
-        /* Copy TID list stats */
-        sm_client_report_tid_stats_calculate_average(
-                client_ctx,
-                &record_entry->tid_record_list,
-                &report_entry->tid_record_list);
+        tid->timestamp_ms =
+            request_ctx->reporting_timestamp - client_ctx->report_ts +
+            tid->timestamp_ms;
     }
 
     LOG(DEBUG,
@@ -717,10 +744,9 @@ bool sm_client_report_send(
         sm_client_ctx_t            *client_ctx)
 {
     bool                            status;
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
+    ds_hash_t                      *record_table =
+        &client_ctx->record_table;
     sm_client_record_t             *record = NULL;
-    ds_dlist_iter_t                 record_iter;
     dpp_client_record_t            *record_entry = NULL;
 
     dpp_client_report_data_t       *report_ctx =
@@ -749,9 +775,7 @@ bool sm_client_report_send(
         get_timestamp();
 
     client_ctx->record_qty++;
-    for (   record = ds_dlist_ifirst(&record_iter, record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
+    ds_hash_foreach(record_table, record)
     {
         record_entry = &record->entry;
 
@@ -767,9 +791,7 @@ bool sm_client_report_send(
         /* Copy client info */
         memcpy(&report_entry->info, &record_entry->info, sizeof(record_entry->info));
 
-        /* Perform data manipulation from the samples collected
-           - for now only aggregation is supported
-         */
+        /* Move the aggregated sample data into the report */
         sm_client_report_calculate_average(
                 client_ctx,
                 record,
@@ -828,58 +850,76 @@ void sm_client_records_mark_disconnected (
 {
     sm_stats_request_t             *request_ctx =
         &client_ctx->request;
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
+    ds_hash_t                      *record_table =
+        &client_ctx->record_table;
     radio_entry_t                  *radio_cfg_ctx =
         client_ctx->radio_cfg;
 
     sm_client_record_t             *record = NULL;
-    ds_dlist_iter_t                 record_iter;
     dpp_client_record_t            *record_entry = NULL;
 
     target_client_record_t         *client_entry = NULL;
     ds_dlist_iter_t                 client_iter;
 
+    uint32_t                        gen = ++client_ctx->record_gen;
     uint32_t                        found;
     uint32_t                        count;
 
-    for (   record = ds_dlist_ifirst(&record_iter, record_list);
-            record != NULL;
-            record = ds_dlist_inext(&record_iter))
+    /* Single pass over the client list, collecting per record whether
+       the client is still present on the same interface and on how
+       many interfaces it shows up */
+    for (   client_entry = ds_dlist_ifirst(&client_iter, client_list);
+            client_entry != NULL;
+            client_entry = ds_dlist_inext(&client_iter))
     {
-        record_entry = &record->entry;
+        record =
+            sm_client_records_mac_find(
+                    client_ctx,
+                    client_entry);
+        if (NULL == record) {
+            continue;
+        }
 
-        found = false;
-        count = 0;
+        if (record->seen_gen != gen) {
+            record->seen_gen = gen;
+            record->seen_count = 0;
+            record->seen_found = false;
+            record->seen_stop = false;
+        }
 
-        for (   client_entry = ds_dlist_ifirst(&client_iter, client_list);
-                client_entry != NULL;
-                client_entry = ds_dlist_inext(&client_iter))
-        {
-            /* Check if client is already connected and if it is
-               on the same interface
-             */
-            if (MAC_ADDR_EQ(
-                        client_entry->info.mac,
-                        record_entry->info.mac)) {
-                /* Notify disconnection through stats cookie */
-                if (client_entry->stats_cookie !=
-                        record->cache.stats_cookie ) {
-                    break;
-                }
+        if (record->seen_stop) {
+            continue;
+        }
 
-                /* Client changed interface */
-                if(0 == strcmp(
-                            client_entry->info.ifname,
-                            record_entry->info.ifname )) {
-                    found = true;
-                }
+        /* Notify disconnection through stats cookie */
+        if (client_entry->stats_cookie !=
+                record->cache.stats_cookie ) {
+            record->seen_stop = true;
+            continue;
+        }
 
-                /* Driver did not yet kickout client so we have
-                   it on both radios
-                 */
-                count++;
-            }
+        /* Client changed interface */
+        if(0 == strcmp(
+                    client_entry->info.ifname,
+                    record->entry.info.ifname )) {
+            record->seen_found = true;
+        }
+
+        /* Driver did not yet kickout client so we have
+           it on both radios
+         */
+        record->seen_count++;
+    }
+
+    ds_hash_foreach(record_table, record)
+    {
+        record_entry = &record->entry;
+
+        found = false;
+        count = 0;
+        if (record->seen_gen == gen) {
+            found = record->seen_found;
+            count = record->seen_count;
         }
 
         /* Client was either disconnected or changed interface */
@@ -924,28 +964,29 @@ static
 bool sm_client_records_reset (
         sm_client_ctx_t            *client_ctx)
 {
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
+    ds_hash_t                      *record_table =
+        &client_ctx->record_table;
     radio_entry_t                  *radio_cfg_ctx =
         client_ctx->radio_cfg;
 
     sm_client_record_t             *record = NULL;
-    ds_dlist_iter_t                 record_iter;
+    ds_hash_iter_t                  record_iter;
     dpp_client_record_t            *record_entry = NULL;
 
     /* Loop through cached structure */
-    for (   record = ds_dlist_ifirst(&record_iter, record_list);
+    for (   record = ds_hash_ifirst(&record_iter, record_table);
             record != NULL;
-            record = ds_dlist_inext(&record_iter))
+            record = ds_hash_inext(&record_iter))
     {
         record_entry = &record->entry;
 
         /* Reset means end of report therefore clear all
            dynamic entries regardless of connection status
          */
-        sm_client_record_clear(
+        sm_client_record_stats_clear(
                 client_ctx,
-                &record->result_list);
+                record_entry);
+        record_entry->uapsd = 0;
 
         if(record_entry->is_connected) {
             /* reset counters for new report */
@@ -970,7 +1011,7 @@ bool sm_client_records_reset (
                 radio_get_name_from_cfg(radio_cfg_ctx),
                 MAC_ADDRESS_PRINT(record_entry->info.mac));
 
-            ds_dlist_iremove(&record_iter);
+            ds_hash_iremove(&record_iter);
             sm_client_record_free(record);
             record = NULL;
         }
@@ -993,7 +1034,8 @@ bool sm_client_records_update_stats(
         client_ctx->radio_cfg;
 
     dpp_client_record_t            *record_entry = NULL;
-    dpp_client_record_t            *result_entry = NULL;
+    dpp_client_record_t             sample;
+    dpp_client_record_t            *result_entry = &sample;
 
     if (NULL == record) {
         return false;
@@ -1001,16 +1043,13 @@ bool sm_client_records_update_stats(
 
     record_entry = &record->entry;
 
-    /* Allocate new sample and convert new and old stats into result delta */
-    result_entry =
-        dpp_client_record_alloc ();
-    if (NULL == result_entry) {
-        LOG(ERR,
-            "Updating %s interface client stats "
-            "(Failed to allocate result memory)",
-            radio_get_name_from_cfg(radio_cfg_ctx));
-        return false;
-    }
+    /* Convert new and old stats into a temporary sample delta which is
+       folded into the record right away */
+    memset(result_entry, 0, sizeof(*result_entry));
+    ds_dlist_init(&result_entry->stats_rx, dpp_client_stats_rx_t, node);
+    ds_dlist_init(&result_entry->stats_tx, dpp_client_stats_tx_t, node);
+    ds_dlist_init(&result_entry->tid_record_list,
+                  dpp_client_tid_record_list_t, node);
 
     /* Start collecting rx stats for new client entry */
     status =
@@ -1024,6 +1063,7 @@ bool sm_client_records_update_stats(
             "Updating %s interface client stats "
             "(Failed to convert target data)",
             radio_get_name_from_cfg(radio_cfg_ctx));
+        sm_client_record_stats_clear(client_ctx, result_entry);
         return false;
     }
 
@@ -1042,11 +1082,15 @@ bool sm_client_records_update_stats(
                 "Updating %s interface client stats "
                 "(Failed to update RSSI data)",
                 radio_get_name_from_cfg(radio_cfg_ctx));
+            sm_client_record_stats_clear(client_ctx, result_entry);
             return false;
         }
     }
 
-    ds_dlist_insert_tail(&record->result_list, result_entry);
+    sm_client_record_fold(client_ctx, record, result_entry);
+
+    /* Release sample entries that were not moved into the record */
+    sm_client_record_stats_clear(client_ctx, result_entry);
 
     /* Update cache entry for average calculation */
     memcpy (&record->cache,
@@ -1066,8 +1110,8 @@ bool sm_client_records_update(
 
     sm_stats_request_t             *request_ctx =
         &client_ctx->request;
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
+    ds_hash_t                      *record_table =
+        &client_ctx->record_table;
     radio_entry_t                  *radio_cfg_ctx =
         client_ctx->radio_cfg;
 
@@ -1134,16 +1178,11 @@ bool sm_client_records_update(
             }
             record_entry = &record->entry;
 
-            /* Initialize sampling/result list and add the first entry */
-            ds_dlist_init(
-                    &record->result_list,
-                    dpp_client_record_t,
-                    node);
-
             /* Copy general client info. */
             memcpy (&record_entry->info,
                      &client_entry->info,
                      sizeof(record_entry->info));
+            sm_client_key_set(&record->key, &record_entry->info);
 
             /* Init connectivity stats */
             record_entry->is_connected = true;
@@ -1163,7 +1202,7 @@ bool sm_client_records_update(
                 record_entry->duration_ms);
 
             /* Insert new entry */
-            ds_dlist_insert_tail(record_list, record);
+            ds_hash_insert(record_table, record, &record->key);
         }
 
 update_cache:
@@ -1447,8 +1486,6 @@ bool sm_client_report_init(
 
     radio_entry_t                  *radio_cfg_ctx =
         client_ctx->radio_cfg;
-    ds_dlist_t                     *record_list =
-        &client_ctx->record_list;
     ds_dlist_t                     *client_list =
         &client_ctx->client_list;
     ds_dlist_init(
@@ -1464,8 +1501,7 @@ bool sm_client_report_init(
     /* Clear cached client records */
     status =
         sm_client_sm_records_clear(
-                client_ctx,
-                record_list);
+                client_ctx);
     if (true != status) {
         LOG(ERR,
             "Processing %s client report "
@@ -1611,11 +1647,13 @@ bool sm_client_report_request(
                 dpp_client_record_t,
                 node);
 
-        /* Initialize client list */
-        ds_dlist_init(
-                &client_ctx->record_list,
+        /* Initialize client table */
+        ds_hash_init(
+                &client_ctx->record_table,
+                sm_client_key_hash,
+                sm_client_key_cmp,
                 sm_client_record_t,
-                node);
+                hnode);
 
         /* Reschedule initialization in case of error */
         ev_init (init_timer, sm_client_init_timer_cb);
@@ -46,6 +46,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "dppline.h"
 #include "os_backtrace.h"
 #include "json_util.h"
+#include "metrics.h"
+#include "evx.h"
 
 #include "sm.h"
 
@@ -90,6 +92,12 @@ int main (int argc, char **argv)
 
     json_memdbg_init(loop);
 
+    metrics_server_start(loop, "SM");
+
+#if defined(CONFIG_LIBEVX_LOOP_WATCHDOG)
+    evx_lag_start(loop, CONFIG_LIBEVX_LOOP_WATCHDOG_MS);
+#endif
+
     /* Initialize target library */
     rc = target_init(TARGET_INIT_MGR_SM, loop);
     if (true != rc)
@@ -136,6 +144,9 @@ int main (int argc, char **argv)
 
     backtrace_init();
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(EV_DEFAULT, 0);
 
     target_close(TARGET_INIT_MGR_SM, loop);
@@ -147,6 +158,9 @@ int main (int argc, char **argv)
 
     sm_mqtt_stop();
 
+    evx_lag_stop();
+    metrics_server_stop();
+
     ev_default_destroy();
 
     LOGN("Exiting SM");
@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "os_nif.h"
+#include "sm_neighbor_diff.h"
+
+#define MODULE_ID LOG_MODULE_ID_MAIN
+
+static
+uint32_t sm_neighbor_key_hash(void *key)
+{
+    return ds_hash_mem(key, sizeof(sm_neighbor_key_t), 0);
+}
+
+static
+int sm_neighbor_key_cmp(void *a, void *b)
+{
+    return memcmp(a, b, sizeof(sm_neighbor_key_t));
+}
+
+static
+bool sm_neighbor_key_set(
+        sm_neighbor_key_t          *key,
+        dpp_neighbor_record_t      *entry)
+{
+    os_macaddr_t                    mac;
+
+    memset(key, 0, sizeof(*key));
+
+    if (!os_nif_macaddr_from_str(&mac, entry->bssid)) {
+        return false;
+    }
+
+    memcpy(key->bssid, mac.addr, sizeof(mac.addr));
+    key->chan = entry->chan;
+
+    return true;
+}
+
+void sm_neighbor_diff_init(
+        sm_neighbor_diff_t         *diff)
+{
+    ds_hash_init(
+            &diff->cache,
+            sm_neighbor_key_hash,
+            sm_neighbor_key_cmp,
+            sm_neighbor_cache_t,
+            hnode);
+    diff->gen = 0;
+}
+
+void sm_neighbor_diff_fini(
+        sm_neighbor_diff_t         *diff)
+{
+    sm_neighbor_cache_t            *cache;
+    ds_hash_iter_t                  cache_iter;
+
+    for (   cache = ds_hash_ifirst(&cache_iter, &diff->cache);
+            cache != NULL;
+            cache = ds_hash_inext(&cache_iter)) {
+        ds_hash_iremove(&cache_iter);
+        free(cache);
+    }
+
+    ds_hash_fini(&diff->cache);
+}
+
+bool sm_neighbor_diff_build(
+        sm_neighbor_diff_t         *diff,
+        dpp_neighbor_list_t        *neighbors,
+        dpp_neighbor_list_t        *report,
+        uint32_t                   *invalid)
+{
+    dpp_neighbor_record_list_t     *neighbor = NULL;
+    ds_dlist_iter_t                 neighbor_iter;
+    dpp_neighbor_record_t          *neighbor_entry = NULL;
+
+    sm_neighbor_cache_t            *cache = NULL;
+    ds_hash_iter_t                  cache_iter;
+    sm_neighbor_key_t               key;
+    uint32_t                        gen = ++diff->gen;
+
+    dpp_neighbor_record_list_t     *record = NULL;
+
+    *invalid = 0;
+
+    /* Each neighbor is looked up by binary BSSID and channel, entries seen
+       in this round are tagged with the current generation and whatever is
+       left untagged afterwards has disappeared since the previous report */
+    for (   neighbor = ds_dlist_ifirst(&neighbor_iter, neighbors);
+            neighbor != NULL;
+            neighbor = ds_dlist_inext(&neighbor_iter))
+    {
+        neighbor_entry = &neighbor->entry;
+
+        if (!sm_neighbor_key_set(&key, neighbor_entry)) {
+            LOGD("Skipping neighbor diff {bssid='%s'} (invalid bssid)",
+                 neighbor_entry->bssid);
+            (*invalid)++;
+            continue;
+        }
+
+        cache = ds_hash_find(&diff->cache, &key);
+        if (NULL != cache) {
+            /* Keep the latest values for the diff- report */
+            cache->gen = gen;
+            cache->update = neighbor_entry;
+            continue;
+        }
+
+        /* Mark entry added */
+        cache = calloc(1, sizeof(*cache));
+        record = dpp_neighbor_record_alloc();
+        if ((NULL == cache) || (NULL == record)) {
+            free(cache);
+            dpp_neighbor_record_free(record);
+            goto error;
+        }
+
+        memcpy(&record->entry, neighbor_entry, sizeof(record->entry));
+        ds_dlist_insert_tail(report, record);
+
+        cache->key = key;
+        cache->gen = gen;
+        cache->added = true;
+        memcpy(&cache->entry, neighbor_entry, sizeof(cache->entry));
+        ds_hash_insert(&diff->cache, cache, &cache->key);
+    }
+
+    /* Mark untagged entries expired */
+    for (   cache = ds_hash_ifirst(&cache_iter, &diff->cache);
+            cache != NULL;
+            cache = ds_hash_inext(&cache_iter))
+    {
+        if (cache->gen == gen) {
+            continue;
+        }
+
+        record = dpp_neighbor_record_alloc();
+        if (NULL == record) {
+            goto error;
+        }
+
+        memcpy(&record->entry, &cache->entry, sizeof(record->entry));
+        record->entry.lastseen = 0;
+        ds_dlist_insert_tail(report, record);
+    }
+
+    return true;
+
+error:
+    sm_neighbor_diff_rollback(diff);
+
+    for (   record = ds_dlist_ifirst(&neighbor_iter, report);
+            record != NULL;
+            record = ds_dlist_inext(&neighbor_iter)) {
+        ds_dlist_iremove(&neighbor_iter);
+        dpp_neighbor_record_free(record);
+    }
+
+    return false;
+}
+
+void sm_neighbor_diff_commit(
+        sm_neighbor_diff_t         *diff)
+{
+    sm_neighbor_cache_t            *cache;
+    ds_hash_iter_t                  cache_iter;
+
+    for (   cache = ds_hash_ifirst(&cache_iter, &diff->cache);
+            cache != NULL;
+            cache = ds_hash_inext(&cache_iter))
+    {
+        if (cache->gen != diff->gen) {
+            ds_hash_iremove(&cache_iter);
+            free(cache);
+            continue;
+        }
+
+        if (NULL != cache->update) {
+            memcpy(&cache->entry, cache->update, sizeof(cache->entry));
+        }
+        cache->update = NULL;
+        cache->added = false;
+    }
+}
+
+void sm_neighbor_diff_rollback(
+        sm_neighbor_diff_t         *diff)
+{
+    sm_neighbor_cache_t            *cache;
+    ds_hash_iter_t                  cache_iter;
+
+    for (   cache = ds_hash_ifirst(&cache_iter, &diff->cache);
+            cache != NULL;
+            cache = ds_hash_inext(&cache_iter))
+    {
+        if (cache->added) {
+            ds_hash_iremove(&cache_iter);
+            free(cache);
+            continue;
+        }
+
+        cache->update = NULL;
+    }
+}
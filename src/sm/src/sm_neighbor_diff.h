@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Neighbor diff report cache
+ *
+ * Keeps the neighbors last reported per radio and scan type. A diff is built
+ * in two steps: sm_neighbor_diff_build() composes the diff+/diff- records
+ * against the cache, then the cache is brought in line with them by
+ * sm_neighbor_diff_commit() once the report is sent, or left as it was by
+ * sm_neighbor_diff_rollback() so the next report carries the same changes.
+ */
+
+#ifndef SM_NEIGHBOR_DIFF_H_INCLUDED
+#define SM_NEIGHBOR_DIFF_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds_hash.h"
+#include "dpp_neighbor.h"
+
+/* Neighbor cache key: binary BSSID and channel (zero padded, hashed as
+   raw memory) */
+typedef struct
+{
+    uint8_t                         bssid[8];
+    uint32_t                        chan;
+} sm_neighbor_key_t;
+
+/* Neighbor cache entry, last reported state of a single neighbor */
+typedef struct
+{
+    sm_neighbor_key_t               key;
+    uint32_t                        gen;
+    /* Inserted by the diff being built, dropped on rollback */
+    bool                            added;
+    /* Latest values, applied to entry on commit */
+    dpp_neighbor_record_t          *update;
+    dpp_neighbor_record_t           entry;
+    ds_hash_node_t                  hnode;
+} sm_neighbor_cache_t;
+
+typedef struct
+{
+    /* Previously reported neighbors, keyed by sm_neighbor_key_t */
+    ds_hash_t                       cache;
+    uint32_t                        gen;
+} sm_neighbor_diff_t;
+
+void sm_neighbor_diff_init(
+        sm_neighbor_diff_t         *diff);
+
+void sm_neighbor_diff_fini(
+        sm_neighbor_diff_t         *diff);
+
+/*
+ * Appends to report a diff+ record per neighbor missing from the cache and a
+ * diff- record (lastseen 0) per cached neighbor missing from neighbors.
+ * Neighbors without a parsable BSSID are skipped and counted in invalid.
+ * The neighbors list must stay unchanged until the commit or rollback.
+ * On allocation failure the report is emptied, the cache rolled back and
+ * false returned.
+ */
+bool sm_neighbor_diff_build(
+        sm_neighbor_diff_t         *diff,
+        dpp_neighbor_list_t        *neighbors,
+        dpp_neighbor_list_t        *report,
+        uint32_t                   *invalid);
+
+void sm_neighbor_diff_commit(
+        sm_neighbor_diff_t         *diff);
+
+void sm_neighbor_diff_rollback(
+        sm_neighbor_diff_t         *diff);
+
+#endif /* SM_NEIGHBOR_DIFF_H_INCLUDED */
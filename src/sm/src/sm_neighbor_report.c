@@ -40,6 +40,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <limits.h>
 
 #include "sm.h"
+#include "sm_neighbor_diff.h"
 
 #define MODULE_ID LOG_MODULE_ID_MAIN
 
@@ -62,8 +63,8 @@ typedef struct
     sm_stats_request_t              request;
     /* Structure pointing to upper layer neighbor storage */
     dpp_neighbor_report_data_t      report;
-    /* Report containing only changes */
-    dpp_neighbor_list_t             diff_cache;
+    /* Previously reported neighbors */
+    sm_neighbor_diff_t              diff;
 
     /* Internal structure used to for neighbor result fetching */
     dpp_neighbor_report_data_t      results;
@@ -254,8 +255,6 @@ bool sm_neighbor_report_send_diff(
     radio_scan_type_t               scan_type =
         neighbor_ctx->scan_type;
 
-    uint32_t                        found = 0;
-
     /* Create new report for diff data (only add/remove 
        compared to previous report)
      */
@@ -275,119 +274,45 @@ bool sm_neighbor_report_send_diff(
         request_ctx->reporting_timestamp - neighbor_ctx->report_ts +
         get_timestamp();
 
-    /* Compose new reprot from collected values and cache */
-    dpp_neighbor_record_list_t     *neighbor = NULL;
-    ds_dlist_iter_t                 neighbor_iter;
-    dpp_neighbor_record_t          *neighbor_entry = NULL;
-
-    dpp_neighbor_record_list_t     *cache = NULL;
-    ds_dlist_iter_t                 cache_iter;
-    dpp_neighbor_record_t          *cache_entry = NULL;
-
+    /* Compose new report from collected values and cache */
     dpp_neighbor_record_list_t     *diff = NULL;
+    ds_dlist_iter_t                 diff_iter;
     dpp_neighbor_record_t          *diff_entry = NULL;
+    uint32_t                        invalid;
+
+    if (!sm_neighbor_diff_build(
+                &neighbor_ctx->diff,
+                neighbor_list,
+                &report_diff.list,
+                &invalid)) {
+        LOGE("Processing %s %s neighbor diff report "
+                "(Failed to allocate memmory)",
+                radio_get_name_from_cfg(radio_cfg_ctx),
+                radio_get_scan_name_from_type(scan_type));
+        goto clear;
+    }
 
-    /* Check for removed entries */
-    for (   cache = ds_dlist_ifirst(&cache_iter, &neighbor_ctx->diff_cache);
-            cache != NULL;
-            cache = ds_dlist_inext(&cache_iter))
-    {
-        cache_entry = &cache->entry;
-        found = false;
-
-        /* Search for existing entry in cache */
-        for (   neighbor = ds_dlist_ifirst(&neighbor_iter, neighbor_list);
-                neighbor != NULL;
-                neighbor = ds_dlist_inext(&neighbor_iter))
-        {
-            neighbor_entry = &neighbor->entry;
-            if (!strcmp (cache_entry->bssid, neighbor_entry->bssid)) {
-                found = true;
-                break;
-            }
-        }
-
-        /* Mark entry removed */
-        if (!found) {
-            diff =
-                dpp_neighbor_record_alloc();
-            if (NULL == diff) {
-                LOGE("Processing %s %s neighbor diff- report "
-                        "(Failed to allocate memmory)",
-                        radio_get_name_from_cfg(radio_cfg_ctx),
-                        radio_get_scan_name_from_type(scan_type));
-                goto clear;
-            }
-            diff_entry = &diff->entry;
-
-            /* Mark entry expired */
-            cache_entry->lastseen = 0;
-
-            memcpy (diff_entry,
-                    cache_entry,
-                    sizeof (dpp_neighbor_record_t));
-
-            LOGT("Sending %s %s neighbor diff- {bssid='%s' ssid='%s' rssi=%d chan=%d}\n",
-                    radio_get_name_from_cfg(radio_cfg_ctx),
-                    radio_get_scan_name_from_type(scan_type),
-                    diff_entry->bssid,
-                    diff_entry->ssid,
-                    diff_entry->sig,
-                    diff_entry->chan);
-
-            ds_dlist_insert_tail(&report_diff.list, diff);
-        }
+    if (invalid) {
+        LOGW("Skipped %u %s %s neighbor(s) with an invalid bssid",
+             invalid,
+             radio_get_name_from_cfg(radio_cfg_ctx),
+             radio_get_scan_name_from_type(scan_type));
     }
 
-    /* Check for new entries */
-    for (   neighbor = ds_dlist_ifirst(&neighbor_iter, neighbor_list);
-            neighbor != NULL;
-            neighbor = ds_dlist_inext(&neighbor_iter))
+    for (   diff = ds_dlist_ifirst(&diff_iter, &report_diff.list);
+            diff != NULL;
+            diff = ds_dlist_inext(&diff_iter))
     {
-        neighbor_entry = &neighbor->entry;
-        found = false;
-
-        /* Search for existing entry in cache */
-        for (   cache = ds_dlist_ifirst(&cache_iter, &neighbor_ctx->diff_cache);
-                cache != NULL;
-                cache = ds_dlist_inext(&cache_iter))
-        {
-            cache_entry = &cache->entry;
-            if (!strcmp (cache_entry->bssid, neighbor_entry->bssid)) {
-                found = true;
-                break;
-            }
-        }
-
-        /* Mark entry added */
-        if (!found) {
-            diff =
-                dpp_neighbor_record_alloc();
-            if (NULL == diff) {
-                LOG(ERR,
-                        "Processing %s %s neighbor diff+ report "
-                        "(Failed to allocate memmory)",
-                        radio_get_name_from_cfg(radio_cfg_ctx),
-                        radio_get_scan_name_from_type(scan_type));
-                goto clear;
-            }
-            diff_entry = &diff->entry;
-
-            memcpy (diff_entry,
-                    neighbor_entry,
-                    sizeof (dpp_neighbor_record_t));
+        diff_entry = &diff->entry;
 
-            LOG(TRACE,
-                "Sending %s %s neighbor diff+ {bssid='%s' ssid='%s' rssi=%d chan=%d}\n",
+        LOGT("Sending %s %s neighbor diff%c {bssid='%s' ssid='%s' rssi=%d chan=%d}\n",
                 radio_get_name_from_cfg(radio_cfg_ctx),
                 radio_get_scan_name_from_type(scan_type),
+                diff_entry->lastseen ? '+' : '-',
                 diff_entry->bssid,
                 diff_entry->ssid,
                 diff_entry->sig,
                 diff_entry->chan);
-
-            ds_dlist_insert_tail(&report_diff.list, diff);
-        }
     }
 
     LOGI("Sending %s %s neighbor report at '%s'",
@@ -395,44 +320,19 @@ bool sm_neighbor_report_send_diff(
          radio_get_scan_name_from_type(scan_type),
          sm_timestamp_ms_to_date(report_diff.timestamp_ms));
 
-    /* Send records to MQTT FIFO (Skip empty reports) */
-    if(!ds_dlist_is_empty(&report_diff.list)) {
-        dpp_put_neighbor(&report_diff);
-    }
-
-    /* Clear previous cache */
-    status =
-        sm_neighbor_results_clear(
-                neighbor_ctx,
-                &neighbor_ctx->diff_cache);
-    if (true != status) {
+    /* Send records to MQTT FIFO (Skip empty reports). The cache only
+       follows the report once it is queued, otherwise the same changes
+       are reported next time. */
+    if(!ds_dlist_is_empty(&report_diff.list) &&
+       !dpp_put_neighbor(&report_diff)) {
+        LOGE("Sending %s %s neighbor report failed, keeping previous cache",
+             radio_get_name_from_cfg(radio_cfg_ctx),
+             radio_get_scan_name_from_type(scan_type));
+        sm_neighbor_diff_rollback(&neighbor_ctx->diff);
         goto clear;
     }
 
-    /* Update neighbor cache */
-    for (   neighbor = ds_dlist_ifirst(&neighbor_iter, neighbor_list);
-            neighbor != NULL;
-            neighbor = ds_dlist_inext(&neighbor_iter))
-    {
-        neighbor_entry = &neighbor->entry;
-
-        cache =
-            dpp_neighbor_record_alloc();
-        if (NULL == cache) {
-            LOGE("Processing %s %s neighbor diff report "
-                 "(Failed to allocate memmory)",
-                 radio_get_name_from_cfg(radio_cfg_ctx),
-                 radio_get_scan_name_from_type(scan_type));
-            goto clear;
-        }
-        cache_entry = &cache->entry;
-
-        memcpy (cache_entry,
-                neighbor_entry,
-                sizeof (dpp_neighbor_record_t));
-
-        ds_dlist_insert_tail(&neighbor_ctx->diff_cache, cache);
-    }
+    sm_neighbor_diff_commit(&neighbor_ctx->diff);
 
 clear:
     status =
@@ -968,13 +868,7 @@ bool sm_neighbor_stats_init (
         return false;
     }
 
-    status =
-        sm_neighbor_results_clear(
-                neighbor_ctx,
-                &neighbor_ctx->diff_cache);
-    if (true != status) {
-        return false;
-    }
+    sm_neighbor_diff_fini(&neighbor_ctx->diff);
 
     return true;
 }
@@ -1141,11 +1035,8 @@ bool sm_neighbor_report_request(
                 dpp_neighbor_record_list_t,
                 node);
 
-        /* Initialize delta neighbor list */
-        ds_dlist_init(
-                &neighbor_ctx->diff_cache,
-                dpp_neighbor_record_list_t,
-                node);
+        /* Initialize delta neighbor cache */
+        sm_neighbor_diff_init(&neighbor_ctx->diff);
 
         if (RADIO_SCAN_TYPE_FULL != scan_type) {
             ev_init (update_timer, sm_neighbor_update);
@@ -71,10 +71,14 @@ typedef struct
     dpp_survey_report_data_t        report;
 
     /* Structure containing cached survey sampling records
-       (dpp_survey_record_t) */
+       (dpp_survey_record_t), raw reports only */
     ds_dlist_t                      record_list;
     uint32_t                        record_qty;
 
+    /* Running per channel aggregates, average reports only
+       (sums in avg until the report is sent) */
+    dpp_survey_record_avg_t         avg_records[RADIO_MAX_CHANNELS];
+
     /* target client temporary list for deriving records */
     ds_dlist_t                      survey_list;
 
@@ -238,6 +242,8 @@ bool sm_survey_records_clear(
         return false;
     }
 
+    memset(survey_ctx->avg_records, 0, sizeof(survey_ctx->avg_records));
+
     if (ds_dlist_is_empty(record_list)) {
         return true;
     }
@@ -368,6 +374,37 @@ void sm_survery_target_validate (
     }
 }
 
+static
+void sm_survey_record_aggregate (
+        dpp_survey_record_avg_t    *avg_record,
+        dpp_survey_record_t        *record_entry)
+{
+#define CALC(_name) do { \
+        avg_record->_name.avg += record_entry->_name;  \
+        if(avg_record->_name.num) { \
+            avg_record->_name.min = \
+                MIN(avg_record->_name.min, record_entry->_name); \
+            avg_record->_name.max = \
+                MAX(avg_record->_name.max, record_entry->_name); \
+        } else { \
+            avg_record->_name.min = record_entry->_name; \
+            avg_record->_name.max = record_entry->_name; \
+        } \
+        avg_record->_name.num++; \
+    } while (0)
+
+    avg_record->info.chan = record_entry->info.chan;
+
+    /* Sum all and derive average at report time */
+    CALC(chan_busy);
+    CALC(chan_tx);
+    CALC(chan_self);
+    CALC(chan_rx);
+    CALC(chan_busy_ext);
+
+#undef CALC
+}
+
 static
 bool sm_survey_report_calculate_average (
         sm_survey_ctx_t            *survey_ctx)
@@ -376,60 +413,21 @@ bool sm_survey_report_calculate_average (
         &survey_ctx->report;
     ds_dlist_t                     *report_list =
         &report_ctx->list;
-    ds_dlist_t                     *record_list =
-        &survey_ctx->record_list;
+    dpp_survey_record_avg_t        *avg_record =
+        survey_ctx->avg_records;
     radio_entry_t                  *radio_cfg_ctx =
         survey_ctx->radio_cfg;
     radio_scan_type_t               scan_type =
         survey_ctx->scan_type;
 
-#define CALC(_name) do { \
-        avg_record[chan_index]._name.avg += record_entry->_name;  \
-        if(avg_record[chan_index]._name.num) { \
-            avg_record[chan_index]._name.min = \
-                MIN(avg_record[chan_index]._name.min, record_entry->_name); \
-            avg_record[chan_index]._name.max = \
-                MAX(avg_record[chan_index]._name.max, record_entry->_name); \
-        } else { \
-            avg_record[chan_index]._name.min = record_entry->_name; \
-            avg_record[chan_index]._name.max = record_entry->_name; \
-        } \
-        avg_record[chan_index]._name.num++; \
-    } while (0)
-
     ds_dlist_init(
             report_list,
             dpp_survey_record_avg_t,
             node);
 
-    dpp_survey_record_t            *record_entry = NULL;
-    ds_dlist_iter_t                 record_iter;
     dpp_survey_record_avg_t        *report_entry = NULL;
-    dpp_survey_record_avg_t         avg_record[RADIO_MAX_CHANNELS];
     uint32_t                        chan_index;
 
-    /* Traverse through cached raw results and derive aggregate */
-    memset(&avg_record, 0, sizeof(avg_record));
-    for (   record_entry = ds_dlist_ifirst(&record_iter, record_list);
-            record_entry != NULL;
-            record_entry = ds_dlist_inext(&record_iter))
-    {
-        /* Get index from channel to fetch the cached entry */
-        chan_index =
-            radio_get_chan_index(
-                    radio_cfg_ctx->type,
-                    record_entry->info.chan);
-
-        avg_record[chan_index].info.chan = record_entry->info.chan;
-
-        /* Sum all and derive average later */
-        CALC(chan_busy);
-        CALC(chan_tx);
-        CALC(chan_self);
-        CALC(chan_rx);
-        CALC(chan_busy_ext);
-    }
-
 #define AVG(_name) do { \
         report_entry->_name.avg = report_entry->_name.avg / report_entry->_name.num; \
         LOGD("Sending %s %s %u  survey report " \
@@ -444,6 +442,7 @@ bool sm_survey_report_calculate_average (
              report_entry->_name.num); \
     } while (0)
 
+    /* The samples were aggregated as they came, derive the averages */
     for (chan_index = 0; chan_index < RADIO_MAX_CHANNELS; chan_index++)
     {
         /* Skip non averaged channels */
@@ -472,7 +471,6 @@ bool sm_survey_report_calculate_average (
 
 #undef MIN
 #undef MAX
-#undef CALC
 #undef AVG
 
     return true;
@@ -740,7 +738,16 @@ bool sm_survey_update_list_cb (
 
         survey_ctx->record_qty++;
 
-        ds_dlist_insert_tail(record_list, result_entry);
+        /* Average reports only need the running per channel aggregate */
+        if (REPORT_TYPE_AVERAGE == request_ctx->report_type) {
+            sm_survey_record_aggregate(
+                    &survey_ctx->avg_records[chan_index],
+                    result_entry);
+            dpp_survey_record_free(result_entry);
+        }
+        else {
+            ds_dlist_insert_tail(record_list, result_entry);
+        }
 
         /* Update cache */
         *record_entry = *survey_entry;
@@ -37,6 +37,7 @@ UNIT_TYPE    := BIN
 UNIT_SRC     := src/sm_main.c
 UNIT_SRC     += src/sm_ovsdb.c
 UNIT_SRC     += src/sm_neighbor_report.c
+UNIT_SRC     += src/sm_neighbor_diff.c
 UNIT_SRC     += src/sm_client_report.c
 UNIT_SRC     += src/sm_device_report.c
 UNIT_SRC     += src/sm_survey_report.c
@@ -60,6 +61,8 @@ UNIT_DEPS    := src/lib/ovsdb
 UNIT_DEPS    += src/lib/pjs
 UNIT_DEPS    += src/lib/schema
 UNIT_DEPS    += src/lib/datapipeline
+UNIT_DEPS    += src/lib/metrics
+UNIT_DEPS    += src/lib/evx
 UNIT_DEPS    += src/lib/target
 
 ifeq ($(CONFIG_MANAGER_QM),y)
@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "log.h"
+#include "target.h"
+#include "unity.h"
+#include "sm_neighbor_diff.h"
+
+const char *test_name = "sm_tests";
+
+static sm_neighbor_diff_t g_diff;
+static dpp_neighbor_list_t g_neighbors;
+static dpp_neighbor_list_t g_report;
+
+/* Number of allocations to let through before failing, -1 never fails */
+static int g_alloc_budget = -1;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+
+static bool alloc_fail(void)
+{
+    if (g_alloc_budget < 0) return false;
+    if (g_alloc_budget == 0) return true;
+    g_alloc_budget--;
+    return false;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return alloc_fail() ? NULL : __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    return alloc_fail() ? NULL : __real_calloc(nmemb, size);
+}
+
+static void list_clear(dpp_neighbor_list_t *list)
+{
+    dpp_neighbor_record_list_t *record;
+    ds_dlist_iter_t iter;
+
+    for (record = ds_dlist_ifirst(&iter, list);
+         record != NULL;
+         record = ds_dlist_inext(&iter))
+    {
+        ds_dlist_iremove(&iter);
+        dpp_neighbor_record_free(record);
+    }
+}
+
+static void neighbor_add(const char *bssid, uint32_t chan, int32_t sig)
+{
+    dpp_neighbor_record_list_t *record;
+
+    record = dpp_neighbor_record_alloc();
+    TEST_ASSERT_NOT_NULL(record);
+    snprintf(record->entry.bssid, sizeof(record->entry.bssid), "%s", bssid);
+    record->entry.chan = chan;
+    record->entry.sig = sig;
+    record->entry.lastseen = 1;
+    ds_dlist_insert_tail(&g_neighbors, record);
+}
+
+/* Finds the report record of bssid, added (lastseen set) or removed */
+static dpp_neighbor_record_t *report_find(const char *bssid, bool added)
+{
+    dpp_neighbor_record_list_t *record;
+
+    ds_dlist_foreach(&g_report, record)
+    {
+        if (strcmp(record->entry.bssid, bssid)) continue;
+        if ((record->entry.lastseen != 0) != added) continue;
+        return &record->entry;
+    }
+
+    return NULL;
+}
+
+static size_t report_len(void)
+{
+    dpp_neighbor_record_list_t *record;
+    size_t len = 0;
+
+    ds_dlist_foreach(&g_report, record) len++;
+    return len;
+}
+
+/* Builds the diff of the current neighbors, the report is left in g_report */
+static void build(bool commit)
+{
+    uint32_t invalid;
+
+    list_clear(&g_report);
+    TEST_ASSERT_TRUE(sm_neighbor_diff_build(&g_diff, &g_neighbors, &g_report, &invalid));
+    TEST_ASSERT_EQUAL_UINT(0, invalid);
+    if (commit)
+        sm_neighbor_diff_commit(&g_diff);
+    else
+        sm_neighbor_diff_rollback(&g_diff);
+    list_clear(&g_neighbors);
+}
+
+void setUp(void)
+{
+    g_alloc_budget = -1;
+    ds_dlist_init(&g_neighbors, dpp_neighbor_record_list_t, node);
+    ds_dlist_init(&g_report, dpp_neighbor_record_list_t, node);
+    sm_neighbor_diff_init(&g_diff);
+}
+
+void tearDown(void)
+{
+    g_alloc_budget = -1;
+    list_clear(&g_neighbors);
+    list_clear(&g_report);
+    sm_neighbor_diff_fini(&g_diff);
+}
+
+void test_diff_add_remove(void)
+{
+    neighbor_add("00:11:22:33:44:01", 1, -40);
+    neighbor_add("00:11:22:33:44:02", 6, -50);
+    build(true);
+    TEST_ASSERT_EQUAL_UINT(2, report_len());
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:01", true));
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:02", true));
+
+    /* A BSSID that moves to another channel is removed and added */
+    neighbor_add("00:11:22:33:44:02", 6, -55);
+    neighbor_add("00:11:22:33:44:03", 11, -60);
+    neighbor_add("00:11:22:33:44:01", 36, -40);
+    build(true);
+    TEST_ASSERT_EQUAL_UINT(3, report_len());
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:03", true));
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:01", true));
+    TEST_ASSERT_EQUAL_UINT(1, report_find("00:11:22:33:44:01", false)->chan);
+
+    /* Unchanged neighbors are not reported */
+    neighbor_add("00:11:22:33:44:02", 6, -57);
+    neighbor_add("00:11:22:33:44:03", 11, -60);
+    neighbor_add("00:11:22:33:44:01", 36, -40);
+    build(true);
+    TEST_ASSERT_EQUAL_UINT(0, report_len());
+
+    /* The diff- carries the values last seen */
+    neighbor_add("00:11:22:33:44:03", 11, -60);
+    neighbor_add("00:11:22:33:44:01", 36, -40);
+    build(true);
+    TEST_ASSERT_EQUAL_UINT(1, report_len());
+    TEST_ASSERT_EQUAL_INT(-57, report_find("00:11:22:33:44:02", false)->sig);
+}
+
+/* A report that could not be sent is composed again next time */
+void test_diff_rollback(void)
+{
+    neighbor_add("00:11:22:33:44:01", 1, -40);
+    neighbor_add("00:11:22:33:44:02", 6, -50);
+    build(true);
+
+    neighbor_add("00:11:22:33:44:01", 1, -45);
+    neighbor_add("00:11:22:33:44:03", 11, -60);
+    build(false);
+    TEST_ASSERT_EQUAL_UINT(2, report_len());
+
+    neighbor_add("00:11:22:33:44:01", 1, -45);
+    neighbor_add("00:11:22:33:44:03", 11, -60);
+    build(true);
+    TEST_ASSERT_EQUAL_UINT(2, report_len());
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:03", true));
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:02", false));
+
+    /* Values of the rolled back report were not kept */
+    build(true);
+    TEST_ASSERT_EQUAL_INT(-45, report_find("00:11:22:33:44:01", false)->sig);
+}
+
+/* Neighbors without a valid BSSID are counted, not reported */
+void test_diff_invalid_bssid(void)
+{
+    uint32_t invalid;
+
+    neighbor_add("00:11:22:33:44:01", 1, -40);
+    neighbor_add("not a bssid", 6, -50);
+    TEST_ASSERT_TRUE(sm_neighbor_diff_build(&g_diff, &g_neighbors, &g_report, &invalid));
+    sm_neighbor_diff_commit(&g_diff);
+    TEST_ASSERT_EQUAL_UINT(1, invalid);
+    TEST_ASSERT_EQUAL_UINT(1, report_len());
+}
+
+/* An allocation failure at any point leaves the cache as it was */
+void test_diff_oom(void)
+{
+    uint32_t invalid;
+    int budget;
+    bool built;
+
+    neighbor_add("00:11:22:33:44:01", 1, -40);
+    neighbor_add("00:11:22:33:44:02", 6, -50);
+    build(true);
+
+    for (budget = 0; ; budget++)
+    {
+        neighbor_add("00:11:22:33:44:02", 6, -50);
+        neighbor_add("00:11:22:33:44:03", 11, -60);
+        neighbor_add("00:11:22:33:44:04", 36, -70);
+
+        g_alloc_budget = budget;
+        built = sm_neighbor_diff_build(&g_diff, &g_neighbors, &g_report, &invalid);
+        g_alloc_budget = -1;
+        if (built) break;
+
+        TEST_ASSERT_EQUAL_UINT(0, report_len());
+        TEST_ASSERT_EQUAL_UINT(2, ds_hash_len(&g_diff.cache));
+        list_clear(&g_neighbors);
+    }
+    TEST_ASSERT_TRUE(budget > 0);
+
+    /* The report still holds every change since the last commit */
+    sm_neighbor_diff_commit(&g_diff);
+    TEST_ASSERT_EQUAL_UINT(3, report_len());
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:03", true));
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:04", true));
+    TEST_ASSERT_NOT_NULL(report_find("00:11:22:33:44:01", false));
+    TEST_ASSERT_EQUAL_UINT(3, ds_hash_len(&g_diff.cache));
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    target_log_open("TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    UnityBegin(test_name);
+
+    RUN_TEST(test_diff_add_remove);
+    RUN_TEST(test_diff_rollback);
+    RUN_TEST(test_diff_invalid_bssid);
+    RUN_TEST(test_diff_oom);
+
+    return UNITY_END();
+}
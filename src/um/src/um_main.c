@@ -116,6 +116,9 @@ int main(int argc, char ** argv)
     log_register_dynamic_severity(EV_DEFAULT);
 
     /* Loop */
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(EV_DEFAULT, 0);
 
 exit:
@@ -39,6 +39,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <inttypes.h>
 #include <jansson.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
 
 #include "json_util.h"
 #include "ds_list.h"
@@ -48,6 +54,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ovsdb.h"
 #include "ovsdb_sync.h"
 #include "ovsdb_table.h"
+#include "ovsdb_cache.h"
 #include "target.h"
 
 // Defines
@@ -218,16 +225,275 @@ wm2_clients_oftag_unset(const char *mac,
     return cnt;
 }
 
+/*
+ * Client isolation moves a station behind its own softwds netdev, plugged
+ * into the bridge in place of the parent vif. Links are managed over
+ * rtnetlink and the bridge ports over OVSDB, so that the association path
+ * never spawns shells or blocks on OVSDB.
+ */
+struct wm2_clients_isolate_req {
+    char bridge[128 + 1];
+    char sta_ifname[IFNAMSIZ];
+    bool connected;
+};
+
+static int
+wm2_clients_rtnl_request(struct nlmsghdr *nlh)
+{
+    static int fd = -1;
+    static uint32_t seq;
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    char buf[1024];
+    struct nlmsghdr *rsp;
+    struct nlmsgerr *err;
+    ssize_t len;
+
+    if (fd < 0) {
+        fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd < 0)
+            return -errno;
+    }
+
+    nlh->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+    nlh->nlmsg_seq = ++seq;
+
+    if (sendto(fd, nlh, nlh->nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        return -errno;
+
+    for (;;) {
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+
+        for (rsp = (struct nlmsghdr *)buf; NLMSG_OK(rsp, len); rsp = NLMSG_NEXT(rsp, len)) {
+            if (rsp->nlmsg_seq != seq || rsp->nlmsg_type != NLMSG_ERROR)
+                continue;
+            err = NLMSG_DATA(rsp);
+            return err->error;
+        }
+    }
+}
+
+static void
+wm2_clients_rtnl_attr(struct nlmsghdr *nlh, int type, const void *data, int len)
+{
+    struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if (len > 0)
+        memcpy(RTA_DATA(rta), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static int
+wm2_clients_link_add(const char *parent, const char *ifname, const char *kind)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+        char attrs[256];
+    } req;
+    struct rtattr *linkinfo;
+    int parent_index;
+
+    if (!(parent_index = if_nametoindex(parent)))
+        return -errno;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nlh.nlmsg_type = RTM_NEWLINK;
+    req.nlh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+    req.ifi.ifi_family = AF_UNSPEC;
+
+    wm2_clients_rtnl_attr(&req.nlh, IFLA_LINK, &parent_index, sizeof(parent_index));
+    wm2_clients_rtnl_attr(&req.nlh, IFLA_IFNAME, ifname, strlen(ifname) + 1);
+
+    linkinfo = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
+    wm2_clients_rtnl_attr(&req.nlh, IFLA_LINKINFO, NULL, 0);
+    wm2_clients_rtnl_attr(&req.nlh, IFLA_INFO_KIND, kind, strlen(kind));
+    linkinfo->rta_len = (char *)&req + req.nlh.nlmsg_len - (char *)linkinfo;
+
+    return wm2_clients_rtnl_request(&req.nlh);
+}
+
+static int
+wm2_clients_link_set(const char *ifname, int type, unsigned int flags)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nlh.nlmsg_type = type;
+    req.ifi.ifi_family = AF_UNSPEC;
+    req.ifi.ifi_flags = flags;
+    req.ifi.ifi_change = IFF_UP;
+
+    if (!(req.ifi.ifi_index = if_nametoindex(ifname)))
+        return -errno;
+
+    return wm2_clients_rtnl_request(&req.nlh);
+}
+
+static int
+wm2_clients_sysfs_write(const char *ifname, const char *attr, const char *value)
+{
+    char path[256];
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/softwds/%s", ifname, attr);
+    if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+        return -errno;
+    n = write(fd, value, strlen(value));
+    close(fd);
+    return n < 0 ? -errno : 0;
+}
+
+static json_t *
+wm2_clients_ovs_port_detach(json_t *trans, const char *port_uuid)
+{
+    json_t *where;
+    json_t *mutations;
+
+    where = json_array();
+    json_array_append_new(where, ovsdb_tran_cond(OCLM_UUID,
+                                                 SCHEMA_COLUMN(Bridge, ports),
+                                                 OFUNC_INC,
+                                                 port_uuid));
+    mutations = json_array();
+    json_array_append_new(mutations,
+                          ovsdb_mutation(SCHEMA_COLUMN(Bridge, ports),
+                                         json_string("delete"),
+                                         ovsdb_tran_uuid_json(port_uuid)));
+
+    return ovsdb_tran_multi(trans, NULL, SCHEMA_TABLE(Bridge), OTR_MUTATE,
+                            where, mutations);
+}
+
+static json_t *
+wm2_clients_ovs_port_attach(json_t *trans, const char *bridge, const char *ifname)
+{
+    json_t *row;
+    json_t *obj;
+    json_t *mutations;
+
+    row = json_object();
+    json_object_set_new(row, "name", json_string(ifname));
+    obj = json_object();
+    json_object_set_new(obj, "uuid-name", json_string("iface"));
+    trans = ovsdb_tran_multi(trans, obj, SCHEMA_TABLE(Interface), OTR_INSERT, NULL, row);
+
+    row = json_object();
+    json_object_set_new(row, "name", json_string(ifname));
+    json_object_set_new(row, "interfaces", json_pack("[s, s]", "named-uuid", "iface"));
+    obj = json_object();
+    json_object_set_new(obj, "uuid-name", json_string("port"));
+    trans = ovsdb_tran_multi(trans, obj, SCHEMA_TABLE(Port), OTR_INSERT, NULL, row);
+
+    mutations = json_array();
+    json_array_append_new(mutations,
+                          ovsdb_mutation(SCHEMA_COLUMN(Bridge, ports),
+                                         json_string("insert"),
+                                         json_pack("[s, s]", "named-uuid", "port")));
+
+    return ovsdb_tran_multi(trans, NULL, SCHEMA_TABLE(Bridge), OTR_MUTATE,
+                            ovsdb_where_simple(SCHEMA_COLUMN(Bridge, name), bridge),
+                            mutations);
+}
+
+static void
+wm2_clients_isolate_ovs_cb(int id, bool is_error, json_t *js, void *data)
+{
+    struct wm2_clients_isolate_req *req = data;
+    json_t *res;
+    size_t i;
+
+    if (!is_error && json_is_array(js))
+        json_array_foreach(js, i, res)
+            if (json_object_get(res, "error"))
+                is_error = true;
+
+    if (is_error)
+        LOGW("%s: isolate: failed to update bridge ports", req->sta_ifname);
+
+    free(req);
+}
+
+/*
+ * Second stage: with the port being replaced resolved (if any), detach it
+ * and, for connect, attach the station netdev in the same transaction.
+ */
+static void
+wm2_clients_isolate_port_cb(int id, bool is_error, json_t *js, void *data)
+{
+    struct wm2_clients_isolate_req *req = data;
+    json_t *trans = NULL;
+    json_t *rows;
+    json_t *row;
+    size_t i;
+
+    if (is_error) {
+        LOGW("%s: isolate: failed to look up bridge port", req->sta_ifname);
+        free(req);
+        return;
+    }
+
+    rows = json_object_get(json_array_get(js, 0), "rows");
+    json_array_foreach(rows, i, row)
+        trans = wm2_clients_ovs_port_detach(trans,
+                    json_string_value(json_array_get(json_object_get(row, "_uuid"), 1)));
+
+    if (req->connected)
+        trans = wm2_clients_ovs_port_attach(trans, req->bridge, req->sta_ifname);
+
+    if (!trans || !ovsdb_method_send(wm2_clients_isolate_ovs_cb, req, MT_TRANS, trans)) {
+        if (trans)
+            LOGW("%s: isolate: failed to send bridge ports update", req->sta_ifname);
+        free(req);
+    }
+}
+
+static void
+wm2_clients_isolate_ovs(const char *port, const char *bridge,
+                        const char *sta_ifname, bool connected)
+{
+    struct wm2_clients_isolate_req *req;
+    json_t *where;
+    json_t *columns;
+
+    if (!(req = calloc(1, sizeof(*req))))
+        return;
+
+    STRSCPY(req->sta_ifname, sta_ifname);
+    if (bridge)
+        STRSCPY(req->bridge, bridge);
+    req->connected = connected;
+
+    where = ovsdb_where_simple(SCHEMA_COLUMN(Port, name), port);
+    columns = json_pack("{s: [s]}", "columns", "_uuid");
+    if (!ovsdb_method_send(wm2_clients_isolate_port_cb, req, MT_TRANS,
+                           ovsdb_tran_multi(NULL, columns, SCHEMA_TABLE(Port),
+                                            OTR_SELECT, where, NULL))) {
+        LOGW("%s: isolate: failed to send bridge port lookup", sta_ifname);
+        free(req);
+    }
+}
+
 static void
 wm2_clients_isolate(const char *ifname, const char *sta, bool connected)
 {
-    struct schema_Wifi_VIF_Config vconf;
+    struct schema_Wifi_VIF_Config *vconf;
     const char *p;
     char sta_ifname[16];
     char path[256];
-    char cmd[1024];
     int err;
-    bool ok;
 
     snprintf(path, sizeof(path), "/.devmode.softwds.%s", ifname);
     if (access(path, R_OK))
@@ -252,41 +518,31 @@ wm2_clients_isolate(const char *ifname, const char *sta, bool connected)
     }
 
     if (connected) {
-        ok = ovsdb_table_select_one(&table_Wifi_VIF_Config,
-                                    SCHEMA_COLUMN(Wifi_VIF_Config, if_name),
-                                    ifname,
-                                    &vconf);
-        if (!ok) {
+        vconf = ovsdb_cache_find_by_key(&table_Wifi_VIF_Config, ifname);
+        if (!vconf) {
             LOGW("%s: %s: isolate: failed to get vconf", ifname, sta);
             return;
         }
 
-        if (!vconf.bridge_exists || !strlen(vconf.bridge)) {
+        if (!vconf->bridge_exists || !strlen(vconf->bridge)) {
             LOGW("%s: %s: isolate: no bridge", ifname, sta);
             return;
         }
 
-        snprintf(cmd, sizeof(cmd), "ovs-vsctl del-port %s ;"
-                                   "ip link add link %s name %s type softwds &&"
-                                   "echo %s > /sys/class/net/%s/softwds/addr &&"
-                                   "echo N > /sys/class/net/%s/softwds/wrap &&"
-                                   "ovs-vsctl add-port %s %s &&"
-                                   "ip link set %s up",
-                                   ifname,
-                                   ifname, sta_ifname,
-                                   sta, sta_ifname,
-                                   sta_ifname,
-                                   vconf.bridge, sta_ifname,
-                                   sta_ifname);
-        err = system(cmd);
-        LOGI("%s: %s: isolating into '%s': %d (errno: %d)", ifname, sta, sta_ifname, err, errno);
+        if (!(err = wm2_clients_link_add(ifname, sta_ifname, "softwds")) &&
+            !(err = wm2_clients_sysfs_write(sta_ifname, "addr", sta)) &&
+            !(err = wm2_clients_sysfs_write(sta_ifname, "wrap", "N")))
+            err = wm2_clients_link_set(sta_ifname, RTM_NEWLINK, IFF_UP);
+
+        LOGI("%s: %s: isolating into '%s': %d", ifname, sta, sta_ifname, err);
+        if (err)
+            return;
+
+        wm2_clients_isolate_ovs(ifname, vconf->bridge, sta_ifname, true);
     } else {
-        snprintf(cmd, sizeof(cmd), "ovs-vsctl del-port %s ;"
-                                   "ip link del %s",
-                                   sta_ifname,
-                                   sta_ifname);
-        err = system(cmd);
-        LOGI("%s: %s: cleaning up isolation of '%s': %d (errno: %d)", ifname, sta, sta_ifname, err, errno);
+        wm2_clients_isolate_ovs(sta_ifname, NULL, sta_ifname, false);
+        err = wm2_clients_link_set(sta_ifname, RTM_DELLINK, 0);
+        LOGI("%s: %s: cleaning up isolation of '%s': %d", ifname, sta, sta_ifname, err);
     }
 }
 
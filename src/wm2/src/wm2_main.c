@@ -101,6 +101,9 @@ main(int argc, char ** argv)
 
     wm2_radio_init();
 
+    /* Signal readiness to DM once the initial OVSDB monitor replies are in */
+    ovsdb_notify_ready();
+
     ev_run(loop, 0);
 
 // exit: